@@ -7,6 +7,10 @@
 #include <SDL_ttf.h>
 #include <SDL_net.h>
 #include <time.h> // <<< ВОТ ОНА, БЛЯДЬ! ИСКРА!
+#include <float.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #ifdef _WIN32
 #include <windows.h>
@@ -22,6 +26,7 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 #define CONFIG_KEY_SIZE 64
 
 #define DAY_NIGHT_DURATION_SECONDS (48.0f * 60.0f)
+#define DAY_NIGHT_LUT_SIZE 1024 // Шагов таблицы цветов на сутки (~2.8 сек игрового времени на шаг)
 #define SKY_RADIUS 100.0f
 #define ASSET_TABLE_SIZE 128
 #define WIDTH 1920
@@ -68,11 +73,15 @@ typedef struct {
     SDL_Renderer* renderer_ref;
 } AssetManager;
 
+typedef struct SoftTexture SoftTexture;
+
 // Прототипы функций менеджера
 static unsigned long asset_hash(const char* str);
 void AssetManager_Init(AssetManager* am, SDL_Renderer* renderer);
 TTF_Font* AssetManager_GetFont(AssetManager* am, const char* filename, int size);
+SoftTexture* AssetManager_GetTexture(AssetManager* am, const char* filename);
 void AssetManager_Destroy(AssetManager* am);
+void SoftTexture_Destroy(SoftTexture* tex);
 
 // Реализация функций менеджера
 static unsigned long asset_hash(const char* str) {
@@ -133,7 +142,7 @@ void AssetManager_Destroy(AssetManager* am) {
                     TTF_CloseFont((TTF_Font*)current->data);
                     break;
                 case ASSET_TEXTURE:
-                    // SDL_DestroyTexture((SDL_Texture*)current->data); // для будущего
+                    SoftTexture_Destroy((SoftTexture*)current->data);
                     break;
                 case ASSET_SOUND:
                     // Mix_FreeChunk((Mix_Chunk*)current->data); // для будущего
@@ -150,7 +159,214 @@ void AssetManager_Destroy(AssetManager* am) {
     printf("Asset Manager destroyed.\n");
 }
 
-float g_fov = 200.0f;
+// --- ТЕКСТУРЫ ДЛЯ ПРОГРАММНОГО РАСТЕРИЗАТОРА ---
+// Текстура живёт в памяти как цепочка мип-уровней (степени двойки, до 1x1).
+// Каждый уровень хранится плитками 4x4: соседние по вертикали тексели лежат в одной
+// кэш-линии, поэтому пролёт под любым углом к текстуре не гуляет по всей памяти.
+#define TEX_MAX_SIZE 256
+#define TEX_MAX_LEVELS 9       // 256 -> 1
+#define TEX_TILE_SHIFT 2       // Плитка 4x4 = 16 текселей = 64 байта, одна кэш-линия
+#define TEX_TILE_MASK ((1 << TEX_TILE_SHIFT) - 1)
+
+typedef struct {
+    int w, h;          // Степени двойки
+    int tilesPerRow;
+    Uint32* texels;    // ARGB8888, плитками
+} SoftTextureLevel;
+
+struct SoftTexture {
+    int numLevels;
+    SoftTextureLevel levels[TEX_MAX_LEVELS];
+};
+
+static inline Uint32 SoftTexture_Fetch(const SoftTextureLevel* lvl, int iu, int iv) {
+    iu &= lvl->w - 1; // Повтор текстуры
+    iv &= lvl->h - 1;
+    int tile = (iv >> TEX_TILE_SHIFT) * lvl->tilesPerRow + (iu >> TEX_TILE_SHIFT);
+    return lvl->texels[(tile << (2 * TEX_TILE_SHIFT)) | ((iv & TEX_TILE_MASK) << TEX_TILE_SHIFT) | (iu & TEX_TILE_MASK)];
+}
+
+static int texPow2Below(int n) {
+    int p = 1;
+    while (p * 2 <= n && p * 2 <= TEX_MAX_SIZE) p *= 2;
+    return p;
+}
+
+// Обычная построчная картинка -> плитки одного уровня
+static int SoftTexture_StoreLevel(SoftTextureLevel* lvl, const Uint32* linear, int w, int h) {
+    lvl->w = w;
+    lvl->h = h;
+    lvl->tilesPerRow = (w + TEX_TILE_MASK) >> TEX_TILE_SHIFT;
+    int tilesPerCol = (h + TEX_TILE_MASK) >> TEX_TILE_SHIFT;
+    lvl->texels = (Uint32*)calloc((size_t)lvl->tilesPerRow * tilesPerCol << (2 * TEX_TILE_SHIFT), sizeof(Uint32));
+    if (!lvl->texels) return 0;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            int tile = (y >> TEX_TILE_SHIFT) * lvl->tilesPerRow + (x >> TEX_TILE_SHIFT);
+            lvl->texels[(tile << (2 * TEX_TILE_SHIFT)) | ((y & TEX_TILE_MASK) << TEX_TILE_SHIFT) | (x & TEX_TILE_MASK)] = linear[y * w + x];
+        }
+    }
+    return 1;
+}
+
+// Строит текстуру со всеми мипами из построчной картинки w x h (степени двойки)
+static SoftTexture* SoftTexture_CreateFromLinear(Uint32* linear, int w, int h) {
+    SoftTexture* tex = (SoftTexture*)calloc(1, sizeof(SoftTexture));
+    if (!tex) return NULL;
+
+    Uint32* level = linear;
+    while (tex->numLevels < TEX_MAX_LEVELS) {
+        if (!SoftTexture_StoreLevel(&tex->levels[tex->numLevels], level, w, h)) break;
+        tex->numLevels++;
+        if (w == 1 && h == 1) break;
+
+        // Следующий мип - среднее по блокам 2x2 (на краю 1xN просто повторяем)
+        int nw = w > 1 ? w / 2 : 1, nh = h > 1 ? h / 2 : 1;
+        Uint32* next = (Uint32*)malloc((size_t)nw * nh * sizeof(Uint32));
+        if (!next) break;
+        for (int y = 0; y < nh; y++) {
+            for (int x = 0; x < nw; x++) {
+                int x0 = x * w / nw, y0 = y * h / nh;
+                int x1 = w > 1 ? x0 + 1 : x0, y1 = h > 1 ? y0 + 1 : y0;
+                Uint32 c[4] = { level[y0 * w + x0], level[y0 * w + x1], level[y1 * w + x0], level[y1 * w + x1] };
+                Uint32 r = 0, g = 0, b = 0;
+                for (int k = 0; k < 4; k++) {
+                    r += (c[k] >> 16) & 0xFF;
+                    g += (c[k] >> 8) & 0xFF;
+                    b += c[k] & 0xFF;
+                }
+                next[y * nw + x] = 0xFF000000u | (((r + 2) / 4) << 16) | (((g + 2) / 4) << 8) | ((b + 2) / 4);
+            }
+        }
+        if (level != linear) free(level);
+        level = next;
+        w = nw;
+        h = nh;
+    }
+    if (level != linear) free(level);
+
+    if (tex->numLevels == 0) {
+        free(tex);
+        return NULL;
+    }
+    return tex;
+}
+
+// Запасная процедурная текстура, если файла нет: плитка для пола, доски для всего остального
+static SoftTexture* SoftTexture_CreateProcedural(const char* name) {
+    const int size = 128;
+    Uint32* linear = (Uint32*)malloc((size_t)size * size * sizeof(Uint32));
+    if (!linear) return NULL;
+    int isFloor = strstr(name, "floor") != NULL;
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            Uint32 hash = ((Uint32)x * 73856093u) ^ ((Uint32)y * 19349663u);
+            hash = (hash ^ (hash >> 13)) * 1274126177u;
+            int noise = (int)((hash >> 24) & 31) - 16;
+            int v;
+            if (isFloor) {
+                // Четыре плитки со швами
+                int seam = (x % 64) < 3 || (y % 64) < 3;
+                v = seam ? 150 : 225 + noise / 2;
+            } else {
+                // Доски с волокнами
+                int plank = y / 32;
+                int grain = (int)(12.0f * sinf((x + plank * 37) * 0.15f + sinf(y * 0.4f) * 2.0f));
+                int seam = (y % 32) < 2;
+                v = seam ? 140 : 210 + grain + noise / 2;
+            }
+            if (v > 255) v = 255;
+            if (v < 0) v = 0;
+            linear[y * size + x] = 0xFF000000u | ((Uint32)v << 16) | ((Uint32)v << 8) | (Uint32)v;
+        }
+    }
+    SoftTexture* tex = SoftTexture_CreateFromLinear(linear, size, size);
+    free(linear);
+    return tex;
+}
+
+static SoftTexture* SoftTexture_LoadBMP(const char* filename) {
+    SDL_Surface* loaded = SDL_LoadBMP(filename);
+    if (!loaded) return NULL;
+    SDL_Surface* surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(loaded);
+    if (!surface) return NULL;
+
+    // Приводим к степени двойки ближайшим текселем: маски повтора в выборке этого требуют
+    int w = texPow2Below(surface->w), h = texPow2Below(surface->h);
+    Uint32* linear = (Uint32*)malloc((size_t)w * h * sizeof(Uint32));
+    SoftTexture* tex = NULL;
+    if (linear) {
+        SDL_LockSurface(surface);
+        for (int y = 0; y < h; y++) {
+            const Uint32* src = (const Uint32*)((const Uint8*)surface->pixels + (y * surface->h / h) * surface->pitch);
+            for (int x = 0; x < w; x++) linear[y * w + x] = src[x * surface->w / w] | 0xFF000000u;
+        }
+        SDL_UnlockSurface(surface);
+        tex = SoftTexture_CreateFromLinear(linear, w, h);
+        free(linear);
+    }
+    SDL_FreeSurface(surface);
+    return tex;
+}
+
+void SoftTexture_Destroy(SoftTexture* tex) {
+    if (!tex) return;
+    for (int i = 0; i < tex->numLevels; i++) free(tex->levels[i].texels);
+    free(tex);
+}
+
+SoftTexture* AssetManager_GetTexture(AssetManager* am, const char* filename) {
+    unsigned long index = asset_hash(filename);
+
+    AssetNode* current = am->table[index];
+    while (current != NULL) {
+        if (strcmp(current->key, filename) == 0 && current->type == ASSET_TEXTURE) {
+            return (SoftTexture*)current->data;
+        }
+        current = current->next;
+    }
+
+    SoftTexture* tex = SoftTexture_LoadBMP(filename);
+    if (!tex) {
+        printf("Texture '%s' not found, using procedural fallback.\n", filename);
+        tex = SoftTexture_CreateProcedural(filename);
+        if (!tex) return NULL;
+    }
+
+    AssetNode* newNode = (AssetNode*)malloc(sizeof(AssetNode));
+    newNode->key = strdup(filename);
+    newNode->data = tex;
+    newNode->type = ASSET_TEXTURE;
+    newNode->next = am->table[index];
+    am->table[index] = newNode;
+
+    printf("Loaded texture '%s' (%dx%d, %d mips) via Asset Manager.\n", filename,
+           tex->levels[0].w, tex->levels[0].h, tex->numLevels);
+    return tex;
+}
+
+// Текстуры мира (грузятся в main через менеджер ресурсов, NULL - рисуем без них)
+SoftTexture* g_floorTexture = NULL;
+SoftTexture* g_boxTexture = NULL;
+
+// Состояние растеризатора, которое у каждого потока своё: виды сплит-скрина
+// рисуются параллельно, и каждый поток видит свой вид, свой проход и свои счётчики
+#define RENDER_TLS _Thread_local
+
+RENDER_TLS float g_fov = 200.0f;
+
+// Куда рисуется текущий вид: прямоугольник экрана [x0, x1) x [y0, y1) и центр проекции.
+// Вне сплит-скрина это весь экран; z-буфер, маски и ID общие, у видов просто разные прямоугольники
+#define SPLIT_MAX_VIEWS 4
+
+typedef struct {
+    int x0, y0, x1, y1;
+    int cx, cy;
+    int index; // Номер вида: по нему объекты помнят свой LOD отдельно для каждой камеры
+} Viewport;
+
+RENDER_TLS Viewport g_view = { 0, 0, WIDTH, HEIGHT, WIDTH / 2, HEIGHT / 2, 0 };
 
 typedef struct {
     float x, y, z;
@@ -170,10 +386,14 @@ typedef struct {
     float jumpForce;
     float gravity;
     float fov;
+    float fogDensity;
+    float lodPointPixels;
+    float lodLowPixels;
 } GameConfig;
 
 typedef struct {
     float timeOfDay;
+    int lutIndex;             // Текущий шаг таблицы цветов: пока он тот же, цвета неба не меняются
     SDL_Color skyTopColor;
     SDL_Color skyBottomColor;
     SDL_Color ambientLightColor;
@@ -307,6 +527,7 @@ typedef struct {
     PickupObject* pulledObject;
     HandFlickGesture flick;
     float currentThrowPower;
+    int lodLevel[2]; // Левая, правая
 } HandsSystem;
 
 typedef struct {
@@ -320,6 +541,7 @@ typedef struct {
     int collected;
     float rotationPhase;
     float bobPhase;
+    int lodLevel[SPLIT_MAX_VIEWS]; // Свой гистерезис LOD у каждого вида
 } Coin;
 
 typedef struct {
@@ -377,6 +599,7 @@ typedef struct {
     float maxRadius;
     float lifetime;
     int active;
+    int lodLevel[SPLIT_MAX_VIEWS];
 } Explosion;
 
 // Состояние кинематографичной камеры
@@ -436,6 +659,7 @@ typedef struct QuestNode {
     int numRequired;
     int unlocksQuests[5];
     int numUnlocks;
+    int unlockLinkLod[5]; // LOD каждой связи к открываемым квестам
     
     int expReward;
     int coinReward;
@@ -628,6 +852,665 @@ int g_numCoins = 0;
 Phone g_phone;
 DayNightCycle g_dayNight;
 float g_zBuffer[HEIGHT][WIDTH];
+
+// --- РЕЖИМЫ РАСТЕРИЗАТОРА ---
+// Обычный проход пишет и глубину, и цвет. Пре-пасс глубины пишет ТОЛЬКО Z,
+// а потом цветовой проход красит лишь те пиксели, чья глубина совпала.
+// Так каждый пиксель непрозрачной геометрии закрашивается ровно один раз.
+typedef enum {
+    RASTER_PASS_NORMAL,      // z < zbuf: пишем глубину и цвет
+    RASTER_PASS_DEPTH_ONLY,  // z < zbuf: пишем только глубину, цвет не трогаем
+    RASTER_PASS_COLOR_EQUAL, // z == zbuf: только цвет, глубина уже готова
+    RASTER_PASS_SBUFFER,     // Пролёт не рисуется, а записывается в s-буфер как закрывающий
+    RASTER_PASS_SHADOW,      // z ~ zbuf и пиксель ещё не в тени: затемняем, глубину не трогаем
+    RASTER_PASS_OBJECT_ID    // Не закрыт сценой и ближе прошлого ID: пишем ID объекта, цвет и z-буфер не трогаем
+} RasterPass;
+
+#define DEPTH_EQUAL_TOLERANCE 1.00001f // Запас на погрешность float при сравнении "равно"
+
+typedef struct {
+    Uint32 pixelsShaded;    // Сколько пикселей реально ушло в рендерер
+    Uint32 pixelsDepthOnly; // Сколько записей глубины сделал пре-пасс
+    Uint32 pixelsRejected;  // Сколько пикселей отбросил тест глубины
+    Uint32 pixelsTextured;  // Сколько из закрашенных пикселей шли с текстурой
+    Uint32 instancesDrawn;  // Экземпляров мешей нарисовано пачками
+    Uint32 instancesCulled; // Экземпляров отброшено целиком до трансформации вершин
+    Uint32 edgesDrawn;      // Рёбер боксов ушло в растеризацию (каждое по разу)
+    Uint32 edgesSilhouette; // Из них на контуре: видна только одна из двух граней
+    Uint32 edgesCulled;     // Рёбер отброшено: обе грани отвёрнуты от глаза
+    Uint32 polygonsFilled;  // Выпуклых полигонов залито одним обходом рёбер
+    Uint32 polygonEdges;    // Сколько рёбер для них настроено (у четырёхугольника обычно 2-4)
+} RasterStats;
+
+RENDER_TLS RasterPass g_rasterPass = RASTER_PASS_NORMAL;
+RENDER_TLS RasterStats g_rasterStats;
+int g_depthPrepassEnabled = 1; // Переключается на F7, чтобы мерить, когда это окупается
+RENDER_TLS int g_depthPrepassActive = 0;  // Пре-пасс реально был сделан в этом кадре
+RENDER_TLS float g_lineDepthBias = 1.0f;  // < 1.0 подтягивает линии к камере (контуры поверх граней)
+
+// --- S-БУФЕР ---
+// Пока мир состоит из одних линий, попиксельный float z-буфер (8 МБ чистки каждый кадр)
+// не нужен. Вместо него на каждую строку экрана держим список пролётов, которые
+// закрывают непрозрачные тела (грани боксов), а линии режутся о них аналитически.
+// Линии друг друга не закрывают - это классическое удаление невидимых линий.
+#define SBUFFER_MAX_SPANS 32           // Пролётов на строку; лишние выкидываем (линии за ними просто видны)
+#define SBUFFER_DEPTH_TOLERANCE 0.999f // Линия скрыта, только если её 1/z меньше, чем у грани (с запасом на float)
+#define SBUFFER_OCCLUDER_INSET 0.25f    // Закрывающие боксы ужаты внутрь: свои рёбра и центральный куб не прячутся
+
+typedef struct {
+    short x0, x1;       // Закрытые пиксели [x0, x1)
+    float zInvA, zInvB; // 1/z грани в пикселе x: zInvA + zInvB * x
+} SBufferSpan;
+
+typedef struct {
+    int active;                  // В этом кадре видимость решает s-буфер, а не g_zBuffer
+    Uint8 count[HEIGHT];
+    SBufferSpan spans[HEIGHT][SBUFFER_MAX_SPANS];
+    Uint32 spansInserted;
+    Uint32 spansDropped;
+} SBuffer;
+
+RENDER_TLS SBuffer g_sbuffer; // У каждого потока свой: строки видов сплит-скрина пересекаются
+
+// --- ПЛОСКИЕ ТЕНИ ---
+// Боксы, предметы и игрок отбрасывают тень от солнца на пол y = SHADOW_FLOOR_Y: их AABB
+// проецируется на пол вдоль лучей, выпуклая оболочка проекции заливается тем же обходом
+// треугольников, но каждый пиксель пола, уже лежащего в z-буфере, только затемняется.
+// Маска с меткой кадра работает как стенсил: пиксель затемняется не больше одного раза,
+// и перекрытые тени не темнеют вдвое. Никаких карт теней - несколько полигонов на кадр.
+#define SHADOW_FLOOR_Y -2.0f
+#define SHADOW_MAX_ALPHA 110          // Насколько темнит тень при солнце в зените
+#define SHADOW_FADE_START 0.08f       // Высота солнца (y направления на него), где тени только появляются...
+#define SHADOW_FADE_FULL 0.35f        // ...и где они уже в полную силу
+#define SHADOW_MIN_ELEVATION 0.12f    // Ниже этого тени не удлиняем, иначе уходят за горизонт
+#define SHADOW_DEPTH_TOLERANCE 1.01f  // Тень и пол - разные треугольники одной плоскости, их 1/z расходятся в округлении
+#define SHADOW_PLAYER_RADIUS 0.3f
+
+typedef struct {
+    int enabled;               // F11
+    Uint8 frame;               // Метка текущего кадра в маске; 0 не бывает
+    Uint8 alpha;               // Сила тени в этом кадре (уже с учётом высоты солнца)
+    int casters;               // Сколько теней реально ушло в растеризацию
+    Uint32 pixels;             // Сколько пикселей затемнено
+    float costMs;
+} ShadowState;
+
+RENDER_TLS ShadowState g_shadows = { .enabled = 1 };
+Uint8 g_shadowMask[HEIGHT][WIDTH]; // Пиксель уже затемнён, если тут лежит метка кадра (метка у каждого вида своя)
+
+// --- ОСВЕЩЕНИЕ ---
+// Ламберт от солнца (ночью - от луны) плюс рассеянный свет; цвет света - g_dayNight.ambientLightColor.
+// Свет считается один раз на вершину, когда полигон готовится к заливке, и идёт по треугольнику
+// как ещё одна линейная величина (Гуро). В ядре пролёта он квантуется до LIGHT_LEVELS ступеней:
+// пролёт рвётся только там, где ступень меняется, а цвет берётся из таблицы множителей 8.8.
+#define LIGHT_LEVELS 32
+#define LIGHT_NONE -1.0f          // Уровень вершины без освещения
+#define LIGHT_MIN 0.25f           // Даже в полночь грани не чернеют до конца
+#define LIGHT_AMBIENT 0.45f       // Доля рассеянного света, остальное - от источника по Ламберту
+#define LIGHT_CORNER_SOFTEN 0.35f // Нормаль в вершине бокса чуть завалена к углу: грани освещены с переливом
+
+typedef struct {
+    int enabled;                 // F12
+    int fromMoon;                // Солнце под горизонтом - светит луна
+    Vec3 dir;                    // Направление НА источник
+    Uint16 lut[LIGHT_LEVELS][3]; // Множитель цвета на ступень, 256 = 1.0
+    Uint32 verticesLit;
+} LightingState;
+
+RENDER_TLS LightingState g_light = { .enabled = 1 };
+
+static inline SDL_Color Light_Apply(SDL_Color c, int level) {
+    const Uint16* m = g_light.lut[level];
+    c.r = (Uint8)((c.r * m[0]) >> 8);
+    c.g = (Uint8)((c.g * m[1]) >> 8);
+    c.b = (Uint8)((c.b * m[2]) >> 8);
+    return c;
+}
+
+// Ступень света i-го пикселя пролёта (свет в вершинах уже в ступенях, с +0.5 на округление)
+static inline int lightLevelAt(float light0, float lightStep, int i) {
+    int level = (int)(light0 + (float)i * lightStep);
+    if (level < 0) return 0;
+    if (level >= LIGHT_LEVELS) return LIGHT_LEVELS - 1;
+    return level;
+}
+
+// Ступень света вершины с нормалью n (n единичная)
+static inline float Light_VertexLevel(Vec3 n) {
+    float d = n.x * g_light.dir.x + n.y * g_light.dir.y + n.z * g_light.dir.z;
+    g_light.verticesLit++;
+    return (d > 0.0f ? d : 0.0f) * (LIGHT_LEVELS - 1) + 0.5f;
+}
+
+// --- ОТЛОЖЕННОЕ ОСВЕЩЕНИЕ (ЛАМПЫ) ---
+// Солнце и луна светят по вершинам (выше), а точечные лампы - взрывы авиаудара и монеты -
+// считаются отдельным проходом по уже готовому кадру. Пока в виде есть хоть одна лампа,
+// растеризатор кладёт рядом с z-буфером компактный G-буфер: индекс нормали грани и её
+// базовый цвет (глубина - сам z-буфер). Потом вид режется на плитки 16x16: по z-буферу
+// у плитки берутся ближняя и дальняя глубины, и в её список идут только лампы, чья сфера
+// задевает плитку и на экране, и по глубине. Каждый пиксель освещается один раз всеми
+// лампами своей плитки (SSE2, по 4 пикселя), вклад складывается с кадром (SDL_BLENDMODE_ADD)
+// и гаснет в тумане так же, как сам пиксель. Плитки разбирает пул потоков, и лампа стоит
+// столько, сколько пикселей она реально накрывает.
+#define DEFERRED_TILE 16
+#define DEFERRED_MAX_LIGHTS 128       // Ламп на кадр; лишние не светят
+#define DEFERRED_TILE_MAX_LIGHTS 32   // Ламп на плитку; лишние отбрасываются (и считаются)
+#define DEFERRED_MIN_ADD 2            // Прибавку меньше этого (из 255) пиксель не получает
+#define GBUF_NORMAL_NONE 0            // Лампы пиксель не освещают: небо, линии, спрайты
+#define GBUF_NORMAL_UP 4              // 1..6 - нормали вдоль осей: -X, +X, -Y, +Y, -Z, +Z
+#define GBUF_NORMAL_COUNT 7
+
+typedef struct {
+    Vec3 pos;
+    float radius;  // Дальше света нет совсем
+    float r, g, b; // Цвет с яркостью: 1.0 в центре удваивает базовый цвет
+} PointLight;
+
+typedef struct {
+    int enabled;                            // Shift+F12
+    int count;
+    PointLight lights[DEFERRED_MAX_LIGHTS]; // Мировые координаты, собираются раз в кадр
+    // За кадр, все виды вместе
+    SDL_atomic_t lightsInView, litTiles, tileLights, pixelsLit, dropped, micros;
+} DeferredLighting;
+
+typedef struct {
+    int writing;  // В этом виде есть лампы: растеризатор пишет G-буфер
+    Uint8 normal; // Что кладут в G-буфер грани, которые рисуются сейчас
+} GBufferWriter;
+
+DeferredLighting g_deferred = { .enabled = 1 };
+RENDER_TLS GBufferWriter g_gbuffer; // У каждого вида сплит-скрина свой
+Uint8 g_gbufferNormal[HEIGHT][WIDTH];
+Uint32 g_gbufferAlbedo[HEIGHT][WIDTH];
+Uint32 g_deferredPixels[HEIGHT][WIDTH]; // Вклад ламп для бэкенда SDL: плитки считаются параллельно, в SDL отдаёт один поток
+
+// Индекс G-буфера для нормали вдоль одной из осей
+static inline Uint8 GBuffer_NormalIndex(Vec3 n) {
+    if (n.x != 0.0f) return n.x < 0.0f ? 1 : 2;
+    if (n.y != 0.0f) return n.y < 0.0f ? 3 : 4;
+    return n.z < 0.0f ? 5 : 6;
+}
+
+// --- БУФЕР ОБЪЕКТОВ (ПИКИНГ) ---
+// Рядом с z-буфером лежит буфер ID: грани объектов, которые можно выбрать, прогоняются
+// через растеризатор ещё раз в проходе RASTER_PASS_OBJECT_ID - без цвета и без записи
+// в z-буфер, только ID и своя глубина, чтобы из нескольких объектов выиграл ближний.
+// Что под прицелом (или под любой точкой экрана) - одно чтение буфера после кадра,
+// сколько бы объектов ни было. Чистить буфер не нужно: в ID зашита метка кадра.
+// Лучом проверяются только объекты меньше пикселя - в буфер они могли не попасть.
+#define PICK_ID_NONE 0
+#define PICK_KIND_SHIFT 12             // ID = вид объекта << 12 | (индекс + 1)
+#define PICK_KIND_PICKUP 1
+#define PICK_MAX_INDEX ((1 << PICK_KIND_SHIFT) - 2)
+#define PICK_MIN_SCREEN_RADIUS 1.0f    // Меньше этого (в пикселях) объект идёт в список для луча
+#define PICK_MAX_TINY 64
+#define PICK_DEPTH_TOLERANCE 1.01f     // Предмет уже в z-буфере своим рисованием, а ID-проход заново заливает его гранями -
+                                       // их 1/z расходятся в последних битах, без запаса предмет закрывал бы сам себя
+
+typedef struct {
+    int enabled;                    // F5: выкл - старый перебор всех предметов лучом
+    int valid;                      // Буфер заполнен с камеры игрока (не кинематографичной)
+    Uint16 frame;                   // Метка кадра в старших битах ids; 0 не бывает
+    Uint16 currentId;               // ID, который сейчас пишет проход RASTER_PASS_OBJECT_ID
+    Uint32 pixels;                  // Сколько пикселей ID записано в этом кадре
+    int numTiny;
+    int tiny[PICK_MAX_TINY];        // Индексы предметов меньше пикселя - для проверки лучом
+    int rayTests;                   // Сколько лучевых проверок понадобилось в последнем пике
+    Uint16 lastId;                  // Что выбрал последний пик
+    int centerX, centerY;           // Где прицел: центр вида, с которого заполнен буфер
+} PickBuffer;
+
+RENDER_TLS PickBuffer g_pick = { .enabled = 1 };
+Uint32 g_pickIds[HEIGHT][WIDTH];    // frame << 16 | ID
+float g_pickDepth[HEIGHT][WIDTH];   // Глубина записанного ID
+
+static inline Uint16 Pick_MakeId(int kind, int index) {
+    return (Uint16)((kind << PICK_KIND_SHIFT) | (index + 1));
+}
+
+static inline int Pick_Kind(Uint16 id) { return id >> PICK_KIND_SHIFT; }
+static inline int Pick_Index(Uint16 id) { return (id & ((1 << PICK_KIND_SHIFT) - 1)) - 1; }
+
+// ID в точке экрана по последнему кадру; depth (если не NULL) - глубина в системе камеры
+Uint16 Pick_At(int x, int y, float* depth) {
+    if (!g_pick.valid || x < 0 || x >= WIDTH || y < 0 || y >= HEIGHT) return PICK_ID_NONE;
+    Uint32 entry = g_pickIds[y][x];
+    if ((entry >> 16) != g_pick.frame) return PICK_ID_NONE;
+    if (depth) *depth = g_pickDepth[y][x];
+    return (Uint16)(entry & 0xFFFF);
+}
+
+// --- КЭШ ВИДИМОСТИ ---
+// Между кадрами камера сдвигается чуть-чуть, и ответ "в пирамиде или нет" почти у всех
+// объектов тот же. Каждый тест отсечения - гладкая функция положения и поворота камеры
+// с известной крутизной (насколько меняется за юнит шага и за радиан поворота), поэтому
+// из запаса до границы теста выводится гарантированный запас хода и запас поворота.
+// Кэш копит пройденный камерой путь и суммарный поворот (они не меньше реального сдвига),
+// и объект перепроверяется, только когда путь или поворот вышли за его запас.
+// Проверка записи - пара сравнений, стоящему игроку отсечение почти ничего не стоит.
+// Вторая половина - перекрытие (VisCache_Occluded): мелкие объекты, прошедшие пирамиду, перед
+// рисованием проверяются по тому, что уже лежит в z-буфере (s-буфере в кадре из линий). Запись
+// помнит прошлый ответ: скрытый в прошлый раз объект первым делом пробует несколько точек своего
+// квадрата и проходит его целиком, только если они тоже закрыты; видимый - свой пиксель-свидетель.
+#define VIS_CACHE_VALUE_EPS 0.001f  // Запас на округление float внутри самих тестов
+#define VIS_CACHE_ANGLE_EPS 0.002f  // Таблица fast_sin шагает по 0.1 градуса - столько может "прыгнуть" угол
+#define VIS_CACHE_NO_LIMIT 1e30
+#define VIS_CACHE_SIDE_SLOPE 1.5f   // Разность "вдоль луча" и "вбок от луча" меняется не быстрее sqrt(2)
+#define VIS_CACHE_MAX_BOXES 64
+#define VIS_CACHE_TILES 17          // Плитки пола: таблица по модулю, 2 * 8 + 1 по стороне
+#define VIS_OCCLUSION_MARGIN 2      // Пикселей вокруг экранного квадрата: округление проекции и толщина линий
+
+typedef struct {
+    double travelLimit;  // До какого пройденного пути ответ ещё верен...
+    double turnLimit;    // ...и до какого суммарного поворота
+    float objX, objZ;    // Где был объект (у плитки - её угол); сдвинулся - перепроверяем
+    Uint32 generation;
+    Uint8 visible;
+    Uint8 occluded;      // Последняя проверка перекрытия: объект целиком за тем, что уже нарисовано
+    Sint16 witnessX, witnessY; // Пиксель, где он в прошлый раз был виден (-1 - нет), - проверяется первым
+} VisCacheEntry;
+
+typedef struct {
+    int enabled;              // F2
+    int hasLast;
+    Vec3 lastEye;
+    float lastRotY, lastAdjRotY, lastRotX;
+    float farPlane;
+    double travel;            // Суммарный путь глаза камеры
+    double turn;              // Суммарный поворот, радианы
+    Uint32 generation;        // Сменилась дальность - все записи разом устарели
+    Uint32 queries, tests;    // За кадр: сколько спросили и сколько реально проверили
+    Uint32 occlusionTests;    // За кадр: проверки перекрытия...
+    Uint32 occlusionPixels;   // ...сколько пикселей z/s-буфера они прочитали...
+    Uint32 occluded;          // ...и сколько объектов оказались закрыты
+    VisCacheEntry boxes[VIS_CACHE_MAX_BOXES];
+    VisCacheEntry coins[sizeof(g_coins) / sizeof(g_coins[0])];
+    VisCacheEntry pickups[MAX_PICKUPS];
+    VisCacheEntry tiles[VIS_CACHE_TILES][VIS_CACHE_TILES];
+} VisibilityCache;
+
+RENDER_TLS VisibilityCache g_vis = { .enabled = 1 };
+
+// --- ТУМАН ---
+// Туман считается в растеризаторе по глубине каждого пикселя и подмешивает g_fog.color.
+// Из плотности выводится дальняя плоскость: на ней туман уже полностью съел цвет.
+// Всё отсечение по дальности (объекты, пол, линии, пиксели) берёт ОДНО это число,
+// поэтому уменьшение дальности на слабой машине не даёт "выпрыгивания" на границе.
+typedef enum {
+    FOG_OFF,     // Цвет не трогаем, но дальняя плоскость всё равно работает
+    FOG_LINEAR,  // От FOG_LINEAR_START * farPlane до farPlane
+    FOG_EXP,     // 1 - exp(-density * z)
+    FOG_MODE_COUNT
+} FogMode;
+
+#define FOG_LEVELS 32              // Густота квантуется: соседние пиксели одного уровня уходят одним пролётом
+#define FOG_LUT_SIZE 256           // Таблица "глубина -> уровень" от 0 до farPlane
+#define FOG_DEFAULT_DENSITY 0.11f  // Дальняя плоскость ~50 юнитов, как раньше было зашито в отсечении
+#define FOG_LINEAR_START 0.5f
+
+typedef struct {
+    FogMode mode;
+    float density;
+    float farPlane;     // ln(255) / density: дальше туман не отличить от фона
+    float lutScale;     // FOG_LUT_SIZE / farPlane
+    Uint8 levelByDepth[FOG_LUT_SIZE];
+    SDL_Color color;    // Цвет, в который уходит геометрия (цвет фона сцены)
+    int active;         // Сцена включила туман (Fog_Begin/Fog_End)
+} FogSettings;
+
+const char* g_fogModeNames[FOG_MODE_COUNT] = { "off", "linear", "exp" };
+RENDER_TLS FogSettings g_fog = { .mode = FOG_LINEAR, .farPlane = 50.0f };
+
+static void Fog_Rebuild(void) {
+    g_fog.farPlane = logf(255.0f) / g_fog.density;
+    g_fog.lutScale = FOG_LUT_SIZE / g_fog.farPlane;
+    float linearStart = g_fog.farPlane * FOG_LINEAR_START;
+    for (int i = 0; i < FOG_LUT_SIZE; i++) {
+        float z = (i + 0.5f) / g_fog.lutScale;
+        float f = 0.0f;
+        if (g_fog.mode == FOG_LINEAR) {
+            f = (z - linearStart) / (g_fog.farPlane - linearStart);
+            if (f < 0.0f) f = 0.0f;
+        } else if (g_fog.mode == FOG_EXP) {
+            f = 1.0f - expf(-g_fog.density * z);
+        }
+        if (f > 1.0f) f = 1.0f;
+        g_fog.levelByDepth[i] = (Uint8)(f * (FOG_LEVELS - 1) + 0.5f);
+    }
+}
+
+void Fog_SetDensity(float density) {
+    if (density < 0.01f) density = 0.01f;
+    if (density == g_fog.density) return;
+    g_fog.density = density;
+    Fog_Rebuild();
+}
+
+void Fog_CycleMode(void) {
+    g_fog.mode = (FogMode)((g_fog.mode + 1) % FOG_MODE_COUNT);
+    Fog_Rebuild();
+    printf("Fog: %s, far plane %.1f\n", g_fogModeNames[g_fog.mode], g_fog.farPlane);
+}
+
+void Fog_Begin(SDL_Color color) {
+    g_fog.color = color;
+    g_fog.active = 1;
+}
+
+void Fog_End(void) {
+    g_fog.active = 0;
+}
+
+// Уровень тумана для глубины z (0 - чисто, FOG_LEVELS-1 - один туман)
+static inline int Fog_Level(float z) {
+    int i = (int)(z * g_fog.lutScale);
+    if (i < 0) return 0;
+    if (i >= FOG_LUT_SIZE) return FOG_LEVELS - 1;
+    return g_fog.levelByDepth[i];
+}
+
+static inline SDL_Color Fog_Apply(SDL_Color c, int level) {
+    if (level <= 0) return c;
+    int t = level * 255 / (FOG_LEVELS - 1), it = 255 - t;
+    SDL_Color out;
+    out.r = (Uint8)((c.r * it + g_fog.color.r * t) / 255);
+    out.g = (Uint8)((c.g * it + g_fog.color.g * t) / 255);
+    out.b = (Uint8)((c.b * it + g_fog.color.b * t) / 255);
+    out.a = c.a;
+    return out;
+}
+
+// --- УРОВНИ ДЕТАЛИЗАЦИИ (LOD) ---
+// Мелкие объекты (монеты, взрывы, связи квестов, руки) выбирают детализацию по тому,
+// сколько пикселей они занимают на экране. Каждый объект помнит свой уровень, и
+// переход на соседний уровень требует выйти за порог с запасом LOD_HYSTERESIS -
+// иначе объект на границе мигал бы между уровнями каждый кадр.
+typedef enum {
+    LOD_POINT,  // Пара пикселей: одна точка
+    LOD_LOW,    // Упрощённая версия: меньше сегментов, без украшений
+    LOD_FULL,   // Как было раньше
+    LOD_LEVEL_COUNT
+} LodLevel;
+
+#define LOD_DEFAULT_POINT_PIXELS 2.0f
+#define LOD_DEFAULT_LOW_PIXELS 24.0f
+#define LOD_HYSTERESIS 0.2f // Запас по размеру при смене уровня (доля порога)
+
+typedef struct {
+    float thresholds[LOD_LEVEL_COUNT - 1]; // Размер в пикселях, с которого начинается следующий уровень
+    int enabled;                           // F9: выкл - всё рисуется в полной детализации
+    Uint32 counts[LOD_LEVEL_COUNT];        // Сколько объектов на каком уровне нарисовано за кадр
+} LodSettings;
+
+const char* g_lodLevelNames[LOD_LEVEL_COUNT] = { "point", "low", "full" };
+RENDER_TLS LodSettings g_lod = { { LOD_DEFAULT_POINT_PIXELS, LOD_DEFAULT_LOW_PIXELS }, 1, {0} };
+
+void Lod_SetThresholds(float pointPixels, float lowPixels) {
+    if (pointPixels < 0.0f) pointPixels = 0.0f;
+    if (lowPixels < pointPixels) lowPixels = pointPixels;
+    g_lod.thresholds[0] = pointPixels;
+    g_lod.thresholds[1] = lowPixels;
+}
+
+// Выбирает уровень по размеру на экране и обновляет запомненный уровень объекта
+LodLevel Lod_Select(float sizePixels, int* level) {
+    int l = *level;
+    if (!g_lod.enabled) {
+        l = LOD_FULL;
+    } else {
+        if (l < LOD_POINT || l > LOD_FULL) l = LOD_FULL;
+        while (l < LOD_FULL && sizePixels >= g_lod.thresholds[l] * (1.0f + LOD_HYSTERESIS)) l++;
+        while (l > LOD_POINT && sizePixels < g_lod.thresholds[l - 1] * (1.0f - LOD_HYSTERESIS)) l--;
+    }
+    *level = l;
+    g_lod.counts[l]++;
+    return (LodLevel)l;
+}
+
+// --- УРОВНИ КАЧЕСТВА ---
+// Цена кадра сильно зависит от состояния мира: каркас почти бесплатный, а материализация со
+// штриховкой и пол с крестами в каждой плитке - дорогие. Менеджер смотрит на сглаженное время
+// кадра (симуляция + рисование, без ожидания Present) и шагает по уровням: вниз быстро, когда
+// кадр стабильно вылезает за бюджет, вверх медленно, когда стабильно есть большой запас. Если
+// поднятый уровень пришлось сразу же снять, следующий подъём ждёт вдвое дольше. Каждое
+// состояние мира помнит свой уровень: вернулись в него - начинаем с того, на чём остановились.
+#define QUALITY_TARGET_MS 16.6f      // 60 кадров в секунду
+#define QUALITY_DOWN_RATIO 1.1f      // Медленнее цели на 10% - кадр вылез
+#define QUALITY_UP_RATIO 0.65f       // Быстрее цели на 35% - есть запас на уровень выше
+#define QUALITY_DOWN_FRAMES 30       // Столько кадров подряд за бюджетом - уровень ниже
+#define QUALITY_UP_FRAMES 180        // Столько кадров подряд с запасом - уровень выше
+#define QUALITY_UP_FRAMES_MAX 1440
+#define QUALITY_COOLDOWN_FRAMES 20   // После смены уровня время кадра ещё старое
+#define QUALITY_BOUNCE_FRAMES 120    // Сняли поднятый уровень быстрее этого - подъём был зря
+
+typedef enum {
+    QUALITY_HIGH,
+    QUALITY_MEDIUM,
+    QUALITY_LOW,
+    QUALITY_LOWEST,
+    QUALITY_TIER_COUNT
+} QualityTierId;
+
+// Ручки уровня - множители и пороги к прежним константам отрисовки
+typedef struct {
+    const char* name;
+    float hatchScale;    // Шаг штриховки граней в drawMaterializedBox (x0.3 / x0.15)
+    float floorRange;    // Дальность плиток пола от камеры в drawMaterializedFloor
+    int floorCross;      // Диагонали и крест в плитках пола (REALISTIC)
+    float wallStepMin;   // Минимальный шаг решётки стен в rebuildWallLattice
+    float lodScale;      // Множитель порогов LOD из настроек
+    int maxShards;       // Потолок осколков в spawnGlassShards
+    int postFx;          // Необязательная пост-обработка (глюк, rgb, виньетка)
+} QualityTier;
+
+static const QualityTier g_qualityTiers[QUALITY_TIER_COUNT] = {
+    [QUALITY_HIGH]   = { "high",   1.0f, 15.0f, 1,  4.0f, 1.0f, MAX_SHARDS, 1 },
+    [QUALITY_MEDIUM] = { "medium", 1.5f, 12.0f, 1,  6.0f, 1.5f, 60,         1 },
+    [QUALITY_LOW]    = { "low",    2.0f,  9.0f, 0,  8.0f, 2.0f, 30,         0 },
+    [QUALITY_LOWEST] = { "lowest", 3.0f,  6.0f, 0, 12.0f, 3.0f, 10,         0 },
+};
+
+typedef struct {
+    int autoAdjust;                          // 0 - уровень зафиксирован (--quality= или Shift+F9)
+    int tier;
+    int stateTier[WORLD_STATE_REALISTIC + 1];
+    WorldState lastState;
+    float frameMs;                           // Сглаженное время кадра
+    int overFrames, underFrames;             // Сколько кадров подряд за порогами
+    int cooldown;
+    int upFrames;                            // Сколько ждать с запасом до подъёма (растёт после отскоков)
+    int framesSinceUp;
+    Uint32 changes;
+} QualityManager;
+
+QualityManager g_quality = { .autoAdjust = 1, .upFrames = QUALITY_UP_FRAMES, .framesSinceUp = QUALITY_BOUNCE_FRAMES };
+
+static inline const QualityTier* Quality_Current(void) {
+    return &g_qualityTiers[g_quality.tier];
+}
+
+const char* g_qualityAutoNames[2] = { "fixed", "auto" };
+
+static void qualitySetTier(int tier, const char* why) {
+    if (tier == g_quality.tier) return;
+    printf("Quality: %s -> %s (%s, %.1f ms/frame)\n", g_qualityTiers[g_quality.tier].name, g_qualityTiers[tier].name, why, g_quality.frameMs);
+    g_quality.tier = tier;
+    g_quality.changes++;
+    g_quality.overFrames = g_quality.underFrames = 0;
+    g_quality.cooldown = QUALITY_COOLDOWN_FRAMES;
+}
+
+// "--quality=auto|high|medium|low|lowest". 0 - не разобрали
+int Quality_Parse(const char* name) {
+    if (strcmp(name, "auto") == 0) {
+        g_quality.autoAdjust = 1;
+        return 1;
+    }
+    for (int t = 0; t < QUALITY_TIER_COUNT; t++) {
+        if (strcmp(name, g_qualityTiers[t].name) != 0) continue;
+        g_quality.autoAdjust = 0;
+        g_quality.tier = t;
+        return 1;
+    }
+    return 0;
+}
+
+// Shift+F9: авто или зафиксировать текущий уровень
+void Quality_ToggleAuto(void) {
+    g_quality.autoAdjust = !g_quality.autoAdjust;
+    g_quality.overFrames = g_quality.underFrames = 0;
+    printf("Quality: %s, tier %s\n", g_qualityAutoNames[g_quality.autoAdjust], Quality_Current()->name);
+}
+
+// Раз в кадр игры: время симуляции и рисования кадра
+void Quality_Update(float frameMs) {
+    QualityManager* q = &g_quality;
+    WorldState state = g_worldEvolution.currentState;
+    if (state != q->lastState) {
+        // Другое состояние - другая цена кадра: берём его уровень и судим заново
+        q->stateTier[q->lastState] = q->tier;
+        q->lastState = state;
+        if (q->autoAdjust) qualitySetTier(q->stateTier[state], "world state");
+        q->cooldown = QUALITY_COOLDOWN_FRAMES;
+        q->upFrames = QUALITY_UP_FRAMES;
+        q->frameMs = frameMs;
+    }
+    q->frameMs = q->frameMs * 0.9f + frameMs * 0.1f;
+    q->framesSinceUp++;
+    if (!q->autoAdjust) return;
+    if (q->cooldown > 0) {
+        q->cooldown--;
+        return;
+    }
+
+    if (q->frameMs > QUALITY_TARGET_MS * QUALITY_DOWN_RATIO) {
+        q->overFrames++;
+        q->underFrames = 0;
+    } else if (q->frameMs < QUALITY_TARGET_MS * QUALITY_UP_RATIO) {
+        q->underFrames++;
+        q->overFrames = 0;
+    } else {
+        q->overFrames = q->underFrames = 0;
+    }
+
+    if (q->overFrames >= QUALITY_DOWN_FRAMES && q->tier < QUALITY_TIER_COUNT - 1) {
+        if (q->framesSinceUp < QUALITY_BOUNCE_FRAMES && q->upFrames < QUALITY_UP_FRAMES_MAX) q->upFrames *= 2;
+        qualitySetTier(q->tier + 1, "over budget");
+    } else if (q->underFrames >= q->upFrames && q->tier > 0) {
+        qualitySetTier(q->tier - 1, "headroom");
+        q->framesSinceUp = 0;
+    }
+    q->stateTier[state] = q->tier;
+}
+
+// --- СПЛИТ-СКРИН ---
+// Несколько игроков на одном экране: у каждого вида своя камера, своя проекция и свой
+// прямоугольник z-буфера. Всё, что от камеры не зависит (свет, строки неба, решётка стен),
+// готовится один раз на кадр, а сами виды рисуются параллельно в пуле потоков - каждый со
+// своим состоянием растеризатора (RENDER_TLS) и своим кэшем видимости. Пикселей у четырёх
+// четвертей экрана столько же, сколько у одного полного вида, и кадр стоит почти столько же.
+#define SPLIT_GUEST_SPEED 4.0f     // Юнитов в секунду при стике до упора
+#define SPLIT_GUEST_TURN 2.5f      // Радиан в секунду
+#define SPLIT_STICK_DEADZONE 8000
+#define SPLIT_GUEST_DISTANCE 8.0f  // Гости встают вокруг центра на том же расстоянии, что и игрок
+
+typedef struct {
+    Viewport view;
+    float fov;
+    Camera cam;
+    SDL_GameController* pad;  // Гость (вид 1 и дальше) ходит с геймпада; нет геймпада - стоит на месте
+    VisibilityCache vis;      // У каждой камеры свой кэш видимости
+    Uint8 shadowFrame;        // Метка этого вида в общей маске теней
+    // Что вид насчитал за кадр - главный поток сводит это в профайлер
+    RasterStats stats;
+    LodSettings lod;
+    ShadowState shadows;
+    PickBuffer pick;
+    Uint32 verticesLit;
+    Uint32 spansInserted, spansDropped;
+    Uint32 submits;
+    float ms;
+} SplitView;
+
+typedef struct {
+    int numViews;                     // 1 - обычный кадр на весь экран
+    SplitView views[SPLIT_MAX_VIEWS];
+    // Снимок настроек главного потока на кадр: с него начинает поток каждого вида
+    FogSettings fog;
+    LightingState light;
+    LodSettings lod;
+    ShadowState shadows;
+    PickBuffer pick;
+    int visEnabled;
+    int lineOnly;
+    float frameMs;                    // Все виды вместе, от раздачи до последнего
+    Viewport savedView;               // Полный экран главного потока, пока рисуем поверх вида игрока
+    float savedFov;
+} SplitScreen;
+
+SplitScreen g_split = { .numViews = 1 };
+
+// --- РЕЙКАСТ ПО BVH ---
+// Другой способ нарисовать мир из боксов: не растеризовать их рёбра и грани, а пустить из глаза
+// луч в каждый пиксель (или в блок 2x2) и найти, во что он упёрся первым. Боксы лежат в BVH -
+// дереве вложенных AABB. Экран режется на плитки 16x16, и дерево обходится один раз на плитку
+// сразу всеми её лучами: ветка, в которую не попадает ни один из них, отпадает целиком, и
+// остаётся короткий список боксов от ближних к дальним. Его проверяют пачки по 4 луча
+// (соседние пиксели 2x2, SSE2), плитки разбирает пул потоков. Грань красится плоско: цвет бокса, ступень света по нормали грани,
+// туман по глубине. Направление луча нормировано на z камеры = 1, поэтому расстояние до
+// попадания - это сразу глубина для z-буфера, и всё остальное (монеты, предметы, руки, стены)
+// рисуется поверх обычным растеризатором. Цена кадра - от числа пикселей, а не от числа линий.
+#define RAYRENDER_MAX_BOXES 4096
+#define RAYRENDER_MAX_NODES (2 * RAYRENDER_MAX_BOXES)
+#define RAYRENDER_LEAF_BOXES 4      // Дальше не делим: столько боксов лист проверяет подряд
+#define RAYRENDER_STACK 64
+#define RAYRENDER_TILE 16           // Сторона плитки в пикселях
+#define RAYRENDER_MIN_DIR 1e-6f     // Меньше этого компонента направления не бывает: 1/d без бесконечностей
+#define RAYRENDER_CULL_SLACK 1e-4f  // Запас отсечения плитки: лучи и плитка считают 1/d в разном порядке
+#define RAYRENDER_FLOOR_TILE 4.0f   // Клетка пола, как у заливки пола растеризатором
+#define RAYRENDER_MISS -1
+#define RAYRENDER_HIT_FLOOR -2
+
+typedef enum {
+    RAYRENDER_OFF,    // Обычный растеризатор
+    RAYRENDER_PIXEL,  // Луч в каждый пиксель
+    RAYRENDER_BLOCK,  // Луч в блок 2x2: лучей вчетверо меньше, картинка грубее
+    RAYRENDER_MODE_COUNT
+} RayRenderMode;
+
+typedef struct {
+    float min[3], max[3];
+    SDL_Color color;
+} RayBox;
+
+typedef struct {
+    float min[3];
+    int first;     // Лист: первый бокс в leafBoxes; узел: правый ребёнок (левый - следующий узел)
+    float max[3];
+    Uint16 count;  // 0 - внутренний узел
+    Uint16 axis;   // Ось деления: ближний по направлению луча ребёнок обходится первым
+} BvhNode;
+
+typedef struct {
+    RayRenderMode mode;                        // F4
+    int numBoxes;
+    int numNodes;
+    int depth;
+    Uint32 rebuilds;
+    RayBox boxes[RAYRENDER_MAX_BOXES];         // Мировые AABB в порядке collisionBoxes: по ним видно, что уровень поменялся
+    RayBox leafBoxes[RAYRENDER_MAX_BOXES];     // Те же боксы в порядке листьев дерева
+    BvhNode nodes[RAYRENDER_MAX_NODES];
+    // За кадр, все виды вместе (виды сплит-скрина считают из разных потоков)
+    SDL_atomic_t rays, tiles, nodeTests, boxTests, micros;
+} RayRenderState;
+
+const char* g_rayRenderModeNames[RAYRENDER_MODE_COUNT] = { "OFF", "per pixel", "2x2 blocks" };
+RayRenderState g_rayRender;
+Uint32 g_rayRenderPixels[HEIGHT][WIDTH]; // Кадр для бэкенда SDL: плитки считаются параллельно, а в SDL отдаёт один поток
+
+static inline int RayRender_Active(void) { return g_rayRender.mode != RAYRENDER_OFF; }
+
 float g_timeScale = 1.0f;
 PickupObject g_pickups[MAX_PICKUPS];
 int g_numPickups = 0;
@@ -710,1144 +1593,3739 @@ int parseConfigValue(const char* line, const char* key, float* value) {
     return 0;
 }
 
-void drawText(SDL_Renderer* renderer, TTF_Font* font, const char* text, int x, int y, SDL_Color color) {
-    // ИСПРАВЛЕНИЕ: Используем UTF8 для поддержки кириллицы
-    SDL_Surface* surface = TTF_RenderUTF8_Solid(font, text, color); 
-    
-    if (!surface) {
-        // Если что-то пойдет не так, мы увидим ошибку в консоли
-        printf("Не удалось создать поверхность для текста! Ошибка SDL_ttf: %s\n", TTF_GetError());
-        return;
-    }
-    
-    SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
-    if (!texture) { 
-        SDL_FreeSurface(surface); 
-        return; 
+// --- ПУЛ ПОТОКОВ ---
+// Простой fork-join: поток игры (главный, если игра не в своём потоке) режет работу на полосы,
+// воркеры и он сам разбирают их через атомарный счётчик. Вызывать только из него; вложенный вызов (из полосы, которую
+// уже разбирает пул) просто выполняется на месте - свободных потоков для него всё равно нет.
+#define MAX_WORKERS 15
+
+typedef void (*JobFunc)(void* ctx, int begin, int end);
+
+typedef struct {
+    SDL_Thread* threads[MAX_WORKERS];
+    int numWorkers;
+    SDL_sem* wake;          // По одному посту на воркера - "есть работа"
+    SDL_sem* done;          // Воркер разобрал все полосы и отчитался
+    SDL_atomic_t nextBand;  // Следующая свободная полоса
+    JobFunc func;
+    void* ctx;
+    int count;
+    int bandSize;
+    int numBands;
+    int busy;               // Идёт ParallelFor: вложенные вызовы работают на месте
+    int quit;
+} JobSystem;
+
+JobSystem g_jobs;
+
+static void Jobs_RunBands(void) {
+    for (;;) {
+        int band = SDL_AtomicAdd(&g_jobs.nextBand, 1);
+        if (band >= g_jobs.numBands) break;
+        int begin = band * g_jobs.bandSize;
+        int end = begin + g_jobs.bandSize;
+        if (end > g_jobs.count) end = g_jobs.count;
+        g_jobs.func(g_jobs.ctx, begin, end);
     }
-    
-    SDL_Rect destRect = { x, y, surface->w, surface->h };
-    SDL_RenderCopy(renderer, texture, NULL, &destRect);
+}
 
-    SDL_DestroyTexture(texture);
-    SDL_FreeSurface(surface);
+static int Jobs_WorkerMain(void* data) {
+    (void)data;
+    for (;;) {
+        SDL_SemWait(g_jobs.wake);
+        if (g_jobs.quit) break;
+        Jobs_RunBands();
+        SDL_SemPost(g_jobs.done);
+    }
+    return 0;
 }
 
-SDL_Color lerpColor(SDL_Color a, SDL_Color b, float t);
+void Jobs_Init(void) {
+    memset(&g_jobs, 0, sizeof(g_jobs));
+    int workers = SDL_GetCPUCount() - 1; // Главный поток тоже работает
+    if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+    if (workers < 0) workers = 0;
 
-void Profiler_Init() {
-    g_perfFrequency = SDL_GetPerformanceFrequency();
-    
-    g_profilerData[PROF_GAME_LOGIC] = (ProfilerData){"game update", 0, 0, 0, 0.0f, 0, {100, 255, 100, 255}};
-    g_profilerData[PROF_PHYSICS_COLLISIONS] = (ProfilerData){"collisions", 0, 0, 0, 0.0f, 0, {220, 200, 100, 255}};
-    g_profilerData[PROF_RENDERING] = (ProfilerData){"projections", 0, 0, 0, 0.0f, 0, {150, 220, 150, 255}};
-    g_profilerData[PROF_OTHER] = (ProfilerData){"other", 0, 0, 0, 0.0f, 0, {200, 200, 200, 255}};
-    
-    g_profilerUpdateTime = SDL_GetTicks();
+    g_jobs.wake = SDL_CreateSemaphore(0);
+    g_jobs.done = SDL_CreateSemaphore(0);
+    if (!g_jobs.wake || !g_jobs.done) workers = 0;
+
+    for (int i = 0; i < workers; i++) {
+        g_jobs.threads[i] = SDL_CreateThread(Jobs_WorkerMain, "worker", NULL);
+        if (!g_jobs.threads[i]) break;
+        g_jobs.numWorkers++;
+    }
+    printf("Job system: %d worker thread(s) + main\n", g_jobs.numWorkers);
 }
 
-void Profiler_Start(ProfilerCategory category) {
-    if (!g_showProfiler) return;
-    g_profilerData[category].startTime = SDL_GetPerformanceCounter();
+void Jobs_Shutdown(void) {
+    g_jobs.quit = 1;
+    for (int i = 0; i < g_jobs.numWorkers; i++) SDL_SemPost(g_jobs.wake);
+    for (int i = 0; i < g_jobs.numWorkers; i++) SDL_WaitThread(g_jobs.threads[i], NULL);
+    if (g_jobs.wake) SDL_DestroySemaphore(g_jobs.wake);
+    if (g_jobs.done) SDL_DestroySemaphore(g_jobs.done);
+    memset(&g_jobs, 0, sizeof(g_jobs));
 }
 
-void Profiler_End(ProfilerCategory category) {
-    if (!g_showProfiler) return;
-    g_profilerData[category].elapsedTicks += SDL_GetPerformanceCounter() - g_profilerData[category].startTime;
-    g_profilerData[category].calls++;
+// func(ctx, begin, end) для полос [0, count), каждая не меньше minBand элементов
+void Jobs_ParallelFor(int count, int minBand, JobFunc func, void* ctx) {
+    if (count <= 0) return;
+    if (g_jobs.numWorkers == 0 || count <= minBand || g_jobs.busy) {
+        func(ctx, 0, count);
+        return;
+    }
+
+    // Полос в несколько раз больше, чем потоков, - так неровная нагрузка выравнивается сама
+    int bands = (g_jobs.numWorkers + 1) * 4;
+    int bandSize = (count + bands - 1) / bands;
+    if (bandSize < minBand) bandSize = minBand;
+
+    g_jobs.func = func;
+    g_jobs.ctx = ctx;
+    g_jobs.count = count;
+    g_jobs.bandSize = bandSize;
+    g_jobs.numBands = (count + bandSize - 1) / bandSize;
+    SDL_AtomicSet(&g_jobs.nextBand, 0);
+    g_jobs.busy = 1;
+
+    for (int i = 0; i < g_jobs.numWorkers; i++) SDL_SemPost(g_jobs.wake);
+    Jobs_RunBands();
+    for (int i = 0; i < g_jobs.numWorkers; i++) SDL_SemWait(g_jobs.done);
+    g_jobs.busy = 0;
 }
 
-void Profiler_Update() {
-    if (!g_showProfiler) return;
-    
-    Uint32 currentTime = SDL_GetTicks();
-    if (currentTime - g_profilerUpdateTime >= 1000) {
-        
-        Uint64 totalTicks = 0;
-        for (int i = 0; i < PROF_CATEGORY_COUNT; i++) {
-            totalTicks += g_profilerData[i].elapsedTicks;
-        }
+// --- ПОСТ-ОБРАБОТКА ---
+// Проходы по готовому CPU-кадру (ARGB8888, WIDTH x HEIGHT) прямо перед выводом.
+// Каждый проход: SIMD-ядро по строке, строки параллельно полосами, свой бюджет по времени.
+// Интенсивность выставляется каждый кадр заново; ~0 - проход не запускается вообще.
+typedef enum {
+    POSTFX_ROW_SHIFT,  // Глюк: полосы строк съезжают вбок
+    POSTFX_RGB_SPLIT,  // Хроматическая аберрация: R и B разъезжаются
+    POSTFX_VIGNETTE,   // Затемнение к краям
+    POSTFX_FADE,       // Затухание в чёрный (выход из игры)
+    POSTFX_COUNT
+} PostFxPassId;
+
+#define POSTFX_EPSILON (1.0f / 255.0f)  // Ниже этого проход невидим - пропускаем
+#define POSTFX_SUSPEND_FRAMES 60        // На сколько кадров снимаем проход, вылезший из бюджета
+#define POSTFX_MAX_GLITCH_BANDS 12
+#define POSTFX_MAX_RGB_SHIFT 8          // Пикселей при интенсивности 1.0
+#define POSTFX_MIN_ROWS_PER_BAND 16
 
-        if (totalTicks > 0) {
-            for (int i = 0; i < PROF_CATEGORY_COUNT; i++) {
-                g_profilerData[i].percentage = ((double)g_profilerData[i].elapsedTicks / totalTicks) * 100.0;
-                g_profilerData[i].callsPerSecond = g_profilerData[i].calls;
-                
-                g_profilerData[i].elapsedTicks = 0;
-                g_profilerData[i].calls = 0;
-            }
-        }
-        g_profilerUpdateTime = currentTime;
+typedef struct {
+    const char* name;
+    float intensity;      // 0..1, выставляется игрой каждый кадр
+    float budgetMs;       // Сколько проходу можно тратить за кадр
+    float costMs;         // Сглаженная реальная цена
+    int essential;        // Обязательный проход никогда не снимается по бюджету
+    int suspendedFrames;  // > 0 - проход временно снят за перерасход
+    int ranThisFrame;
+} PostFxPass;
+
+typedef struct {
+    int y0, y1;   // Строки [y0, y1)
+    int shift;    // Сдвиг вправо (может быть отрицательным)
+    Uint8 tint;   // Фиолетовый подсвет полосы
+} GlitchBand;
+
+typedef struct {
+    PostFxPass passes[POSTFX_COUNT];
+    GlitchBand bands[POSTFX_MAX_GLITCH_BANDS];
+    int numBands;
+    Uint16 vignetteCol[WIDTH];  // Множитель по столбцам, 0..255 (произведение должно влезть в 16 бит)
+    Uint16 vignetteRow[HEIGHT]; // Множитель по строкам, 0..255
+    float vignetteBuiltFor;     // Для какой интенсивности таблицы посчитаны
+} PostFx;
+
+PostFx g_postFx = {
+    .passes = {
+        [POSTFX_ROW_SHIFT] = { "glitch",   0, 0.6f, 0, 0 },
+        [POSTFX_RGB_SPLIT] = { "rgb",      0, 1.0f, 0, 0 },
+        [POSTFX_VIGNETTE]  = { "vignette", 0, 1.0f, 0, 0 },
+        [POSTFX_FADE]      = { "fade",     0, 1.5f, 0, 1 },
+    },
+    .vignetteBuiltFor = -1.0f
+};
+
+void PostFX_BeginFrame(void) {
+    for (int i = 0; i < POSTFX_COUNT; i++) {
+        g_postFx.passes[i].intensity = 0.0f;
     }
 }
 
-void Profiler_Draw(SDL_Renderer* ren, TTF_Font* font) {
-    if (!g_showProfiler) return;
+void PostFX_SetIntensity(PostFxPassId id, float intensity) {
+    if (intensity < 0.0f) intensity = 0.0f;
+    if (intensity > 1.0f) intensity = 1.0f;
+    g_postFx.passes[id].intensity = intensity;
+}
 
-    int x = 20, y = 20, w = 400, h = 25;
-    
-    for (int i = 0; i < PROF_CATEGORY_COUNT; i++) {
-        ProfilerData* data = &g_profilerData[i];
-        
-        SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
-        SDL_SetRenderDrawColor(ren, data->color.r, data->color.g, data->color.b, 80);
-        SDL_Rect bgRect = {x, y + i * h, w, h - 5};
-        SDL_RenderFillRect(ren, &bgRect);
-        
-        int barWidth = (int)(w * (data->percentage / 100.0f));
-        SDL_SetRenderDrawColor(ren, data->color.r, data->color.g, data->color.b, 255);
-        SDL_Rect barRect = {x, y + i * h, barWidth, h - 5};
-        SDL_RenderFillRect(ren, &barRect);
-        
-        char buffer[128];
-        snprintf(buffer, 128, "%s: %u /s  (%.0f%%)", data->name, data->callsPerSecond, data->percentage);
-        SDL_Color white = {255, 255, 255, 255};
-        drawText(ren, font, buffer, x + 5, y + i * h + 2, white);
-    }
+// Умножение 4 пикселей на 16-битные множители (0..256) по каналам
+#ifdef __SSE2__
+static inline __m128i postfxScale4(__m128i px, __m128i scaleLo, __m128i scaleHi) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(px, zero), scaleLo), 8);
+    __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(px, zero), scaleHi), 8);
+    return _mm_packus_epi16(lo, hi);
 }
+#endif
 
-// ИСПРАВЛЯЕМ: Инициализируем коллизии ДО квестов
-    CollisionBox collisionBoxes[] = {
-        { {0, 0, 0}, {-2.1, -2.1, -2.1, 2.1, 2.1, 2.1}, {255, 255, 255, 255} },
-        { {8, -1, 5}, {-1.5, -1, -1.5, 1.5, 3, 1.5}, {100, 255, 100, 255} },  // Зелёная платформа
-        { {-6, -1.5, 3}, {-2, -0.5, -2, 2, 0.5, 2}, {100, 100, 255, 255} },
-        { {5, -1, -8}, {-3, -1, -1, 3, 1, 1}, {255, 100, 100, 255} },
-        { {-10, 0, -5}, {-1, -2, -1, 1, 2, 1}, {255, 255, 100, 255} },
-    };
-    int numCollisionBoxes = sizeof(collisionBoxes) / sizeof(collisionBoxes[0]);
+static inline Uint32 postfxScalePixel(Uint32 p, Uint32 scale) {
+    Uint32 rb = ((p & 0x00FF00FFu) * scale >> 8) & 0x00FF00FFu;
+    Uint32 g = ((p & 0x0000FF00u) * scale >> 8) & 0x0000FF00u;
+    return 0xFF000000u | rb | g;
+}
 
-    // --- ПРОТОТИПЫ НОВЫХ ФУНКЦИЙ ---
-void calculateTrajectory(Camera* cam, float power, Trajectory* traj, CollisionBox* boxes, int numBoxes, float gravity);
-int intersectRayAABB(Vec3 rayOrigin, Vec3 rayDir, Vec3 boxMin, Vec3 boxMax, float* t);
+// Глюк: строка прокручивается по кругу на shift пикселей и подсвечивается
+static void postfxRowShiftBand(void* ctx, int begin, int end) {
+    Uint32* pixels = (Uint32*)ctx;
+    Uint32 scratch[WIDTH];
+    for (int y = begin; y < end; y++) {
+        const GlitchBand* band = NULL;
+        for (int b = 0; b < g_postFx.numBands; b++) {
+            if (y >= g_postFx.bands[b].y0 && y < g_postFx.bands[b].y1) { band = &g_postFx.bands[b]; break; }
+        }
+        if (!band) continue;
+
+        Uint32* row = pixels + y * WIDTH;
+        int s = ((band->shift % WIDTH) + WIDTH) % WIDTH;
+        memcpy(scratch, row + WIDTH - s, s * sizeof(Uint32));
+        memcpy(scratch + s, row, (WIDTH - s) * sizeof(Uint32));
+
+        Uint32 tint = ((Uint32)band->tint << 16) | ((Uint32)band->tint * 2 > 255 ? 255u : (Uint32)band->tint * 2);
+        int x = 0;
+#ifdef __SSE2__
+        __m128i tintVec = _mm_set1_epi32((int)tint);
+        for (; x + 4 <= WIDTH; x += 4) {
+            __m128i px = _mm_loadu_si128((const __m128i*)(scratch + x));
+            _mm_storeu_si128((__m128i*)(row + x), _mm_adds_epu8(px, tintVec));
+        }
+#endif
+        for (; x < WIDTH; x++) {
+            Uint32 p = scratch[x];
+            Uint32 r = ((p >> 16) & 0xFF) + band->tint; if (r > 255) r = 255;
+            Uint32 b = (p & 0xFF) + (tint & 0xFF);     if (b > 255) b = 255;
+            row[x] = (p & 0xFF00FF00u) | (r << 16) | b;
+        }
+    }
+}
 
-Vec3 cross(Vec3 a, Vec3 b) {
-    Vec3 r = { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
-    return r;
+// Хроматическая аберрация: красный берём справа, синий слева, зелёный на месте
+static void postfxRgbSplitBand(void* ctx, int begin, int end) {
+    Uint32* pixels = (Uint32*)ctx;
+    int d = (int)(g_postFx.passes[POSTFX_RGB_SPLIT].intensity * POSTFX_MAX_RGB_SHIFT + 0.5f);
+    if (d < 1) return;
+    Uint32 src[WIDTH + 2 * POSTFX_MAX_RGB_SHIFT];
+
+    for (int y = begin; y < end; y++) {
+        Uint32* row = pixels + y * WIDTH;
+        // Края дублируем, чтобы не проверять границы во внутреннем цикле
+        Uint32* s = src + POSTFX_MAX_RGB_SHIFT;
+        memcpy(s, row, WIDTH * sizeof(Uint32));
+        for (int i = 1; i <= d; i++) { s[-i] = row[0]; s[WIDTH - 1 + i] = row[WIDTH - 1]; }
+
+        int x = 0;
+#ifdef __SSE2__
+        __m128i maskR = _mm_set1_epi32(0x00FF0000);
+        __m128i maskG = _mm_set1_epi32((int)0xFF00FF00u);
+        __m128i maskB = _mm_set1_epi32(0x000000FF);
+        for (; x + 4 <= WIDTH; x += 4) {
+            __m128i r = _mm_and_si128(_mm_loadu_si128((const __m128i*)(s + x + d)), maskR);
+            __m128i g = _mm_and_si128(_mm_loadu_si128((const __m128i*)(s + x)), maskG);
+            __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i*)(s + x - d)), maskB);
+            _mm_storeu_si128((__m128i*)(row + x), _mm_or_si128(_mm_or_si128(r, g), b));
+        }
+#endif
+        for (; x < WIDTH; x++) {
+            row[x] = (s[x + d] & 0x00FF0000u) | (s[x] & 0xFF00FF00u) | (s[x - d] & 0x000000FFu);
+        }
+    }
 }
-Vec3 normalize(Vec3 v) {
-    float len = sqrtf(v.x*v.x + v.y*v.y + v.z*v.z);
-    if (len < 1e-6f) { Vec3 zero = {0, 0, 0}; return zero; }
-    Vec3 r = {v.x/len, v.y/len, v.z/len};
-    return r;
+
+// Виньетка: множитель = столбец * строка, таблицы считаются один раз на интенсивность
+static void postfxBuildVignette(float intensity) {
+    for (int x = 0; x < WIDTH; x++) {
+        float u = (x - WIDTH * 0.5f) / (WIDTH * 0.5f);
+        g_postFx.vignetteCol[x] = (Uint16)(255.0f * (1.0f - intensity * 0.55f * u * u));
+    }
+    for (int y = 0; y < HEIGHT; y++) {
+        float v = (y - HEIGHT * 0.5f) / (HEIGHT * 0.5f);
+        g_postFx.vignetteRow[y] = (Uint16)(255.0f * (1.0f - intensity * 0.45f * v * v));
+    }
+    g_postFx.vignetteBuiltFor = intensity;
 }
-float dot(Vec3 a, Vec3 b) {
-    return a.x*b.x + a.y*b.y + a.z*b.z;
+
+static void postfxVignetteBand(void* ctx, int begin, int end) {
+    Uint32* pixels = (Uint32*)ctx;
+    for (int y = begin; y < end; y++) {
+        Uint32* row = pixels + y * WIDTH;
+        Uint32 rowScale = g_postFx.vignetteRow[y];
+        int x = 0;
+#ifdef __SSE2__
+        __m128i rowVec = _mm_set1_epi16((short)rowScale);
+        for (; x + 4 <= WIDTH; x += 4) {
+            // Множители 4 столбцов -> по 4 одинаковых 16-битных на пиксель
+            __m128i col = _mm_loadl_epi64((const __m128i*)(g_postFx.vignetteCol + x));
+            col = _mm_srli_epi16(_mm_mullo_epi16(col, rowVec), 8);
+            __m128i c01 = _mm_unpacklo_epi16(col, col);
+            __m128i scaleLo = _mm_unpacklo_epi32(c01, c01);
+            __m128i scaleHi = _mm_unpackhi_epi32(c01, c01);
+            __m128i px = _mm_loadu_si128((const __m128i*)(row + x));
+            px = _mm_or_si128(postfxScale4(px, scaleLo, scaleHi), _mm_set1_epi32((int)0xFF000000u));
+            _mm_storeu_si128((__m128i*)(row + x), px);
+        }
+#endif
+        for (; x < WIDTH; x++) {
+            row[x] = postfxScalePixel(row[x], g_postFx.vignetteCol[x] * rowScale >> 8);
+        }
+    }
 }
-float lerp(float a, float b, float t) {
-    if (t > 1.0f) t = 1.0f;
-    if (t < 0.0f) t = 0.0f;
-    return a + (b - a) * t;
+
+// Затухание: всё умножаем на (1 - intensity)
+static void postfxFadeBand(void* ctx, int begin, int end) {
+    Uint32* pixels = (Uint32*)ctx;
+    Uint32 scale = (Uint32)((1.0f - g_postFx.passes[POSTFX_FADE].intensity) * 256.0f);
+    Uint32* p = pixels + begin * WIDTH;
+    int n = (end - begin) * WIDTH;
+    int i = 0;
+#ifdef __SSE2__
+    __m128i scaleVec = _mm_set1_epi16((short)scale);
+    __m128i alpha = _mm_set1_epi32((int)0xFF000000u);
+    for (; i + 4 <= n; i += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i*)(p + i));
+        _mm_storeu_si128((__m128i*)(p + i), _mm_or_si128(postfxScale4(px, scaleVec, scaleVec), alpha));
+    }
+#endif
+    for (; i < n; i++) p[i] = postfxScalePixel(p[i], scale);
 }
 
-typedef struct {
-    int x, y;
-    float z;
-} ProjectedPoint;
+// Случайные полосы глюка на этот кадр (главный поток, rand() не потокобезопасен)
+static void postfxRollGlitchBands(float intensity) {
+    g_postFx.numBands = 0;
+    for (int i = 0; i < POSTFX_MAX_GLITCH_BANDS; i++) {
+        if (rand() % 100 >= intensity * 100) continue;
+        GlitchBand* b = &g_postFx.bands[g_postFx.numBands++];
+        b->y0 = rand() % HEIGHT;
+        b->y1 = b->y0 + rand() % 20 + 5;
+        if (b->y1 > HEIGHT) b->y1 = HEIGHT;
+        b->shift = (rand() % 200 - 100) * (int)(intensity * 4.0f + 1.0f);
+        b->tint = (Uint8)(rand() % 20);
+    }
+}
 
-ProjectedPoint project_with_depth(Vec3 p, Camera cam) {
-    float cameraEyeY = cam.y + cam.height + cam.currentBobY;
-    float dx = p.x - cam.x;
-    float dy = p.y - cameraEyeY;
-    float dz = p.z - cam.z;
+// Прогоняет все активные проходы по кадру. Вызывается бэкендом, у которого есть CPU-кадр.
+// Возвращает, сколько проходов отработало (каждый трогает весь кадр)
+int PostFX_Apply(Uint32* pixels) {
+    int ran = 0;
+    for (int i = 0; i < POSTFX_COUNT; i++) {
+        PostFxPass* pass = &g_postFx.passes[i];
+        pass->ranThisFrame = 0;
+        if (pass->intensity < POSTFX_EPSILON) continue;
+        if (!pass->essential && !Quality_Current()->postFx) continue; // Снята уровнем качества
+        if (pass->suspendedFrames > 0) {
+            pass->suspendedFrames--;
+            continue;
+        }
 
-    float adjustedRotY = cam.rotY + cam.currentBobX * 0.02f;
-    float sy = fast_sin(adjustedRotY), cy = fast_cos(adjustedRotY);
-    float x_cam = cy * dx - sy * dz;
-    float z_cam = sy * dx + cy * dz;
+        Uint64 start = SDL_GetPerformanceCounter();
+        switch (i) {
+            case POSTFX_ROW_SHIFT:
+                postfxRollGlitchBands(pass->intensity);
+                if (g_postFx.numBands > 0) {
+                    Jobs_ParallelFor(HEIGHT, POSTFX_MIN_ROWS_PER_BAND, postfxRowShiftBand, pixels);
+                }
+                break;
+            case POSTFX_RGB_SPLIT:
+                Jobs_ParallelFor(HEIGHT, POSTFX_MIN_ROWS_PER_BAND, postfxRgbSplitBand, pixels);
+                break;
+            case POSTFX_VIGNETTE:
+                if (fabsf(g_postFx.vignetteBuiltFor - pass->intensity) > 0.01f) {
+                    postfxBuildVignette(pass->intensity);
+                }
+                Jobs_ParallelFor(HEIGHT, POSTFX_MIN_ROWS_PER_BAND, postfxVignetteBand, pixels);
+                break;
+            case POSTFX_FADE:
+                Jobs_ParallelFor(HEIGHT, POSTFX_MIN_ROWS_PER_BAND, postfxFadeBand, pixels);
+                break;
+        }
+        float ms = (float)((SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+        pass->costMs = pass->costMs * 0.9f + ms * 0.1f;
+        pass->ranThisFrame = 1;
+        ran++;
+
+        // Необязательный проход, стабильно вылезающий из бюджета, снимаем на время
+        if (!pass->essential && pass->costMs > pass->budgetMs) {
+            pass->suspendedFrames = POSTFX_SUSPEND_FRAMES;
+            pass->costMs = pass->budgetMs * 0.5f; // Дадим шанс после паузы
+        }
+    }
+    return ran;
+}
 
-    float sx = fast_sin(cam.rotX), cx = fast_cos(cam.rotX);
-    float y_cam = cx * dy - sx * z_cam;
-    z_cam = sx * dy + cx * z_cam;
+// --- БЕЗ ОКНА (HEADLESS) ---
+// --headless: ни окна, ни GPU, ни шрифта не нужно. Кадр рисует программный бэкенд в память,
+// Present пропускается, а выбранные кадры (--shots=) сохраняются в BMP. Играется тот же
+// синглплеер тем же кодом, только время идёт ровно по 1/HEADLESS_FPS на кадр и rand()
+// засеян константой - два прогона дают одинаковые картинки, их можно сравнивать.
+#define HEADLESS_FPS 60
+#define HEADLESS_DEFAULT_FRAMES 300
+#define HEADLESS_MAX_SHOTS 64
+#define HEADLESS_SEED 1337
 
-    float fov = g_fov;
-    ProjectedPoint result;
-    result.z = z_cam;
+typedef struct {
+    int enabled;
+    int frames;                     // Сколько кадров прогнать до выхода
+    int frameIndex;                 // Номер текущего кадра, он же часы
+    int shots[HEADLESS_MAX_SHOTS];  // Какие кадры сохранить
+    int numShots;
+    const char* shotPrefix;         // Файлы <prefix>_<кадр>.bmp
+    int shotsWritten;
+} HeadlessRun;
+
+HeadlessRun g_headless = { .frames = HEADLESS_DEFAULT_FRAMES, .shotPrefix = "shot" };
+
+// Часы для анимаций. В окне - настоящие, в headless - номер кадра, чтобы прогоны совпадали
+Uint32 Game_GetTicks(void) {
+    if (g_headless.enabled) return (Uint32)((Uint64)g_headless.frameIndex * 1000 / HEADLESS_FPS);
+    return SDL_GetTicks();
+}
 
-    if (z_cam <= 0.1f) {
-        result.x = -9999;
-        result.y = -9999;
-    } else {
-        result.x = (int)(WIDTH/2 + x_cam * fov / z_cam);
-        result.y = (int)(HEIGHT/2 - y_cam * fov / z_cam);
+// "--shots=60,120,299": номера кадров через запятую
+void Headless_ParseShots(const char* list) {
+    g_headless.numShots = 0;
+    while (*list && g_headless.numShots < HEADLESS_MAX_SHOTS) {
+        char* end;
+        long frame = strtol(list, &end, 10);
+        if (end == list) break;
+        if (frame >= 0) g_headless.shots[g_headless.numShots++] = (int)frame;
+        list = (*end == ',') ? end + 1 : end;
     }
-    
-    return result;
 }
 
-void drawPixelWithZCheck_Fast(SDL_Renderer* ren, int x, int y, float z) {
-    // Проверка границ и глубины
-    if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT && z < g_zBuffer[y][x]) {
-        // Просто рисуем точку. Цвет уже должен быть установлен снаружи.
-        SDL_RenderDrawPoint(ren, x, y);
-        // Обновляем Z-буфер
-        g_zBuffer[y][x] = z;
+// Вызывается бэкендом с готовым кадром (после постобработки)
+void Headless_SubmitPixels(Uint32* pixels) {
+    if (!g_headless.enabled) return;
+    int wanted = 0;
+    for (int i = 0; i < g_headless.numShots; i++) {
+        if (g_headless.shots[i] == g_headless.frameIndex) wanted = 1;
+    }
+    if (!wanted) return;
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s_%05d.bmp", g_headless.shotPrefix, g_headless.frameIndex);
+    SDL_Surface* frame = SDL_CreateRGBSurfaceWithFormatFrom(pixels, WIDTH, HEIGHT, 32, WIDTH * sizeof(Uint32), SDL_PIXELFORMAT_ARGB8888);
+    // В BMP без альфы: не все пиксели кадра держат 0xFF в старшем байте, а смотрелки это учитывают
+    SDL_Surface* rgb = frame ? SDL_ConvertSurfaceFormat(frame, SDL_PIXELFORMAT_RGB24, 0) : NULL;
+    if (rgb && SDL_SaveBMP(rgb, path) == 0) {
+        g_headless.shotsWritten++;
+        printf("Headless: frame %d -> %s\n", g_headless.frameIndex, path);
+    } else {
+        printf("Headless: failed to save %s: %s\n", path, SDL_GetError());
     }
+    if (rgb) SDL_FreeSurface(rgb);
+    if (frame) SDL_FreeSurface(frame);
 }
 
-void clipAndDrawLine(SDL_Renderer* r, Vec3 p1, Vec3 p2, Camera cam, SDL_Color color) {
-    // --- Шаг 1 и 2: Трансформация и отсечение (остаются без изменений) ---
-    float cameraEyeY = cam.y + cam.height + cam.currentBobY;
-    float dx1 = p1.x - cam.x, dy1 = p1.y - cameraEyeY, dz1 = p1.z - cam.z;
-    float sy = fast_sin(cam.rotY), cy = fast_cos(cam.rotY);
-    float sx = fast_sin(cam.rotX), cx = fast_cos(cam.rotX);
-    float x1_cam = cy * dx1 - sy * dz1;
-    float z1_cam_temp = sy * dx1 + cy * dz1;
-    float y1_cam = cx * dy1 - sx * z1_cam_temp;
-    float z1_cam = sx * dy1 + cx * z1_cam_temp;
-    float dx2 = p2.x - cam.x, dy2 = p2.y - cameraEyeY, dz2 = p2.z - cam.z;
-    float x2_cam = cy * dx2 - sy * dz2;
-    float z2_cam_temp = sy * dx2 + cy * dz2;
-    float y2_cam = cx * dy2 - sx * z2_cam_temp;
-    float z2_cam = sx * dy2 + cx * z2_cam_temp;
-    const float near_plane = 0.1f;
-    if (z1_cam < near_plane && z2_cam < near_plane) return;
-    if (z1_cam < near_plane) {
-        float t = (near_plane - z1_cam) / (z2_cam - z1_cam);
-        x1_cam = lerp(x1_cam, x2_cam, t); y1_cam = lerp(y1_cam, y2_cam, t); z1_cam = near_plane;
+// --- ЗАПИСЬ КАДРОВ ---
+// Готовый кадр копируется в один из CAPTURE_RING_SIZE заранее выделенных буферов кольца,
+// а фоновый поток перегоняет его в YUV 4:2:0 и дописывает в видеофайл Y4M (его понимают
+// ffmpeg и mpv). Рендер-поток никогда не ждёт писателя: если диск не успевает и кольцо
+// полное, кадр просто пропускается и попадает в счётчик framesDropped.
+#define CAPTURE_RING_SIZE 6
+#define CAPTURE_FPS 60 // Номинальная частота в заголовке Y4M
+
+typedef struct {
+    int active;
+    FILE* file;
+    char path[256];
+    Uint32* ring[CAPTURE_RING_SIZE]; // ARGB8888, WIDTH x HEIGHT
+    int writeIndex;                  // Трогает только рендер-поток
+    int readIndex;                   // Трогает только писатель
+    SDL_atomic_t queued;             // Сколько слотов ждут записи
+    SDL_atomic_t stop;
+    SDL_sem* frameReady;             // Один пост на кадр плюс один на остановку
+    SDL_Thread* writer;
+    Uint8* yuv;                      // Рабочий буфер писателя: Y, потом U, потом V
+    Uint32 framesCaptured;
+    Uint32 framesDropped;
+    SDL_atomic_t framesWritten;
+    SDL_atomic_t writeFailed;
+    float copyMs;                    // Цена копирования в кадре (рендер-поток), скользящее среднее
+    float encodeMs;                  // Цена кодирования + записи кадра (писатель), скользящее среднее
+} FrameCapture;
+
+FrameCapture g_capture;
+
+// ARGB -> YUV 4:2:0 (BT.601, ограниченный диапазон), цвет усредняется по квадрату 2x2
+static void captureConvertToYUV(const Uint32* pixels, Uint8* yuv) {
+    Uint8* yPlane = yuv;
+    Uint8* uPlane = yuv + WIDTH * HEIGHT;
+    Uint8* vPlane = uPlane + (WIDTH / 2) * (HEIGHT / 2);
+    for (int y = 0; y < HEIGHT; y += 2) {
+        const Uint32* row0 = pixels + y * WIDTH;
+        const Uint32* row1 = row0 + WIDTH;
+        for (int x = 0; x < WIDTH; x += 2) {
+            Uint32 quad[4] = { row0[x], row0[x + 1], row1[x], row1[x + 1] };
+            int sumR = 0, sumG = 0, sumB = 0;
+            for (int k = 0; k < 4; k++) {
+                int r = (quad[k] >> 16) & 0xFF, g = (quad[k] >> 8) & 0xFF, b = quad[k] & 0xFF;
+                yPlane[(y + (k >> 1)) * WIDTH + x + (k & 1)] = (Uint8)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+                sumR += r; sumG += g; sumB += b;
+            }
+            int r = sumR >> 2, g = sumG >> 2, b = sumB >> 2;
+            int c = (y / 2) * (WIDTH / 2) + x / 2;
+            uPlane[c] = (Uint8)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            vPlane[c] = (Uint8)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
     }
-    if (z2_cam < near_plane) {
-        float t = (near_plane - z2_cam) / (z1_cam - z2_cam);
-        x2_cam = lerp(x2_cam, x1_cam, t); y2_cam = lerp(y2_cam, y1_cam, t); z2_cam = near_plane;
+}
+
+static int Capture_WriterMain(void* data) {
+    (void)data;
+    const size_t frameBytes = (size_t)WIDTH * HEIGHT * 3 / 2;
+    for (;;) {
+        SDL_SemWait(g_capture.frameReady);
+        if (SDL_AtomicGet(&g_capture.queued) > 0) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            captureConvertToYUV(g_capture.ring[g_capture.readIndex], g_capture.yuv);
+            g_capture.readIndex = (g_capture.readIndex + 1) % CAPTURE_RING_SIZE;
+            SDL_AtomicAdd(&g_capture.queued, -1); // Слот свободен, дальше работаем со своим буфером
+
+            if (!SDL_AtomicGet(&g_capture.writeFailed)) {
+                if (fputs("FRAME\n", g_capture.file) < 0 || fwrite(g_capture.yuv, 1, frameBytes, g_capture.file) != frameBytes) {
+                    SDL_AtomicSet(&g_capture.writeFailed, 1);
+                } else {
+                    SDL_AtomicAdd(&g_capture.framesWritten, 1);
+                }
+            }
+            float ms = (float)((SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+            g_capture.encodeMs = g_capture.encodeMs * 0.9f + ms * 0.1f;
+            continue;
+        }
+        if (SDL_AtomicGet(&g_capture.stop)) break;
     }
-    
-    // --- Шаг 3: Проекция (без изменений) ---
-    float fov = g_fov;
-    int sx1 = (int)(WIDTH/2 + x1_cam * fov / z1_cam);
-    int sy1 = (int)(HEIGHT/2 - y1_cam * fov / z1_cam);
-    int sx2 = (int)(WIDTH/2 + x2_cam * fov / z2_cam);
-    int sy2 = (int)(HEIGHT/2 - y2_cam * fov / z2_cam);
+    return 0;
+}
 
-    SDL_SetRenderDrawColor(r, color.r, color.g, color.b, color.a);
+void Capture_Stop(void);
+
+int Capture_Start(const char* path) {
+    if (g_capture.active) Capture_Stop();
+    memset(&g_capture, 0, sizeof(g_capture));
+
+    // Всё выделяем заранее: во время записи рендер-поток ничего не аллоцирует
+    int ok = 1;
+    for (int i = 0; i < CAPTURE_RING_SIZE && ok; i++) {
+        g_capture.ring[i] = (Uint32*)malloc(WIDTH * HEIGHT * sizeof(Uint32));
+        ok = g_capture.ring[i] != NULL;
+    }
+    g_capture.yuv = ok ? (Uint8*)malloc((size_t)WIDTH * HEIGHT * 3 / 2) : NULL;
+    g_capture.file = g_capture.yuv ? fopen(path, "wb") : NULL;
+    g_capture.frameReady = g_capture.file ? SDL_CreateSemaphore(0) : NULL;
+    if (g_capture.frameReady) {
+        fprintf(g_capture.file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", WIDTH, HEIGHT, CAPTURE_FPS);
+        g_capture.writer = SDL_CreateThread(Capture_WriterMain, "capture", NULL);
+    }
+    if (!g_capture.writer) {
+        printf("Capture: failed to start '%s'\n", path);
+        if (g_capture.frameReady) SDL_DestroySemaphore(g_capture.frameReady);
+        if (g_capture.file) fclose(g_capture.file);
+        for (int i = 0; i < CAPTURE_RING_SIZE; i++) free(g_capture.ring[i]);
+        free(g_capture.yuv);
+        memset(&g_capture, 0, sizeof(g_capture));
+        return 0;
+    }
 
-    int dx = abs(sx2 - sx1);
-    int dy = abs(sy2 - sy1);
-    int steps = (dx > dy) ? dx : dy;
+    snprintf(g_capture.path, sizeof(g_capture.path), "%s", path);
+    g_capture.active = 1;
+    printf("Capture: recording to '%s'\n", g_capture.path);
+    return 1;
+}
 
-    // <<< УДАР #2: БЫСТРЫЙ ПУТЬ ДЛЯ КОРОТКИХ ЛИНИЙ >>>
-    if (steps < 2) {
-        drawPixelWithZCheck_Fast(r, sx1, sy1, z1_cam);
-        return; // ВЫХОДИМ, ИЗБЕГАЯ ДОРОГОГО ЦИКЛА
-    }
+// Останавливает запись: писатель дописывает всё, что уже в кольце, и только потом выходит
+void Capture_Stop(void) {
+    if (!g_capture.active) return;
+    SDL_AtomicSet(&g_capture.stop, 1);
+    SDL_SemPost(g_capture.frameReady);
+    SDL_WaitThread(g_capture.writer, NULL);
+
+    fclose(g_capture.file);
+    SDL_DestroySemaphore(g_capture.frameReady);
+    for (int i = 0; i < CAPTURE_RING_SIZE; i++) free(g_capture.ring[i]);
+    free(g_capture.yuv);
+    printf("Capture: stopped '%s' - %d frames written, %u dropped%s\n", g_capture.path,
+           SDL_AtomicGet(&g_capture.framesWritten), g_capture.framesDropped,
+           SDL_AtomicGet(&g_capture.writeFailed) ? " (WRITE ERROR)" : "");
+    g_capture.active = 0;
+}
 
-    if (steps == 0) { // Эта проверка на всякий случай
-        drawPixelWithZCheck_Fast(r, sx1, sy1, z1_cam);
+// F10: запись в capture_ГГГГММДД_ЧЧММСС.y4m рядом с игрой
+void Capture_Toggle(void) {
+    if (g_capture.active) {
+        Capture_Stop();
         return;
     }
+    char path[64];
+    time_t now = time(NULL);
+    strftime(path, sizeof(path), "capture_%Y%m%d_%H%M%S.y4m", localtime(&now));
+    Capture_Start(path);
+}
 
-    float x_inc = (float)(sx2 - sx1) / (float)steps;
-    float y_inc = (float)(sy2 - sy1) / (float)steps;
-    float z1_inv = 1.0f / z1_cam;
-    float z2_inv = 1.0f / z2_cam;
-    float z_inv_inc = (z2_inv - z1_inv) / (float)steps;
-    float current_x = sx1, current_y = sy1, current_z_inv = z1_inv;
-
-    for (int i = 0; i <= steps; i++) {
-        float current_z = 1.0f / current_z_inv;
-        drawPixelWithZCheck_Fast(r, (int)current_x, (int)current_y, current_z); // <<< Используем быструю функцию
-        current_x += x_inc;
-        current_y += y_inc;
-        current_z_inv += z_inv_inc;
+// Свободный слот кольца под следующий кадр или NULL (записи нет или писатель не успевает).
+// После заполнения слота обязательно Capture_CommitSlot.
+Uint32* Capture_AcquireSlot(void) {
+    if (!g_capture.active) return NULL;
+    g_capture.framesCaptured++;
+    // Без окна спешить некуда: ждём писателя, чтобы в файл попал каждый кадр
+    while (g_headless.enabled && SDL_AtomicGet(&g_capture.queued) >= CAPTURE_RING_SIZE &&
+           !SDL_AtomicGet(&g_capture.writeFailed)) {
+        SDL_Delay(1);
+    }
+    if (SDL_AtomicGet(&g_capture.queued) >= CAPTURE_RING_SIZE) {
+        g_capture.framesDropped++;
+        return NULL;
     }
+    return g_capture.ring[g_capture.writeIndex];
 }
-// Вспомогательная функция для сортировки 3-х вершин по оси Y
-void sortVerticesAscendingByY(ProjectedPoint* v1, ProjectedPoint* v2, ProjectedPoint* v3) {
-    ProjectedPoint temp;
-    if (v1->y > v2->y) { temp = *v1; *v1 = *v2; *v2 = temp; }
-    if (v1->y > v3->y) { temp = *v1; *v1 = *v3; *v3 = temp; }
-    if (v2->y > v3->y) { temp = *v2; *v2 = *v3; *v3 = temp; }
+
+void Capture_CommitSlot(Uint64 copyStart) {
+    g_capture.writeIndex = (g_capture.writeIndex + 1) % CAPTURE_RING_SIZE;
+    SDL_AtomicAdd(&g_capture.queued, 1);
+    SDL_SemPost(g_capture.frameReady);
+    float ms = (float)((SDL_GetPerformanceCounter() - copyStart) * 1000.0 / SDL_GetPerformanceFrequency());
+    g_capture.copyMs = g_capture.copyMs * 0.9f + ms * 0.1f;
 }
 
-void fillTriangle(SDL_Renderer* ren, ProjectedPoint v1, ProjectedPoint v2, ProjectedPoint v3, SDL_Color color) {
-    sortVerticesAscendingByY(&v1, &v2, &v3);
+// Для бэкенда с готовым CPU-кадром: одна копия в кольцо
+void Capture_SubmitPixels(const Uint32* pixels) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    Uint32* slot = Capture_AcquireSlot();
+    if (!slot) return;
+    memcpy(slot, pixels, WIDTH * HEIGHT * sizeof(Uint32));
+    Capture_CommitSlot(start);
+}
 
-    // Если весь треугольник - это одна горизонтальная линия, выходим
-    if (v3.y == v1.y) return;
+// --- ГРЯЗНЫЕ ПРЯМОУГОЛЬНИКИ ---
+// В меню от кадра к кадру меняются октаэдр, пульсирующий сплэш и курсор, а остальной экран -
+// тот же фон. Программный бэкенд запоминает, куда рисовал каждый примитив, и в следующий раз
+// в этом буфере чистит только это, а в текстуру заливает только то, что поменялось с прошлого
+// показанного кадра (его прямоугольники плюс свои). Близкие прямоугольники сливаются, а когда
+// их набирается на большую часть экрана - считаем грязным весь кадр и дальше не считаем
+// (в игре так с первого же неба).
+#define DIRTY_MAX_RECTS 32
+#define DIRTY_MERGE_GAP 8     // Прямоугольники ближе этого сливаются в один
+#define DIRTY_FULL_PERCENT 60 // Больше этой доли экрана - грязный весь кадр
 
-    SDL_SetRenderDrawColor(ren, color.r, color.g, color.b, color.a);
+typedef struct {
+    SDL_Rect rects[DIRTY_MAX_RECTS];
+    int count;
+    int area;                 // Сумма площадей (после слияний пересечений почти нет)
+    SDL_atomic_t full;        // Весь экран; тогда rects не важны
+} DirtyRects;
+
+static void DirtyRects_Reset(DirtyRects* d) {
+    d->count = 0;
+    d->area = 0;
+    SDL_AtomicSet(&d->full, 0);
+}
 
-    // --- Верхняя половина треугольника (от v1 к v2) ---
-    // Проверяем, есть ли вообще у верхней части высота. Если v1 и v2 на одной линии, эту часть рисовать не нужно.
-    if (v2.y > v1.y) {
-        float invslope1 = (float)(v2.x - v1.x) / (float)(v2.y - v1.y);
-        float invslope2 = (float)(v3.x - v1.x) / (float)(v3.y - v1.y);
-        // <<< ИСПРАВЛЕНИЕ: Добавляем проверку на ноль для Z-интерполяции >>>
-        float z_invslope1 = (v2.y > v1.y) ? (1.0f/v2.z - 1.0f/v1.z) / (float)(v2.y - v1.y) : 0.0f;
-        float z_invslope2 = (v3.y > v1.y) ? (1.0f/v3.z - 1.0f/v1.z) / (float)(v3.y - v1.y) : 0.0f;
+static void DirtyRects_MarkFull(DirtyRects* d) {
+    SDL_AtomicSet(&d->full, 1);
+}
 
-        float curx1 = v1.x;
-        float curx2 = v1.x;
-        float curz1_inv = 1.0f/v1.z;
-        float curz2_inv = 1.0f/v1.z;
+static inline int DirtyRects_IsFull(const DirtyRects* d) {
+    return SDL_AtomicGet((SDL_atomic_t*)&d->full);
+}
 
-        for (int scanlineY = v1.y; scanlineY < v2.y; scanlineY++) {
-            // Рисуем горизонтальную линию
-            int startX = (int)curx1, endX = (int)curx2;
-            float z_start_inv = curz1_inv, z_end_inv = curz2_inv;
-            if (startX > endX) {
-                int tmpX = startX; startX = endX; endX = tmpX;
-                float tmpZ = z_start_inv; z_start_inv = z_end_inv; z_end_inv = tmpZ;
-            }
-            float z_inv_span = (endX > startX) ? (z_end_inv - z_start_inv) / (float)(endX - startX) : 0.0f;
+static inline int dirtyRectsNear(const SDL_Rect* a, const SDL_Rect* b) {
+    return a->x <= b->x + b->w + DIRTY_MERGE_GAP && b->x <= a->x + a->w + DIRTY_MERGE_GAP &&
+           a->y <= b->y + b->h + DIRTY_MERGE_GAP && b->y <= a->y + a->h + DIRTY_MERGE_GAP;
+}
 
-            for (int x = startX; x < endX; x++) {
-                float z_inv = z_start_inv + (float)(x - startX) * z_inv_span;
-                drawPixelWithZCheck_Fast(ren, x, scanlineY, 1.0f/z_inv);
-            }
-            curx1 += invslope1;
-            curx2 += invslope2;
-            curz1_inv += z_invslope1;
-            curz2_inv += z_invslope2;
-        }
-    }
-
-    // --- Нижняя половина треугольника (от v2 к v3) ---
-    // Аналогичная проверка для нижней части
-    if (v3.y > v2.y) {
-        float invslope1 = (float)(v3.x - v2.x) / (float)(v3.y - v2.y);
-        float invslope2 = (float)(v3.x - v1.x) / (float)(v3.y - v1.y); // Наклон длинной стороны не меняется
-        // <<< ИСПРАВЛЕНИЕ: Добавляем проверку на ноль для Z-интерполяции >>>
-        float z_invslope1 = (v3.y > v2.y) ? (1.0f/v3.z - 1.0f/v2.z) / (float)(v3.y - v2.y) : 0.0f;
-        float z_invslope2 = (v3.y > v1.y) ? (1.0f/v3.z - 1.0f/v1.z) / (float)(v3.y - v1.y) : 0.0f;
-
-        float curx1 = v2.x;
-        float curx2 = v1.x + invslope2 * (float)(v2.y - v1.y); // Посчитаем где должна быть вторая точка
-        float curz1_inv = 1.0f/v2.z;
-        float curz2_inv = 1.0f/v1.z + z_invslope2 * (float)(v2.y - v1.y);
-
-        for (int scanlineY = v2.y; scanlineY <= v3.y; scanlineY++) {
-            // Рисуем горизонтальную линию
-            int startX = (int)curx1, endX = (int)curx2;
-            float z_start_inv = curz1_inv, z_end_inv = curz2_inv;
-            if (startX > endX) {
-               int tmpX = startX; startX = endX; endX = tmpX;
-               float tmpZ = z_start_inv; z_start_inv = z_end_inv; z_end_inv = tmpZ;
-            }
-            float z_inv_span = (endX > startX) ? (z_end_inv - z_start_inv) / (float)(endX - startX) : 0.0f;
-            
-            for (int x = startX; x < endX; x++) {
-                float z_inv = z_start_inv + (float)(x - startX) * z_inv_span;
-                drawPixelWithZCheck_Fast(ren, x, scanlineY, 1.0f/z_inv);
-            }
-            curx1 += invslope1;
-            curx2 += invslope2;
-            curz1_inv += z_invslope1;
-            curz2_inv += z_invslope2;
+static inline SDL_Rect dirtyRectsUnion(const SDL_Rect* a, const SDL_Rect* b) {
+    int x0 = a->x < b->x ? a->x : b->x, y0 = a->y < b->y ? a->y : b->y;
+    int x1 = a->x + a->w > b->x + b->w ? a->x + a->w : b->x + b->w;
+    int y1 = a->y + a->h > b->y + b->h ? a->y + a->h : b->y + b->h;
+    return (SDL_Rect){ x0, y0, x1 - x0, y1 - y0 };
+}
+
+// Экранные границы [x0, x1) x [y0, y1). Один поток: примитивы копятся в DirtyBand
+static void DirtyRects_Add(DirtyRects* d, int x0, int y0, int x1, int y1) {
+    if (DirtyRects_IsFull(d)) return;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > WIDTH) x1 = WIDTH;
+    if (y1 > HEIGHT) y1 = HEIGHT;
+    if (x0 >= x1 || y0 >= y1) return;
+
+    SDL_Rect r = { x0, y0, x1 - x0, y1 - y0 };
+    // Сливаем со всеми соседями; выросший прямоугольник может дотянуться до новых
+    for (int i = 0; i < d->count;) {
+        if (!dirtyRectsNear(&r, &d->rects[i])) { i++; continue; }
+        r = dirtyRectsUnion(&r, &d->rects[i]);
+        d->area -= d->rects[i].w * d->rects[i].h;
+        d->rects[i] = d->rects[--d->count];
+        i = 0;
+    }
+    if (d->count == DIRTY_MAX_RECTS) {
+        // Места нет: прибиваем к тому, чья площадь вырастет меньше всех
+        int best = 0, bestGrowth = WIDTH * HEIGHT + 1;
+        for (int i = 0; i < d->count; i++) {
+            SDL_Rect u = dirtyRectsUnion(&r, &d->rects[i]);
+            int growth = u.w * u.h - d->rects[i].w * d->rects[i].h;
+            if (growth < bestGrowth) { best = i; bestGrowth = growth; }
         }
+        r = dirtyRectsUnion(&r, &d->rects[best]);
+        d->area -= d->rects[best].w * d->rects[best].h;
+        d->rects[best] = d->rects[--d->count];
     }
+    d->rects[d->count++] = r;
+    d->area += r.w * r.h;
+    if ((Sint64)d->area * 100 > (Sint64)WIDTH * HEIGHT * DIRTY_FULL_PERCENT) SDL_AtomicSet(&d->full, 1);
 }
 
-void updateWorldEvolution(float deltaTime) {
-    WorldState oldState = g_worldEvolution.currentState;
-    
-    // Определяем состояние на основе монет
-    if (g_coinsCollected < 10) {
-        g_worldEvolution.currentState = WORLD_STATE_WIREFRAME;
-    } else if (g_coinsCollected < 15) {
-        g_worldEvolution.currentState = WORLD_STATE_GRID_GROWING;
-    } else if (g_coinsCollected < 20) {
-        g_worldEvolution.currentState = WORLD_STATE_CUBE_COMPLETE;
-    } else if (g_coinsCollected < 30) {
-        g_worldEvolution.currentState = WORLD_STATE_MATERIALIZING;
-    } else if (g_coinsCollected < 40) {
-        g_worldEvolution.currentState = WORLD_STATE_TEXTURED;
-    } else {
-        g_worldEvolution.currentState = WORLD_STATE_REALISTIC;
+// dst += src
+static void DirtyRects_Merge(DirtyRects* dst, const DirtyRects* src) {
+    if (DirtyRects_IsFull(src)) {
+        DirtyRects_MarkFull(dst);
+        return;
     }
-    
-    // Если состояние изменилось, запускаем переход
-    if (oldState != g_worldEvolution.currentState) {
-        g_worldEvolution.transitionProgress = 0.0f;
-        g_worldEvolution.glitchIntensity = 1.0f; // Глюки при переходе
-        printf("WORLD EVOLUTION: Entering %d state\n", g_worldEvolution.currentState);
+    for (int i = 0; i < src->count; i++) {
+        const SDL_Rect* r = &src->rects[i];
+        DirtyRects_Add(dst, r->x, r->y, r->x + r->w, r->y + r->h);
     }
-    
-    // Обновляем параметры в зависимости от состояния
-    switch(g_worldEvolution.currentState) {
-        case WORLD_STATE_WIREFRAME:
-            // Базовое состояние - просто пульсация
-            g_worldEvolution.gridPulse = fast_sin(SDL_GetTicks() * 0.001f) * 0.1f;
-            break;
-            
-        case WORLD_STATE_GRID_GROWING:
-    // --- МЕДЛЕННЕЕ И ПЛАВНЕЕ ---
-    g_worldEvolution.gridWallHeight = lerp(g_worldEvolution.gridWallHeight, 50.0f, deltaTime * 0.2f); // Было 0.5f
-    g_worldEvolution.gridDensity = lerp(g_worldEvolution.gridDensity, 2.0f, deltaTime * 0.15f); // Было 3.0f и 0.3f
-    break;
+}
 
-case WORLD_STATE_CUBE_COMPLETE:
-    g_worldEvolution.gridWallHeight = 50.0f;
-    // --- МЕДЛЕННАЯ ПУЛЬСАЦИЯ ---
-    g_worldEvolution.gridPulse = fast_sin(SDL_GetTicks() * 0.0008f) * 0.15f; // Было 0.002f и 0.2f
-    g_worldEvolution.polygonOpacity = fast_sin(SDL_GetTicks() * 0.001f) * 0.05f + 0.02f; // Плавнее
-    break;
-            
-        case WORLD_STATE_MATERIALIZING:
-            // Появляются полупрозрачные полигоны
-            g_worldEvolution.polygonOpacity = lerp(g_worldEvolution.polygonOpacity, 0.5f, deltaTime * 0.2f);
-            g_worldEvolution.chromaAberration = fast_sin(SDL_GetTicks() * 0.01f) * 0.02f;
-            break;
-            
-        case WORLD_STATE_TEXTURED:
-            // Текстуры и начало скайбокса
-            g_worldEvolution.polygonOpacity = lerp(g_worldEvolution.polygonOpacity, 0.8f, deltaTime * 0.3f);
-            g_worldEvolution.textureBlend = lerp(g_worldEvolution.textureBlend, 0.7f, deltaTime * 0.2f);
-            g_worldEvolution.skyboxEnabled = 1;
-            g_worldEvolution.skyboxAlpha = lerp(g_worldEvolution.skyboxAlpha, 0.3f, deltaTime * 0.1f);
-            break;
-            
-        case WORLD_STATE_REALISTIC:
-            // Полный рендер
-            g_worldEvolution.polygonOpacity = 1.0f;
-            g_worldEvolution.textureBlend = 1.0f;
-            g_worldEvolution.skyboxAlpha = lerp(g_worldEvolution.skyboxAlpha, 1.0f, deltaTime * 0.2f);
-            g_worldEvolution.gridWallHeight = lerp(g_worldEvolution.gridWallHeight, 0.0f, deltaTime * 0.5f);
-            break;
+static void DirtyRects_Copy(DirtyRects* dst, const DirtyRects* src) {
+    memcpy(dst->rects, src->rects, (size_t)src->count * sizeof(SDL_Rect));
+    dst->count = src->count;
+    dst->area = src->area;
+    SDL_AtomicSet(&dst->full, DirtyRects_IsFull(src));
+}
+
+// Сколько пикселей кадр заливает в текстуру - для профайлера
+static int DirtyRects_Pixels(const DirtyRects* d) {
+    return DirtyRects_IsFull(d) ? WIDTH * HEIGHT : d->area;
+}
+
+// Заливка в стриминг-текстуру только грязных кусков кадра
+static void DirtyRects_Upload(SDL_Texture* texture, const Uint32* pixels, const DirtyRects* d) {
+    if (DirtyRects_IsFull(d)) {
+        SDL_UpdateTexture(texture, NULL, pixels, WIDTH * sizeof(Uint32));
+        return;
+    }
+    for (int i = 0; i < d->count; i++) {
+        const SDL_Rect* r = &d->rects[i];
+        SDL_UpdateTexture(texture, r, pixels + r->y * WIDTH + r->x, WIDTH * sizeof(Uint32));
     }
-    
-    // Обновляем прогресс перехода
-    g_worldEvolution.transitionProgress = lerp(g_worldEvolution.transitionProgress, 1.0f, deltaTime * 2.0f);
-    
-    // Затухание глюков
-    g_worldEvolution.glitchIntensity = lerp(g_worldEvolution.glitchIntensity, 0.0f, deltaTime * 3.0f);
 }
 
-void drawEvolvingWalls(SDL_Renderer* ren, Camera cam) {
-    if (g_worldEvolution.gridWallHeight <= 0.01f) return;
-    
-    float h = g_worldEvolution.gridWallHeight;
-    float density = g_worldEvolution.gridDensity;
-    
-    SDL_Color wallColor = {80, 80, 90, 255};
-    float worldSize = 30.0f;
-    
-    // --- ОПТИМИЗАЦИЯ 1: Увеличиваем шаг, чтобы было меньше линий ---
-    float step = fmaxf(4.0f, 8.0f / density); // Шаг не меньше 4.0 юнитов!
+// Куда рисовали примитивы, по полосам строк. Пролётов и строк пикселей за кадр тысячи, и идут они
+// из разных потоков (виды сплит-скрина, плитки), поэтому каждый только расширяет рамку своей
+// полосы атомарными min/max - без блокировки и слияний. В DirtyRects полосы уходят один раз,
+// в конце кадра, и там уже сливаются с соседями как обычно
+#define DIRTY_BAND_ROWS 16
+#define DIRTY_BANDS ((HEIGHT + DIRTY_BAND_ROWS - 1) / DIRTY_BAND_ROWS)
+
+typedef struct {
+    SDL_atomic_t x0, y0, x1, y1; // Пустая полоса: x0 >= x1
+} DirtyBand;
 
-    // Вертикальные линии
-    for (float i = -worldSize; i <= worldSize; i += step) {
-        float waveOffset = fast_sin(i * 0.1f + SDL_GetTicks() * 0.0005f) * g_worldEvolution.gridPulse * 0.5f;
-        float currentHeight = -2.0f + h + waveOffset;
+static inline void dirtyAtomicMin(SDL_atomic_t* a, int v) {
+    int cur = SDL_AtomicGet(a);
+    while (v < cur && !SDL_AtomicCAS(a, cur, v)) cur = SDL_AtomicGet(a);
+}
 
-        // Передняя и задняя стены
-        clipAndDrawLine(ren, (Vec3){i, -2.0f, -worldSize}, (Vec3){i, currentHeight, -worldSize}, cam, wallColor);
-        clipAndDrawLine(ren, (Vec3){i, -2.0f, worldSize}, (Vec3){i, currentHeight, worldSize}, cam, wallColor);
+static inline void dirtyAtomicMax(SDL_atomic_t* a, int v) {
+    int cur = SDL_AtomicGet(a);
+    while (v > cur && !SDL_AtomicCAS(a, cur, v)) cur = SDL_AtomicGet(a);
+}
 
-        // Левая и правая стены
-        clipAndDrawLine(ren, (Vec3){-worldSize, -2.0f, i}, (Vec3){-worldSize, currentHeight, i}, cam, wallColor);
-        clipAndDrawLine(ren, (Vec3){worldSize, -2.0f, i}, (Vec3){worldSize, currentHeight, i}, cam, wallColor);
+static void DirtyBands_Reset(DirtyBand* bands) {
+    for (int i = 0; i < DIRTY_BANDS; i++) {
+        SDL_AtomicSet(&bands[i].x0, WIDTH);
+        SDL_AtomicSet(&bands[i].y0, HEIGHT);
+        SDL_AtomicSet(&bands[i].x1, 0);
+        SDL_AtomicSet(&bands[i].y1, 0);
     }
+}
 
-    // --- ОПТИМИЗАЦИЯ 2: Горизонтальные линии рисуем еще реже ---
-    for (float y = -2.0f; y <= -2.0f + h; y += step * 2.0f) { // Шаг по Y в 2 раза больше!
-        clipAndDrawLine(ren, (Vec3){-worldSize, y, -worldSize}, (Vec3){worldSize, y, -worldSize}, cam, wallColor);
-        clipAndDrawLine(ren, (Vec3){-worldSize, y, worldSize}, (Vec3){worldSize, y, worldSize}, cam, wallColor);
-        clipAndDrawLine(ren, (Vec3){-worldSize, y, -worldSize}, (Vec3){-worldSize, y, worldSize}, cam, wallColor);
-        clipAndDrawLine(ren, (Vec3){worldSize, y, -worldSize}, (Vec3){worldSize, y, worldSize}, cam, wallColor);
+// Непустой прямоугольник [x0, x1) x [y0, y1), уже обрезанный по экрану
+static void DirtyBands_Add(DirtyBand* bands, int x0, int y0, int x1, int y1) {
+    for (int b = y0 / DIRTY_BAND_ROWS; b <= (y1 - 1) / DIRTY_BAND_ROWS; b++) {
+        int by0 = b * DIRTY_BAND_ROWS, by1 = by0 + DIRTY_BAND_ROWS;
+        dirtyAtomicMin(&bands[b].x0, x0);
+        dirtyAtomicMax(&bands[b].x1, x1);
+        dirtyAtomicMin(&bands[b].y0, y0 > by0 ? y0 : by0);
+        dirtyAtomicMax(&bands[b].y1, y1 < by1 ? y1 : by1);
     }
+}
 
-    // --- ОПТИМИЗАЦИЯ 3: Потолок рисуем только контуром и диагоналями ---
-    if (g_worldEvolution.currentState >= WORLD_STATE_CUBE_COMPLETE) {
-        float ceilingY = -2.0f + h;
-        Vec3 corners[4] = {
-            {-worldSize, ceilingY, -worldSize}, {worldSize, ceilingY, -worldSize},
-            {worldSize, ceilingY, worldSize}, {-worldSize, ceilingY, worldSize}
-        };
-        // Рисуем периметр
-        for (int i = 0; i < 4; i++) {
-            clipAndDrawLine(ren, corners[i], corners[(i+1)%4], cam, wallColor);
+// Полосы кадра - в d. Один поток, когда все примитивы уже нарисованы
+static void DirtyBands_Flush(const DirtyBand* bands, DirtyRects* d) {
+    for (int i = 0; i < DIRTY_BANDS; i++) {
+        DirtyBand* b = (DirtyBand*)&bands[i];
+        int x0 = SDL_AtomicGet(&b->x0), x1 = SDL_AtomicGet(&b->x1);
+        if (x0 < x1) DirtyRects_Add(d, x0, SDL_AtomicGet(&b->y0), x1, SDL_AtomicGet(&b->y1));
+    }
+}
+
+// --- ПОКАЗ КАДРА И ПОТОК ИГРЫ ---
+// У программного бэкенда кадр целиком готов в памяти, а заливка в текстуру и SDL_RenderPresent
+// (который ждёт vsync или композитор) только тормозят следующий кадр. SDL_Renderer при этом можно
+// трогать только из главного потока (SDL_render.h; на macOS и части GL-драйверов иначе падает), и
+// события окна SDL тоже качает только там. Поэтому переезжает не показ, а игра: симуляция и
+// растеризация идут в потоке игры, а главный поток только качает события, заливает отданные ему
+// буферы в текстуру и показывает. Кадров в полёте до PRESENT_MAX_FRAMES: поток игры рисует N+1 в
+// свой буфер, пока главный заливает и показывает N. Передача - два семафора: ready (кадр отдан на
+// показ) и released (буфер залит в текстуру, можно рисовать) - это и есть забор, на котором поток
+// игры ждёт, если убежал на maxInFlight кадров вперёд. То немногое из SDL, что игре нужно от окна
+// (режим мыши, ввод текста), она просит через Present_*, а главный поток применяет.
+// SDL-бэкенд рисует через рендерер сам, поэтому с ним (и в headless, и в бенчмарке) всё остаётся
+// в главном потоке, как раньше.
+#define PRESENT_MAX_FRAMES 3
+#define PRESENT_DEFAULT_FRAMES 2
+#define PRESENT_PUMP_MS 4 // Без новых кадров главный поток всё равно качает события так часто
+
+typedef struct {
+    int active;
+    int gameThread;                     // Игра идёт в своём потоке, главный только показывает
+    int maxInFlight;                    // Буферов всего: один рисуется, остальные ждут показа или уже показаны
+    SDL_Renderer* renderer;             // Только главный поток
+    SDL_Texture* texture;               // Стриминг-текстура бэкенда, только главный поток
+    Uint32* queue[PRESENT_MAX_FRAMES];  // Отданные на показ кадры, по порядку
+    DirtyRects queueDirty[PRESENT_MAX_FRAMES]; // Что в каждом из них нарисовано
+    int queueClearedAll[PRESENT_MAX_FRAMES];   // ... или весь кадр новый
+    Uint64 queuedAt[PRESENT_MAX_FRAMES];
+    DirtyRects shown;                   // Только главный поток: что нарисовано в кадре, который сейчас в текстуре
+    SDL_atomic_t uploadedPixels;        // Сколько пикселей ушло в текстуру последним кадром
+    Uint32* freed[PRESENT_MAX_FRAMES];  // Показанные буферы, поток игры забирает под рисование
+    int queueWrite, queueRead;          // queueWrite и freedRead трогает поток игры, остальные два - главный
+    int freedWrite, freedRead;
+    SDL_sem* ready;                     // Один пост на кадр плюс один на конец игры
+    SDL_sem* released;                  // Один пост на освободившийся буфер
+    SDL_atomic_t queued;
+    SDL_atomic_t gameDone;
+    SDL_atomic_t wantRelativeMouse;     // Что игра попросила у окна; главный поток применяет
+    SDL_atomic_t wantTextInput;
+    Uint32 framesPresented;
+    float waitMs;                       // Поток игры ждал свободный буфер, скользящее среднее
+    float lastWaitMs;                   // ... и в последнем кадре (уровни качества вычитают его из времени кадра)
+    float presentMs;                    // Заливка + Present в главном потоке, скользящее среднее
+    float latencyMs;                    // От сдачи кадра до возврата из Present, скользящее среднее
+} FramePresenter;
+
+FramePresenter g_present = { .maxInFlight = 1 };
+
+// Главный поток: заливает и показывает самый старый отданный кадр
+static void Present_ShowNext(void) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    Uint32* frame = g_present.queue[g_present.queueRead];
+    const DirtyRects* drawn = &g_present.queueDirty[g_present.queueRead];
+    Uint64 queuedAt = g_present.queuedAt[g_present.queueRead];
+
+    // От прошлого показанного кадра изменилось только то, что нарисовано в нём или в этом
+    DirtyRects_Merge(&g_present.shown, drawn);
+    if (g_present.queueClearedAll[g_present.queueRead]) DirtyRects_MarkFull(&g_present.shown);
+    DirtyRects_Upload(g_present.texture, frame, &g_present.shown);
+    SDL_AtomicSet(&g_present.uploadedPixels, DirtyRects_Pixels(&g_present.shown));
+    DirtyRects_Copy(&g_present.shown, drawn);
+    g_present.queueRead = (g_present.queueRead + 1) % PRESENT_MAX_FRAMES;
+    SDL_AtomicAdd(&g_present.queued, -1);
+
+    // Пиксели уже в текстуре - буфер можно отдавать под рисование, не дожидаясь vsync
+    g_present.freed[g_present.freedWrite] = frame;
+    g_present.freedWrite = (g_present.freedWrite + 1) % PRESENT_MAX_FRAMES;
+    SDL_SemPost(g_present.released);
+
+    SDL_RenderCopy(g_present.renderer, g_present.texture, NULL, NULL);
+    SDL_RenderPresent(g_present.renderer);
+    Uint64 end = SDL_GetPerformanceCounter();
+    double freq = (double)SDL_GetPerformanceFrequency();
+    g_present.presentMs = g_present.presentMs * 0.9f + (float)((end - start) * 1000.0 / freq) * 0.1f;
+    g_present.latencyMs = g_present.latencyMs * 0.9f + (float)((end - queuedAt) * 1000.0 / freq) * 0.1f;
+    g_present.framesPresented++;
+}
+
+// Готовит показ из главного потока в текстуру программного бэкенда: frames (2..PRESENT_MAX_FRAMES)
+// буферов в полёте. 0 - не вышло (кадр заливается и показывается прямо в EndFrame, как раньше)
+int Present_Start(SDL_Renderer* renderer, SDL_Texture* texture, int frames) {
+    if (frames < 2 || !renderer || !texture) return 0;
+    if (frames > PRESENT_MAX_FRAMES) frames = PRESENT_MAX_FRAMES;
+    memset(&g_present, 0, sizeof(g_present));
+    g_present.renderer = renderer;
+    g_present.texture = texture;
+    g_present.maxInFlight = frames;
+    DirtyRects_MarkFull(&g_present.shown); // Текстура ещё пустая
+    SDL_AtomicSet(&g_present.wantRelativeMouse, SDL_GetRelativeMouseMode());
+    SDL_AtomicSet(&g_present.wantTextInput, SDL_IsTextInputActive());
+
+    // Один буфер поток игры принесёт сам (кадр бэкенда), остальные с самого начала свободны
+    int ok = 1;
+    for (int i = 0; i < frames - 1 && ok; i++) {
+        g_present.freed[i] = (Uint32*)malloc(WIDTH * HEIGHT * sizeof(Uint32));
+        ok = g_present.freed[i] != NULL;
+    }
+    g_present.freedWrite = (frames - 1) % PRESENT_MAX_FRAMES;
+    g_present.ready = ok ? SDL_CreateSemaphore(0) : NULL;
+    g_present.released = g_present.ready ? SDL_CreateSemaphore(frames - 1) : NULL;
+    if (!g_present.released) {
+        printf("Present: no frame buffers (%s), presenting in EndFrame\n", SDL_GetError());
+        if (g_present.ready) SDL_DestroySemaphore(g_present.ready);
+        for (int i = 0; i < PRESENT_MAX_FRAMES; i++) free(g_present.freed[i]);
+        memset(&g_present, 0, sizeof(g_present));
+        g_present.maxInFlight = 1;
+        return 0;
+    }
+
+    g_present.active = 1;
+    printf("Present: %d frames in flight\n", frames);
+    return 1;
+}
+
+// Поток игры: отдаёт готовый кадр (и где в нём рисовали, или что он весь новый) на показ и
+// возвращает буфер под следующий. Если все буферы ещё в очереди - ждёт, пока главный поток освободит один
+Uint32* Present_Submit(Uint32* pixels, const DirtyRects* drawn, int clearedAll) {
+    g_present.queue[g_present.queueWrite] = pixels;
+    DirtyRects_Copy(&g_present.queueDirty[g_present.queueWrite], drawn);
+    g_present.queueClearedAll[g_present.queueWrite] = clearedAll;
+    g_present.queuedAt[g_present.queueWrite] = SDL_GetPerformanceCounter();
+    g_present.queueWrite = (g_present.queueWrite + 1) % PRESENT_MAX_FRAMES;
+    SDL_AtomicAdd(&g_present.queued, 1);
+    SDL_SemPost(g_present.ready);
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    SDL_SemWait(g_present.released);
+    g_present.lastWaitMs = (float)((SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+    g_present.waitMs = g_present.waitMs * 0.9f + g_present.lastWaitMs * 0.1f;
+
+    Uint32* next = g_present.freed[g_present.freedRead];
+    g_present.freed[g_present.freedRead] = NULL;
+    g_present.freedRead = (g_present.freedRead + 1) % PRESENT_MAX_FRAMES;
+    return next;
+}
+
+// События окна для игры. В своём потоке игра только забирает их из очереди SDL (это можно из
+// любого потока), а качает их главный поток в Present_Run
+int Present_PollEvent(SDL_Event* e) {
+    if (g_present.gameThread) return SDL_PeepEvents(e, 1, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT) > 0;
+    return SDL_PollEvent(e);
+}
+
+void Present_SetRelativeMouseMode(SDL_bool on) {
+    if (g_present.gameThread) {
+        SDL_AtomicSet(&g_present.wantRelativeMouse, on);
+    } else {
+        SDL_SetRelativeMouseMode(on);
+    }
+}
+
+void Present_SetTextInput(int on) {
+    if (g_present.gameThread) {
+        SDL_AtomicSet(&g_present.wantTextInput, on);
+    } else if (on) {
+        SDL_StartTextInput();
+    } else {
+        SDL_StopTextInput();
+    }
+}
+
+// Поток игры закончил: главный поток показывает, что осталось в очереди, и выходит из Present_Run
+void Present_GameFinished(void) {
+    SDL_AtomicSet(&g_present.gameDone, 1);
+    SDL_SemPost(g_present.ready);
+}
+
+// Главный поток, пока игра в своём: события, просьбы игры к окну и показ отданных кадров
+void Present_Run(void) {
+    int relativeMouse = -1, textInput = -1;
+    for (;;) {
+        SDL_PumpEvents();
+        int want = SDL_AtomicGet(&g_present.wantRelativeMouse);
+        if (want != relativeMouse) {
+            SDL_SetRelativeMouseMode(want ? SDL_TRUE : SDL_FALSE);
+            relativeMouse = want;
         }
-        // Рисуем диагонали
-        clipAndDrawLine(ren, corners[0], corners[2], cam, wallColor);
-        clipAndDrawLine(ren, corners[1], corners[3], cam, wallColor);
+        want = SDL_AtomicGet(&g_present.wantTextInput);
+        if (want != textInput) {
+            if (want) SDL_StartTextInput(); else SDL_StopTextInput();
+            textInput = want;
+        }
+
+        SDL_SemWaitTimeout(g_present.ready, PRESENT_PUMP_MS);
+        if (SDL_AtomicGet(&g_present.queued) > 0) {
+            Present_ShowNext();
+            continue;
+        }
+        if (SDL_AtomicGet(&g_present.gameDone)) break;
     }
 }
 
-// [Продолжение следует в следующем сообщении...]
+// Показывает всё, что уже отдано, и освобождает буферы. Буфер, который сейчас у бэкенда,
+// остаётся бэкенду. Только главный поток, когда потока игры уже нет
+void Present_Stop(void) {
+    if (!g_present.active) return;
+    while (SDL_AtomicGet(&g_present.queued) > 0) Present_ShowNext();
+    SDL_DestroySemaphore(g_present.released);
+    SDL_DestroySemaphore(g_present.ready);
+    for (int i = 0; i < PRESENT_MAX_FRAMES; i++) free(g_present.freed[i]);
+    printf("Present: stopped after %u frames\n", g_present.framesPresented);
+    memset(&g_present, 0, sizeof(g_present));
+    g_present.maxInFlight = 1;
+}
 
-void drawSkybox(SDL_Renderer* ren) {
-    // УДАЛИ СТАРЫЙ КОД С ЦВЕТАМИ, ОСТАВЬ ТОЛЬКО ЭТО:
-    if (!g_worldEvolution.skyboxEnabled || g_worldEvolution.skyboxAlpha < 0.01f) return;
-    
-    SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
-    
-    SDL_Color skyTop = g_dayNight.skyTopColor;
-    SDL_Color skyBottom = g_dayNight.skyBottomColor;
-    
-    for (int y = 0; y < HEIGHT; y += 4) { // Шаг 4 для скорости
-        float t = (float)y / HEIGHT;
-        
-        SDL_Color finalColor = lerpColor(skyTop, skyBottom, t);
-        finalColor.a = (Uint8)(g_worldEvolution.skyboxAlpha * 255);
-        
-        SDL_SetRenderDrawColor(ren, finalColor.r, finalColor.g, finalColor.b, finalColor.a);
-        SDL_Rect lineRect = {0, y, WIDTH, 4};
-        SDL_RenderFillRect(ren, &lineRect);
+// --- БЭКЕНД РЕНДЕРА ---
+// Все функции отрисовки говорят не с SDL_Renderer напрямую, а с этим маленьким интерфейсом.
+// Z-буфер и тест глубины остаются общими (на CPU), бэкенду приходят уже "победившие" пиксели.
+// Реализации две:
+//   soft - чистый программный кадр ARGB8888, раз в кадр заливается в стриминг-текстуру;
+//   sdl  - всё копится в пачки SDL_RenderGeometry / SDL_RenderDrawLines для любого рендерера SDL.
+// Какой быстрее, зависит от машины, поэтому выбираем на старте (--backend=) и меряем (--bench).
+typedef enum {
+    RENDER_BACKEND_SOFTWARE,
+    RENDER_BACKEND_SDL_BATCHED,
+    RENDER_BACKEND_COUNT
+} RenderBackendType;
+
+typedef struct RenderBackend RenderBackend;
+struct RenderBackend {
+    const char* name;
+    RenderBackendType type;
+    SDL_Renderer* sdl;        // Рендерер окна: через него идёт Present в обоих бэкендах
+    SDL_Color color;          // Текущий цвет рисования
+    SDL_BlendMode blendMode;  // Текущий режим смешивания
+    Uint32 submits;           // Сколько вызовов ушло в SDL за кадр (для профайлера и бенчмарка)
+    int pixelRows;            // 1 - пиксели пишутся прямо в свой кадр, и цвет в каждом пикселе почти бесплатен
+    SDL_Rect clip;            // Куда можно рисовать: весь экран или вид сплит-скрина
+    float presentWaitMs;      // Сколько последний EndFrame ждал показа (vsync, свободный буфер) - это не работа кадра
+    void* impl;               // Данные конкретной реализации
+
+    void (*BeginFrame)(RenderBackend* rb, SDL_Color clearColor);
+    void (*Span)(RenderBackend* rb, int y, int x0, int x1);                    // Горизонтальный пролёт [x0, x1) текущим цветом
+    void (*Lines)(RenderBackend* rb, const SDL_Point* points, int count);       // Ломаная, как SDL_RenderDrawLines
+    void (*Triangles)(RenderBackend* rb, const SDL_Vertex* verts, int count);   // Треугольники с цветом в вершинах
+    void (*Pixels)(RenderBackend* rb, int y, int x0, const Uint32* colors, int count); // Пролёт со своим цветом в каждом пикселе (ARGB, альфа в старшем байте)
+    void (*FillRect)(RenderBackend* rb, const SDL_Rect* rect);
+    void (*Text)(RenderBackend* rb, SDL_Surface* surface, int x, int y);
+    void (*RowFill)(RenderBackend* rb, const Uint32* rowColors, Uint32 version); // Вся область clip: HEIGHT строк rowColors (ARGB) растянуты на её высоту; version меняется вместе с цветами
+    void (*Flush)(RenderBackend* rb);                                          // Сбросить накопленное (перед сменой режима)
+    void (*EndFrame)(RenderBackend* rb);
+};
+
+// SDL_RenderPresent и сколько он ждал (vsync)
+static float Render_PresentTimed(SDL_Renderer* sdl) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    SDL_RenderPresent(sdl);
+    return (float)((SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+}
+
+const char* g_renderBackendNames[RENDER_BACKEND_COUNT] = { "soft", "sdl" };
+
+static inline void Render_SetColor(RenderBackend* rb, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+    rb->color = (SDL_Color){r, g, b, a};
+}
+
+static inline void Render_SetBlendMode(RenderBackend* rb, SDL_BlendMode mode) {
+    if (mode == rb->blendMode) return;
+    rb->Flush(rb); // Накопленное должно смешаться в СТАРОМ режиме
+    rb->blendMode = mode;
+}
+
+// Область отсечения. Программный бэкенд режет по ней сам, SDL - через свой clip rect
+static inline void Render_SetClip(RenderBackend* rb, const SDL_Rect* rect) {
+    SDL_Rect full = { 0, 0, WIDTH, HEIGHT };
+    SDL_Rect clip = rect ? *rect : full;
+    if (clip.x == rb->clip.x && clip.y == rb->clip.y && clip.w == rb->clip.w && clip.h == rb->clip.h) return;
+    rb->Flush(rb); // Накопленное режется по СТАРОЙ области
+    rb->clip = clip;
+    if (rb->type == RENDER_BACKEND_SDL_BATCHED) SDL_RenderSetClipRect(rb->sdl, rect ? &clip : NULL);
+}
+
+static inline void Render_Point(RenderBackend* rb, int x, int y) {
+    rb->Span(rb, y, x, x + 1);
+}
+
+static inline void Render_Line(RenderBackend* rb, int x1, int y1, int x2, int y2) {
+    SDL_Point points[2] = { {x1, y1}, {x2, y2} };
+    rb->Lines(rb, points, 2);
+}
+
+static inline void Render_FillRect(RenderBackend* rb, const SDL_Rect* rect) {
+    rb->FillRect(rb, rect);
+}
+
+// --- Программный бэкенд: свой кадр в памяти ---
+// Что было нарисовано в буфере кадра, когда его отдали в прошлый раз (буферов несколько,
+// когда показывает отдельный поток)
+typedef struct {
+    Uint32* pixels;
+    Uint32 clearColor;
+    DirtyRects drawn;
+} SoftFrameHistory;
+
+typedef struct {
+    Uint32* pixels;       // WIDTH * HEIGHT, ARGB8888
+    SDL_Texture* texture; // Стриминг-текстура для вывода кадра
+    DirtyRects drawn;     // Куда рисовали в этом кадре
+    DirtyBand bands[DIRTY_BANDS]; // ... пока кадр рисуется; в drawn уходят в EndFrame
+    int clearedAll;       // Кадр чистился целиком (новый фон или новый буфер) - в текстуру весь
+    DirtyRects shown;     // Куда рисовали в кадре, который сейчас в текстуре
+    SoftFrameHistory history[PRESENT_MAX_FRAMES];
+    SoftFrameHistory* frame; // История буфера, в который рисуем сейчас
+    int frameOpen;        // BeginFrame был, EndFrame ещё нет
+    int uploadedPixels;   // Сколько пикселей ушло в текстуру последним кадром
+    int clearedPixels;    // Сколько почистил BeginFrame
+} SoftBackend;
+
+static inline void softMarkDirty(RenderBackend* rb, int x0, int y0, int x1, int y1) {
+    SoftBackend* sb = (SoftBackend*)rb->impl;
+    if (DirtyRects_IsFull(&sb->drawn)) return;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > WIDTH) x1 = WIDTH;
+    if (y1 > HEIGHT) y1 = HEIGHT;
+    if (x0 >= x1 || y0 >= y1) return;
+    DirtyBands_Add(sb->bands, x0, y0, x1, y1);
+}
+
+static inline Uint32 packARGB(SDL_Color c) {
+    return 0xFF000000u | ((Uint32)c.r << 16) | ((Uint32)c.g << 8) | (Uint32)c.b;
+}
+
+static inline SDL_Color unpackARGB(Uint32 c) {
+    SDL_Color out = { (Uint8)(c >> 16), (Uint8)(c >> 8), (Uint8)c, (Uint8)(c >> 24) };
+    return out;
+}
+
+// Смешивание одного пикселя так же, как это делает SDL для соответствующего режима
+static inline Uint32 softBlendPixel(Uint32 dst, SDL_Color c, SDL_BlendMode mode) {
+    Uint32 dr = (dst >> 16) & 0xFF, dg = (dst >> 8) & 0xFF, db = dst & 0xFF;
+    switch (mode) {
+        case SDL_BLENDMODE_BLEND: {
+            Uint32 a = c.a, ia = 255 - a;
+            dr = (c.r * a + dr * ia) / 255;
+            dg = (c.g * a + dg * ia) / 255;
+            db = (c.b * a + db * ia) / 255;
+            break;
+        }
+        case SDL_BLENDMODE_ADD:
+            dr += c.r * c.a / 255; if (dr > 255) dr = 255;
+            dg += c.g * c.a / 255; if (dg > 255) dg = 255;
+            db += c.b * c.a / 255; if (db > 255) db = 255;
+            break;
+        case SDL_BLENDMODE_MOD:
+            dr = dr * c.r / 255;
+            dg = dg * c.g / 255;
+            db = db * c.b / 255;
+            break;
+        default:
+            return packARGB(c);
     }
-    
-    SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_NONE);
+    return 0xFF000000u | (dr << 16) | (dg << 8) | db;
 }
-// Эффект глюков при переходах
-void applyGlitchEffect(SDL_Renderer* ren) {
-    if (g_worldEvolution.glitchIntensity < 0.01f) return;
-    
-    SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_ADD);
-    
-    for (int i = 0; i < 10; i++) {
-        if (rand() % 100 < g_worldEvolution.glitchIntensity * 100) {
-            int x = rand() % WIDTH;
-            int y = rand() % HEIGHT;
-            int w = rand() % 200 + 50;
-            int h = rand() % 20 + 5;
-            
-            Uint8 color = rand() % 50;
-            SDL_SetRenderDrawColor(ren, color, 0, color * 2, 100);
-            SDL_Rect glitchRect = {x, y, w, h};
-            SDL_RenderFillRect(ren, &glitchRect);
+
+static void SoftBackend_BeginFrame(RenderBackend* rb, SDL_Color clearColor) {
+    SoftBackend* sb = (SoftBackend*)rb->impl;
+    PostFX_BeginFrame();
+    Uint32 c = packARGB(clearColor);
+
+    // История этого буфера; новый буфер начинает с нуля
+    SoftFrameHistory* h = NULL;
+    for (int i = 0; i < PRESENT_MAX_FRAMES && !h; i++) {
+        if (sb->history[i].pixels == sb->pixels) h = &sb->history[i];
+    }
+    for (int i = 0; i < PRESENT_MAX_FRAMES && !h; i++) {
+        if (!sb->history[i].pixels) h = &sb->history[i];
+    }
+    if (!h) h = &sb->history[0];
+    if (h->pixels != sb->pixels) {
+        h->pixels = sb->pixels;
+        DirtyRects_MarkFull(&h->drawn);
+    }
+    if (sb->frameOpen) { // Прошлый кадр бросили без EndFrame
+        DirtyBands_Flush(sb->bands, &sb->drawn);
+        DirtyRects_Merge(&h->drawn, &sb->drawn);
+    }
+
+    // Вне нарисованного в прошлый раз буфер уже залит фоном - чистим только нарисованное.
+    // Другой фон - чистим всё, и тогда в текстуру уходит весь кадр
+    DirtyRects_Reset(&sb->drawn);
+    DirtyBands_Reset(sb->bands);
+    sb->clearedAll = h->clearColor != c || DirtyRects_IsFull(&h->drawn);
+    if (sb->clearedAll) {
+        for (int i = 0; i < WIDTH * HEIGHT; i++) sb->pixels[i] = c;
+        sb->clearedPixels = WIDTH * HEIGHT;
+    } else {
+        for (int i = 0; i < h->drawn.count; i++) {
+            const SDL_Rect* r = &h->drawn.rects[i];
+            for (int y = r->y; y < r->y + r->h; y++) {
+                Uint32* row = sb->pixels + y * WIDTH;
+                for (int x = r->x; x < r->x + r->w; x++) row[x] = c;
+            }
         }
+        sb->clearedPixels = h->drawn.area;
     }
-    
-    SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_NONE);
+    h->clearColor = c;
+    sb->frame = h;
+    sb->frameOpen = 1;
+    rb->submits = 0;
 }
 
-// Полигональная заливка для продвинутых состояний
-void drawFilledTriangle(SDL_Renderer* ren, Vec3 p1, Vec3 p2, Vec3 p3, Camera cam, SDL_Color color) {
-    if (g_worldEvolution.polygonOpacity < 0.01f) return;
-    
-    ProjectedPoint pp1 = project_with_depth(p1, cam);
-    ProjectedPoint pp2 = project_with_depth(p2, cam);
-    ProjectedPoint pp3 = project_with_depth(p3, cam);
-    
-    // Простая проверка видимости
-    if (pp1.z <= 0.1f || pp2.z <= 0.1f || pp3.z <= 0.1f) return;
-    if (pp1.x < -WIDTH || pp1.x > WIDTH*2) return;
-    
-    // Применяем прозрачность
-    color.a = (Uint8)(g_worldEvolution.polygonOpacity * 255);
-    
-    SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
-    SDL_SetRenderDrawColor(ren, color.r, color.g, color.b, color.a);
-    
-    // Рисуем треугольник линиями (SDL не умеет заливать треугольники напрямую)
-    // Но создаём иллюзию заливки частыми горизонтальными линиями
-    int minY = fminf(pp1.y, fminf(pp2.y, pp3.y));
-    int maxY = fmaxf(pp1.y, fmaxf(pp2.y, pp3.y));
-    
-    for (int y = minY; y <= maxY; y += 2) {
-        // Тут нужна растеризация треугольника, но для простоты просто рисуем линии
-        SDL_RenderDrawLine(ren, pp1.x, pp1.y, pp2.x, pp2.y);
-        SDL_RenderDrawLine(ren, pp2.x, pp2.y, pp3.x, pp3.y);
-        SDL_RenderDrawLine(ren, pp3.x, pp3.y, pp1.x, pp1.y);
+// Пролёт, уже обрезанный по клипу и отмеченный грязным
+static inline void softWriteSpan(RenderBackend* rb, int y, int x0, int x1) {
+    Uint32* row = ((SoftBackend*)rb->impl)->pixels + y * WIDTH;
+    if (rb->blendMode == SDL_BLENDMODE_NONE) {
+        Uint32 c = packARGB(rb->color);
+        for (int x = x0; x < x1; x++) row[x] = c;
+    } else {
+        for (int x = x0; x < x1; x++) row[x] = softBlendPixel(row[x], rb->color, rb->blendMode);
     }
-    
-    SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_NONE);
 }
 
-void initHandsSystem() {
-    g_hands.leftPos = (Vec3){-0.45f, -0.9f, 0.35f};
-    g_hands.rightPos = (Vec3){0.45f, -0.9f, 0.35f};
-    
-    float inwardAngle = 0.5f;
-    g_hands.leftRot = (Vec3){0, inwardAngle, 0};
-    g_hands.rightRot = (Vec3){0, -inwardAngle, 0};
-    
-    g_hands.currentState = HAND_STATE_IDLE;
-    g_hands.targetState = HAND_STATE_IDLE;
-    g_hands.stateTransition = 1.0f;
-    
-    g_hands.walkPhase = 0.0f;
-    g_hands.runPhase = 0.0f;
-    g_hands.inspectPhase = 0.0f;
-    g_hands.throwPhase = 0.0f;
-    g_hands.idlePhase = 0.0f;
-    
-    g_hands.heldObject = NULL;
-    g_hands.pulledObject = NULL;
-    g_hands.targetedObject = NULL;
-    g_hands.flick.isActive = 0;
-    g_hands.flick.progress = 0.0f;
-    g_hands.reachDistance = 2.0f;
-    g_hands.currentThrowPower = THROW_POWER_DEFAULT;
+static void SoftBackend_Span(RenderBackend* rb, int y, int x0, int x1) {
+    if (y < rb->clip.y || y >= rb->clip.y + rb->clip.h) return;
+    if (x0 < rb->clip.x) x0 = rb->clip.x;
+    if (x1 > rb->clip.x + rb->clip.w) x1 = rb->clip.x + rb->clip.w;
+    if (x0 >= x1) return;
+    softMarkDirty(rb, x0, y, x1, y + 1);
+    softWriteSpan(rb, y, x0, x1);
 }
 
-void spawnBottle(Vec3 pos) {
-    if (g_numPickups >= MAX_PICKUPS) return;
-    
-    PickupObject* bottle = &g_pickups[g_numPickups];
-    bottle->pos = pos;
-    bottle->velocity = (Vec3){0, 0, 0};
-    bottle->rotation = (Vec3){0, 0, 0};
-    bottle->rotVelocity = (Vec3){0, 0, 0};
-    
-    bottle->type = PICKUP_TYPE_BOTTLE;
-    bottle->state = PICKUP_STATE_IDLE;
-    
-    bottle->health = 1.0f;
-    bottle->mass = 0.5f;
-    bottle->bounciness = 0.3f;
-    
-    bottle->size = (Vec3){0.15f, 0.4f, 0.15f};
-    bottle->color = (SDL_Color){100, 150, 100, 200}; // Зеленоватое стекло
-    
-    bottle->breakable = 1;
-    bottle->breakThreshold = 5.0f; // Разбивается при скорости > 5
-    
-    g_numPickups++;
-    printf("🍾 Bottle spawned at (%.1f, %.1f, %.1f)\n", pos.x, pos.y, pos.z);
+static void SoftBackend_Lines(RenderBackend* rb, const SDL_Point* points, int count) {
+    SoftBackend* sb = (SoftBackend*)rb->impl;
+    int cx0 = rb->clip.x, cx1 = rb->clip.x + rb->clip.w;
+    int cy0 = rb->clip.y, cy1 = rb->clip.y + rb->clip.h;
+    if (!DirtyRects_IsFull(&sb->drawn) && count > 0) {
+        int bx0 = points[0].x, by0 = points[0].y, bx1 = points[0].x, by1 = points[0].y;
+        for (int i = 1; i < count; i++) {
+            if (points[i].x < bx0) bx0 = points[i].x;
+            if (points[i].x > bx1) bx1 = points[i].x;
+            if (points[i].y < by0) by0 = points[i].y;
+            if (points[i].y > by1) by1 = points[i].y;
+        }
+        softMarkDirty(rb, bx0 > cx0 ? bx0 : cx0, by0 > cy0 ? by0 : cy0, bx1 + 1 < cx1 ? bx1 + 1 : cx1, by1 + 1 < cy1 ? by1 + 1 : cy1);
+    }
+    for (int i = 0; i + 1 < count; i++) {
+        // Брезенхем, концы включительно - как у SDL_RenderDrawLines
+        int x0 = points[i].x, y0 = points[i].y;
+        int x1 = points[i + 1].x, y1 = points[i + 1].y;
+        int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+        int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+        int err = dx + dy;
+        for (;;) {
+            if (x0 >= cx0 && x0 < cx1 && y0 >= cy0 && y0 < cy1) {
+                Uint32* p = &sb->pixels[y0 * WIDTH + x0];
+                *p = softBlendPixel(*p, rb->color, rb->blendMode);
+            }
+            if (x0 == x1 && y0 == y1) break;
+            int e2 = 2 * err;
+            if (e2 >= dy) { err += dy; x0 += sx; }
+            if (e2 <= dx) { err += dx; y0 += sy; }
+        }
+    }
 }
 
-void spawnGlassShards(Vec3 pos, int count) {
-    for (int i = 0; i < count && g_numShards < MAX_SHARDS; i++) {
-        GlassShard* shard = &g_shards[g_numShards];
-        
-        // Случайное направление разлёта
-        float angle = ((float)rand() / RAND_MAX) * 2.0f * M_PI;
-        float pitch = ((float)rand() / RAND_MAX - 0.5f) * M_PI;
-        float speed = 2.0f + ((float)rand() / RAND_MAX) * 3.0f;
-        
-        shard->pos = pos;
-        shard->velocity.x = fast_cos(angle) * fast_cos(pitch) * speed;
-        shard->velocity.y = fast_sin(pitch) * speed + 2.0f; // Подлетают вверх
-        shard->velocity.z = fast_sin(angle) * fast_cos(pitch) * speed;
-        
-        shard->rotation = (Vec3){
-            ((float)rand() / RAND_MAX) * 2.0f * M_PI,
-            ((float)rand() / RAND_MAX) * 2.0f * M_PI,
-            ((float)rand() / RAND_MAX) * 2.0f * M_PI
-        };
-        
-        shard->lifetime = 2.0f + ((float)rand() / RAND_MAX) * 2.0f;
-        shard->size = 0.05f + ((float)rand() / RAND_MAX) * 0.1f;
-        
-        // Цвет стекла с вариациями
-        int brightness = 100 + rand() % 100;
-        shard->color = (SDL_Color){brightness, brightness + 50, brightness, 200};
-        
-        g_numShards++;
+static void SoftBackend_Triangles(RenderBackend* rb, const SDL_Vertex* verts, int count) {
+    SoftBackend* sb = (SoftBackend*)rb->impl;
+    for (int t = 0; t + 2 < count; t += 3) {
+        const SDL_Vertex* a = &verts[t];
+        const SDL_Vertex* b = &verts[t + 1];
+        const SDL_Vertex* c = &verts[t + 2];
+
+        float area = (b->position.x - a->position.x) * (c->position.y - a->position.y) -
+                     (b->position.y - a->position.y) * (c->position.x - a->position.x);
+        if (fabsf(area) < 1e-6f) continue;
+        float invArea = 1.0f / area;
+
+        int minX = (int)floorf(fminf(a->position.x, fminf(b->position.x, c->position.x)));
+        int maxX = (int)ceilf(fmaxf(a->position.x, fmaxf(b->position.x, c->position.x)));
+        int minY = (int)floorf(fminf(a->position.y, fminf(b->position.y, c->position.y)));
+        int maxY = (int)ceilf(fmaxf(a->position.y, fmaxf(b->position.y, c->position.y)));
+        if (minX < rb->clip.x) minX = rb->clip.x;
+        if (minY < rb->clip.y) minY = rb->clip.y;
+        if (maxX > rb->clip.x + rb->clip.w) maxX = rb->clip.x + rb->clip.w;
+        if (maxY > rb->clip.y + rb->clip.h) maxY = rb->clip.y + rb->clip.h;
+        softMarkDirty(rb, minX, minY, maxX, maxY);
+
+        // Барицентрики в центре пикселя, цвет интерполируется по вершинам
+        for (int y = minY; y < maxY; y++) {
+            float py = y + 0.5f;
+            for (int x = minX; x < maxX; x++) {
+                float px = x + 0.5f;
+                float w0 = ((b->position.x - px) * (c->position.y - py) - (b->position.y - py) * (c->position.x - px)) * invArea;
+                float w1 = ((c->position.x - px) * (a->position.y - py) - (c->position.y - py) * (a->position.x - px)) * invArea;
+                float w2 = 1.0f - w0 - w1;
+                if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+
+                SDL_Color col = {
+                    (Uint8)(a->color.r * w0 + b->color.r * w1 + c->color.r * w2),
+                    (Uint8)(a->color.g * w0 + b->color.g * w1 + c->color.g * w2),
+                    (Uint8)(a->color.b * w0 + b->color.b * w1 + c->color.b * w2),
+                    (Uint8)(a->color.a * w0 + b->color.a * w1 + c->color.a * w2)
+                };
+                Uint32* p = &sb->pixels[y * WIDTH + x];
+                *p = softBlendPixel(*p, col, rb->blendMode);
+            }
+        }
     }
 }
 
-// --- ОБНОВЛЕНИЕ ФИЗИКИ ---
+static void SoftBackend_Pixels(RenderBackend* rb, int y, int x0, const Uint32* colors, int count) {
+    SoftBackend* sb = (SoftBackend*)rb->impl;
+    if (y < rb->clip.y || y >= rb->clip.y + rb->clip.h) return;
+    int start = x0 < rb->clip.x ? rb->clip.x : x0;
+    int end = x0 + count > rb->clip.x + rb->clip.w ? rb->clip.x + rb->clip.w : x0 + count;
+    softMarkDirty(rb, start, y, end, y + 1);
 
-void updatePickupPhysics(PickupObject* obj, float deltaTime, CollisionBox* boxes, int numBoxes, Camera* cam) {
-    if (obj->state == PICKUP_STATE_BROKEN || obj->state == PICKUP_STATE_HELD) return;
-    
-    // [НОВЫЙ КОД] Логика притягивания
-    if (obj->state == PICKUP_STATE_PULLED) {
-        Vec3 targetPos = {cam->x, cam->y + cam->height, cam->z};
-        Vec3 dir = {targetPos.x - obj->pos.x, targetPos.y - obj->pos.y, targetPos.z - obj->pos.z};
-        float dist = sqrtf(dir.x*dir.x + dir.y*dir.y + dir.z*dir.z);
+    Uint32* row = sb->pixels + y * WIDTH;
+    if (rb->blendMode == SDL_BLENDMODE_NONE) {
+        for (int x = start; x < end; x++) row[x] = colors[x - x0] | 0xFF000000u;
+    } else {
+        for (int x = start; x < end; x++) row[x] = softBlendPixel(row[x], unpackARGB(colors[x - x0]), rb->blendMode);
+    }
+}
 
-        if (dist < 1.0f) { // Объект пойман!
-            obj->state = PICKUP_STATE_HELD;
-            g_hands.heldObject = obj;
-            g_hands.pulledObject = NULL;
-            obj->velocity = (Vec3){0,0,0};
-            printf("🤏 Object caught!\n");
-            return;
+static void SoftBackend_FillRect(RenderBackend* rb, const SDL_Rect* rect) {
+    // Грязным весь прямоугольник разом, строки пишутся уже без отметок
+    int cx0 = rect->x > rb->clip.x ? rect->x : rb->clip.x;
+    int cy0 = rect->y > rb->clip.y ? rect->y : rb->clip.y;
+    int cx1 = rect->x + rect->w < rb->clip.x + rb->clip.w ? rect->x + rect->w : rb->clip.x + rb->clip.w;
+    int cy1 = rect->y + rect->h < rb->clip.y + rb->clip.h ? rect->y + rect->h : rb->clip.y + rb->clip.h;
+    if (cx0 >= cx1 || cy0 >= cy1) return;
+    softMarkDirty(rb, cx0, cy0, cx1, cy1);
+    for (int y = cy0; y < cy1; y++) softWriteSpan(rb, y, cx0, cx1);
+}
+
+static void SoftBackend_Text(RenderBackend* rb, SDL_Surface* surface, int x, int y) {
+    SoftBackend* sb = (SoftBackend*)rb->impl;
+    // TTF отдаёт 8-битную палитру с цветовым ключом - приводим к ARGB и смешиваем по альфе
+    SDL_Surface* argb = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+    if (!argb) return;
+
+    Uint32 colorKey = 0;
+    int hasColorKey = (SDL_GetColorKey(argb, &colorKey) == 0);
+    // Только внутри клипа, как у остальных примитивов: в сплит-скрине HUD вида не лезет в соседние
+    int cx0 = x > rb->clip.x ? x : rb->clip.x;
+    int cy0 = y > rb->clip.y ? y : rb->clip.y;
+    int cx1 = x + argb->w < rb->clip.x + rb->clip.w ? x + argb->w : rb->clip.x + rb->clip.w;
+    int cy1 = y + argb->h < rb->clip.y + rb->clip.h ? y + argb->h : rb->clip.y + rb->clip.h;
+    if (cx0 >= cx1 || cy0 >= cy1) {
+        SDL_FreeSurface(argb);
+        return;
+    }
+    softMarkDirty(rb, cx0, cy0, cx1, cy1);
+
+    SDL_LockSurface(argb);
+    for (int dy = cy0; dy < cy1; dy++) {
+        const Uint32* src = (const Uint32*)((const Uint8*)argb->pixels + (dy - y) * argb->pitch);
+        for (int dx = cx0; dx < cx1; dx++) {
+            Uint32 p = src[dx - x];
+            if (hasColorKey && p == colorKey) continue;
+            SDL_Color c = { (p >> 16) & 0xFF, (p >> 8) & 0xFF, p & 0xFF, p >> 24 };
+            if (c.a == 0) continue;
+            Uint32* d = &sb->pixels[dy * WIDTH + dx];
+            *d = softBlendPixel(*d, c, SDL_BLENDMODE_BLEND);
         }
+    }
+    SDL_UnlockSurface(argb);
+    SDL_FreeSurface(argb);
+}
 
-        dir = normalize(dir);
-        // Ускоряем объект к игроку
-        obj->velocity.x = lerp(obj->velocity.x, dir.x * PULL_FORCE, deltaTime * 5.0f);
-        obj->velocity.y = lerp(obj->velocity.y, dir.y * PULL_FORCE, deltaTime * 5.0f);
-        obj->velocity.z = lerp(obj->velocity.z, dir.z * PULL_FORCE, deltaTime * 5.0f);
+static void SoftBackend_RowFill(RenderBackend* rb, const Uint32* rowColors, Uint32 version) {
+    (void)version; // Версия нужна только SDL-бэкенду с его кэшем текстуры неба
+    SoftBackend* sb = (SoftBackend*)rb->impl;
+    const SDL_Rect* c = &rb->clip;
+    softMarkDirty(rb, c->x, c->y, c->x + c->w, c->y + c->h);
+    for (int y = 0; y < c->h; y++) {
+        Uint32* row = sb->pixels + (c->y + y) * WIDTH + c->x;
+        Uint32 color = rowColors[y * HEIGHT / c->h];
+        for (int x = 0; x < c->w; x++) row[x] = color;
+    }
+}
 
-        obj->pos.x += obj->velocity.x * deltaTime;
-        obj->pos.y += obj->velocity.y * deltaTime;
-        obj->pos.z += obj->velocity.z * deltaTime;
+static void SoftBackend_Flush(RenderBackend* rb) {
+    (void)rb; // Программному кадру копить нечего
+}
+
+static void SoftBackend_EndFrame(RenderBackend* rb) {
+    SoftBackend* sb = (SoftBackend*)rb->impl;
+    DirtyBands_Flush(sb->bands, &sb->drawn);
+    if (PostFX_Apply(sb->pixels)) DirtyRects_MarkFull(&sb->drawn); // Пост-обработка трогает весь кадр
+    Capture_SubmitPixels(sb->pixels);
+    Headless_SubmitPixels(sb->pixels);
+    if (sb->frame) DirtyRects_Copy(&sb->frame->drawn, &sb->drawn);
+    sb->frameOpen = 0;
+    if (g_present.active) {
+        // Кадр уходит главному потоку на показ, рисуем дальше в другой буфер
+        sb->pixels = Present_Submit(sb->pixels, &sb->drawn, sb->clearedAll);
+        sb->uploadedPixels = SDL_AtomicGet(&g_present.uploadedPixels);
+        rb->presentWaitMs = g_present.lastWaitMs;
+        rb->submits++;
         return;
     }
+    rb->presentWaitMs = 0.0f;
+    if (!rb->sdl) return; // Headless: кадр остаётся в памяти, показывать некуда
+    // От кадра в текстуре изменилось только то, что нарисовано в нём или в этом
+    DirtyRects_Merge(&sb->shown, &sb->drawn);
+    if (sb->clearedAll) DirtyRects_MarkFull(&sb->shown);
+    DirtyRects_Upload(sb->texture, sb->pixels, &sb->shown);
+    sb->uploadedPixels = DirtyRects_Pixels(&sb->shown);
+    DirtyRects_Copy(&sb->shown, &sb->drawn);
+    SDL_RenderCopy(rb->sdl, sb->texture, NULL, NULL);
+    rb->presentWaitMs = Render_PresentTimed(rb->sdl);
+    rb->submits++;
+}
 
-    if (obj->state == PICKUP_STATE_IDLE || obj->state == PICKUP_STATE_THROWN) {
-        // Гравитация
-        obj->velocity.y -= 9.8f * deltaTime;
-        
-        // Обновляем позицию
-        Vec3 newPos = {
-            obj->pos.x + obj->velocity.x * deltaTime,
-            obj->pos.y + obj->velocity.y * deltaTime,
-            obj->pos.z + obj->velocity.z * deltaTime
-        };
-        
-        // Проверка коллизии с полом
-        if (newPos.y <= -2.0f + obj->size.y/2) {
-            newPos.y = -2.0f + obj->size.y/2;
-            
-            // Проверяем, разбивается ли при ударе
-            float impactSpeed = fabsf(obj->velocity.y);
-            if (obj->breakable && impactSpeed > obj->breakThreshold) {
-                printf("💥 Bottle shattered! Impact speed: %.2f\n", impactSpeed);
-                obj->state = PICKUP_STATE_BROKEN;
-                spawnGlassShards(obj->pos, 15 + rand() % 10);
-                return;
-            }
-            
-            // Отскок
-            obj->velocity.y = -obj->velocity.y * obj->bounciness;
-            
-            // Трение
-            obj->velocity.x *= 0.8f;
-            obj->velocity.z *= 0.8f;
-        }
-        
-        // Проверка коллизий с объектами
-        for (int i = 0; i < numBoxes; i++) {
-            CollisionBox* box = &boxes[i];
-            
-            // Простая проверка AABB
-            if (newPos.x + obj->size.x/2 > box->pos.x + box->bounds.minX &&
-                newPos.x - obj->size.x/2 < box->pos.x + box->bounds.maxX &&
-                newPos.y + obj->size.y/2 > box->pos.y + box->bounds.minY &&
-                newPos.y - obj->size.y/2 < box->pos.y + box->bounds.maxY &&
-                newPos.z + obj->size.z/2 > box->pos.z + box->bounds.minZ &&
-                newPos.z - obj->size.z/2 < box->pos.z + box->bounds.maxZ) {
-                
-                // Отталкиваем объект
-                Vec3 center = box->pos;
-                Vec3 toObj = {newPos.x - center.x, 0, newPos.z - center.z};
-                float len = sqrtf(toObj.x*toObj.x + toObj.z*toObj.z);
-                if (len > 0.01f) {
-                    toObj.x /= len;
-                    toObj.z /= len;
-                    
-                    newPos.x = center.x + toObj.x * (box->bounds.maxX + obj->size.x);
-                    newPos.z = center.z + toObj.z * (box->bounds.maxZ + obj->size.z);
-                }
-                
-                // Проверяем разбивание при ударе о стену
-                float hitSpeed = sqrtf(obj->velocity.x*obj->velocity.x + 
-                                      obj->velocity.z*obj->velocity.z);
-                if (obj->breakable && hitSpeed > obj->breakThreshold) {
-                    obj->state = PICKUP_STATE_BROKEN;
-                    spawnGlassShards(obj->pos, 12);
-                    return;
-                }
-                
-                // Отскок от стены
-                obj->velocity.x *= -obj->bounciness;
-                obj->velocity.z *= -obj->bounciness;
-            }
-        }
-        
-        obj->pos = newPos;
-        
-        // Вращение в полёте
-        if (obj->state == PICKUP_STATE_THROWN) {
-            obj->rotation.x += obj->rotVelocity.x * deltaTime;
-            obj->rotation.y += obj->rotVelocity.y * deltaTime;
-            obj->rotation.z += obj->rotVelocity.z * deltaTime;
-        }
-        
-        // Останавливаем, если почти не движется
-        float speed = sqrtf(obj->velocity.x*obj->velocity.x + 
-                          obj->velocity.z*obj->velocity.z);
-        if (speed < 0.1f && fabsf(obj->velocity.y) < 0.1f && 
-            obj->state == PICKUP_STATE_THROWN) {
-            obj->state = PICKUP_STATE_IDLE;
-            obj->velocity = (Vec3){0, 0, 0};
-            obj->rotVelocity = (Vec3){0, 0, 0};
-        }
-    }
-}
-
-// [НОВЫЙ КОД] Функция для рейкастинга
-// Проверяет пересечение луча с AABB (ограничивающим параллелепипедом)
-// Возвращает 1 если есть пересечение, и записывает расстояние до него в t
-int intersectRayAABB(Vec3 rayOrigin, Vec3 rayDir, Vec3 boxMin, Vec3 boxMax, float* t) {
-    float tmin = (boxMin.x - rayOrigin.x) / rayDir.x;
-    float tmax = (boxMax.x - rayOrigin.x) / rayDir.x;
-
-    if (tmin > tmax) { float tmp = tmin; tmin = tmax; tmax = tmp; }
+// --- SDL-бэкенд: пачки геометрии для SDL_RenderGeometry ---
+#define RENDER_BATCH_QUADS 16384
 
-    float tymin = (boxMin.y - rayOrigin.y) / rayDir.y;
-    float tymax = (boxMax.y - rayOrigin.y) / rayDir.y;
+typedef struct {
+    SDL_Vertex verts[RENDER_BATCH_QUADS * 4];
+    int indices[RENDER_BATCH_QUADS * 6];
+    int numVerts;
+    int numIndices;
+    int lastSpanVert; // Начало последнего квада-пролёта (для склейки соседей), -1 если нет
+    int lastSpanY;
+    int lastSpanX1;
+    SDL_Texture* rowTexture; // 1 x HEIGHT, растягивается на область clip одним RenderCopy
+    Uint32 rowVersion;       // Какая версия строк сейчас лежит в текстуре
+} SdlBatchBackend;
+
+static void SdlBackend_Flush(RenderBackend* rb) {
+    SdlBatchBackend* bb = (SdlBatchBackend*)rb->impl;
+    if (bb->numIndices > 0) {
+        SDL_SetRenderDrawBlendMode(rb->sdl, rb->blendMode);
+        SDL_RenderGeometry(rb->sdl, NULL, bb->verts, bb->numVerts, bb->indices, bb->numIndices);
+        rb->submits++;
+    }
+    bb->numVerts = 0;
+    bb->numIndices = 0;
+    bb->lastSpanVert = -1;
+}
 
-    if (tymin > tymax) { float tmp = tymin; tymin = tymax; tymax = tmp; }
+// Перед "немедленными" вызовами SDL: пачка, цвет и режим должны быть актуальны
+static void SdlBackend_PrepareImmediate(RenderBackend* rb) {
+    SdlBackend_Flush(rb);
+    SDL_SetRenderDrawBlendMode(rb->sdl, rb->blendMode);
+    SDL_SetRenderDrawColor(rb->sdl, rb->color.r, rb->color.g, rb->color.b, rb->color.a);
+    rb->submits++;
+}
 
-    if ((tmin > tymax) || (tymin > tmax)) return 0;
+static void SdlBackend_BeginFrame(RenderBackend* rb, SDL_Color clearColor) {
+    SdlBatchBackend* bb = (SdlBatchBackend*)rb->impl;
+    PostFX_BeginFrame();
+    bb->numVerts = 0;
+    bb->numIndices = 0;
+    bb->lastSpanVert = -1;
+    SDL_SetRenderDrawColor(rb->sdl, clearColor.r, clearColor.g, clearColor.b, 255);
+    SDL_RenderClear(rb->sdl);
+    rb->submits = 1;
+}
 
-    if (tymin > tmin) tmin = tymin;
-    if (tymax < tmax) tmax = tymax;
+static void SdlBackend_Span(RenderBackend* rb, int y, int x0, int x1) {
+    SdlBatchBackend* bb = (SdlBatchBackend*)rb->impl;
+    if (x0 >= x1) return;
+
+    // Продолжение предыдущего пролёта тем же цветом - просто растягиваем квад
+    if (bb->lastSpanVert >= 0 && bb->lastSpanY == y && bb->lastSpanX1 == x0) {
+        SDL_Vertex* q = &bb->verts[bb->lastSpanVert];
+        SDL_Color c = q->color;
+        if (c.r == rb->color.r && c.g == rb->color.g && c.b == rb->color.b && c.a == rb->color.a) {
+            q[1].position.x = (float)x1;
+            q[2].position.x = (float)x1;
+            bb->lastSpanX1 = x1;
+            return;
+        }
+    }
 
-    float tzmin = (boxMin.z - rayOrigin.z) / rayDir.z;
-    float tzmax = (boxMax.z - rayOrigin.z) / rayDir.z;
+    if (bb->numVerts + 4 > RENDER_BATCH_QUADS * 4) SdlBackend_Flush(rb);
 
-    if (tzmin > tzmax) { float tmp = tzmin; tzmin = tzmax; tzmax = tmp; }
+    int base = bb->numVerts;
+    SDL_Vertex* q = &bb->verts[base];
+    q[0] = (SDL_Vertex){ {(float)x0, (float)y},     rb->color, {0, 0} };
+    q[1] = (SDL_Vertex){ {(float)x1, (float)y},     rb->color, {0, 0} };
+    q[2] = (SDL_Vertex){ {(float)x1, (float)y + 1}, rb->color, {0, 0} };
+    q[3] = (SDL_Vertex){ {(float)x0, (float)y + 1}, rb->color, {0, 0} };
+    int* idx = &bb->indices[bb->numIndices];
+    idx[0] = base; idx[1] = base + 1; idx[2] = base + 2;
+    idx[3] = base; idx[4] = base + 2; idx[5] = base + 3;
+    bb->numVerts += 4;
+    bb->numIndices += 6;
 
-    if ((tmin > tzmax) || (tzmin > tmax)) return 0;
-    
-    if (tzmin > tmin) tmin = tzmin;
-    if (tzmax < tmax) tmax = tzmax;
+    bb->lastSpanVert = base;
+    bb->lastSpanY = y;
+    bb->lastSpanX1 = x1;
+}
 
-    *t = tmin;
-    return tmax > 0;
+static void SdlBackend_Lines(RenderBackend* rb, const SDL_Point* points, int count) {
+    SdlBackend_PrepareImmediate(rb);
+    SDL_RenderDrawLines(rb->sdl, points, count);
 }
-void updateShards(float deltaTime) {
-    for (int i = 0; i < g_numShards; i++) {
-        GlassShard* shard = &g_shards[i];
-        
-        if (shard->lifetime <= 0) continue;
-        
-        shard->lifetime -= deltaTime;
-        
-        // Физика
-        shard->velocity.y -= 15.0f * deltaTime; // Гравитация
-        
-        shard->pos.x += shard->velocity.x * deltaTime;
-        shard->pos.y += shard->velocity.y * deltaTime;
-        shard->pos.z += shard->velocity.z * deltaTime;
-        
-        // Отскок от пола
-        if (shard->pos.y <= -2.0f) {
-            shard->pos.y = -2.0f;
-            shard->velocity.y *= -0.3f;
-            shard->velocity.x *= 0.7f;
-            shard->velocity.z *= 0.7f;
-        }
-        
-        // Вращение
-        shard->rotation.x += deltaTime * 5.0f;
-        shard->rotation.y += deltaTime * 3.0f;
-        
-        // Затухание
-        if (shard->lifetime < 0.5f) {
-            shard->color.a = (Uint8)(shard->lifetime * 2.0f * 200);
-        }
-    }
-    
-    // Удаляем мёртвые осколки (сдвигаем живые в начало массива)
-    int writeIdx = 0;
-    for (int i = 0; i < g_numShards; i++) {
-        if (g_shards[i].lifetime > 0) {
-            if (writeIdx != i) {
-                g_shards[writeIdx] = g_shards[i];
-            }
-            writeIdx++;
+
+static void SdlBackend_Triangles(RenderBackend* rb, const SDL_Vertex* verts, int count) {
+    SdlBatchBackend* bb = (SdlBatchBackend*)rb->impl;
+    count -= count % 3;
+    for (int i = 0; i < count; i += 3) {
+        if (bb->numVerts + 3 > RENDER_BATCH_QUADS * 4) SdlBackend_Flush(rb);
+        int base = bb->numVerts;
+        for (int k = 0; k < 3; k++) {
+            bb->verts[base + k] = verts[i + k];
+            bb->indices[bb->numIndices++] = base + k;
         }
+        bb->numVerts += 3;
     }
-    g_numShards = writeIdx;
+    bb->lastSpanVert = -1;
 }
 
-// [ИЗМЕНЕНО] Бросок объекта, теперь с набором силы
-void throwObject(Camera* cam, float power) {
-    if (!g_hands.heldObject) return;
-    
-    g_hands.heldObject->state = PICKUP_STATE_THROWN;
-    
-    Vec3 throwDir = {
-        fast_sin(cam->rotY) * fast_cos(cam->rotX),
-        -fast_sin(cam->rotX),
-        fast_cos(cam->rotY) * fast_cos(cam->rotX)
-    };
-    throwDir = normalize(throwDir);
+// Попиксельного цвета у SDL нет: режем на пролёты одинакового цвета
+static void SdlBackend_Pixels(RenderBackend* rb, int y, int x0, const Uint32* colors, int count) {
+    SDL_Color saved = rb->color;
+    int i = 0;
+    while (i < count) {
+        int j = i + 1;
+        while (j < count && colors[j] == colors[i]) j++;
+        rb->color = unpackARGB(colors[i]);
+        SdlBackend_Span(rb, y, x0 + i, x0 + j);
+        i = j;
+    }
+    rb->color = saved;
+}
 
-    g_hands.heldObject->velocity.x = throwDir.x * power;
-    g_hands.heldObject->velocity.y = throwDir.y * power;
-    g_hands.heldObject->velocity.z = throwDir.z * power;
-    
-    // Позиция броска
-    g_hands.heldObject->pos.x = cam->x + throwDir.x * 1.5f;
-    g_hands.heldObject->pos.y = cam->y + cam->height + throwDir.y;
-    g_hands.heldObject->pos.z = cam->z + throwDir.z * 1.5f;
+static void SdlBackend_FillRect(RenderBackend* rb, const SDL_Rect* rect) {
+    SdlBackend_PrepareImmediate(rb);
+    SDL_RenderFillRect(rb->sdl, rect);
+}
 
-    g_hands.heldObject = NULL;
-    g_hands.currentThrowPower = THROW_POWER_DEFAULT; // Сброс силы
-    g_trajectory.numPoints = 0; // Скрыть траекторию
+static void SdlBackend_Text(RenderBackend* rb, SDL_Surface* surface, int x, int y) {
+    SdlBackend_Flush(rb);
+    SDL_Texture* texture = SDL_CreateTextureFromSurface(rb->sdl, surface);
+    if (!texture) return;
+    SDL_Rect destRect = { x, y, surface->w, surface->h };
+    SDL_RenderCopy(rb->sdl, texture, NULL, &destRect);
+    SDL_DestroyTexture(texture);
+    rb->submits++;
+}
 
-    printf("💨 Threw object with power %.1f!\n", power);
+static void SdlBackend_RowFill(RenderBackend* rb, const Uint32* rowColors, Uint32 version) {
+    SdlBatchBackend* bb = (SdlBatchBackend*)rb->impl;
+    SdlBackend_Flush(rb);
+    if (!bb->rowTexture) {
+        bb->rowTexture = SDL_CreateTexture(rb->sdl, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, 1, HEIGHT);
+        if (!bb->rowTexture) return;
+        SDL_SetTextureBlendMode(bb->rowTexture, SDL_BLENDMODE_NONE);
+        bb->rowVersion = 0;
+    }
+    // Заливаем в текстуру только если цвета поменялись
+    if (bb->rowVersion != version) {
+        SDL_UpdateTexture(bb->rowTexture, NULL, rowColors, sizeof(Uint32));
+        bb->rowVersion = version;
+    }
+    SDL_RenderCopy(rb->sdl, bb->rowTexture, NULL, &rb->clip);
+    rb->submits++;
 }
 
-// [НОВЫЙ КОД] Расчет траектории
-void calculateTrajectory(Camera* cam, float power, Trajectory* traj, CollisionBox* boxes, int numBoxes, float gravity) {
-    traj->numPoints = 0;
-    traj->didHit = 0;
+// CPU-кадра тут нет: глюк и затухание рисуем по-старому прямоугольниками,
+// RGB-сдвиг и виньетку пропускаем
+static void SdlBackend_PostFallback(RenderBackend* rb) {
+    float glitch = g_postFx.passes[POSTFX_ROW_SHIFT].intensity;
+    if (glitch >= POSTFX_EPSILON) {
+        Render_SetBlendMode(rb, SDL_BLENDMODE_ADD);
+        for (int i = 0; i < 10; i++) {
+            if (rand() % 100 < glitch * 100) {
+                Uint8 color = rand() % 50;
+                Render_SetColor(rb, color, 0, color * 2, 100);
+                SDL_Rect glitchRect = {rand() % WIDTH, rand() % HEIGHT, rand() % 200 + 50, rand() % 20 + 5};
+                Render_FillRect(rb, &glitchRect);
+            }
+        }
+    }
 
-    Vec3 pos;
-    Vec3 vel;
-    
-    // Начальные условия
-    Vec3 throwDir = {
-        fast_sin(cam->rotY) * fast_cos(cam->rotX),
-        -fast_sin(cam->rotX),
-        fast_cos(cam->rotY) * fast_cos(cam->rotX)
-    };
-    throwDir = normalize(throwDir);
+    float fade = g_postFx.passes[POSTFX_FADE].intensity;
+    if (fade >= POSTFX_EPSILON) {
+        Render_SetBlendMode(rb, SDL_BLENDMODE_BLEND);
+        Render_SetColor(rb, 0, 0, 0, (Uint8)(fade * 255.0f));
+        SDL_Rect fadeRect = {0, 0, WIDTH, HEIGHT};
+        Render_FillRect(rb, &fadeRect);
+    }
+    Render_SetBlendMode(rb, SDL_BLENDMODE_NONE);
+}
 
-    pos.x = cam->x + throwDir.x * 1.5f;
-    pos.y = cam->y + cam->height + throwDir.y;
-    pos.z = cam->z + throwDir.z * 1.5f;
-    
-    vel.x = throwDir.x * power;
-    vel.y = throwDir.y * power;
-    vel.z = throwDir.z * power;
+static void SdlBackend_EndFrame(RenderBackend* rb) {
+    SdlBackend_PostFallback(rb);
+    SdlBackend_Flush(rb);
 
-    for (int i = 0; i < TRAJECTORY_STEPS; i++) {
-        // Простое симулирование физики
-        vel.y -= gravity * TRAJECTORY_TIME_STEP;
-        pos.x += vel.x * TRAJECTORY_TIME_STEP;
-        pos.y += vel.y * TRAJECTORY_TIME_STEP;
-        pos.z += vel.z * TRAJECTORY_TIME_STEP;
-        
-        traj->points[i] = pos;
-        traj->numPoints++;
+    // Кадр живёт на GPU: при записи забираем его обратно прямо в слот кольца
+    Uint64 captureStart = SDL_GetPerformanceCounter();
+    Uint32* slot = Capture_AcquireSlot();
+    if (slot) {
+        SDL_RenderReadPixels(rb->sdl, NULL, SDL_PIXELFORMAT_ARGB8888, slot, WIDTH * sizeof(Uint32));
+        rb->submits++;
+        Capture_CommitSlot(captureStart);
+    }
+    rb->presentWaitMs = Render_PresentTimed(rb->sdl);
+}
 
-        // Проверка столкновений (упрощенная)
-        if (pos.y < -2.0f) { // Столкновение с полом
-             traj->didHit = 1;
-             break;
+RenderBackend* RenderBackend_Create(RenderBackendType type, SDL_Renderer* sdl) {
+    RenderBackend* rb = (RenderBackend*)calloc(1, sizeof(RenderBackend));
+    if (!rb) return NULL;
+    rb->type = type;
+    rb->name = g_renderBackendNames[type];
+    rb->sdl = sdl;
+    rb->color = (SDL_Color){0, 0, 0, 255};
+    rb->blendMode = SDL_BLENDMODE_NONE;
+    rb->clip = (SDL_Rect){ 0, 0, WIDTH, HEIGHT };
+
+    if (type == RENDER_BACKEND_SOFTWARE) {
+        SoftBackend* sb = (SoftBackend*)calloc(1, sizeof(SoftBackend));
+        if (sb) {
+            sb->pixels = (Uint32*)malloc(WIDTH * HEIGHT * sizeof(Uint32));
+            if (sdl) sb->texture = SDL_CreateTexture(sdl, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, WIDTH, HEIGHT);
+            DirtyRects_MarkFull(&sb->shown); // Текстура ещё пустая
         }
-        for(int j=0; j < numBoxes; ++j) {
-            // ... тут можно добавить проверку столкновений с collisionBoxes
+        if (!sb || !sb->pixels || (sdl && !sb->texture)) {
+            printf("Software backend init failed: %s\n", SDL_GetError());
+            if (sb) {
+                if (sb->texture) SDL_DestroyTexture(sb->texture);
+                free(sb->pixels);
+                free(sb);
+            }
+            free(rb);
+            return NULL;
         }
+        rb->impl = sb;
+        rb->BeginFrame = SoftBackend_BeginFrame;
+        rb->Span = SoftBackend_Span;
+        rb->Lines = SoftBackend_Lines;
+        rb->Triangles = SoftBackend_Triangles;
+        rb->Pixels = SoftBackend_Pixels;
+        rb->pixelRows = 1;
+        rb->FillRect = SoftBackend_FillRect;
+        rb->Text = SoftBackend_Text;
+        rb->RowFill = SoftBackend_RowFill;
+        rb->Flush = SoftBackend_Flush;
+        rb->EndFrame = SoftBackend_EndFrame;
+    } else {
+        if (!sdl) {
+            printf("SDL backend needs a window renderer, not available headless\n");
+            free(rb);
+            return NULL;
+        }
+        SdlBatchBackend* bb = (SdlBatchBackend*)calloc(1, sizeof(SdlBatchBackend));
+        if (!bb) {
+            free(rb);
+            return NULL;
+        }
+        bb->lastSpanVert = -1;
+        rb->impl = bb;
+        rb->BeginFrame = SdlBackend_BeginFrame;
+        rb->Span = SdlBackend_Span;
+        rb->Lines = SdlBackend_Lines;
+        rb->Triangles = SdlBackend_Triangles;
+        rb->Pixels = SdlBackend_Pixels;
+        rb->FillRect = SdlBackend_FillRect;
+        rb->Text = SdlBackend_Text;
+        rb->RowFill = SdlBackend_RowFill;
+        rb->Flush = SdlBackend_Flush;
+        rb->EndFrame = SdlBackend_EndFrame;
+    }
+
+    printf("Render backend: %s\n", rb->name);
+    return rb;
+}
+
+void RenderBackend_Destroy(RenderBackend* rb) {
+    if (!rb) return;
+    if (rb->type == RENDER_BACKEND_SOFTWARE) {
+        SoftBackend* sb = (SoftBackend*)rb->impl;
+        if (sb->texture) SDL_DestroyTexture(sb->texture);
+        free(sb->pixels);
+    } else {
+        SdlBatchBackend* bb = (SdlBatchBackend*)rb->impl;
+        if (bb->rowTexture) SDL_DestroyTexture(bb->rowTexture);
     }
+    free(rb->impl);
+    free(rb);
 }
 
-// [НОВЫЙ КОД] Отрисовка траектории
-void drawTrajectory(SDL_Renderer* ren, Camera cam, Trajectory* traj) {
-    if (traj->numPoints < 2) return;
+// "--backend=soft" / "--backend=sdl"; -1 если имя незнакомое
+int RenderBackend_ParseName(const char* name) {
+    for (int i = 0; i < RENDER_BACKEND_COUNT; i++) {
+        if (strcmp(name, g_renderBackendNames[i]) == 0) return i;
+    }
+    return -1;
+}
 
-    SDL_Color color = traj->didHit ? (SDL_Color){255, 100, 100, 255} : (SDL_Color){150, 200, 255, 255};
+void drawText(RenderBackend* renderer, TTF_Font* font, const char* text, int x, int y, SDL_Color color) {
+    if (!font) return; // Headless без arial.ttf: рисуем всё, кроме текста
+    // ИСПРАВЛЕНИЕ: Используем UTF8 для поддержки кириллицы
+    SDL_Surface* surface = TTF_RenderUTF8_Solid(font, text, color); 
     
-    // Рисуем пунктирной линией
-    for (int i = 0; i < traj->numPoints - 1; i += 2) {
-        clipAndDrawLine(ren, traj->points[i], traj->points[i+1], cam, color);
+    if (!surface) {
+        // Если что-то пойдет не так, мы увидим ошибку в консоли
+        printf("Не удалось создать поверхность для текста! Ошибка SDL_ttf: %s\n", TTF_GetError());
+        return;
     }
+    
+    renderer->Text(renderer, surface, x, y);
+    SDL_FreeSurface(surface);
 }
 
-// --- ОТРИСОВКА ---
+SDL_Color lerpColor(SDL_Color a, SDL_Color b, float t);
 
-void drawPickupObject(SDL_Renderer* ren, PickupObject* obj, Camera cam) {
-    if (obj->state == PICKUP_STATE_BROKEN) return;
-    if (obj->state == PICKUP_STATE_HELD) return; // Не рисуем, если в руке
+void Profiler_Init() {
+    g_perfFrequency = SDL_GetPerformanceFrequency();
     
-    // Вершины объекта (простой параллелепипед)
-    Vec3 vertices[8];
-    float sx = obj->size.x / 2;
-    float sy = obj->size.y / 2;
-    float sz = obj->size.z / 2;
+    g_profilerData[PROF_GAME_LOGIC] = (ProfilerData){"game update", 0, 0, 0, 0.0f, 0, {100, 255, 100, 255}};
+    g_profilerData[PROF_PHYSICS_COLLISIONS] = (ProfilerData){"collisions", 0, 0, 0, 0.0f, 0, {220, 200, 100, 255}};
+    g_profilerData[PROF_RENDERING] = (ProfilerData){"projections", 0, 0, 0, 0.0f, 0, {150, 220, 150, 255}};
+    g_profilerData[PROF_OTHER] = (ProfilerData){"other", 0, 0, 0, 0.0f, 0, {200, 200, 200, 255}};
     
-    // Создаём вершины с учётом вращения
-    Vec3 baseVerts[8] = {
-        {-sx, -sy, -sz}, {sx, -sy, -sz}, {sx, sy, -sz}, {-sx, sy, -sz},
-        {-sx, -sy, sz}, {sx, -sy, sz}, {sx, sy, sz}, {-sx, sy, sz}
-    };
-    
-    // Применяем вращение
-    for (int i = 0; i < 8; i++) {
-        Vec3 v = baseVerts[i];
-        
-        // Вращение вокруг Y
-        float cy = fast_cos(obj->rotation.y);
-        float sy = fast_sin(obj->rotation.y);
-        float newX = v.x * cy - v.z * sy;
-        float newZ = v.x * sy + v.z * cy;
-        v.x = newX;
-        v.z = newZ;
-        
-        // Вращение вокруг X
-        float cx = fast_cos(obj->rotation.x);
-        float sx = fast_sin(obj->rotation.x);
-        float newY = v.y * cx - v.z * sx;
-        newZ = v.y * sx + v.z * cx;
-        v.y = newY;
-        v.z = newZ;
-        
-        // Добавляем позицию объекта
-        vertices[i].x = obj->pos.x + v.x;
-        vertices[i].y = obj->pos.y + v.y;
-        vertices[i].z = obj->pos.z + v.z;
-    }
-    
-    // Рёбра для отрисовки
-    int edges[12][2] = {
-        {0,1},{1,2},{2,3},{3,0},
-        {4,5},{5,6},{6,7},{7,4},
-        {0,4},{1,5},{2,6},{3,7}
-    };
-    
-    // Рисуем бутылку
-    for (int i = 0; i < 12; i++) {
-        clipAndDrawLine(ren, vertices[edges[i][0]], vertices[edges[i][1]], cam, obj->color);
-    }
+    g_profilerUpdateTime = SDL_GetTicks();
+}
+
+void Profiler_Start(ProfilerCategory category) {
+    if (!g_showProfiler) return;
+    g_profilerData[category].startTime = SDL_GetPerformanceCounter();
+}
+
+void Profiler_End(ProfilerCategory category) {
+    if (!g_showProfiler) return;
+    g_profilerData[category].elapsedTicks += SDL_GetPerformanceCounter() - g_profilerData[category].startTime;
+    g_profilerData[category].calls++;
+}
+
+void Profiler_Update() {
+    if (!g_showProfiler) return;
     
-    // Если это бутылка, добавляем горлышко
-    if (obj->type == PICKUP_TYPE_BOTTLE) {
-        Vec3 neckBottom = {obj->pos.x, obj->pos.y + sy, obj->pos.z};
-        Vec3 neckTop = {obj->pos.x, obj->pos.y + sy + 0.1f, obj->pos.z};
+    Uint32 currentTime = SDL_GetTicks();
+    if (currentTime - g_profilerUpdateTime >= 1000) {
         
-        // Горлышко (простые линии)
-        float neckRadius = sx * 0.5f;
-        for (int i = 0; i < 4; i++) {
-            float angle = (float)i / 4 * 2 * M_PI;
-            Vec3 p1 = {
-                neckBottom.x + fast_cos(angle) * neckRadius,
-                neckBottom.y,
-                neckBottom.z + fast_sin(angle) * neckRadius
-            };
-            Vec3 p2 = {
-                neckTop.x + fast_cos(angle) * neckRadius * 0.7f,
-                neckTop.y,
-                neckTop.z + fast_sin(angle) * neckRadius * 0.7f
-            };
-            clipAndDrawLine(ren, p1, p2, cam, obj->color);
+        Uint64 totalTicks = 0;
+        for (int i = 0; i < PROF_CATEGORY_COUNT; i++) {
+            totalTicks += g_profilerData[i].elapsedTicks;
+        }
+
+        if (totalTicks > 0) {
+            for (int i = 0; i < PROF_CATEGORY_COUNT; i++) {
+                g_profilerData[i].percentage = ((double)g_profilerData[i].elapsedTicks / totalTicks) * 100.0;
+                g_profilerData[i].callsPerSecond = g_profilerData[i].calls;
+                
+                g_profilerData[i].elapsedTicks = 0;
+                g_profilerData[i].calls = 0;
+            }
         }
+        g_profilerUpdateTime = currentTime;
     }
 }
 
-void drawGlassShards(SDL_Renderer* ren, Camera cam) {
-    for (int i = 0; i < g_numShards; i++) {
-        GlassShard* shard = &g_shards[i];
-        if (shard->lifetime <= 0) continue;
+void RenderGraph_DrawStats(RenderBackend* ren, TTF_Font* font, int x, int y);
+
+void Profiler_Draw(RenderBackend* ren, TTF_Font* font) {
+    if (!g_showProfiler) return;
+
+    int x = 20, y = 20, w = 400, h = 25;
+    
+    for (int i = 0; i < PROF_CATEGORY_COUNT; i++) {
+        ProfilerData* data = &g_profilerData[i];
         
-        // Простой треугольник для осколка
-        Vec3 p1 = {
-            shard->pos.x + fast_cos(shard->rotation.x) * shard->size,
-            shard->pos.y,
-            shard->pos.z + fast_sin(shard->rotation.x) * shard->size
-        };
-        Vec3 p2 = {
-            shard->pos.x + fast_cos(shard->rotation.y) * shard->size,
-            shard->pos.y + shard->size,
-            shard->pos.z + fast_sin(shard->rotation.y) * shard->size
-        };
-        Vec3 p3 = {
-            shard->pos.x,
-            shard->pos.y + shard->size * 0.5f,
-            shard->pos.z
-        };
+        Render_SetBlendMode(ren, SDL_BLENDMODE_BLEND);
+        Render_SetColor(ren, data->color.r, data->color.g, data->color.b, 80);
+        SDL_Rect bgRect = {x, y + i * h, w, h - 5};
+        Render_FillRect(ren, &bgRect);
         
-        clipAndDrawLine(ren, p1, p2, cam, shard->color);
-        clipAndDrawLine(ren, p2, p3, cam, shard->color);
-        clipAndDrawLine(ren, p3, p1, cam, shard->color);
-    }
-}
-// Вспомогательная функция для вращения точки вокруг центра
-Vec3 rotatePoint(Vec3 point, Vec3 center, float angleX, float angleY, float angleZ) {
-    Vec3 result = point;
-    
-    result.x -= center.x;
-    result.y -= center.y;
-    result.z -= center.z;
-    
-    if (fabsf(angleY) > 0.001f) {
-        float cy = fast_cos(angleY); float sy = fast_sin(angleY);
-        float newX = result.x * cy - result.z * sy;
-        float newZ = result.x * sy + result.z * cy;
-        result.x = newX; result.z = newZ;
+        int barWidth = (int)(w * (data->percentage / 100.0f));
+        Render_SetColor(ren, data->color.r, data->color.g, data->color.b, 255);
+        SDL_Rect barRect = {x, y + i * h, barWidth, h - 5};
+        Render_FillRect(ren, &barRect);
+        
+        char buffer[128];
+        snprintf(buffer, 128, "%s: %u /s  (%.0f%%)", data->name, data->callsPerSecond, data->percentage);
+        SDL_Color white = {255, 255, 255, 255};
+        drawText(ren, font, buffer, x + 5, y + i * h + 2, white);
     }
-    if (fabsf(angleX) > 0.001f) {
-        float cx = fast_cos(angleX); float sx = fast_sin(angleX);
-        float newY = result.y * cx - result.z * sx;
-        float newZ = result.y * sx + result.z * cx;
-        result.y = newY; result.z = newZ;
+
+    // Статистика растеризатора за последний кадр
+    char rasterLine[224];
+    snprintf(rasterLine, sizeof(rasterLine), "depth pre-pass [F7]: %s%s | shaded: %u px (textured %u) | z-only: %u px | rejected: %u px | polygons: %u (%.1f edges)",
+             g_depthPrepassEnabled ? "ON" : "OFF",
+             (g_depthPrepassEnabled && !g_depthPrepassActive) ? " (idle)" : "",
+             g_rasterStats.pixelsShaded, g_rasterStats.pixelsTextured, g_rasterStats.pixelsDepthOnly, g_rasterStats.pixelsRejected,
+             g_rasterStats.polygonsFilled, g_rasterStats.polygonsFilled ? (float)g_rasterStats.polygonEdges / g_rasterStats.polygonsFilled : 0.0f);
+    drawText(ren, font, rasterLine, x + 5, y + PROF_CATEGORY_COUNT * h + 2, (SDL_Color){255, 255, 255, 255});
+
+    char backendLine[160];
+    snprintf(backendLine, sizeof(backendLine), "backend: %s | SDL calls so far: %u | visibility: %s (%u spans, %u dropped)",
+             ren->name, ren->submits, g_sbuffer.active ? "s-buffer" : "z-buffer", g_sbuffer.spansInserted, g_sbuffer.spansDropped);
+    drawText(ren, font, backendLine, x + 5, y + PROF_CATEGORY_COUNT * h + 22, (SDL_Color){255, 255, 255, 255});
+
+    // Пост-обработка: цена каждого прохода или почему он не работал
+    char postLine[192];
+    int len = snprintf(postLine, sizeof(postLine), "post:");
+    for (int i = 0; i < POSTFX_COUNT && len < (int)sizeof(postLine); i++) {
+        PostFxPass* pass = &g_postFx.passes[i];
+        if (pass->suspendedFrames > 0) {
+            len += snprintf(postLine + len, sizeof(postLine) - len, " %s OVER BUDGET |", pass->name);
+        } else if (pass->ranThisFrame) {
+            len += snprintf(postLine + len, sizeof(postLine) - len, " %s %.2fms |", pass->name, pass->costMs);
+        } else {
+            len += snprintf(postLine + len, sizeof(postLine) - len, " %s - |", pass->name);
+        }
     }
-    if (fabsf(angleZ) > 0.001f) {
-        float cz = fast_cos(angleZ); float sz = fast_sin(angleZ);
-        float newX = result.x * cz - result.y * sz;
-        float newY = result.x * sz + result.y * cz;
-        result.x = newX; result.y = newY;
+    drawText(ren, font, postLine, x + 5, y + PROF_CATEGORY_COUNT * h + 42, (SDL_Color){255, 255, 255, 255});
+
+    char fogLine[96];
+    snprintf(fogLine, sizeof(fogLine), "fog [F8]: %s | density %.3f | far plane %.1f",
+             g_fogModeNames[g_fog.mode], g_fog.density, g_fog.farPlane);
+    drawText(ren, font, fogLine, x + 5, y + PROF_CATEGORY_COUNT * h + 62, (SDL_Color){255, 255, 255, 255});
+
+    char instanceLine[128];
+    snprintf(instanceLine, sizeof(instanceLine), "instances: %u drawn | %u culled | box edges: %u drawn (%u silhouette) | %u culled",
+             g_rasterStats.instancesDrawn, g_rasterStats.instancesCulled,
+             g_rasterStats.edgesDrawn, g_rasterStats.edgesSilhouette, g_rasterStats.edgesCulled);
+    drawText(ren, font, instanceLine, x + 5, y + PROF_CATEGORY_COUNT * h + 82, (SDL_Color){255, 255, 255, 255});
+
+    char lodLine[128];
+    snprintf(lodLine, sizeof(lodLine), "LOD [F9]: %s | %s %u | %s %u | %s %u | thresholds %.1f / %.1f px",
+             g_lod.enabled ? "ON" : "OFF",
+             g_lodLevelNames[LOD_POINT], g_lod.counts[LOD_POINT],
+             g_lodLevelNames[LOD_LOW], g_lod.counts[LOD_LOW],
+             g_lodLevelNames[LOD_FULL], g_lod.counts[LOD_FULL],
+             g_lod.thresholds[0], g_lod.thresholds[1]);
+    drawText(ren, font, lodLine, x + 5, y + PROF_CATEGORY_COUNT * h + 102, (SDL_Color){255, 255, 255, 255});
+
+    char captureLine[160];
+    if (g_capture.active) {
+        snprintf(captureLine, sizeof(captureLine), "capture [F10]: REC %s | %d written, %u dropped | copy %.2f ms/frame | encode %.1f ms | queue %d/%d%s",
+                 g_capture.path, SDL_AtomicGet(&g_capture.framesWritten), g_capture.framesDropped,
+                 g_capture.copyMs, g_capture.encodeMs, SDL_AtomicGet(&g_capture.queued), CAPTURE_RING_SIZE,
+                 SDL_AtomicGet(&g_capture.writeFailed) ? " | WRITE ERROR" : "");
+    } else {
+        snprintf(captureLine, sizeof(captureLine), "capture [F10]: off");
+    }
+    drawText(ren, font, captureLine, x + 5, y + PROF_CATEGORY_COUNT * h + 122, (SDL_Color){255, 255, 255, 255});
+
+    char shadowLine[128];
+    snprintf(shadowLine, sizeof(shadowLine), "shadows [F11]: %s | %d casters | %u px | alpha %u | %.2f ms",
+             g_shadows.enabled ? "ON" : "OFF", g_shadows.casters, g_shadows.pixels, g_shadows.alpha, g_shadows.costMs);
+    drawText(ren, font, shadowLine, x + 5, y + PROF_CATEGORY_COUNT * h + 142, (SDL_Color){255, 255, 255, 255});
+
+    char lightLine[128];
+    snprintf(lightLine, sizeof(lightLine), "lighting [F12]: %s | %s (%.2f, %.2f, %.2f) | %u vertices lit",
+             g_light.enabled ? "ON" : "OFF", g_light.fromMoon ? "moon" : "sun",
+             g_light.dir.x, g_light.dir.y, g_light.dir.z, g_light.verticesLit);
+    drawText(ren, font, lightLine, x + 5, y + PROF_CATEGORY_COUNT * h + 162, (SDL_Color){255, 255, 255, 255});
+
+    char pickLine[128];
+    snprintf(pickLine, sizeof(pickLine), "pick [F5]: %s | under crosshair 0x%04x | %u id px | %d tiny | %d ray tests",
+             g_pick.enabled ? "ID buffer" : "ray loop", g_pick.lastId, g_pick.pixels, g_pick.numTiny, g_pick.rayTests);
+    drawText(ren, font, pickLine, x + 5, y + PROF_CATEGORY_COUNT * h + 182, (SDL_Color){255, 255, 255, 255});
+
+    char visLine[192];
+    snprintf(visLine, sizeof(visLine), "vis cache [F2]: %s | %u queries | %u retested | moved %.1f, turned %.2f rad | occlusion %u tests, %u px, %u hidden",
+             g_vis.enabled ? "ON" : "OFF", g_vis.queries, g_vis.tests, g_vis.travel, g_vis.turn,
+             g_vis.occlusionTests, g_vis.occlusionPixels, g_vis.occluded);
+    drawText(ren, font, visLine, x + 5, y + PROF_CATEGORY_COUNT * h + 202, (SDL_Color){255, 255, 255, 255});
+
+    char splitLine[160];
+    int splitLen = snprintf(splitLine, sizeof(splitLine), "split screen: %d view(s)", g_split.numViews);
+    if (g_split.numViews > 1) {
+        splitLen += snprintf(splitLine + splitLen, sizeof(splitLine) - splitLen, " | %.2f ms all | per view:", g_split.frameMs);
+        for (int i = 0; i < g_split.numViews && splitLen < (int)sizeof(splitLine); i++) {
+            splitLen += snprintf(splitLine + splitLen, sizeof(splitLine) - splitLen, " %.2f", g_split.views[i].ms);
+        }
     }
-    
-    result.x += center.x;
-    result.y += center.y;
-    result.z += center.z;
-    
-    return result;
-}
-
-// Структура для пальца
-typedef struct {
-    Vec3 base;      // Основание пальца
-    Vec3 middle;    // Средний сустав
-    Vec3 tip;       // Кончик
-    float bendAngle; // Угол сгиба
-} Finger;
-
-void draw3DFinger(SDL_Renderer* ren, Finger* finger, Camera cam, SDL_Color color, float thickness) {
-    // Сегмент 1: База -> Средний сустав
-    Vec3 seg1[8];
-    float t = thickness;
-    
-    // Создаём 8 точек для первого сегмента (параллелепипед)
-    seg1[0] = (Vec3){finger->base.x - t, finger->base.y - t, finger->base.z - t};
-    seg1[1] = (Vec3){finger->base.x + t, finger->base.y - t, finger->base.z - t};
-    seg1[2] = (Vec3){finger->base.x + t, finger->base.y - t, finger->base.z + t};
-    seg1[3] = (Vec3){finger->base.x - t, finger->base.y - t, finger->base.z + t};
-    
-    seg1[4] = (Vec3){finger->middle.x - t*0.8f, finger->middle.y - t*0.8f, finger->middle.z - t*0.8f};
-    seg1[5] = (Vec3){finger->middle.x + t*0.8f, finger->middle.y - t*0.8f, finger->middle.z - t*0.8f};
-    seg1[6] = (Vec3){finger->middle.x + t*0.8f, finger->middle.y - t*0.8f, finger->middle.z + t*0.8f};
-    seg1[7] = (Vec3){finger->middle.x - t*0.8f, finger->middle.y - t*0.8f, finger->middle.z + t*0.8f};
-    
-    // Рисуем первый сегмент
-    int edges[12][2] = {
-        {0,1},{1,2},{2,3},{3,0}, // Низ
-        {4,5},{5,6},{6,7},{7,4}, // Верх
-        {0,4},{1,5},{2,6},{3,7}  // Вертикальные
-    };
-    
-    for (int i = 0; i < 12; i++) {
-        clipAndDrawLine(ren, seg1[edges[i][0]], seg1[edges[i][1]], cam, color);
+    drawText(ren, font, splitLine, x + 5, y + PROF_CATEGORY_COUNT * h + 222, (SDL_Color){255, 255, 255, 255});
+
+    char rayLine[192];
+    int rays = SDL_AtomicGet(&g_rayRender.rays);
+    snprintf(rayLine, sizeof(rayLine), "raycast [F4]: %s | BVH %d boxes, %d nodes, depth %d, built %u times | %d rays, %.1f nodes/ray, %.1f boxes/ray | %.2f ms",
+             g_rayRenderModeNames[g_rayRender.mode], g_rayRender.numBoxes, g_rayRender.numNodes, g_rayRender.depth, g_rayRender.rebuilds, rays,
+             rays ? (float)SDL_AtomicGet(&g_rayRender.nodeTests) / rays : 0.0f, rays ? (float)SDL_AtomicGet(&g_rayRender.boxTests) / rays : 0.0f,
+             SDL_AtomicGet(&g_rayRender.micros) / 1000.0f);
+    drawText(ren, font, rayLine, x + 5, y + PROF_CATEGORY_COUNT * h + 242, (SDL_Color){255, 255, 255, 255});
+
+    char lampLine[192];
+    int litTiles = SDL_AtomicGet(&g_deferred.litTiles);
+    snprintf(lampLine, sizeof(lampLine), "lamps [Shift+F12]: %s | %d lamps, %d in view | %d lit tiles, %.1f lamps/tile, %d dropped | %d px | %.2f ms",
+             g_deferred.enabled ? "ON" : "OFF", g_deferred.count, SDL_AtomicGet(&g_deferred.lightsInView), litTiles,
+             litTiles ? (float)SDL_AtomicGet(&g_deferred.tileLights) / litTiles : 0.0f, SDL_AtomicGet(&g_deferred.dropped),
+             SDL_AtomicGet(&g_deferred.pixelsLit), SDL_AtomicGet(&g_deferred.micros) / 1000.0f);
+    drawText(ren, font, lampLine, x + 5, y + PROF_CATEGORY_COUNT * h + 262, (SDL_Color){255, 255, 255, 255});
+
+    char presentLine[192];
+    int len2;
+    if (g_present.active) {
+        len2 = snprintf(presentLine, sizeof(presentLine), "present: game thread + main, %d frames in flight | wait %.2f ms | upload+present %.2f ms | latency %.2f ms",
+                        g_present.maxInFlight, g_present.waitMs, g_present.presentMs, g_present.latencyMs);
+    } else {
+        len2 = snprintf(presentLine, sizeof(presentLine), "present: main thread (%s)", ren->name);
     }
-    
-    // Сегмент 2: Средний сустав -> Кончик
-    Vec3 seg2[8];
-    t *= 0.8f; // Сужаем к кончику
-    
-    seg2[0] = (Vec3){finger->middle.x - t, finger->middle.y - t, finger->middle.z - t};
-    seg2[1] = (Vec3){finger->middle.x + t, finger->middle.y - t, finger->middle.z - t};
-    seg2[2] = (Vec3){finger->middle.x + t, finger->middle.y - t, finger->middle.z + t};
-    seg2[3] = (Vec3){finger->middle.x - t, finger->middle.y - t, finger->middle.z + t};
-    
-    seg2[4] = (Vec3){finger->tip.x - t*0.5f, finger->tip.y - t*0.5f, finger->tip.z - t*0.5f};
-    seg2[5] = (Vec3){finger->tip.x + t*0.5f, finger->tip.y - t*0.5f, finger->tip.z - t*0.5f};
-    seg2[6] = (Vec3){finger->tip.x + t*0.5f, finger->tip.y - t*0.5f, finger->tip.z + t*0.5f};
-    seg2[7] = (Vec3){finger->tip.x - t*0.5f, finger->tip.y - t*0.5f, finger->tip.z + t*0.5f};
-    
-    for (int i = 0; i < 12; i++) {
-        clipAndDrawLine(ren, seg2[edges[i][0]], seg2[edges[i][1]], cam, color);
+    if (ren->type == RENDER_BACKEND_SOFTWARE && len2 < (int)sizeof(presentLine)) {
+        const SoftBackend* sb = (const SoftBackend*)ren->impl;
+        snprintf(presentLine + len2, sizeof(presentLine) - len2, " | dirty: cleared %.0f%%, uploaded %.0f%%",
+                 100.0f * sb->clearedPixels / (WIDTH * HEIGHT), 100.0f * sb->uploadedPixels / (WIDTH * HEIGHT));
     }
-}
-static Vec3 transform_hand_vertex(Vec3 localPoint, const Vec3* handPos, const Vec3* handRot, const Camera* cam) {
-    // a) Применяем собственное вращение руки (поворот внутрь)
-    Vec3 v = rotatePoint(localPoint, (Vec3){0,0,0}, handRot->x, handRot->y, handRot->z);
-
-    // b) Смещаем руку в ее позицию относительно камеры (вниз и вбок)
-    v.x += handPos->x;
-    v.y += handPos->y;
-    v.z += handPos->z;
-
-    // c) Вращаем точку вместе с камерой
-    float sinY = fast_sin(cam->rotY); float cosY = fast_cos(cam->rotY);
-    float sinX = fast_sin(cam->rotX); float cosX = fast_cos(cam->rotX);
+    drawText(ren, font, presentLine, x + 5, y + PROF_CATEGORY_COUNT * h + 282, (SDL_Color){255, 255, 255, 255});
 
-    // Вращение по Y (поворот влево-вправо)
-    float rotatedX = v.x * cosY - v.z * sinY;
-    float rotatedZ = v.x * sinY + v.z * cosY;
-    
-    // Вращение по X (взгляд вверх-вниз)
-    float finalY = v.y * cosX - rotatedZ * sinX;
-    float finalZ = v.y * sinX + rotatedZ * cosX;
+    char qualityLine[160];
+    const QualityTier* qt = Quality_Current();
+    snprintf(qualityLine, sizeof(qualityLine), "quality [Shift+F9]: %s, %s | %.2f ms/frame (target %.1f) | hatch x%.1f, floor %.0f, shards %d, postfx %s | %u changes",
+             qt->name, g_qualityAutoNames[g_quality.autoAdjust], g_quality.frameMs, QUALITY_TARGET_MS, qt->hatchScale, qt->floorRange,
+             qt->maxShards, qt->postFx ? "on" : "off", g_quality.changes);
+    drawText(ren, font, qualityLine, x + 5, y + PROF_CATEGORY_COUNT * h + 302, (SDL_Color){255, 255, 255, 255});
 
-    // d) Прибавляем к мировой позиции камеры
-    return (Vec3){
-        cam->x + rotatedX,
-        (cam->y + cam->height + cam->currentBobY) + finalY,
-        cam->z + finalZ
-    };
+    RenderGraph_DrawStats(ren, font, x + 5, y + PROF_CATEGORY_COUNT * h + 322);
 }
 
-void drawVolumetricSegment(SDL_Renderer* ren, Vec3 p1, Vec3 p2, float thickness, Camera cam, SDL_Color color) {
-    Vec3 dir = normalize((Vec3){p2.x - p1.x, p2.y - p1.y, p2.z - p1.z});
-    // Находим перпендикулярные векторы, чтобы "построить" объем
-    Vec3 up = {0, 1, 0};
-    Vec3 right = normalize(cross(dir, up));
-    up = normalize(cross(right, dir));
+// ИСПРАВЛЯЕМ: Инициализируем коллизии ДО квестов
+    CollisionBox collisionBoxes[] = {
+        { {0, 0, 0}, {-2.1, -2.1, -2.1, 2.1, 2.1, 2.1}, {255, 255, 255, 255} },
+        { {8, -1, 5}, {-1.5, -1, -1.5, 1.5, 3, 1.5}, {100, 255, 100, 255} },  // Зелёная платформа
+        { {-6, -1.5, 3}, {-2, -0.5, -2, 2, 0.5, 2}, {100, 100, 255, 255} },
+        { {5, -1, -8}, {-3, -1, -1, 3, 1, 1}, {255, 100, 100, 255} },
+        { {-10, 0, -5}, {-1, -2, -1, 1, 2, 1}, {255, 255, 100, 255} },
+    };
+    int numCollisionBoxes = sizeof(collisionBoxes) / sizeof(collisionBoxes[0]);
 
-    right.x *= thickness; right.y *= thickness; right.z *= thickness;
-    up.x *= thickness; up.y *= thickness; up.z *= thickness;
+    // --- ПРОТОТИПЫ НОВЫХ ФУНКЦИЙ ---
+void calculateTrajectory(Camera* cam, float power, Trajectory* traj, CollisionBox* boxes, int numBoxes, float gravity);
+int intersectRayAABB(Vec3 rayOrigin, Vec3 rayDir, Vec3 boxMin, Vec3 boxMax, float* t);
+int isBoxInFrustum_Improved(CollisionBox* box, Camera cam);
+int isBoxInFrustum_Cached(CollisionBox* box, Camera cam);
+float Pick_ScreenRadius(Vec3 center, float radius, Camera cam);
+void Pick_WriteBox(RenderBackend* ren, const Vec3 v[8], Uint16 id, Camera cam);
 
-    // 8 вершин призмы
+Vec3 cross(Vec3 a, Vec3 b) {
+    Vec3 r = { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+    return r;
+}
+Vec3 normalize(Vec3 v) {
+    float len = sqrtf(v.x*v.x + v.y*v.y + v.z*v.z);
+    if (len < 1e-6f) { Vec3 zero = {0, 0, 0}; return zero; }
+    Vec3 r = {v.x/len, v.y/len, v.z/len};
+    return r;
+}
+float dot(Vec3 a, Vec3 b) {
+    return a.x*b.x + a.y*b.y + a.z*b.z;
+}
+float lerp(float a, float b, float t) {
+    if (t > 1.0f) t = 1.0f;
+    if (t < 0.0f) t = 0.0f;
+    return a + (b - a) * t;
+}
+
+typedef struct {
+    int x, y;
+    float z;
+} ProjectedPoint;
+
+ProjectedPoint project_with_depth(Vec3 p, Camera cam) {
+    float cameraEyeY = cam.y + cam.height + cam.currentBobY;
+    float dx = p.x - cam.x;
+    float dy = p.y - cameraEyeY;
+    float dz = p.z - cam.z;
+
+    float adjustedRotY = cam.rotY + cam.currentBobX * 0.02f;
+    float sy = fast_sin(adjustedRotY), cy = fast_cos(adjustedRotY);
+    float x_cam = cy * dx - sy * dz;
+    float z_cam = sy * dx + cy * dz;
+
+    float sx = fast_sin(cam.rotX), cx = fast_cos(cam.rotX);
+    float y_cam = cx * dy - sx * z_cam;
+    z_cam = sx * dy + cx * z_cam;
+
+    float fov = g_fov;
+    ProjectedPoint result;
+    result.z = z_cam;
+
+    if (z_cam <= 0.1f) {
+        result.x = -9999;
+        result.y = -9999;
+    } else {
+        result.x = (int)(g_view.cx + x_cam * fov / z_cam);
+        result.y = (int)(g_view.cy - y_cam * fov / z_cam);
+    }
+    
+    return result;
+}
+
+// Закрыт ли пиксель (x, y) с глубиной z какой-нибудь гранью из s-буфера
+static int SBuffer_IsHidden(int x, int y, float z) {
+    float zInv = 1.0f / z;
+    const SBufferSpan* span = g_sbuffer.spans[y];
+    for (int i = 0; i < g_sbuffer.count[y]; i++, span++) {
+        if (x >= span->x0 && x < span->x1 && zInv < (span->zInvA + span->zInvB * x) * SBUFFER_DEPTH_TOLERANCE) return 1;
+    }
+    return 0;
+}
+
+void drawPixelWithZCheck_Fast(RenderBackend* ren, int x, int y, float z) {
+    // Проверка границ и глубины
+    if (x >= g_view.x0 && x < g_view.x1 && y >= g_view.y0 && y < g_view.y1) {
+        if (g_sbuffer.active) {
+            if (SBuffer_IsHidden(x, y, z)) {
+                g_rasterStats.pixelsRejected++;
+            } else {
+                Render_Point(ren, x, y);
+                g_rasterStats.pixelsShaded++;
+            }
+        } else if (z < g_zBuffer[y][x]) {
+            // Просто рисуем точку. Цвет уже должен быть установлен снаружи.
+            Render_Point(ren, x, y);
+            // Обновляем Z-буфер
+            g_zBuffer[y][x] = z;
+            g_rasterStats.pixelsShaded++;
+        } else {
+            g_rasterStats.pixelsRejected++;
+        }
+    }
+}
+
+// Глубина i-го пикселя пролёта. Все ядра считают её ОДНОЙ и той же формулой,
+// иначе пре-пасс и цветовой проход разойдутся в последних битах float.
+static inline float spanDepthAt(float zInv0, float zInvStep, int i) {
+    return 1.0f / (zInv0 + (float)i * zInvStep);
+}
+
+// Отдаёт в бэкенд готовый пролёт, подкрашенный туманом своего уровня
+static inline void emitFoggedSpan(RenderBackend* ren, int y, int x0, int x1, SDL_Color base, int level) {
+    ren->color = Fog_Apply(base, level);
+    ren->Span(ren, y, x0, x1);
+}
+
+// Тень в тумане слабеет вместе с полом под ней
+static inline void emitShadowSpan(RenderBackend* ren, int y, int x0, int x1, int level) {
+    ren->color = (SDL_Color){0, 0, 0, (Uint8)(g_shadows.alpha * (FOG_LEVELS - 1 - level) / (FOG_LEVELS - 1))};
+    ren->Span(ren, y, x0, x1);
+}
+
+// Закрашенный пролёт - в G-буфер: нормаль текущих граней и базовый цвет (до света и тумана).
+// Без нормали (GBUF_NORMAL_NONE) цвет не нужен: такой пиксель лампы пропустят
+static inline void GBuffer_WriteRun(int y, int x0, int x1, SDL_Color base) {
+    memset(&g_gbufferNormal[y][x0], g_gbuffer.normal, (size_t)(x1 - x0));
+    if (g_gbuffer.normal == GBUF_NORMAL_NONE) return;
+    Uint32 c = packARGB(base);
+    Uint32* row = g_gbufferAlbedo[y];
+    for (int x = x0; x < x1; x++) row[x] = c;
+}
+
+// Пролёт со своей ступенью света и уровнем тумана, упакованными в один ключ
+static inline void emitShadedSpan(RenderBackend* ren, int y, int x0, int x1, SDL_Color base, int key) {
+    if (g_gbuffer.writing) GBuffer_WriteRun(y, x0, x1, base);
+    int light = key / FOG_LEVELS - 1;
+    emitFoggedSpan(ren, y, x0, x1, light >= 0 ? Light_Apply(base, light) : base, key % FOG_LEVELS);
+}
+
+// Ядро растеризации горизонтального пролёта [x0, x1) на строке y.
+// Что делать с пикселем, решает текущий проход g_rasterPass.
+// При включённом тумане пиксели дальше farPlane отбрасываются, а непрерывный пролёт
+// дополнительно рвётся там, где меняется уровень тумана или ступень света (light0 >= 0).
+void rasterSpanLit(RenderBackend* ren, int y, int x0, int x1, float zInv0, float zInvStep, float light0, float lightStep) {
+    if (y < g_view.y0 || y >= g_view.y1) return;
+    int start = x0 < g_view.x0 ? g_view.x0 : x0;
+    int end = x1 > g_view.x1 ? g_view.x1 : x1;
+    if (start >= end) return;
+
+    float* zRow = g_zBuffer[y];
+    int runStart = -1; // Прошедшие тест пиксели уходят в бэкенд непрерывными пролётами, а не по одному
+    int runLevel = 0;
+    float farZ = g_fog.active ? g_fog.farPlane : FLT_MAX;
+    int shadeFog = g_fog.active && g_fog.mode != FOG_OFF;
+    int lit = light0 >= 0.0f;
+    SDL_Color baseColor = ren->color;
+
+    switch (g_rasterPass) {
+        case RASTER_PASS_SBUFFER:
+            // Целый пролёт одной записью: ни глубины, ни цвета по пикселям
+            if (g_sbuffer.count[y] < SBUFFER_MAX_SPANS) {
+                SBufferSpan* span = &g_sbuffer.spans[y][g_sbuffer.count[y]++];
+                span->x0 = (short)start;
+                span->x1 = (short)end;
+                span->zInvA = zInv0 - (float)x0 * zInvStep;
+                span->zInvB = zInvStep;
+                g_sbuffer.spansInserted++;
+            } else {
+                g_sbuffer.spansDropped++;
+            }
+            break;
+
+        case RASTER_PASS_SHADOW: {
+            // Затемняем только то, что уже нарисовано на глубине тени (пол), и каждый пиксель один раз
+            Uint8* maskRow = g_shadowMask[y];
+            Uint8 stamp = g_shadows.frame;
+            for (int x = start; x < end; x++) {
+                float z = spanDepthAt(zInv0, zInvStep, x - x0);
+                if (maskRow[x] != stamp && z <= zRow[x] * SHADOW_DEPTH_TOLERANCE && z < farZ) {
+                    int level = shadeFog ? Fog_Level(z) : 0;
+                    if (runStart >= 0 && level != runLevel) { emitShadowSpan(ren, y, runStart, x, runLevel); runStart = -1; }
+                    if (runStart < 0) { runStart = x; runLevel = level; }
+                    maskRow[x] = stamp;
+                    g_shadows.pixels++;
+                } else if (runStart >= 0) {
+                    emitShadowSpan(ren, y, runStart, x, runLevel);
+                    runStart = -1;
+                }
+            }
+            if (runStart >= 0) emitShadowSpan(ren, y, runStart, end, runLevel);
+            runStart = -1;
+            break;
+        }
+
+        case RASTER_PASS_OBJECT_ID: {
+            // Сцена уже нарисована: объект под чем-то непрозрачным ID не получает.
+            // В кадре из линий z-буфер не чистится, там закрывает s-буфер.
+            Uint32* idRow = g_pickIds[y];
+            float* pickZRow = g_pickDepth[y];
+            Uint32 entry = ((Uint32)g_pick.frame << 16) | g_pick.currentId;
+            for (int x = start; x < end; x++) {
+                float z = spanDepthAt(zInv0, zInvStep, x - x0);
+                if (z >= farZ) continue;
+                if (g_sbuffer.active ? SBuffer_IsHidden(x, y, z) : z > zRow[x] * PICK_DEPTH_TOLERANCE) continue;
+                if ((idRow[x] >> 16) == g_pick.frame && z >= pickZRow[x]) continue;
+                idRow[x] = entry;
+                pickZRow[x] = z;
+                g_pick.pixels++;
+            }
+            break;
+        }
+
+        case RASTER_PASS_DEPTH_ONLY:
+            // Депт-онли ядро: никаких обращений к рендереру
+            for (int x = start; x < end; x++) {
+                float z = spanDepthAt(zInv0, zInvStep, x - x0);
+                if (z < zRow[x] && z < farZ) {
+                    zRow[x] = z;
+                    g_rasterStats.pixelsDepthOnly++;
+                }
+            }
+            break;
+
+        case RASTER_PASS_COLOR_EQUAL:
+            // Глубина уже лежит в буфере: красим только "победителей"
+            for (int x = start; x < end; x++) {
+                float z = spanDepthAt(zInv0, zInvStep, x - x0);
+                if (z <= zRow[x] * DEPTH_EQUAL_TOLERANCE && z < farZ) {
+                    int level = shadeFog ? Fog_Level(z) : 0;
+                    if (lit) level += (lightLevelAt(light0, lightStep, x - x0) + 1) * FOG_LEVELS;
+                    if (runStart >= 0 && level != runLevel) { emitShadedSpan(ren, y, runStart, x, baseColor, runLevel); runStart = -1; }
+                    if (runStart < 0) { runStart = x; runLevel = level; }
+                    g_rasterStats.pixelsShaded++;
+                } else {
+                    if (runStart >= 0) { emitShadedSpan(ren, y, runStart, x, baseColor, runLevel); runStart = -1; }
+                    g_rasterStats.pixelsRejected++;
+                }
+            }
+            break;
+
+        case RASTER_PASS_NORMAL:
+        default:
+            for (int x = start; x < end; x++) {
+                float z = spanDepthAt(zInv0, zInvStep, x - x0);
+                if (z < zRow[x] && z < farZ) {
+                    int level = shadeFog ? Fog_Level(z) : 0;
+                    if (lit) level += (lightLevelAt(light0, lightStep, x - x0) + 1) * FOG_LEVELS;
+                    if (runStart >= 0 && level != runLevel) { emitShadedSpan(ren, y, runStart, x, baseColor, runLevel); runStart = -1; }
+                    if (runStart < 0) { runStart = x; runLevel = level; }
+                    zRow[x] = z;
+                    g_rasterStats.pixelsShaded++;
+                } else {
+                    if (runStart >= 0) { emitShadedSpan(ren, y, runStart, x, baseColor, runLevel); runStart = -1; }
+                    g_rasterStats.pixelsRejected++;
+                }
+            }
+            break;
+    }
+
+    // Хвост последнего непрерывного пролёта
+    if (runStart >= 0) emitShadedSpan(ren, y, runStart, end, baseColor, runLevel);
+    ren->color = baseColor;
+}
+
+void rasterSpan(RenderBackend* ren, int y, int x0, int x1, float zInv0, float zInvStep) {
+    rasterSpanLit(ren, y, x0, x1, zInv0, zInvStep, LIGHT_NONE, 0.0f);
+}
+
+// Сужает отрезок шагов [lo, hi] до тех i, где a + b * i > 0
+static inline void sbufferKeepPositive(float a, float b, float* lo, float* hi) {
+    if (b > 0.0f) {
+        float r = -a / b;
+        if (r > *lo) *lo = r;
+    } else if (b < 0.0f) {
+        float r = -a / b;
+        if (r < *hi) *hi = r;
+    } else if (a <= 0.0f) {
+        *hi = *lo - 1.0f;
+    }
+}
+
+// Шаги линии x(i) = x + i*xInc, y(i) = y + i*yInc, которые могут попасть в текущий вид:
+// [*first, *last] с запасом в пиксель (точная проверка всё равно попиксельная); 0 - линия мимо.
+// Иначе линия, уходящая далеко за край вида, шагала бы по всей своей длине впустую
+static int lineStepsInView(float x, float y, float xInc, float yInc, int steps, int* first, int* last) {
+    float lo = 0.0f, hi = (float)steps;
+    sbufferKeepPositive(x - (float)(g_view.x0 - 1), xInc, &lo, &hi);
+    sbufferKeepPositive((float)(g_view.x1 + 1) - x, -xInc, &lo, &hi);
+    sbufferKeepPositive(y - (float)(g_view.y0 - 1), yInc, &lo, &hi);
+    sbufferKeepPositive((float)(g_view.y1 + 1) - y, -yInc, &lo, &hi);
+    if (lo > hi) return 0;
+    *first = (int)ceilf(lo);
+    *last = (int)floorf(hi);
+    return *first <= *last;
+}
+
+// Линия в режиме s-буфера. Шаг i линии - это x(i) = x + i*xInc, y(i) = y + i*yInc,
+// 1/z(i) = zInv + i*zInvInc. Линию режем на куски по строкам, и для каждого пролёта
+// строки закрытые им шаги находятся решением трёх линейных неравенств (попал в [x0, x1)
+// и лежит дальше грани), без всяких буферов глубины. Видимые шаги уходят в бэкенд пролётами.
+static void SBuffer_DrawLine(RenderBackend* r, float x, float y, float zInv, float xInc, float yInc, float zInvInc,
+                             int steps, SDL_Color color) {
+    int shadeFog = g_fog.active && g_fog.mode != FOG_OFF;
+    int first, last;
+    if (!lineStepsInView(x, y, xInc, yInc, steps, &first, &last)) return;
+    int i = first;
+    while (i <= last) {
+        // Кусок линии на одной строке: шаги [i0, i1]
+        int row = (int)(y + (float)i * yInc);
+        int i0 = i;
+        while (i < last && (int)(y + (float)(i + 1) * yInc) == row) i++;
+        int i1 = i++;
+        if (row < g_view.y0 || row >= g_view.y1) continue;
+
+        int hidden[SBUFFER_MAX_SPANS][2];
+        int numHidden = 0;
+        const SBufferSpan* span = g_sbuffer.spans[row];
+        for (int k = 0; k < g_sbuffer.count[row]; k++, span++) {
+            float lo = (float)i0, hi = (float)i1;
+            sbufferKeepPositive(x - span->x0, xInc, &lo, &hi);
+            sbufferKeepPositive(span->x1 - x, -xInc, &lo, &hi);
+            sbufferKeepPositive(SBUFFER_DEPTH_TOLERANCE * (span->zInvA + span->zInvB * x) - zInv,
+                                SBUFFER_DEPTH_TOLERANCE * span->zInvB * xInc - zInvInc, &lo, &hi);
+            int h0 = (int)ceilf(lo), h1 = (int)floorf(hi);
+            if (h0 <= h1) {
+                hidden[numHidden][0] = h0;
+                hidden[numHidden][1] = h1;
+                numHidden++;
+            }
+        }
+
+        // Соседние видимые пиксели одного уровня тумана склеиваем в один пролёт
+        int runX0 = 0, runX1 = -1, runLevel = 0;
+        for (int step = i0; step <= i1; step++) {
+            int px = (int)(x + (float)step * xInc);
+            if (px < g_view.x0 || px >= g_view.x1) continue;
+            int isHidden = 0;
+            for (int k = 0; k < numHidden; k++) {
+                if (step >= hidden[k][0] && step <= hidden[k][1]) { isHidden = 1; break; }
+            }
+            if (isHidden) {
+                g_rasterStats.pixelsRejected++;
+                continue;
+            }
+            g_rasterStats.pixelsShaded++;
+
+            int level = shadeFog ? Fog_Level(1.0f / (zInv + (float)step * zInvInc)) : 0;
+            if (runX1 >= runX0 && level == runLevel && px >= runX0 - 1 && px <= runX1 + 1) {
+                if (px < runX0) runX0 = px;
+                if (px > runX1) runX1 = px;
+                continue;
+            }
+            if (runX1 >= runX0) emitFoggedSpan(r, row, runX0, runX1 + 1, color, runLevel);
+            runX0 = runX1 = px;
+            runLevel = level;
+        }
+        if (runX1 >= runX0) emitFoggedSpan(r, row, runX0, runX1 + 1, color, runLevel);
+    }
+    r->color = color;
+}
+
+// Поворот камеры, посчитанный один раз: синусы/косинусы и позиция глаза.
+// Любая точка мира переводится в систему камеры одними и теми же операциями.
+typedef struct {
+    float eyeX, eyeY, eyeZ;
+    float sy, cy, sx, cx;
+} CameraTransform;
+
+CameraTransform CameraTransform_From(Camera cam) {
+    CameraTransform ct;
+    ct.eyeX = cam.x;
+    ct.eyeY = cam.y + cam.height + cam.currentBobY;
+    ct.eyeZ = cam.z;
+    ct.sy = fast_sin(cam.rotY); ct.cy = fast_cos(cam.rotY);
+    ct.sx = fast_sin(cam.rotX); ct.cx = fast_cos(cam.rotX);
+    return ct;
+}
+
+static inline Vec3 CameraTransform_Apply(const CameraTransform* ct, Vec3 p) {
+    float dx = p.x - ct->eyeX, dy = p.y - ct->eyeY, dz = p.z - ct->eyeZ;
+    float x = ct->cy * dx - ct->sy * dz;
+    float zTemp = ct->sy * dx + ct->cy * dz;
+    Vec3 out;
+    out.x = x;
+    out.y = ct->cx * dy - ct->sx * zTemp;
+    out.z = ct->sx * dy + ct->cx * zTemp;
+    return out;
+}
+
+// Пачка точек в систему камеры за один SIMD-проход (инстансинг, решётка стен)
+#define INSTANCE_BATCH_VERTS 512 // Вершин за один SIMD-проход (64 куба)
+
+// SoA-буферы пачки: мировые координаты на входе, координаты камеры на выходе
+static RENDER_TLS float g_batchWX[INSTANCE_BATCH_VERTS], g_batchWY[INSTANCE_BATCH_VERTS], g_batchWZ[INSTANCE_BATCH_VERTS];
+static RENDER_TLS float g_batchCX[INSTANCE_BATCH_VERTS], g_batchCY[INSTANCE_BATCH_VERTS], g_batchCZ[INSTANCE_BATCH_VERTS];
+
+// Те же операции, что и в CameraTransform_Apply, только по 4 точки за раз
+static void transformBatchToCameraSpace(const CameraTransform* ct, int count) {
+    int i = 0;
+#ifdef __SSE2__
+    __m128 eyeX = _mm_set1_ps(ct->eyeX), eyeY = _mm_set1_ps(ct->eyeY), eyeZ = _mm_set1_ps(ct->eyeZ);
+    __m128 sy = _mm_set1_ps(ct->sy), cy = _mm_set1_ps(ct->cy);
+    __m128 sx = _mm_set1_ps(ct->sx), cx = _mm_set1_ps(ct->cx);
+    for (; i + 4 <= count; i += 4) {
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(g_batchWX + i), eyeX);
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(g_batchWY + i), eyeY);
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(g_batchWZ + i), eyeZ);
+        __m128 x = _mm_sub_ps(_mm_mul_ps(cy, dx), _mm_mul_ps(sy, dz));
+        __m128 zTemp = _mm_add_ps(_mm_mul_ps(sy, dx), _mm_mul_ps(cy, dz));
+        _mm_storeu_ps(g_batchCX + i, x);
+        _mm_storeu_ps(g_batchCY + i, _mm_sub_ps(_mm_mul_ps(cx, dy), _mm_mul_ps(sx, zTemp)));
+        _mm_storeu_ps(g_batchCZ + i, _mm_add_ps(_mm_mul_ps(sx, dy), _mm_mul_ps(cx, zTemp)));
+    }
+#endif
+    for (; i < count; i++) {
+        Vec3 c = CameraTransform_Apply(ct, (Vec3){g_batchWX[i], g_batchWY[i], g_batchWZ[i]});
+        g_batchCX[i] = c.x; g_batchCY[i] = c.y; g_batchCZ[i] = c.z;
+    }
+}
+
+void drawCameraSpaceLine(RenderBackend* r, Vec3 a, Vec3 b, SDL_Color color);
+
+void clipAndDrawLine(RenderBackend* r, Vec3 p1, Vec3 p2, Camera cam, SDL_Color color) {
+    CameraTransform ct = CameraTransform_From(cam);
+    drawCameraSpaceLine(r, CameraTransform_Apply(&ct, p1), CameraTransform_Apply(&ct, p2), color);
+}
+
+// Отсечение, проекция и растеризация линии, концы которой уже в системе камеры
+void drawCameraSpaceLine(RenderBackend* r, Vec3 a, Vec3 b, SDL_Color color) {
+    float x1_cam = a.x, y1_cam = a.y, z1_cam = a.z;
+    float x2_cam = b.x, y2_cam = b.y, z2_cam = b.z;
+    // --- Шаг 2: Отсечение по ближней плоскости ---
+    const float near_plane = 0.1f;
+    if (z1_cam < near_plane && z2_cam < near_plane) return;
+    if (z1_cam < near_plane) {
+        float t = (near_plane - z1_cam) / (z2_cam - z1_cam);
+        x1_cam = lerp(x1_cam, x2_cam, t); y1_cam = lerp(y1_cam, y2_cam, t); z1_cam = near_plane;
+    }
+    if (z2_cam < near_plane) {
+        float t = (near_plane - z2_cam) / (z1_cam - z2_cam);
+        x2_cam = lerp(x2_cam, x1_cam, t); y2_cam = lerp(y2_cam, y1_cam, t); z2_cam = near_plane;
+    }
+    // То же самое с дальней плоскостью тумана: за ней линия всё равно растворилась бы в фоне
+    if (g_fog.active) {
+        const float far_plane = g_fog.farPlane;
+        if (z1_cam > far_plane && z2_cam > far_plane) return;
+        if (z1_cam > far_plane) {
+            float t = (z1_cam - far_plane) / (z1_cam - z2_cam);
+            x1_cam = lerp(x1_cam, x2_cam, t); y1_cam = lerp(y1_cam, y2_cam, t); z1_cam = far_plane;
+        }
+        if (z2_cam > far_plane) {
+            float t = (z2_cam - far_plane) / (z2_cam - z1_cam);
+            x2_cam = lerp(x2_cam, x1_cam, t); y2_cam = lerp(y2_cam, y1_cam, t); z2_cam = far_plane;
+        }
+    }
+    
+    // --- Шаг 3: Проекция (без изменений) ---
+    float fov = g_fov;
+    int sx1 = (int)(g_view.cx + x1_cam * fov / z1_cam);
+    int sy1 = (int)(g_view.cy - y1_cam * fov / z1_cam);
+    int sx2 = (int)(g_view.cx + x2_cam * fov / z2_cam);
+    int sy2 = (int)(g_view.cy - y2_cam * fov / z2_cam);
+
+    Render_SetColor(r, color.r, color.g, color.b, color.a);
+    int shadeFog = g_fog.active && g_fog.mode != FOG_OFF;
+    int fogLevel = 0;
+
+    int dx = abs(sx2 - sx1);
+    int dy = abs(sy2 - sy1);
+    int steps = (dx > dy) ? dx : dy;
+
+    // <<< УДАР #2: БЫСТРЫЙ ПУТЬ ДЛЯ КОРОТКИХ ЛИНИЙ >>>
+    if (steps < 2) {
+        if (shadeFog) r->color = Fog_Apply(color, Fog_Level(z1_cam));
+        drawPixelWithZCheck_Fast(r, sx1, sy1, z1_cam * g_lineDepthBias);
+        return; // ВЫХОДИМ, ИЗБЕГАЯ ДОРОГОГО ЦИКЛА
+    }
+
+    if (steps == 0) { // Эта проверка на всякий случай
+        drawPixelWithZCheck_Fast(r, sx1, sy1, z1_cam * g_lineDepthBias);
+        return;
+    }
+
+    float x_inc = (float)(sx2 - sx1) / (float)steps;
+    float y_inc = (float)(sy2 - sy1) / (float)steps;
+    float z1_inv = 1.0f / z1_cam;
+    float z2_inv = 1.0f / z2_cam;
+    float z_inv_inc = (z2_inv - z1_inv) / (float)steps;
+    float current_x = sx1, current_y = sy1, current_z_inv = z1_inv;
+
+    if (g_sbuffer.active) {
+        SBuffer_DrawLine(r, current_x, current_y, z1_inv / g_lineDepthBias, x_inc, y_inc, z_inv_inc / g_lineDepthBias, steps, color);
+        return;
+    }
+
+    int first, last;
+    if (!lineStepsInView(current_x, current_y, x_inc, y_inc, steps, &first, &last)) return;
+    if (first > 0) {
+        current_x += (float)first * x_inc;
+        current_y += (float)first * y_inc;
+        current_z_inv += (float)first * z_inv_inc;
+    }
+    for (int i = first; i <= last; i++) {
+        float current_z = g_lineDepthBias / current_z_inv;
+        if (shadeFog) {
+            // Цвет меняем только когда линия перешла на другой уровень тумана
+            int level = Fog_Level(current_z);
+            if (level != fogLevel) { fogLevel = level; r->color = Fog_Apply(color, level); }
+        }
+        drawPixelWithZCheck_Fast(r, (int)current_x, (int)current_y, current_z); // <<< Используем быструю функцию
+        current_x += x_inc;
+        current_y += y_inc;
+        current_z_inv += z_inv_inc;
+    }
+}
+// Примерный диаметр на экране (в пикселях) сферы радиуса radius вокруг center.
+// Если сфера задевает ближнюю плоскость, объект считаем огромным.
+float Lod_ProjectedSize(Vec3 center, float radius, Camera cam) {
+    CameraTransform ct = CameraTransform_From(cam);
+    float z = CameraTransform_Apply(&ct, center).z;
+    if (z - radius <= NEAR_PLANE) return FLT_MAX;
+    return 2.0f * radius * g_fov / z;
+}
+
+// Вершина для обхода полигона: экранные x, y и всё, что линейно по экрану -
+// 1/z, (для текстур) u/z, v/z и ступень света (LIGHT_NONE - без освещения)
+typedef struct {
+    int x, y;
+    float zInv, uz, vz;
+    float light;
+} RasterVertex;
+
+// Куда обход отдаёт каждую строку полигона
+typedef void (*TriangleSpanFunc)(RenderBackend* ren, int y, int x0, int x1, float zInv0, float zInvStep,
+                                 float uz0, float uzStep, float vz0, float vzStep,
+                                 float light0, float lightStep, void* ctx);
+
+// Активное ребро выпуклого полигона: текущие значения на строке и их шаг на следующую
+typedef struct {
+    float x, zInv, uz, vz, light;
+    float dx, dzInv, duz, dvz, dlight;
+    int yEnd; // Строка нижней вершины ребра
+    int end;  // Индекс нижней вершины
+} PolygonEdge;
+
+// Следующее ребро цепочки от вершины from в сторону dir (+1/-1), уже сдвинутое на строку y.
+// Горизонтальные рёбра (и ступеньки вверх от округления проекции) пропускаем. 0 - цепочка дошла до низа
+static int polygonEdgeSetup(PolygonEdge* e, const RasterVertex* v, int count, int from, int dir, int bottom, int y) {
+    for (int guard = 0; guard < count && from != bottom; guard++) {
+        int to = (from + dir + count) % count;
+        const RasterVertex* a = &v[from];
+        const RasterVertex* b = &v[to];
+        if (b->y <= a->y) {
+            from = to;
+            continue;
+        }
+        float invDy = 1.0f / (float)(b->y - a->y);
+        e->dx = (float)(b->x - a->x) * invDy;
+        e->dzInv = (b->zInv - a->zInv) * invDy;
+        e->duz = (b->uz - a->uz) * invDy;
+        e->dvz = (b->vz - a->vz) * invDy;
+        e->dlight = (b->light - a->light) * invDy;
+        e->x = a->x;
+        e->zInv = a->zInv;
+        e->uz = a->uz;
+        e->vz = a->vz;
+        e->light = a->light;
+        e->yEnd = b->y;
+        e->end = to;
+        if (y > a->y) { // Ребро начинается выше текущей строки
+            float steps = (float)(y - a->y);
+            e->x += e->dx * steps;
+            e->zInv += e->dzInv * steps;
+            e->uz += e->duz * steps;
+            e->vz += e->dvz * steps;
+            e->light += e->dlight * steps;
+        }
+        g_rasterStats.polygonEdges++;
+        return 1;
+    }
+    return 0;
+}
+
+static inline void polygonEdgeStep(PolygonEdge* e) {
+    e->x += e->dx;
+    e->zInv += e->dzInv;
+    e->uz += e->duz;
+    e->vz += e->dvz;
+    e->light += e->dlight;
+}
+
+// Выпуклый полигон одним обходом: от верхней вершины вниз идут две цепочки рёбер (левая и
+// правая), и в каждый момент активны ровно два ребра. Каждое ребро настраивается один раз, на
+// строку - один пролёт. Веер из треугольников настраивал бы общие диагонали дважды, и на них
+// от разного накопления float появлялись щели и двойные пиксели (видно на полупрозрачном).
+// Строки [верх, низ], пролёт [x0, x1). Плоская и текстурная заливка идут через один обход,
+// поэтому глубина у них считается одними и теми же операциями - иначе пре-пасс и текстурный
+// цветовой проход разошлись бы в последних битах.
+static void walkPolygon(RenderBackend* ren, const RasterVertex* v, int count, TriangleSpanFunc spanFunc, void* ctx) {
+    int top = 0, bottom = 0;
+    for (int i = 1; i < count; i++) {
+        if (v[i].y < v[top].y) top = i;
+        if (v[i].y > v[bottom].y) bottom = i;
+    }
+    int yTop = v[top].y, yBottom = v[bottom].y;
+    if (yTop == yBottom) return; // Весь полигон - одна горизонтальная линия
+
+    PolygonEdge a, b;
+    if (!polygonEdgeSetup(&a, v, count, top, 1, bottom, yTop) || !polygonEdgeSetup(&b, v, count, top, -1, bottom, yTop)) return;
+    g_rasterStats.polygonsFilled++;
+
+    for (int y = yTop; y <= yBottom; y++) {
+        // Ребро кончилось на этой строке - дальше по цепочке (с низу полигона уже некуда)
+        if (a.yEnd <= y && a.end != bottom && !polygonEdgeSetup(&a, v, count, a.end, 1, bottom, y)) a.end = bottom;
+        if (b.yEnd <= y && b.end != bottom && !polygonEdgeSetup(&b, v, count, b.end, -1, bottom, y)) b.end = bottom;
+
+        const PolygonEdge* l = &a;
+        const PolygonEdge* r = &b;
+        int startX = (int)a.x, endX = (int)b.x;
+        if (startX > endX) {
+            int tmpX = startX; startX = endX; endX = tmpX;
+            l = &b;
+            r = &a;
+        }
+        float span = (float)(endX - startX);
+        float invSpan = (endX > startX) ? 1.0f / span : 0.0f;
+        spanFunc(ren, y, startX, endX, l->zInv, (r->zInv - l->zInv) * invSpan, l->uz, (r->uz - l->uz) * invSpan,
+                 l->vz, (r->vz - l->vz) * invSpan, l->light, (r->light - l->light) * invSpan, ctx);
+        polygonEdgeStep(&a);
+        polygonEdgeStep(&b);
+    }
+}
+
+static void flatSpan(RenderBackend* ren, int y, int x0, int x1, float zInv0, float zInvStep,
+                     float uz0, float uzStep, float vz0, float vzStep, float light0, float lightStep, void* ctx) {
+    (void)uz0; (void)uzStep; (void)vz0; (void)vzStep; (void)ctx; // UV нужны только текстурному пролёту
+    rasterSpanLit(ren, y, x0, x1, zInv0, zInvStep, light0, lightStep);
+}
+
+static inline RasterVertex rasterVertexFromProjected(ProjectedPoint p, float u, float v) {
+    float zInv = 1.0f / p.z;
+    RasterVertex r = { p.x, p.y, zInv, u * zInv, v * zInv, LIGHT_NONE };
+    return r;
+}
+
+// Выпуклый полигон плоским цветом (вершины по обходу, любому из двух)
+void fillPolygon(RenderBackend* ren, const RasterVertex* v, int count, SDL_Color color) {
+    if (g_fog.active) {
+        float farInv = 1.0f / g_fog.farPlane;
+        int beyond = 0;
+        for (int i = 0; i < count; i++) beyond += v[i].zInv < farInv;
+        if (beyond == count) return;
+    }
+    if (g_rasterPass != RASTER_PASS_DEPTH_ONLY) {
+        Render_SetColor(ren, color.r, color.g, color.b, color.a);
+    }
+    walkPolygon(ren, v, count, flatSpan, NULL);
+}
+
+// --- ТЕКСТУРНАЯ ЗАЛИВКА ---
+// UV интерполируются как u/z и v/z вместе с 1/z и делятся обратно в каждом пикселе -
+// перспективно-корректно. Мип выбирается один на пролёт по производным UV в его середине.
+#define TEX_WRAP_BIAS 65536.0f // Сдвиг, чтобы (int) всегда округлял вниз; кратен любому размеру текстуры
+
+typedef struct {
+    const SoftTexture* texture;
+    SDL_Color color;   // Цвет материала: текстура его модулирует
+    int blend256;      // 0 - плоский цвет, 256 - полностью текстура
+    float dZdx, dUZdx, dVZdx; // Экранные градиенты 1/z, u/z, v/z по треугольнику
+    float dZdy, dUZdy, dVZdy;
+} TexturedTriangle;
+
+static RENDER_TLS Uint32 g_texturedRow[WIDTH]; // Готовые цвета пролёта перед отправкой в бэкенд
+
+// Градиент величины, заданной в трёх вершинах, по экранным x и y
+static void planeGradient(const RasterVertex* a, const RasterVertex* b, const RasterVertex* c,
+                          float fa, float fb, float fc, float invArea, float* ddx, float* ddy) {
+    float x1 = (float)(b->x - a->x), y1 = (float)(b->y - a->y);
+    float x2 = (float)(c->x - a->x), y2 = (float)(c->y - a->y);
+    *ddx = ((fb - fa) * y2 - (fc - fa) * y1) * invArea;
+    *ddy = ((fc - fa) * x1 - (fb - fa) * x2) * invArea;
+}
+
+// Мип: log2 от числа текселей на пиксель (по худшей из осей экрана)
+static int selectMipLevel(const TexturedTriangle* tt, float zInv, float uz, float vz) {
+    if (zInv <= 0.0f) return 0;
+    const SoftTextureLevel* base = &tt->texture->levels[0];
+    float z = 1.0f / zInv;
+    float u = uz * z, v = vz * z;
+    float dudx = (tt->dUZdx - u * tt->dZdx) * z * base->w;
+    float dvdx = (tt->dVZdx - v * tt->dZdx) * z * base->h;
+    float dudy = (tt->dUZdy - u * tt->dZdy) * z * base->w;
+    float dvdy = (tt->dVZdy - v * tt->dZdy) * z * base->h;
+    float rhoX = dudx * dudx + dvdx * dvdx;
+    float rhoY = dudy * dudy + dvdy * dvdy;
+    float rho2 = rhoX > rhoY ? rhoX : rhoY;
+
+    int level = 0;
+    while (rho2 >= 4.0f && level < tt->texture->numLevels - 1) {
+        rho2 *= 0.25f;
+        level++;
+    }
+    return level;
+}
+
+// Цвет пикселя при данном уровне тумана - линейная функция от текселя: c = (a + b * t) >> 16.
+// Коэффициенты считаются, только когда вдоль пролёта сменился уровень тумана.
+typedef struct {
+    int level;
+    int a[3], b[3];
+} TexelShade;
+
+static void texelShadeForLevel(TexelShade* sh, SDL_Color base, int blend256, int fogLevel) {
+    float fogT = (float)fogLevel / (FOG_LEVELS - 1);
+    float keep = 1.0f - fogT;
+    float flat = (256 - blend256) / 256.0f;      // Доля плоского цвета
+    float textured = blend256 / (256.0f * 255.0f); // Доля цвета, промодулированного текселем (на единицу текселя)
+    const Uint8 baseC[3] = { base.r, base.g, base.b };
+    const Uint8 fogC[3] = { g_fog.color.r, g_fog.color.g, g_fog.color.b };
+    for (int k = 0; k < 3; k++) {
+        sh->a[k] = (int)((baseC[k] * flat * keep + fogC[k] * fogT) * 65536.0f);
+        sh->b[k] = (int)(baseC[k] * textured * keep * 65536.0f);
+    }
+    sh->level = fogLevel;
+}
+
+static void texturedSpan(RenderBackend* ren, int y, int x0, int x1, float zInv0, float zInvStep,
+                         float uz0, float uzStep, float vz0, float vzStep, float light0, float lightStep, void* ctx) {
+    const TexturedTriangle* tt = (const TexturedTriangle*)ctx;
+
+    // Пре-пассу нужна только глубина - та же самая, что у плоской заливки.
+    // Бэкенду без своего кадра попиксельный цвет дорог: там текстура - это её самый мелкий мип
+    // (средний цвет), и пролёт уходит обычной плоской заливкой.
+    if (g_rasterPass == RASTER_PASS_DEPTH_ONLY || !ren->pixelRows) {
+        if (g_rasterPass != RASTER_PASS_DEPTH_ONLY) {
+            const SoftTextureLevel* coarsest = &tt->texture->levels[tt->texture->numLevels - 1];
+            SDL_Color avg = unpackARGB(coarsest->texels[0]);
+            SDL_Color c = tt->color;
+            c.r = (Uint8)(c.r + (c.r * avg.r / 255 - c.r) * tt->blend256 / 256);
+            c.g = (Uint8)(c.g + (c.g * avg.g / 255 - c.g) * tt->blend256 / 256);
+            c.b = (Uint8)(c.b + (c.b * avg.b / 255 - c.b) * tt->blend256 / 256);
+            ren->color = c;
+        }
+        rasterSpanLit(ren, y, x0, x1, zInv0, zInvStep, light0, lightStep);
+        return;
+    }
+    if (y < g_view.y0 || y >= g_view.y1) return;
+    int start = x0 < g_view.x0 ? g_view.x0 : x0;
+    int end = x1 > g_view.x1 ? g_view.x1 : x1;
+    if (start >= end) return;
+
+    float mid = (float)(x1 - x0) * 0.5f;
+    int level = selectMipLevel(tt, zInv0 + mid * zInvStep, uz0 + mid * uzStep, vz0 + mid * vzStep);
+    const SoftTextureLevel* lvl = &tt->texture->levels[level];
+    float uScale = (float)lvl->w, vScale = (float)lvl->h;
+
+    float* zRow = g_zBuffer[y];
+    int equalPass = g_rasterPass == RASTER_PASS_COLOR_EQUAL;
+    float farZ = g_fog.active ? g_fog.farPlane : FLT_MAX;
+    int shadeFog = g_fog.active && g_fog.mode != FOG_OFF;
+    Uint32 alpha = (Uint32)tt->color.a << 24;
+    int lit = light0 >= 0.0f;
+    int lightLevel = -1; // Ступень, под которую посчитан shade (-1 - без света)
+    TexelShade shade;
+    texelShadeForLevel(&shade, tt->color, tt->blend256, 0);
+    int runStart = -1;
+    Uint32 shaded = 0;
+
+    for (int x = start; x < end; x++) {
+        int i = x - x0;
+        float z = spanDepthAt(zInv0, zInvStep, i);
+        int visible = equalPass ? (z <= zRow[x] * DEPTH_EQUAL_TOLERANCE) : (z < zRow[x]);
+        if (visible && z < farZ) {
+            if (!equalPass) zRow[x] = z;
+
+            float u = (uz0 + (float)i * uzStep) * z;
+            float v = (vz0 + (float)i * vzStep) * z;
+            Uint32 texel = SoftTexture_Fetch(lvl, (int)(u * uScale + TEX_WRAP_BIAS), (int)(v * vScale + TEX_WRAP_BIAS));
+
+            if (shadeFog || lit) {
+                int fogLevel = shadeFog ? Fog_Level(z) : 0;
+                int lightNow = lit ? lightLevelAt(light0, lightStep, i) : -1;
+                if (fogLevel != shade.level || lightNow != lightLevel) {
+                    lightLevel = lightNow;
+                    texelShadeForLevel(&shade, lit ? Light_Apply(tt->color, lightLevel) : tt->color, tt->blend256, fogLevel);
+                }
+            }
+            Uint32 r = (Uint32)(shade.a[0] + shade.b[0] * (int)((texel >> 16) & 0xFF)) >> 16;
+            Uint32 g = (Uint32)(shade.a[1] + shade.b[1] * (int)((texel >> 8) & 0xFF)) >> 16;
+            Uint32 b = (Uint32)(shade.a[2] + shade.b[2] * (int)(texel & 0xFF)) >> 16;
+            g_texturedRow[x] = alpha | (r << 16) | (g << 8) | b;
+
+            if (runStart < 0) runStart = x;
+            shaded++;
+        } else {
+            if (runStart >= 0) {
+                if (g_gbuffer.writing) GBuffer_WriteRun(y, runStart, x, tt->color);
+                ren->Pixels(ren, y, runStart, &g_texturedRow[runStart], x - runStart);
+                runStart = -1;
+            }
+        }
+    }
+    if (runStart >= 0) {
+        if (g_gbuffer.writing) GBuffer_WriteRun(y, runStart, end, tt->color);
+        ren->Pixels(ren, y, runStart, &g_texturedRow[runStart], end - runStart);
+    }
+
+    g_rasterStats.pixelsShaded += shaded;
+    g_rasterStats.pixelsTextured += shaded;
+    g_rasterStats.pixelsRejected += (Uint32)(end - start) - shaded;
+}
+
+// Выпуклый полигон с текстурой. Полигон плоский, поэтому градиенты для мипа - по одному его
+// треугольнику: берём самый большой из веера, чтобы узкие и почти вырожденные не врали
+void fillPolygonTextured(RenderBackend* ren, const RasterVertex* v, int count,
+                         const SoftTexture* texture, SDL_Color color, float blend) {
+    if (g_fog.active) {
+        float farInv = 1.0f / g_fog.farPlane;
+        int beyond = 0;
+        for (int i = 0; i < count; i++) beyond += v[i].zInv < farInv;
+        if (beyond == count) return;
+    }
+    TexturedTriangle tt;
+    tt.texture = texture;
+    tt.color = color;
+    tt.blend256 = (int)(blend * 256.0f);
+    if (tt.blend256 < 0) tt.blend256 = 0;
+    if (tt.blend256 > 256) tt.blend256 = 256;
+
+    int best = 1;
+    float bestArea = 0.0f;
+    for (int i = 1; i < count - 1; i++) {
+        float area = (float)(v[i].x - v[0].x) * (float)(v[i + 1].y - v[0].y) - (float)(v[i + 1].x - v[0].x) * (float)(v[i].y - v[0].y);
+        if (fabsf(area) > fabsf(bestArea)) {
+            bestArea = area;
+            best = i;
+        }
+    }
+    const RasterVertex* p0 = &v[0];
+    const RasterVertex* p1 = &v[best];
+    const RasterVertex* p2 = &v[best + 1];
+    float invArea = fabsf(bestArea) < 0.5f ? 0.0f : 1.0f / bestArea;
+    planeGradient(p0, p1, p2, p0->zInv, p1->zInv, p2->zInv, invArea, &tt.dZdx, &tt.dZdy);
+    planeGradient(p0, p1, p2, p0->uz, p1->uz, p2->uz, invArea, &tt.dUZdx, &tt.dUZdy);
+    planeGradient(p0, p1, p2, p0->vz, p1->vz, p2->vz, invArea, &tt.dVZdx, &tt.dVZdy);
+
+    walkPolygon(ren, v, count, texturedSpan, &tt);
+}
+
+void updateWorldEvolution(float deltaTime) {
+    WorldState oldState = g_worldEvolution.currentState;
+    
+    // Определяем состояние на основе монет
+    if (g_coinsCollected < 10) {
+        g_worldEvolution.currentState = WORLD_STATE_WIREFRAME;
+    } else if (g_coinsCollected < 15) {
+        g_worldEvolution.currentState = WORLD_STATE_GRID_GROWING;
+    } else if (g_coinsCollected < 20) {
+        g_worldEvolution.currentState = WORLD_STATE_CUBE_COMPLETE;
+    } else if (g_coinsCollected < 30) {
+        g_worldEvolution.currentState = WORLD_STATE_MATERIALIZING;
+    } else if (g_coinsCollected < 40) {
+        g_worldEvolution.currentState = WORLD_STATE_TEXTURED;
+    } else {
+        g_worldEvolution.currentState = WORLD_STATE_REALISTIC;
+    }
+    
+    // Если состояние изменилось, запускаем переход
+    if (oldState != g_worldEvolution.currentState) {
+        g_worldEvolution.transitionProgress = 0.0f;
+        g_worldEvolution.glitchIntensity = 1.0f; // Глюки при переходе
+        printf("WORLD EVOLUTION: Entering %d state\n", g_worldEvolution.currentState);
+    }
+    
+    // Обновляем параметры в зависимости от состояния
+    switch(g_worldEvolution.currentState) {
+        case WORLD_STATE_WIREFRAME:
+            // Базовое состояние - просто пульсация
+            g_worldEvolution.gridPulse = fast_sin(Game_GetTicks() * 0.001f) * 0.1f;
+            break;
+            
+        case WORLD_STATE_GRID_GROWING:
+    // --- МЕДЛЕННЕЕ И ПЛАВНЕЕ ---
+    g_worldEvolution.gridWallHeight = lerp(g_worldEvolution.gridWallHeight, 50.0f, deltaTime * 0.2f); // Было 0.5f
+    g_worldEvolution.gridDensity = lerp(g_worldEvolution.gridDensity, 2.0f, deltaTime * 0.15f); // Было 3.0f и 0.3f
+    break;
+
+case WORLD_STATE_CUBE_COMPLETE:
+    g_worldEvolution.gridWallHeight = 50.0f;
+    // --- МЕДЛЕННАЯ ПУЛЬСАЦИЯ ---
+    g_worldEvolution.gridPulse = fast_sin(Game_GetTicks() * 0.0008f) * 0.15f; // Было 0.002f и 0.2f
+    g_worldEvolution.polygonOpacity = fast_sin(Game_GetTicks() * 0.001f) * 0.05f + 0.02f; // Плавнее
+    break;
+            
+        case WORLD_STATE_MATERIALIZING:
+            // Появляются полупрозрачные полигоны
+            g_worldEvolution.polygonOpacity = lerp(g_worldEvolution.polygonOpacity, 0.5f, deltaTime * 0.2f);
+            g_worldEvolution.chromaAberration = fast_sin(Game_GetTicks() * 0.01f) * 0.02f;
+            break;
+            
+        case WORLD_STATE_TEXTURED:
+            // Текстуры и начало скайбокса
+            g_worldEvolution.polygonOpacity = lerp(g_worldEvolution.polygonOpacity, 0.8f, deltaTime * 0.3f);
+            g_worldEvolution.textureBlend = lerp(g_worldEvolution.textureBlend, 0.7f, deltaTime * 0.2f);
+            g_worldEvolution.skyboxEnabled = 1;
+            g_worldEvolution.skyboxAlpha = lerp(g_worldEvolution.skyboxAlpha, 0.3f, deltaTime * 0.1f);
+            break;
+            
+        case WORLD_STATE_REALISTIC:
+            // Полный рендер
+            g_worldEvolution.polygonOpacity = 1.0f;
+            g_worldEvolution.textureBlend = 1.0f;
+            g_worldEvolution.skyboxAlpha = lerp(g_worldEvolution.skyboxAlpha, 1.0f, deltaTime * 0.2f);
+            g_worldEvolution.gridWallHeight = lerp(g_worldEvolution.gridWallHeight, 0.0f, deltaTime * 0.5f);
+            break;
+    }
+    
+    // Обновляем прогресс перехода
+    g_worldEvolution.transitionProgress = lerp(g_worldEvolution.transitionProgress, 1.0f, deltaTime * 2.0f);
+    
+    // Затухание глюков
+    g_worldEvolution.glitchIntensity = lerp(g_worldEvolution.glitchIntensity, 0.0f, deltaTime * 3.0f);
+}
+
+// --- РЕШЁТКА СТЕН ---
+// Вершины и рёбра стен живут между кадрами и перестраиваются, только когда высота
+// или плотность перешагнули свой квант. Каждый кадр остаётся лишь волна: верхние
+// вершины столбцов сдвигаются по Y на смещение своего столбца прямо при заполнении
+// пачки, а потом вся решётка уходит в систему камеры одним SIMD-проходом.
+#define WALL_WORLD_SIZE 30.0f
+#define WALL_HEIGHT_QUANTUM 0.25f  // Шаг перестройки по gridWallHeight (в юнитах)
+#define WALL_DENSITY_QUANTUM 0.05f // Шаг перестройки по gridDensity
+#define WALL_MAX_COLUMNS 64
+#define WALL_MAX_EDGES 512
+
+typedef struct {
+    int valid;
+    int heightStep, densityStep, hasCeiling; // Ключ кэша
+    int qualityTier;                         // ... и шаг решётки уровня качества
+    int numColumns;
+    float columnPos[WALL_MAX_COLUMNS];       // Координата столбца вдоль стены (для фазы волны)
+    int numVerts;
+    Vec3 verts[INSTANCE_BATCH_VERTS];
+    short waveColumn[INSTANCE_BATCH_VERTS];  // Столбец, чья волна двигает вершину; -1 - не двигается
+    int numEdges;
+    short edges[WALL_MAX_EDGES][2];
+    Uint32 rebuilds;
+} WallLattice;
+
+WallLattice g_wallLattice;
+
+static int wallAddVertex(WallLattice* wl, Vec3 v, int waveColumn) {
+    if (wl->numVerts >= INSTANCE_BATCH_VERTS) return -1;
+    wl->verts[wl->numVerts] = v;
+    wl->waveColumn[wl->numVerts] = (short)waveColumn;
+    return wl->numVerts++;
+}
+
+static void wallAddEdge(WallLattice* wl, int a, int b) {
+    if (a < 0 || b < 0 || wl->numEdges >= WALL_MAX_EDGES) return;
+    wl->edges[wl->numEdges][0] = (short)a;
+    wl->edges[wl->numEdges][1] = (short)b;
+    wl->numEdges++;
+}
+
+static void rebuildWallLattice(WallLattice* wl, float h, float density, int hasCeiling) {
+    float worldSize = WALL_WORLD_SIZE;
+    wl->numColumns = 0;
+    wl->numVerts = 0;
+    wl->numEdges = 0;
+
+    // --- ОПТИМИЗАЦИЯ 1: Увеличиваем шаг, чтобы было меньше линий ---
+    float step = fmaxf(Quality_Current()->wallStepMin, 8.0f / density); // Шаг не меньше wallStepMin текущего уровня качества!
+
+    // Вертикальные линии: низ на полу, верх на высоте стены (его потом качает волна)
+    for (float i = -worldSize; i <= worldSize && wl->numColumns < WALL_MAX_COLUMNS; i += step) {
+        int c = wl->numColumns++;
+        wl->columnPos[c] = i;
+        float top = -2.0f + h;
+        // Передняя и задняя стены, левая и правая стены
+        Vec3 bottoms[4] = { {i, -2.0f, -worldSize}, {i, -2.0f, worldSize}, {-worldSize, -2.0f, i}, {worldSize, -2.0f, i} };
+        for (int k = 0; k < 4; k++) {
+            int b = wallAddVertex(wl, bottoms[k], -1);
+            int t = wallAddVertex(wl, (Vec3){bottoms[k].x, top, bottoms[k].z}, c);
+            wallAddEdge(wl, b, t);
+        }
+    }
+
+    // --- ОПТИМИЗАЦИЯ 2: Горизонтальные линии рисуем еще реже ---
+    for (float y = -2.0f; y <= -2.0f + h; y += step * 2.0f) { // Шаг по Y в 2 раза больше!
+        int c0 = wallAddVertex(wl, (Vec3){-worldSize, y, -worldSize}, -1);
+        int c1 = wallAddVertex(wl, (Vec3){worldSize, y, -worldSize}, -1);
+        int c2 = wallAddVertex(wl, (Vec3){worldSize, y, worldSize}, -1);
+        int c3 = wallAddVertex(wl, (Vec3){-worldSize, y, worldSize}, -1);
+        wallAddEdge(wl, c0, c1);
+        wallAddEdge(wl, c3, c2);
+        wallAddEdge(wl, c0, c3);
+        wallAddEdge(wl, c1, c2);
+    }
+
+    // --- ОПТИМИЗАЦИЯ 3: Потолок рисуем только контуром и диагоналями ---
+    if (hasCeiling) {
+        float ceilingY = -2.0f + h;
+        int corners[4] = {
+            wallAddVertex(wl, (Vec3){-worldSize, ceilingY, -worldSize}, -1),
+            wallAddVertex(wl, (Vec3){worldSize, ceilingY, -worldSize}, -1),
+            wallAddVertex(wl, (Vec3){worldSize, ceilingY, worldSize}, -1),
+            wallAddVertex(wl, (Vec3){-worldSize, ceilingY, worldSize}, -1)
+        };
+        // Рисуем периметр
+        for (int i = 0; i < 4; i++) {
+            wallAddEdge(wl, corners[i], corners[(i + 1) % 4]);
+        }
+        // Рисуем диагонали
+        wallAddEdge(wl, corners[0], corners[2]);
+        wallAddEdge(wl, corners[1], corners[3]);
+    }
+    wl->rebuilds++;
+}
+
+// Перестраиваем решётку только при переходе через квант высоты или плотности.
+// Решётка общая для всех видов, поэтому это делается до отрисовки, а не внутри неё
+void updateWallLattice(void) {
+    if (g_worldEvolution.gridWallHeight <= 0.01f) return;
+
+    WallLattice* wl = &g_wallLattice;
+    int heightStep = (int)lroundf(g_worldEvolution.gridWallHeight / WALL_HEIGHT_QUANTUM);
+    int densityStep = (int)lroundf(g_worldEvolution.gridDensity / WALL_DENSITY_QUANTUM);
+    int hasCeiling = g_worldEvolution.currentState >= WORLD_STATE_CUBE_COMPLETE;
+    if (!wl->valid || heightStep != wl->heightStep || densityStep != wl->densityStep || hasCeiling != wl->hasCeiling ||
+        g_quality.tier != wl->qualityTier) {
+        float density = densityStep > 0 ? densityStep * WALL_DENSITY_QUANTUM : WALL_DENSITY_QUANTUM;
+        rebuildWallLattice(wl, heightStep * WALL_HEIGHT_QUANTUM, density, hasCeiling);
+        wl->heightStep = heightStep;
+        wl->densityStep = densityStep;
+        wl->hasCeiling = hasCeiling;
+        wl->qualityTier = g_quality.tier;
+        wl->valid = 1;
+    }
+}
+
+void drawEvolvingWalls(RenderBackend* ren, Camera cam) {
+    WallLattice* wl = &g_wallLattice;
+    if (g_worldEvolution.gridWallHeight <= 0.01f || !wl->valid) return;
+
+    // Волна по столбцам: одно смещение на столбец за кадр
+    float wave[WALL_MAX_COLUMNS];
+    float time = Game_GetTicks() * 0.0005f;
+    for (int c = 0; c < wl->numColumns; c++) {
+        wave[c] = fast_sin(wl->columnPos[c] * 0.1f + time) * g_worldEvolution.gridPulse * 0.5f;
+    }
+
+    for (int v = 0; v < wl->numVerts; v++) {
+        g_batchWX[v] = wl->verts[v].x;
+        g_batchWY[v] = wl->verts[v].y + (wl->waveColumn[v] >= 0 ? wave[wl->waveColumn[v]] : 0.0f);
+        g_batchWZ[v] = wl->verts[v].z;
+    }
+    CameraTransform ct = CameraTransform_From(cam);
+    transformBatchToCameraSpace(&ct, wl->numVerts);
+
+    SDL_Color wallColor = {80, 80, 90, 255};
+    for (int e = 0; e < wl->numEdges; e++) {
+        int a = wl->edges[e][0], b = wl->edges[e][1];
+        drawCameraSpaceLine(ren, (Vec3){g_batchCX[a], g_batchCY[a], g_batchCZ[a]},
+                                 (Vec3){g_batchCX[b], g_batchCY[b], g_batchCZ[b]}, wallColor);
+    }
+}
+
+// [Продолжение следует в следующем сообщении...]
+
+// --- НЕБО ---
+// Градиент неба держим готовыми строками: каждая уже смешана с цветом фона по skyboxAlpha,
+// так что в кадре небо - это просто заливка строк без всякого смешивания.
+// Пересчитываем только когда сменился шаг таблицы цветов суток или прозрачность неба.
+typedef struct {
+    Uint32 rows[HEIGHT];
+    int lutIndex;
+    Uint8 alpha;
+    Uint32 version; // 0 - кэш ещё не строился
+} SkyCache;
+
+SkyCache g_skyCache = { .lutIndex = -1 };
+
+// Цвет очистки кадра в синглплеере: из "пустоты" в цвет тумана по мере появления неба
+SDL_Color getSkyClearColor(float skyboxAlpha) {
+    const SDL_Color baseBackgroundColor = {20, 20, 30, 255};
+    return lerpColor(baseBackgroundColor, g_dayNight.fogColor, skyboxAlpha);
+}
+
+static void rebuildSkyCache(Uint8 alpha) {
+    SDL_Color clear = getSkyClearColor(alpha / 255.0f);
+    SDL_Color skyTop = g_dayNight.skyTopColor;
+    SDL_Color skyBottom = g_dayNight.skyBottomColor;
+    Uint32 a = alpha, ia = 255 - alpha;
+
+    for (int y = 0; y < HEIGHT; y++) {
+        SDL_Color c = lerpColor(skyTop, skyBottom, (float)y / HEIGHT);
+        // То же смешивание, что SDL_BLENDMODE_BLEND делал поверх очищенного кадра
+        c.r = (Uint8)((c.r * a + clear.r * ia) / 255);
+        c.g = (Uint8)((c.g * a + clear.g * ia) / 255);
+        c.b = (Uint8)((c.b * a + clear.b * ia) / 255);
+        g_skyCache.rows[y] = packARGB(c);
+    }
+    g_skyCache.lutIndex = g_dayNight.lutIndex;
+    g_skyCache.alpha = alpha;
+    g_skyCache.version++;
+    if (g_skyCache.version == 0) g_skyCache.version = 1;
+}
+
+void updateSkyCache(void) {
+    if (!g_worldEvolution.skyboxEnabled || g_worldEvolution.skyboxAlpha < 0.01f) return;
+
+    Uint8 alpha = (Uint8)(g_worldEvolution.skyboxAlpha * 255);
+    if (g_skyCache.version == 0 || g_skyCache.lutIndex != g_dayNight.lutIndex || g_skyCache.alpha != alpha) {
+        rebuildSkyCache(alpha);
+    }
+}
+
+// Небо рисуется первым после очистки и перекрывает весь вид (строки готовит updateSkyCache)
+void drawSkybox(RenderBackend* ren) {
+    if (!g_worldEvolution.skyboxEnabled || g_worldEvolution.skyboxAlpha < 0.01f || g_skyCache.version == 0) return;
+    ren->RowFill(ren, g_skyCache.rows, g_skyCache.version);
+}
+// Эффект глюков при переходах
+void applyGlitchEffect(void) {
+    // Глюки переходов - это проходы пост-обработки по готовому кадру, а не пачка вызовов рендерера
+    float glitch = g_worldEvolution.glitchIntensity;
+    PostFX_SetIntensity(POSTFX_ROW_SHIFT, glitch);
+    PostFX_SetIntensity(POSTFX_RGB_SPLIT, fabsf(g_worldEvolution.chromaAberration) * 50.0f + glitch * 0.5f);
+    PostFX_SetIntensity(POSTFX_VIGNETTE, g_worldEvolution.skyboxAlpha * 0.6f);
+}
+
+// Полигональная заливка для продвинутых состояний
+void drawFilledTriangle(RenderBackend* ren, Vec3 p1, Vec3 p2, Vec3 p3, Camera cam, SDL_Color color) {
+    if (g_worldEvolution.polygonOpacity < 0.01f) return;
+    
+    ProjectedPoint pp1 = project_with_depth(p1, cam);
+    ProjectedPoint pp2 = project_with_depth(p2, cam);
+    ProjectedPoint pp3 = project_with_depth(p3, cam);
+    
+    // Простая проверка видимости
+    if (pp1.z <= 0.1f || pp2.z <= 0.1f || pp3.z <= 0.1f) return;
+    if (pp1.x < -WIDTH || pp1.x > WIDTH*2) return;
+    
+    // Применяем прозрачность
+    color.a = (Uint8)(g_worldEvolution.polygonOpacity * 255);
+    
+    Render_SetBlendMode(ren, SDL_BLENDMODE_BLEND);
+    Render_SetColor(ren, color.r, color.g, color.b, color.a);
+    
+    // Рисуем треугольник линиями (SDL не умеет заливать треугольники напрямую)
+    // Но создаём иллюзию заливки частыми горизонтальными линиями
+    int minY = fminf(pp1.y, fminf(pp2.y, pp3.y));
+    int maxY = fmaxf(pp1.y, fmaxf(pp2.y, pp3.y));
+    
+    for (int y = minY; y <= maxY; y += 2) {
+        // Тут нужна растеризация треугольника, но для простоты просто рисуем линии
+        Render_Line(ren, pp1.x, pp1.y, pp2.x, pp2.y);
+        Render_Line(ren, pp2.x, pp2.y, pp3.x, pp3.y);
+        Render_Line(ren, pp3.x, pp3.y, pp1.x, pp1.y);
+    }
+    
+    Render_SetBlendMode(ren, SDL_BLENDMODE_NONE);
+}
+
+void initHandsSystem() {
+    g_hands.leftPos = (Vec3){-0.45f, -0.9f, 0.35f};
+    g_hands.rightPos = (Vec3){0.45f, -0.9f, 0.35f};
+    
+    float inwardAngle = 0.5f;
+    g_hands.leftRot = (Vec3){0, inwardAngle, 0};
+    g_hands.rightRot = (Vec3){0, -inwardAngle, 0};
+    
+    g_hands.currentState = HAND_STATE_IDLE;
+    g_hands.targetState = HAND_STATE_IDLE;
+    g_hands.stateTransition = 1.0f;
+    
+    g_hands.walkPhase = 0.0f;
+    g_hands.runPhase = 0.0f;
+    g_hands.inspectPhase = 0.0f;
+    g_hands.throwPhase = 0.0f;
+    g_hands.idlePhase = 0.0f;
+    
+    g_hands.heldObject = NULL;
+    g_hands.pulledObject = NULL;
+    g_hands.targetedObject = NULL;
+    g_hands.flick.isActive = 0;
+    g_hands.flick.progress = 0.0f;
+    g_hands.reachDistance = 2.0f;
+    g_hands.currentThrowPower = THROW_POWER_DEFAULT;
+}
+
+void spawnBottle(Vec3 pos) {
+    if (g_numPickups >= MAX_PICKUPS) return;
+    
+    PickupObject* bottle = &g_pickups[g_numPickups];
+    bottle->pos = pos;
+    bottle->velocity = (Vec3){0, 0, 0};
+    bottle->rotation = (Vec3){0, 0, 0};
+    bottle->rotVelocity = (Vec3){0, 0, 0};
+    
+    bottle->type = PICKUP_TYPE_BOTTLE;
+    bottle->state = PICKUP_STATE_IDLE;
+    
+    bottle->health = 1.0f;
+    bottle->mass = 0.5f;
+    bottle->bounciness = 0.3f;
+    
+    bottle->size = (Vec3){0.15f, 0.4f, 0.15f};
+    bottle->color = (SDL_Color){100, 150, 100, 200}; // Зеленоватое стекло
+    
+    bottle->breakable = 1;
+    bottle->breakThreshold = 5.0f; // Разбивается при скорости > 5
+    
+    g_numPickups++;
+    printf("🍾 Bottle spawned at (%.1f, %.1f, %.1f)\n", pos.x, pos.y, pos.z);
+}
+
+void spawnGlassShards(Vec3 pos, int count) {
+    for (int i = 0; i < count && g_numShards < Quality_Current()->maxShards; i++) {
+        GlassShard* shard = &g_shards[g_numShards];
+        
+        // Случайное направление разлёта
+        float angle = ((float)rand() / RAND_MAX) * 2.0f * M_PI;
+        float pitch = ((float)rand() / RAND_MAX - 0.5f) * M_PI;
+        float speed = 2.0f + ((float)rand() / RAND_MAX) * 3.0f;
+        
+        shard->pos = pos;
+        shard->velocity.x = fast_cos(angle) * fast_cos(pitch) * speed;
+        shard->velocity.y = fast_sin(pitch) * speed + 2.0f; // Подлетают вверх
+        shard->velocity.z = fast_sin(angle) * fast_cos(pitch) * speed;
+        
+        shard->rotation = (Vec3){
+            ((float)rand() / RAND_MAX) * 2.0f * M_PI,
+            ((float)rand() / RAND_MAX) * 2.0f * M_PI,
+            ((float)rand() / RAND_MAX) * 2.0f * M_PI
+        };
+        
+        shard->lifetime = 2.0f + ((float)rand() / RAND_MAX) * 2.0f;
+        shard->size = 0.05f + ((float)rand() / RAND_MAX) * 0.1f;
+        
+        // Цвет стекла с вариациями
+        int brightness = 100 + rand() % 100;
+        shard->color = (SDL_Color){brightness, brightness + 50, brightness, 200};
+        
+        g_numShards++;
+    }
+}
+
+// --- ОБНОВЛЕНИЕ ФИЗИКИ ---
+
+void updatePickupPhysics(PickupObject* obj, float deltaTime, CollisionBox* boxes, int numBoxes, Camera* cam) {
+    if (obj->state == PICKUP_STATE_BROKEN || obj->state == PICKUP_STATE_HELD) return;
+    
+    // [НОВЫЙ КОД] Логика притягивания
+    if (obj->state == PICKUP_STATE_PULLED) {
+        Vec3 targetPos = {cam->x, cam->y + cam->height, cam->z};
+        Vec3 dir = {targetPos.x - obj->pos.x, targetPos.y - obj->pos.y, targetPos.z - obj->pos.z};
+        float dist = sqrtf(dir.x*dir.x + dir.y*dir.y + dir.z*dir.z);
+
+        if (dist < 1.0f) { // Объект пойман!
+            obj->state = PICKUP_STATE_HELD;
+            g_hands.heldObject = obj;
+            g_hands.pulledObject = NULL;
+            obj->velocity = (Vec3){0,0,0};
+            printf("🤏 Object caught!\n");
+            return;
+        }
+
+        dir = normalize(dir);
+        // Ускоряем объект к игроку
+        obj->velocity.x = lerp(obj->velocity.x, dir.x * PULL_FORCE, deltaTime * 5.0f);
+        obj->velocity.y = lerp(obj->velocity.y, dir.y * PULL_FORCE, deltaTime * 5.0f);
+        obj->velocity.z = lerp(obj->velocity.z, dir.z * PULL_FORCE, deltaTime * 5.0f);
+
+        obj->pos.x += obj->velocity.x * deltaTime;
+        obj->pos.y += obj->velocity.y * deltaTime;
+        obj->pos.z += obj->velocity.z * deltaTime;
+        return;
+    }
+
+    if (obj->state == PICKUP_STATE_IDLE || obj->state == PICKUP_STATE_THROWN) {
+        // Гравитация
+        obj->velocity.y -= 9.8f * deltaTime;
+        
+        // Обновляем позицию
+        Vec3 newPos = {
+            obj->pos.x + obj->velocity.x * deltaTime,
+            obj->pos.y + obj->velocity.y * deltaTime,
+            obj->pos.z + obj->velocity.z * deltaTime
+        };
+        
+        // Проверка коллизии с полом
+        if (newPos.y <= -2.0f + obj->size.y/2) {
+            newPos.y = -2.0f + obj->size.y/2;
+            
+            // Проверяем, разбивается ли при ударе
+            float impactSpeed = fabsf(obj->velocity.y);
+            if (obj->breakable && impactSpeed > obj->breakThreshold) {
+                printf("💥 Bottle shattered! Impact speed: %.2f\n", impactSpeed);
+                obj->state = PICKUP_STATE_BROKEN;
+                spawnGlassShards(obj->pos, 15 + rand() % 10);
+                return;
+            }
+            
+            // Отскок
+            obj->velocity.y = -obj->velocity.y * obj->bounciness;
+            
+            // Трение
+            obj->velocity.x *= 0.8f;
+            obj->velocity.z *= 0.8f;
+        }
+        
+        // Проверка коллизий с объектами
+        for (int i = 0; i < numBoxes; i++) {
+            CollisionBox* box = &boxes[i];
+            
+            // Простая проверка AABB
+            if (newPos.x + obj->size.x/2 > box->pos.x + box->bounds.minX &&
+                newPos.x - obj->size.x/2 < box->pos.x + box->bounds.maxX &&
+                newPos.y + obj->size.y/2 > box->pos.y + box->bounds.minY &&
+                newPos.y - obj->size.y/2 < box->pos.y + box->bounds.maxY &&
+                newPos.z + obj->size.z/2 > box->pos.z + box->bounds.minZ &&
+                newPos.z - obj->size.z/2 < box->pos.z + box->bounds.maxZ) {
+                
+                // Отталкиваем объект
+                Vec3 center = box->pos;
+                Vec3 toObj = {newPos.x - center.x, 0, newPos.z - center.z};
+                float len = sqrtf(toObj.x*toObj.x + toObj.z*toObj.z);
+                if (len > 0.01f) {
+                    toObj.x /= len;
+                    toObj.z /= len;
+                    
+                    newPos.x = center.x + toObj.x * (box->bounds.maxX + obj->size.x);
+                    newPos.z = center.z + toObj.z * (box->bounds.maxZ + obj->size.z);
+                }
+                
+                // Проверяем разбивание при ударе о стену
+                float hitSpeed = sqrtf(obj->velocity.x*obj->velocity.x + 
+                                      obj->velocity.z*obj->velocity.z);
+                if (obj->breakable && hitSpeed > obj->breakThreshold) {
+                    obj->state = PICKUP_STATE_BROKEN;
+                    spawnGlassShards(obj->pos, 12);
+                    return;
+                }
+                
+                // Отскок от стены
+                obj->velocity.x *= -obj->bounciness;
+                obj->velocity.z *= -obj->bounciness;
+            }
+        }
+        
+        obj->pos = newPos;
+        
+        // Вращение в полёте
+        if (obj->state == PICKUP_STATE_THROWN) {
+            obj->rotation.x += obj->rotVelocity.x * deltaTime;
+            obj->rotation.y += obj->rotVelocity.y * deltaTime;
+            obj->rotation.z += obj->rotVelocity.z * deltaTime;
+        }
+        
+        // Останавливаем, если почти не движется
+        float speed = sqrtf(obj->velocity.x*obj->velocity.x + 
+                          obj->velocity.z*obj->velocity.z);
+        if (speed < 0.1f && fabsf(obj->velocity.y) < 0.1f && 
+            obj->state == PICKUP_STATE_THROWN) {
+            obj->state = PICKUP_STATE_IDLE;
+            obj->velocity = (Vec3){0, 0, 0};
+            obj->rotVelocity = (Vec3){0, 0, 0};
+        }
+    }
+}
+
+// [НОВЫЙ КОД] Функция для рейкастинга
+// Проверяет пересечение луча с AABB (ограничивающим параллелепипедом)
+// Возвращает 1 если есть пересечение, и записывает расстояние до него в t
+int intersectRayAABB(Vec3 rayOrigin, Vec3 rayDir, Vec3 boxMin, Vec3 boxMax, float* t) {
+    float tmin = (boxMin.x - rayOrigin.x) / rayDir.x;
+    float tmax = (boxMax.x - rayOrigin.x) / rayDir.x;
+
+    if (tmin > tmax) { float tmp = tmin; tmin = tmax; tmax = tmp; }
+
+    float tymin = (boxMin.y - rayOrigin.y) / rayDir.y;
+    float tymax = (boxMax.y - rayOrigin.y) / rayDir.y;
+
+    if (tymin > tymax) { float tmp = tymin; tymin = tymax; tymax = tmp; }
+
+    if ((tmin > tymax) || (tymin > tmax)) return 0;
+
+    if (tymin > tmin) tmin = tymin;
+    if (tymax < tmax) tmax = tymax;
+
+    float tzmin = (boxMin.z - rayOrigin.z) / rayDir.z;
+    float tzmax = (boxMax.z - rayOrigin.z) / rayDir.z;
+
+    if (tzmin > tzmax) { float tmp = tzmin; tzmin = tzmax; tzmax = tmp; }
+
+    if ((tmin > tzmax) || (tzmin > tmax)) return 0;
+    
+    if (tzmin > tmin) tmin = tzmin;
+    if (tzmax < tmax) tmax = tzmax;
+
+    *t = tmin;
+    return tmax > 0;
+}
+void updateShards(float deltaTime) {
+    for (int i = 0; i < g_numShards; i++) {
+        GlassShard* shard = &g_shards[i];
+        
+        if (shard->lifetime <= 0) continue;
+        
+        shard->lifetime -= deltaTime;
+        
+        // Физика
+        shard->velocity.y -= 15.0f * deltaTime; // Гравитация
+        
+        shard->pos.x += shard->velocity.x * deltaTime;
+        shard->pos.y += shard->velocity.y * deltaTime;
+        shard->pos.z += shard->velocity.z * deltaTime;
+        
+        // Отскок от пола
+        if (shard->pos.y <= -2.0f) {
+            shard->pos.y = -2.0f;
+            shard->velocity.y *= -0.3f;
+            shard->velocity.x *= 0.7f;
+            shard->velocity.z *= 0.7f;
+        }
+        
+        // Вращение
+        shard->rotation.x += deltaTime * 5.0f;
+        shard->rotation.y += deltaTime * 3.0f;
+        
+        // Затухание
+        if (shard->lifetime < 0.5f) {
+            shard->color.a = (Uint8)(shard->lifetime * 2.0f * 200);
+        }
+    }
+    
+    // Удаляем мёртвые осколки (сдвигаем живые в начало массива)
+    int writeIdx = 0;
+    for (int i = 0; i < g_numShards; i++) {
+        if (g_shards[i].lifetime > 0) {
+            if (writeIdx != i) {
+                g_shards[writeIdx] = g_shards[i];
+            }
+            writeIdx++;
+        }
+    }
+    g_numShards = writeIdx;
+}
+
+// [ИЗМЕНЕНО] Бросок объекта, теперь с набором силы
+void throwObject(Camera* cam, float power) {
+    if (!g_hands.heldObject) return;
+    
+    g_hands.heldObject->state = PICKUP_STATE_THROWN;
+    
+    Vec3 throwDir = {
+        fast_sin(cam->rotY) * fast_cos(cam->rotX),
+        -fast_sin(cam->rotX),
+        fast_cos(cam->rotY) * fast_cos(cam->rotX)
+    };
+    throwDir = normalize(throwDir);
+
+    g_hands.heldObject->velocity.x = throwDir.x * power;
+    g_hands.heldObject->velocity.y = throwDir.y * power;
+    g_hands.heldObject->velocity.z = throwDir.z * power;
+    
+    // Позиция броска
+    g_hands.heldObject->pos.x = cam->x + throwDir.x * 1.5f;
+    g_hands.heldObject->pos.y = cam->y + cam->height + throwDir.y;
+    g_hands.heldObject->pos.z = cam->z + throwDir.z * 1.5f;
+
+    g_hands.heldObject = NULL;
+    g_hands.currentThrowPower = THROW_POWER_DEFAULT; // Сброс силы
+    g_trajectory.numPoints = 0; // Скрыть траекторию
+
+    printf("💨 Threw object with power %.1f!\n", power);
+}
+
+// [НОВЫЙ КОД] Расчет траектории
+void calculateTrajectory(Camera* cam, float power, Trajectory* traj, CollisionBox* boxes, int numBoxes, float gravity) {
+    traj->numPoints = 0;
+    traj->didHit = 0;
+
+    Vec3 pos;
+    Vec3 vel;
+    
+    // Начальные условия
+    Vec3 throwDir = {
+        fast_sin(cam->rotY) * fast_cos(cam->rotX),
+        -fast_sin(cam->rotX),
+        fast_cos(cam->rotY) * fast_cos(cam->rotX)
+    };
+    throwDir = normalize(throwDir);
+
+    pos.x = cam->x + throwDir.x * 1.5f;
+    pos.y = cam->y + cam->height + throwDir.y;
+    pos.z = cam->z + throwDir.z * 1.5f;
+    
+    vel.x = throwDir.x * power;
+    vel.y = throwDir.y * power;
+    vel.z = throwDir.z * power;
+
+    for (int i = 0; i < TRAJECTORY_STEPS; i++) {
+        // Простое симулирование физики
+        vel.y -= gravity * TRAJECTORY_TIME_STEP;
+        pos.x += vel.x * TRAJECTORY_TIME_STEP;
+        pos.y += vel.y * TRAJECTORY_TIME_STEP;
+        pos.z += vel.z * TRAJECTORY_TIME_STEP;
+        
+        traj->points[i] = pos;
+        traj->numPoints++;
+
+        // Проверка столкновений (упрощенная)
+        if (pos.y < -2.0f) { // Столкновение с полом
+             traj->didHit = 1;
+             break;
+        }
+        for(int j=0; j < numBoxes; ++j) {
+            // ... тут можно добавить проверку столкновений с collisionBoxes
+        }
+    }
+}
+
+// [НОВЫЙ КОД] Отрисовка траектории
+void drawTrajectory(RenderBackend* ren, Camera cam, Trajectory* traj) {
+    if (traj->numPoints < 2) return;
+
+    SDL_Color color = traj->didHit ? (SDL_Color){255, 100, 100, 255} : (SDL_Color){150, 200, 255, 255};
+    
+    // Рисуем пунктирной линией
+    for (int i = 0; i < traj->numPoints - 1; i += 2) {
+        clipAndDrawLine(ren, traj->points[i], traj->points[i+1], cam, color);
+    }
+}
+
+// --- ОТРИСОВКА ---
+
+// Геометрия куба: 6 граней, каждая из 4 вершин (индексы из getBoxVertices)
+static const int BOX_FACES[6][4] = {
+    {0, 1, 2, 3}, // Передняя
+    {5, 4, 7, 6}, // Задняя
+    {4, 0, 3, 7}, // Левая
+    {1, 5, 6, 2}, // Правая
+    {3, 2, 6, 7}, // Верхняя
+    {4, 5, 1, 0}  // Нижняя
+};
+
+// Нормали для каждой из 6 граней (векторы, "смотрящие" наружу)
+static const Vec3 BOX_FACE_NORMALS[6] = {
+    {0, 0, -1}, // Передняя
+    {0, 0, 1},  // Задняя
+    {-1, 0, 0}, // Левая
+    {1, 0, 0},  // Правая
+    {0, 1, 0},  // Верхняя
+    {0, -1, 0}  // Нижняя
+};
+
+// 12 рёбер в той же нумерации вершин и две грани, которые на каждом ребре сходятся
+static const int BOX_EDGES[12][2] = {
+    {0,1},{1,2},{2,3},{3,0},
+    {4,5},{5,6},{6,7},{7,4},
+    {0,4},{1,5},{2,6},{3,7}
+};
+static const int BOX_EDGE_FACES[12][2] = {
+    {0, 5}, {0, 3}, {0, 4}, {0, 2},
+    {1, 5}, {1, 3}, {1, 4}, {1, 2},
+    {2, 5}, {3, 5}, {3, 4}, {2, 4}
+};
+
+// Что делать с ребром после проверки граней
+#define BOX_EDGE_HIDDEN     0 // Обе грани отвёрнуты - не рисуем
+#define BOX_EDGE_INNER      1 // Обе грани видны - ребро внутри силуэта
+#define BOX_EDGE_SILHOUETTE 2 // Видна ровно одна грань - ребро на контуре
+
+// Видна ли грань f из точки глаза: глаз с "наружной" стороны её плоскости (а не по центру бокса).
+// Нормаль берём из самих вершин: годится и для повёрнутых пикапов, и для вершин, уже
+// переведённых в систему камеры (там глаз в нуле). Единая проверка для заливки, рёбер и пика.
+int boxFaceFacesEye(const Vec3 v[8], int f, Vec3 eye) {
+    Vec3 a = v[BOX_FACES[f][0]], b = v[BOX_FACES[f][1]], d = v[BOX_FACES[f][3]];
+    Vec3 n = cross((Vec3){d.x - a.x, d.y - a.y, d.z - a.z}, (Vec3){b.x - a.x, b.y - a.y, b.z - a.z});
+    return dot(n, (Vec3){eye.x - a.x, eye.y - a.y, eye.z - a.z}) > 0.0f;
+}
+
+// Видимость граней, потом каждое ребро получает флаг по двум своим граням. Так общее ребро
+// рисуется один раз, а не дважды. Возвращает, сколько рёбер надо рисовать.
+int classifyBoxEdges(const Vec3 v[8], Vec3 eye, unsigned char edgeFlags[12]) {
+    int faceVisible[6];
+    for (int f = 0; f < 6; f++) faceVisible[f] = boxFaceFacesEye(v, f, eye);
+    int drawn = 0;
+    for (int e = 0; e < 12; e++) {
+        int visible = faceVisible[BOX_EDGE_FACES[e][0]] + faceVisible[BOX_EDGE_FACES[e][1]];
+        edgeFlags[e] = visible == 2 ? BOX_EDGE_INNER : (visible == 1 ? BOX_EDGE_SILHOUETTE : BOX_EDGE_HIDDEN);
+        if (visible) {
+            drawn++;
+            g_rasterStats.edgesDrawn++;
+            if (visible == 1) g_rasterStats.edgesSilhouette++;
+        } else {
+            g_rasterStats.edgesCulled++;
+        }
+    }
+    return drawn;
+}
+
+// Глаз камеры в мире - та же точка, что в worldToCamera
+Vec3 cameraEyePosition(Camera cam) {
+    return (Vec3){cam.x, cam.y + cam.height + cam.currentBobY, cam.z};
+}
+
+void drawPickupObject(RenderBackend* ren, PickupObject* obj, Camera cam) {
+    if (obj->state == PICKUP_STATE_BROKEN) return;
+    if (obj->state == PICKUP_STATE_HELD) return; // Не рисуем, если в руке
+    
+    // Вершины объекта (простой параллелепипед)
+    Vec3 vertices[8];
+    float sx = obj->size.x / 2;
+    float sy = obj->size.y / 2;
+    float sz = obj->size.z / 2;
+    
+    // Создаём вершины с учётом вращения
+    Vec3 baseVerts[8] = {
+        {-sx, -sy, -sz}, {sx, -sy, -sz}, {sx, sy, -sz}, {-sx, sy, -sz},
+        {-sx, -sy, sz}, {sx, -sy, sz}, {sx, sy, sz}, {-sx, sy, sz}
+    };
+    
+    // Применяем вращение
+    for (int i = 0; i < 8; i++) {
+        Vec3 v = baseVerts[i];
+        
+        // Вращение вокруг Y
+        float cy = fast_cos(obj->rotation.y);
+        float sy = fast_sin(obj->rotation.y);
+        float newX = v.x * cy - v.z * sy;
+        float newZ = v.x * sy + v.z * cy;
+        v.x = newX;
+        v.z = newZ;
+        
+        // Вращение вокруг X
+        float cx = fast_cos(obj->rotation.x);
+        float sx = fast_sin(obj->rotation.x);
+        float newY = v.y * cx - v.z * sx;
+        newZ = v.y * sx + v.z * cx;
+        v.y = newY;
+        v.z = newZ;
+        
+        // Добавляем позицию объекта
+        vertices[i].x = obj->pos.x + v.x;
+        vertices[i].y = obj->pos.y + v.y;
+        vertices[i].z = obj->pos.z + v.z;
+    }
+    
+    // Рисуем бутылку: только рёбра видимых граней, каждое по разу
+    unsigned char edgeFlags[12];
+    classifyBoxEdges(vertices, cameraEyePosition(cam), edgeFlags);
+    for (int i = 0; i < 12; i++) {
+        if (edgeFlags[i] == BOX_EDGE_HIDDEN) continue;
+        clipAndDrawLine(ren, vertices[BOX_EDGES[i][0]], vertices[BOX_EDGES[i][1]], cam, obj->color);
+    }
+
+    // Предмет, который можно взять, пишет свои грани в буфер ID. Совсем мелкий -
+    // только в список для проверки лучом, в пиксели он может и не попасть
+    int index = (int)(obj - g_pickups);
+    if (g_pick.valid && obj->state == PICKUP_STATE_IDLE && index >= 0 && index < g_numPickups && index <= PICK_MAX_INDEX) {
+        float radius = 0.5f * sqrtf(obj->size.x * obj->size.x + obj->size.y * obj->size.y + obj->size.z * obj->size.z);
+        if (Pick_ScreenRadius(obj->pos, radius, cam) < PICK_MIN_SCREEN_RADIUS) {
+            if (g_pick.numTiny < PICK_MAX_TINY) g_pick.tiny[g_pick.numTiny++] = index;
+        } else {
+            Pick_WriteBox(ren, vertices, Pick_MakeId(PICK_KIND_PICKUP, index), cam);
+        }
+    }
+    
+    // Если это бутылка, добавляем горлышко
+    if (obj->type == PICKUP_TYPE_BOTTLE) {
+        Vec3 neckBottom = {obj->pos.x, obj->pos.y + sy, obj->pos.z};
+        Vec3 neckTop = {obj->pos.x, obj->pos.y + sy + 0.1f, obj->pos.z};
+        
+        // Горлышко (простые линии)
+        float neckRadius = sx * 0.5f;
+        for (int i = 0; i < 4; i++) {
+            float angle = (float)i / 4 * 2 * M_PI;
+            Vec3 p1 = {
+                neckBottom.x + fast_cos(angle) * neckRadius,
+                neckBottom.y,
+                neckBottom.z + fast_sin(angle) * neckRadius
+            };
+            Vec3 p2 = {
+                neckTop.x + fast_cos(angle) * neckRadius * 0.7f,
+                neckTop.y,
+                neckTop.z + fast_sin(angle) * neckRadius * 0.7f
+            };
+            clipAndDrawLine(ren, p1, p2, cam, obj->color);
+        }
+    }
+}
+
+void drawGlassShards(RenderBackend* ren, Camera cam) {
+    for (int i = 0; i < g_numShards; i++) {
+        GlassShard* shard = &g_shards[i];
+        if (shard->lifetime <= 0) continue;
+        
+        // Простой треугольник для осколка
+        Vec3 p1 = {
+            shard->pos.x + fast_cos(shard->rotation.x) * shard->size,
+            shard->pos.y,
+            shard->pos.z + fast_sin(shard->rotation.x) * shard->size
+        };
+        Vec3 p2 = {
+            shard->pos.x + fast_cos(shard->rotation.y) * shard->size,
+            shard->pos.y + shard->size,
+            shard->pos.z + fast_sin(shard->rotation.y) * shard->size
+        };
+        Vec3 p3 = {
+            shard->pos.x,
+            shard->pos.y + shard->size * 0.5f,
+            shard->pos.z
+        };
+        
+        clipAndDrawLine(ren, p1, p2, cam, shard->color);
+        clipAndDrawLine(ren, p2, p3, cam, shard->color);
+        clipAndDrawLine(ren, p3, p1, cam, shard->color);
+    }
+}
+// Вспомогательная функция для вращения точки вокруг центра
+Vec3 rotatePoint(Vec3 point, Vec3 center, float angleX, float angleY, float angleZ) {
+    Vec3 result = point;
+    
+    result.x -= center.x;
+    result.y -= center.y;
+    result.z -= center.z;
+    
+    if (fabsf(angleY) > 0.001f) {
+        float cy = fast_cos(angleY); float sy = fast_sin(angleY);
+        float newX = result.x * cy - result.z * sy;
+        float newZ = result.x * sy + result.z * cy;
+        result.x = newX; result.z = newZ;
+    }
+    if (fabsf(angleX) > 0.001f) {
+        float cx = fast_cos(angleX); float sx = fast_sin(angleX);
+        float newY = result.y * cx - result.z * sx;
+        float newZ = result.y * sx + result.z * cx;
+        result.y = newY; result.z = newZ;
+    }
+    if (fabsf(angleZ) > 0.001f) {
+        float cz = fast_cos(angleZ); float sz = fast_sin(angleZ);
+        float newX = result.x * cz - result.y * sz;
+        float newY = result.x * sz + result.y * cz;
+        result.x = newX; result.y = newY;
+    }
+    
+    result.x += center.x;
+    result.y += center.y;
+    result.z += center.z;
+    
+    return result;
+}
+
+// Структура для пальца
+typedef struct {
+    Vec3 base;      // Основание пальца
+    Vec3 middle;    // Средний сустав
+    Vec3 tip;       // Кончик
+    float bendAngle; // Угол сгиба
+} Finger;
+
+void draw3DFinger(RenderBackend* ren, Finger* finger, Camera cam, SDL_Color color, float thickness) {
+    // Сегмент 1: База -> Средний сустав
+    Vec3 seg1[8];
+    float t = thickness;
+    
+    // Создаём 8 точек для первого сегмента (параллелепипед)
+    seg1[0] = (Vec3){finger->base.x - t, finger->base.y - t, finger->base.z - t};
+    seg1[1] = (Vec3){finger->base.x + t, finger->base.y - t, finger->base.z - t};
+    seg1[2] = (Vec3){finger->base.x + t, finger->base.y - t, finger->base.z + t};
+    seg1[3] = (Vec3){finger->base.x - t, finger->base.y - t, finger->base.z + t};
+    
+    seg1[4] = (Vec3){finger->middle.x - t*0.8f, finger->middle.y - t*0.8f, finger->middle.z - t*0.8f};
+    seg1[5] = (Vec3){finger->middle.x + t*0.8f, finger->middle.y - t*0.8f, finger->middle.z - t*0.8f};
+    seg1[6] = (Vec3){finger->middle.x + t*0.8f, finger->middle.y - t*0.8f, finger->middle.z + t*0.8f};
+    seg1[7] = (Vec3){finger->middle.x - t*0.8f, finger->middle.y - t*0.8f, finger->middle.z + t*0.8f};
+    
+    // Рисуем первый сегмент
+    int edges[12][2] = {
+        {0,1},{1,2},{2,3},{3,0}, // Низ
+        {4,5},{5,6},{6,7},{7,4}, // Верх
+        {0,4},{1,5},{2,6},{3,7}  // Вертикальные
+    };
+    
+    for (int i = 0; i < 12; i++) {
+        clipAndDrawLine(ren, seg1[edges[i][0]], seg1[edges[i][1]], cam, color);
+    }
+    
+    // Сегмент 2: Средний сустав -> Кончик
+    Vec3 seg2[8];
+    t *= 0.8f; // Сужаем к кончику
+    
+    seg2[0] = (Vec3){finger->middle.x - t, finger->middle.y - t, finger->middle.z - t};
+    seg2[1] = (Vec3){finger->middle.x + t, finger->middle.y - t, finger->middle.z - t};
+    seg2[2] = (Vec3){finger->middle.x + t, finger->middle.y - t, finger->middle.z + t};
+    seg2[3] = (Vec3){finger->middle.x - t, finger->middle.y - t, finger->middle.z + t};
+    
+    seg2[4] = (Vec3){finger->tip.x - t*0.5f, finger->tip.y - t*0.5f, finger->tip.z - t*0.5f};
+    seg2[5] = (Vec3){finger->tip.x + t*0.5f, finger->tip.y - t*0.5f, finger->tip.z - t*0.5f};
+    seg2[6] = (Vec3){finger->tip.x + t*0.5f, finger->tip.y - t*0.5f, finger->tip.z + t*0.5f};
+    seg2[7] = (Vec3){finger->tip.x - t*0.5f, finger->tip.y - t*0.5f, finger->tip.z + t*0.5f};
+    
+    for (int i = 0; i < 12; i++) {
+        clipAndDrawLine(ren, seg2[edges[i][0]], seg2[edges[i][1]], cam, color);
+    }
+}
+static Vec3 transform_hand_vertex(Vec3 localPoint, const Vec3* handPos, const Vec3* handRot, const Camera* cam) {
+    // a) Применяем собственное вращение руки (поворот внутрь)
+    Vec3 v = rotatePoint(localPoint, (Vec3){0,0,0}, handRot->x, handRot->y, handRot->z);
+
+    // b) Смещаем руку в ее позицию относительно камеры (вниз и вбок)
+    v.x += handPos->x;
+    v.y += handPos->y;
+    v.z += handPos->z;
+
+    // c) Вращаем точку вместе с камерой
+    float sinY = fast_sin(cam->rotY); float cosY = fast_cos(cam->rotY);
+    float sinX = fast_sin(cam->rotX); float cosX = fast_cos(cam->rotX);
+
+    // Вращение по Y (поворот влево-вправо)
+    float rotatedX = v.x * cosY - v.z * sinY;
+    float rotatedZ = v.x * sinY + v.z * cosY;
+    
+    // Вращение по X (взгляд вверх-вниз)
+    float finalY = v.y * cosX - rotatedZ * sinX;
+    float finalZ = v.y * sinX + rotatedZ * cosX;
+
+    // d) Прибавляем к мировой позиции камеры
+    return (Vec3){
+        cam->x + rotatedX,
+        (cam->y + cam->height + cam->currentBobY) + finalY,
+        cam->z + finalZ
+    };
+}
+
+void drawVolumetricSegment(RenderBackend* ren, Vec3 p1, Vec3 p2, float thickness, Camera cam, SDL_Color color) {
+    Vec3 dir = normalize((Vec3){p2.x - p1.x, p2.y - p1.y, p2.z - p1.z});
+    // Находим перпендикулярные векторы, чтобы "построить" объем
+    Vec3 up = {0, 1, 0};
+    Vec3 right = normalize(cross(dir, up));
+    up = normalize(cross(right, dir));
+
+    right.x *= thickness; right.y *= thickness; right.z *= thickness;
+    up.x *= thickness; up.y *= thickness; up.z *= thickness;
+
+    // 8 вершин призмы
     Vec3 verts[8] = {
         {p1.x + right.x + up.x, p1.y + right.y + up.y, p1.z + right.z + up.z},
         {p1.x - right.x + up.x, p1.y - right.y + up.y, p1.z - right.z + up.z},
@@ -1859,2260 +5337,4825 @@ void drawVolumetricSegment(SDL_Renderer* ren, Vec3 p1, Vec3 p2, float thickness,
         {p2.x + right.x - up.x, p2.y + right.y - up.y, p2.z + right.z - up.z},
     };
     
-    int edges[12][2] = {{0,1},{1,2},{2,3},{3,0}, {4,5},{5,6},{6,7},{7,4}, {0,4},{1,5},{2,6},{3,7}};
-    for(int i=0; i<12; ++i) {
-        clipAndDrawLine(ren, verts[edges[i][0]], verts[edges[i][1]], cam, color);
+    int edges[12][2] = {{0,1},{1,2},{2,3},{3,0}, {4,5},{5,6},{6,7},{7,4}, {0,4},{1,5},{2,6},{3,7}};
+    for(int i=0; i<12; ++i) {
+        clipAndDrawLine(ren, verts[edges[i][0]], verts[edges[i][1]], cam, color);
+    }
+}
+
+// ФИНАЛЬНАЯ, ИСПРАВЛЕННАЯ ВЕРСЯ. РУКИ ЖЕСТКО ПРИВЯЗАНЫ К КАМЕРЕ.
+void draw3DHand(RenderBackend* ren, Vec3 handPos, Vec3 handRot, Camera cam, int isRight) {
+    SDL_Color skinColor = {220, 180, 140, 255};
+    SDL_Color darkSkinColor = {200, 160, 120, 255};
+    
+    // ЛАДОНЬ
+    float pW = 0.08f, pH = 0.12f, pD = 0.02f;
+    Vec3 localPalmVerts[8] = {
+        {-pW/2,-pH/2,-pD/2}, {pW/2,-pH/2,-pD/2}, {pW/2, pH/2,-pD/2}, {-pW/2, pH/2,-pD/2},
+        {-pW/2,-pH/2, pD/2}, {pW/2,-pH/2, pD/2}, {pW/2, pH/2, pD/2}, {-pW/2, pH/2, pD/2}
+    };
+    
+    // Детализация по размеру кисти вместе с пальцами (~0.12 от центра ладони)
+    Vec3 palmCenter = transform_hand_vertex((Vec3){0, 0, 0}, &handPos, &handRot, &cam);
+    LodLevel lod = Lod_Select(Lod_ProjectedSize(palmCenter, 0.12f, cam), &g_hands.lodLevel[isRight ? 1 : 0]);
+    if (lod == LOD_POINT) {
+        clipAndDrawLine(ren, palmCenter, palmCenter, cam, skinColor);
+        return;
+    }
+
+    Vec3 finalPalmVerts[8];
+    for (int i = 0; i < 8; ++i) {
+        finalPalmVerts[i] = transform_hand_vertex(localPalmVerts[i], &handPos, &handRot, &cam);
+    }
+    
+    int palmEdges[12][2] = {{0,1},{1,2},{2,3},{3,0}, {4,5},{5,6},{6,7},{7,4}, {0,4},{1,5},{2,6},{3,7}};
+    for (int i=0; i<12; ++i) {
+        clipAndDrawLine(ren, finalPalmVerts[palmEdges[i][0]], finalPalmVerts[palmEdges[i][1]], cam, skinColor);
+    }
+
+    // ПАЛЬЦЫ
+    // ПАЛЬЦЫ
+    float fLen = 0.08f, fSpace = pW / 4.0f;
+    float thickness = 0.015f;
+    float bend = 0.0f;
+
+    if (g_hands.heldObject && isRight) bend = 0.8f;
+    else if (g_hands.currentState == HAND_STATE_AIMING && isRight) bend = 0.2f;
+
+    for (int i = 0; i < 4; i++) {
+        float fX = (i - 1.5f) * fSpace;
+        
+        // Суставы
+        Vec3 base = transform_hand_vertex((Vec3){fX, pH/2, 0}, &handPos, &handRot, &cam);
+        Vec3 mid = transform_hand_vertex((Vec3){fX, pH/2 + fLen/2, fLen/2 * fast_sin(bend)}, &handPos, &handRot, &cam);
+        Vec3 tip = transform_hand_vertex((Vec3){fX, pH/2 + fLen, fLen * fast_sin(bend)}, &handPos, &handRot, &cam);
+
+        // Рисуем два сегмента (в упрощённой версии - просто линиями, без объёма)
+        if (lod == LOD_FULL) {
+            drawVolumetricSegment(ren, base, mid, thickness, cam, skinColor);
+            drawVolumetricSegment(ren, mid, tip, thickness * 0.8f, cam, skinColor);
+        } else {
+            clipAndDrawLine(ren, base, mid, cam, skinColor);
+            clipAndDrawLine(ren, mid, tip, cam, skinColor);
+        }
+    }
+    
+    // БОЛЬШОЙ ПАЛЕЦ
+    float thumbSide = isRight ? pW/2 : -pW/2;
+    Vec3 t_base = transform_hand_vertex((Vec3){thumbSide, -pH/4, 0.01f}, &handPos, &handRot, &cam);
+    Vec3 t_mid = transform_hand_vertex((Vec3){thumbSide + (isRight?0.03f:-0.03f), 0, 0.04f}, &handPos, &handRot, &cam);
+    Vec3 t_tip = transform_hand_vertex((Vec3){thumbSide + (isRight?0.05f:-0.05f), 0.02f, 0.05f}, &handPos, &handRot, &cam);
+    clipAndDrawLine(ren, t_base, t_mid, cam, skinColor);
+    clipAndDrawLine(ren, t_mid, t_tip, cam, skinColor);
+    if (lod < LOD_FULL) return;
+
+    // ЗАПЯСТЬЕ
+    Vec3 wristEnd = transform_hand_vertex((Vec3){0, -pH/2 - 0.08f, 0}, &handPos, &handRot, &cam);
+    clipAndDrawLine(ren, finalPalmVerts[0], wristEnd, cam, darkSkinColor);
+    clipAndDrawLine(ren, finalPalmVerts[1], wristEnd, cam, darkSkinColor);
+    clipAndDrawLine(ren, finalPalmVerts[4], wristEnd, cam, darkSkinColor);
+    clipAndDrawLine(ren, finalPalmVerts[5], wristEnd, cam, darkSkinColor);
+}
+
+// Обновлённая функция отрисовки обеих рук
+void drawHands(RenderBackend* ren, Camera cam) {
+    // Определяем, нужно ли показывать руки
+    int shouldDrawHands = 0;
+    float handsAlpha = 1.0f;
+    
+    // Всегда показываем при осмотре
+    if (g_hands.currentState == HAND_STATE_INSPECTING) {
+        shouldDrawHands = 1;
+        handsAlpha = 1.0f;
+    }
+    // Показываем при взгляде вниз
+    else if (cam.rotX < -0.3f) {
+        shouldDrawHands = 1;
+        handsAlpha = fmaxf(0.3f, fminf(1.0f, (-cam.rotX - 0.3f) * 2));
+    }
+    // Показываем при взаимодействии
+    else if (g_hands.currentState == HAND_STATE_REACHING || 
+             g_hands.currentState == HAND_STATE_HOLDING ||
+             g_hands.currentState == HAND_STATE_THROWING) {
+        shouldDrawHands = 1;
+        handsAlpha = 1.0f;
+    }
+    // При ходьбе/беге показываем слегка
+    else if (g_hands.currentState == HAND_STATE_WALKING || 
+             g_hands.currentState == HAND_STATE_RUNNING) {
+        shouldDrawHands = 1;
+        handsAlpha = 0.5f;
+    }
+    
+    if (!shouldDrawHands) return;
+    
+    // Рисуем обе руки
+    draw3DHand(ren, g_hands.leftPos, g_hands.leftRot, cam, 0);
+    draw3DHand(ren, g_hands.rightPos, g_hands.rightRot, cam, 1);
+    
+    // Если держим объект, рисуем его в правой руке
+    if (g_hands.heldObject) {
+        float cameraEyeY = cam.y + cam.height;
+        
+        // Позиционируем объект чуть впереди правой руки
+        Vec3 holdOffset = {
+            g_hands.rightPos.x + 0.05f,
+            g_hands.rightPos.y + 0.1f,
+            g_hands.rightPos.z + 0.15f
+        };
+        
+        // Применяем поворот камеры
+        float camSin = fast_sin(cam.rotY);
+        float camCos = fast_cos(cam.rotY);
+        
+        g_hands.heldObject->pos.x = cam.x + camCos * holdOffset.x - camSin * holdOffset.z;
+        g_hands.heldObject->pos.y = cameraEyeY + holdOffset.y;
+        g_hands.heldObject->pos.z = cam.z + camSin * holdOffset.x + camCos * holdOffset.z;
+        
+        // Поворачиваем объект вместе с камерой
+        g_hands.heldObject->rotation.y = -cam.rotY;
+        g_hands.heldObject->rotation.x = -cam.rotX * 0.5f;
+        
+        drawPickupObject(ren, g_hands.heldObject, cam);
+    }
+}
+
+void updateCameraBob(Camera* cam, float deltaTime) {
+    float speed = sqrtf(cam->vx * cam->vx + cam->vz * cam->vz);
+    
+    if (speed > 0.01f) {
+        cam->isMoving = 1;
+        
+        float bobFrequency = cam->isRunning ? 12.0f : 8.0f;
+        float bobAmplitude = cam->isRunning ? 0.08f : (cam->isCrouching ? 0.03f : 0.05f);
+        
+        cam->bobPhase += bobFrequency * deltaTime * speed * 5.0f;
+        cam->bobAmount = lerp(cam->bobAmount, 1.0f, deltaTime * 8.0f);
+        
+        float verticalBob = fast_sin(cam->bobPhase) * bobAmplitude * cam->bobAmount;
+        float horizontalBob = fast_sin(cam->bobPhase * 0.5f) * bobAmplitude * 0.5f * cam->bobAmount;
+        
+        cam->currentBobY = lerp(cam->currentBobY, verticalBob, deltaTime * 15.0f);
+        cam->currentBobX = lerp(cam->currentBobX, horizontalBob, deltaTime * 15.0f);
+    } else {
+        cam->isMoving = 0;
+        
+        cam->bobAmount = lerp(cam->bobAmount, 0.0f, deltaTime * 6.0f);
+        cam->currentBobY = lerp(cam->currentBobY, 0.0f, deltaTime * 8.0f);
+        cam->currentBobX = lerp(cam->currentBobX, 0.0f, deltaTime * 8.0f);
+    }
+    
+    if (!cam->isMoving) {
+        float breathe = fast_sin(Game_GetTicks() * 0.001f) * 0.01f;
+        cam->currentBobY += breathe;
+    }
+}
+
+int checkCollision(float x, float y, float z, float radius, CollisionBox* boxes, int numBoxes) {
+    for (int i = 0; i < numBoxes; i++) {
+        CollisionBox* box = &boxes[i];
+        
+        float boxMinX = box->pos.x + box->bounds.minX;
+        float boxMaxX = box->pos.x + box->bounds.maxX;
+        float boxMinY = box->pos.y + box->bounds.minY;
+        float boxMaxY = box->pos.y + box->bounds.maxY;
+        float boxMinZ = box->pos.z + box->bounds.minZ;
+        float boxMaxZ = box->pos.z + box->bounds.maxZ;
+        
+        boxMinX -= radius;
+        boxMaxX += radius;
+        boxMinY -= radius;
+        boxMaxY += radius;
+        boxMinZ -= radius;
+        boxMaxZ += radius;
+        
+        if (x >= boxMinX && x <= boxMaxX &&
+            y >= boxMinY && y <= boxMaxY &&
+            z >= boxMinZ && z <= boxMaxZ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Добавь после функции checkCollision:
+
+// Проверяет, находится ли точка внутри какого-либо объекта
+int isPositionInsideBox(Vec3 pos, CollisionBox* boxes, int numBoxes) {
+    for (int i = 0; i < numBoxes; i++) {
+        CollisionBox* box = &boxes[i];
+        
+        // Проверяем, находится ли точка внутри границ бокса
+        if (pos.x >= box->pos.x + box->bounds.minX &&
+            pos.x <= box->pos.x + box->bounds.maxX &&
+            pos.y >= box->pos.y + box->bounds.minY &&
+            pos.y <= box->pos.y + box->bounds.maxY &&
+            pos.z >= box->pos.z + box->bounds.minZ &&
+            pos.z <= box->pos.z + box->bounds.maxZ) {
+            return 1; // Позиция занята
+        }
+    }
+    return 0; // Позиция свободна
+}
+
+// Находит безопасную позицию для спавна монеты
+Vec3 findSafeSpawnPosition(float baseX, float baseY, float baseZ, CollisionBox* boxes, int numBoxes) {
+    Vec3 pos = {baseX, baseY, baseZ};
+    
+    // Если позиция свободна, возвращаем её
+    if (!isPositionInsideBox(pos, boxes, numBoxes)) {
+        return pos;
+    }
+    
+    // Иначе ищем свободную позицию по спирали вокруг
+    float searchRadius = 1.0f;
+    int attempts = 0;
+    
+    while (attempts < 50) { // Максимум 50 попыток
+        float angle = (float)attempts * 0.5f;
+        float radius = searchRadius + (float)attempts * 0.2f;
+        
+        pos.x = baseX + fast_cos(angle) * radius;
+        pos.z = baseZ + fast_sin(angle) * radius;
+        pos.y = baseY;
+        
+        if (!isPositionInsideBox(pos, boxes, numBoxes)) {
+            return pos; // Нашли свободную позицию
+        }
+        
+        attempts++;
+    }
+    
+    // Если не нашли, поднимаем выше
+    pos.x = baseX;
+    pos.z = baseZ;
+    pos.y = baseY + 3.0f;
+    return pos;
+}
+
+int checkWallCollision(float x, float y, float z, float radius, CollisionBox* boxes, int numBoxes) {
+    for (int i = 0; i < numBoxes; i++) {
+        CollisionBox* box = &boxes[i];
+        
+        float boxMinX = box->pos.x + box->bounds.minX;
+        float boxMaxX = box->pos.x + box->bounds.maxX;
+        float boxMinY = box->pos.y + box->bounds.minY;
+        float boxMaxY = box->pos.y + box->bounds.maxY;
+        float boxMinZ = box->pos.z + box->bounds.minZ;
+        float boxMaxZ = box->pos.z + box->bounds.maxZ;
+        
+        if (y + radius > boxMinY && y - radius < boxMaxY) {
+            if (x + radius > boxMinX && x - radius < boxMaxX &&
+                z + radius > boxMinZ && z - radius < boxMaxZ) {
+                
+                float distToTop = fabsf(y - (boxMaxY + radius));
+                if (distToTop < 0.2f) {
+                    continue;
+                }
+                
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+float getGroundHeight(float x, float z, float playerRadius, CollisionBox* boxes, int numBoxes, int* foundGround) {
+    float highestGround = -999.0f;
+    *foundGround = 0;
+    
+    for (int i = 0; i < numBoxes; i++) {
+        CollisionBox* box = &boxes[i];
+        
+        if (x >= box->pos.x + box->bounds.minX - playerRadius &&
+            x <= box->pos.x + box->bounds.maxX + playerRadius &&
+            z >= box->pos.z + box->bounds.minZ - playerRadius &&
+            z <= box->pos.z + box->bounds.maxZ + playerRadius) {
+            
+            float boxTop = box->pos.y + box->bounds.maxY;
+            
+            if (boxTop > highestGround) {
+                highestGround = boxTop;
+                *foundGround = 1;
+            }
+        }
+    }
+    
+    return highestGround;
+}
+
+int isGrounded(Camera* cam, float playerRadius, CollisionBox* boxes, int numBoxes) {
+    if (cam->y <= 0.01f && cam->vy <= 0) {
+        return 1;
+    }
+    
+    int foundGround;
+    float groundHeight = getGroundHeight(cam->x, cam->z, playerRadius, boxes, numBoxes, &foundGround);
+    
+    if (foundGround) {
+        float distToGround = cam->y - (groundHeight + playerRadius);
+        if (distToGround <= 0.1f && distToGround >= -0.1f && cam->vy <= 0) {
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+// 8 вершин бокса в мировых координатах
+void getBoxVertices(CollisionBox* box, Vec3 vertices[8]) {
+    vertices[0] = (Vec3){box->pos.x + box->bounds.minX, box->pos.y + box->bounds.minY, box->pos.z + box->bounds.minZ};
+    vertices[1] = (Vec3){box->pos.x + box->bounds.maxX, box->pos.y + box->bounds.minY, box->pos.z + box->bounds.minZ};
+    vertices[2] = (Vec3){box->pos.x + box->bounds.maxX, box->pos.y + box->bounds.maxY, box->pos.z + box->bounds.minZ};
+    vertices[3] = (Vec3){box->pos.x + box->bounds.minX, box->pos.y + box->bounds.maxY, box->pos.z + box->bounds.minZ};
+    vertices[4] = (Vec3){box->pos.x + box->bounds.minX, box->pos.y + box->bounds.minY, box->pos.z + box->bounds.maxZ};
+    vertices[5] = (Vec3){box->pos.x + box->bounds.maxX, box->pos.y + box->bounds.minY, box->pos.z + box->bounds.maxZ};
+    vertices[6] = (Vec3){box->pos.x + box->bounds.maxX, box->pos.y + box->bounds.maxY, box->pos.z + box->bounds.maxZ};
+    vertices[7] = (Vec3){box->pos.x + box->bounds.minX, box->pos.y + box->bounds.maxY, box->pos.z + box->bounds.maxZ};
+}
+
+void drawOptimizedBox(RenderBackend* ren, CollisionBox* box, Camera cam) {
+    // 1. Получаем 8 вершин бокса в мировых координатах
+    Vec3 vertices[8];
+    getBoxVertices(box, vertices);
+
+    // 2. Грани проверяем по их собственным плоскостям от глаза, рёбра - по две грани на ребро
+    unsigned char edgeFlags[12];
+    if (classifyBoxEdges(vertices, cameraEyePosition(cam), edgeFlags) == 0) return;
+
+    // 3. Каждое из 12 рёбер - не больше одного раза
+    for (int i = 0; i < 12; i++) {
+        if (edgeFlags[i] == BOX_EDGE_HIDDEN) continue;
+        clipAndDrawLine(ren, vertices[BOX_EDGES[i][0]], vertices[BOX_EDGES[i][1]], cam, box->color);
+    }
+}
+
+// Мировая точка -> пространство камеры. Та же математика, что в clipAndDrawLine,
+// чтобы заливка граней и контуры совпадали пиксель в пиксель.
+Vec3 worldToCamera(Vec3 p, Camera cam) {
+    float cameraEyeY = cam.y + cam.height + cam.currentBobY;
+    float dx = p.x - cam.x, dy = p.y - cameraEyeY, dz = p.z - cam.z;
+    float sy = fast_sin(cam.rotY), cy = fast_cos(cam.rotY);
+    float sx = fast_sin(cam.rotX), cx = fast_cos(cam.rotX);
+    float x_cam = cy * dx - sy * dz;
+    float z_temp = sy * dx + cy * dz;
+    Vec3 r = { x_cam, cx * dy - sx * z_temp, sx * dy + cx * z_temp };
+    return r;
+}
+
+// Проекция точки, которая уже в пространстве камеры и перед ближней плоскостью
+ProjectedPoint projectCameraPoint(Vec3 c) {
+    ProjectedPoint result;
+    result.x = (int)(g_view.cx + c.x * g_fov / c.z);
+    result.y = (int)(g_view.cy - c.y * g_fov / c.z);
+    result.z = c.z;
+    return result;
+}
+
+#define MAX_POLY_VERTS 8 // Больше всех даёт тень бокса (castBoxShadow): оболочка его 8 углов на полу
+
+// Текстура на полигоне: uvs - по паре (u, v) на каждую вершину, в повторах текстуры
+typedef struct {
+    const SoftTexture* texture;
+    const float* uvs;
+    float blend; // textureBlend: насколько текстура уже проявилась
+} PolygonTexturing;
+
+// Заливка выпуклого полигона из мира: отсекаем по ближней плоскости
+// (Сазерленд-Ходжман) и заливаем целиком одним обходом рёбер (fillPolygon).
+// С текстурой (tex != NULL) UV отсекаются вместе с вершинами и идут в fillPolygonTextured.
+// light - ступени света в вершинах (Light_VertexLevel) или NULL, если полигон не освещается.
+void fillWorldPolygon(RenderBackend* ren, const Vec3* verts, int count, Camera cam, SDL_Color color,
+                      const PolygonTexturing* tex, const float* light) {
+    if (count < 3 || count > MAX_POLY_VERTS) return;
+
+    Vec3 camVerts[MAX_POLY_VERTS];
+    int behind = 0;
+    for (int i = 0; i < count; i++) {
+        camVerts[i] = worldToCamera(verts[i], cam);
+        if (camVerts[i].z < NEAR_PLANE) behind++;
+    }
+    if (behind == count) return; // Полностью за спиной
+
+    int textured = tex && tex->texture && tex->blend > 0.0f;
+    Vec3 clipped[MAX_POLY_VERTS * 2];
+    float clippedUV[MAX_POLY_VERTS * 2][2];
+    float clippedLight[MAX_POLY_VERTS * 2];
+    int clippedCount = 0;
+    for (int i = 0; i < count; i++) {
+        int j = (i + 1) % count;
+        Vec3 a = camVerts[i];
+        Vec3 b = camVerts[j];
+        int aIn = a.z >= NEAR_PLANE, bIn = b.z >= NEAR_PLANE;
+        if (aIn) {
+            if (textured) { clippedUV[clippedCount][0] = tex->uvs[i * 2]; clippedUV[clippedCount][1] = tex->uvs[i * 2 + 1]; }
+            clippedLight[clippedCount] = light ? light[i] : LIGHT_NONE;
+            clipped[clippedCount++] = a;
+        }
+        if (aIn != bIn) {
+            float t = (NEAR_PLANE - a.z) / (b.z - a.z);
+            if (textured) {
+                clippedUV[clippedCount][0] = lerp(tex->uvs[i * 2], tex->uvs[j * 2], t);
+                clippedUV[clippedCount][1] = lerp(tex->uvs[i * 2 + 1], tex->uvs[j * 2 + 1], t);
+            }
+            clippedLight[clippedCount] = light ? lerp(light[i], light[j], t) : LIGHT_NONE;
+            clipped[clippedCount++] = (Vec3){ a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, NEAR_PLANE };
+        }
+    }
+    if (clippedCount < 3) return;
+
+    RasterVertex rv[MAX_POLY_VERTS * 2];
+    for (int i = 0; i < clippedCount; i++) {
+        ProjectedPoint projected = projectCameraPoint(clipped[i]);
+        rv[i] = rasterVertexFromProjected(projected, textured ? clippedUV[i][0] : 0.0f, textured ? clippedUV[i][1] : 0.0f);
+        rv[i].light = clippedLight[i];
+    }
+
+    if (textured) {
+        fillPolygonTextured(ren, rv, clippedCount, tex->texture, color, tex->blend);
+    } else {
+        fillPolygon(ren, rv, clippedCount, color);
+    }
+}
+
+// Радиус объекта на экране в пикселях по описанной сфере; у самого глаза - заведомо большой
+float Pick_ScreenRadius(Vec3 center, float radius, Camera cam) {
+    float z = worldToCamera(center, cam).z;
+    if (z <= radius + NEAR_PLANE) return FLT_MAX;
+    return radius * g_fov / z;
+}
+
+// Видимые из глаза грани бокса - в буфер ID. Вершины в нумерации getBoxVertices
+void Pick_WriteBox(RenderBackend* ren, const Vec3 v[8], Uint16 id, Camera cam) {
+    RasterPass savedPass = g_rasterPass;
+    SDL_Color unused = {0, 0, 0, 0};
+    Vec3 eye = cameraEyePosition(cam);
+    g_rasterPass = RASTER_PASS_OBJECT_ID;
+    g_pick.currentId = id;
+    for (int f = 0; f < 6; f++) {
+        if (!boxFaceFacesEye(v, f, eye)) continue;
+        Vec3 quad[4] = { v[BOX_FACES[f][0]], v[BOX_FACES[f][1]], v[BOX_FACES[f][2]], v[BOX_FACES[f][3]] };
+        fillWorldPolygon(ren, quad, 4, cam, unused, NULL, NULL);
+    }
+    g_rasterPass = savedPass;
+}
+
+// Начало кадра для буфера ID. С кинематографичной камеры буфер не годится для прицела игрока
+void Pick_BeginFrame(int fromPlayerCamera) {
+    g_pick.valid = g_pick.enabled && fromPlayerCamera;
+    g_pick.pixels = 0;
+    g_pick.numTiny = 0;
+    g_pick.centerX = g_view.cx;
+    g_pick.centerY = g_view.cy;
+    if (!g_pick.valid) return;
+    if (++g_pick.frame == 0) { // Метки кончились - чистим буфер целиком
+        memset(g_pickIds, 0, sizeof(g_pickIds));
+        g_pick.frame = 1;
+    }
+}
+
+// Сплошная заливка видимых граней бокса (верх чуть светлее - "освещение")
+#define BOX_TEXTURE_WORLD_SIZE 2.0f
+
+static float edgeLength(Vec3 a, Vec3 b) {
+    float dx = b.x - a.x, dy = b.y - a.y, dz = b.z - a.z;
+    return sqrtf(dx*dx + dy*dy + dz*dz);
+}
+
+// texture может быть NULL - тогда грани плоские (так их гоняет пре-пасс глубины)
+void fillBoxFaces(RenderBackend* ren, CollisionBox* box, Camera cam, SDL_Color sideColor, SDL_Color topColor,
+                  const SoftTexture* texture, float textureBlend) {
+    Vec3 vertices[8];
+    getBoxVertices(box, vertices);
+
+    // Свет нужен только проходам, которые красят
+    int lit = g_light.enabled && (g_rasterPass == RASTER_PASS_NORMAL || g_rasterPass == RASTER_PASS_COLOR_EQUAL);
+    Vec3 center = {
+        box->pos.x + (box->bounds.minX + box->bounds.maxX) * 0.5f,
+        box->pos.y + (box->bounds.minY + box->bounds.maxY) * 0.5f,
+        box->pos.z + (box->bounds.minZ + box->bounds.maxZ) * 0.5f
+    };
+
+    Vec3 eye = cameraEyePosition(cam);
+    for (int f = 0; f < 6; f++) {
+        if (!boxFaceFacesEye(vertices, f, eye)) continue;
+        Vec3 quad[4] = {
+            vertices[BOX_FACES[f][0]], vertices[BOX_FACES[f][1]],
+            vertices[BOX_FACES[f][2]], vertices[BOX_FACES[f][3]]
+        };
+
+        // Одна текстура на BOX_TEXTURE_WORLD_SIZE юнитов, чтобы доски не растягивались на длинных гранях
+        float lenU = edgeLength(quad[0], quad[1]) / BOX_TEXTURE_WORLD_SIZE;
+        float lenV = edgeLength(quad[0], quad[3]) / BOX_TEXTURE_WORLD_SIZE;
+        float uvs[8] = { 0, 0,  lenU, 0,  lenU, lenV,  0, lenV };
+        PolygonTexturing tex = { texture, uvs, textureBlend };
+
+        float light[4];
+        if (lit) {
+            for (int k = 0; k < 4; k++) {
+                Vec3 corner = normalize((Vec3){quad[k].x - center.x, quad[k].y - center.y, quad[k].z - center.z});
+                Vec3 n = BOX_FACE_NORMALS[f];
+                light[k] = Light_VertexLevel(normalize((Vec3){n.x + corner.x * LIGHT_CORNER_SOFTEN,
+                                                              n.y + corner.y * LIGHT_CORNER_SOFTEN,
+                                                              n.z + corner.z * LIGHT_CORNER_SOFTEN}));
+            }
+        }
+        g_gbuffer.normal = GBuffer_NormalIndex(BOX_FACE_NORMALS[f]);
+        fillWorldPolygon(ren, quad, 4, cam, (f == 4) ? topColor : sideColor, &tex, lit ? light : NULL);
+    }
+    g_gbuffer.normal = GBUF_NORMAL_NONE;
+}
+
+// Пре-пасс глубины: прогоняем всю непрозрачную геометрию через депт-онли ядро.
+// После этого пол, стены и всё остальное отбрасываются тестом глубины ДО рендерера,
+// а грани в цветовом проходе красятся только там, где их глубина победила.
+void depthPrepassOpaque(RenderBackend* ren, CollisionBox* boxes, int numBoxes, Camera cam) {
+    SDL_Color unused = {0, 0, 0, 0};
+    g_rasterPass = RASTER_PASS_DEPTH_ONLY;
+    for (int i = 0; i < numBoxes; i++) {
+        if (isBoxInFrustum_Cached(&boxes[i], cam)) {
+            fillBoxFaces(ren, &boxes[i], cam, unused, unused, NULL, 0.0f);
+        }
+    }
+    g_rasterPass = RASTER_PASS_NORMAL;
+}
+
+// S-буфер для кадров из линий: видимые грани боксов идут тем же обходом треугольников,
+// но каждый пролёт не рисуется, а записывается в список своей строки.
+// Бокс ужимаем на SBUFFER_OCCLUDER_INSET, чтобы его собственные рёбра (и куб внутри
+// центрального бокса) оставались перед гранями на любом расстоянии.
+void buildSBufferOccluders(RenderBackend* ren, CollisionBox* boxes, int numBoxes, Camera cam) {
+    SDL_Color unused = {0, 0, 0, 0};
+    g_rasterPass = RASTER_PASS_SBUFFER;
+    for (int i = 0; i < numBoxes; i++) {
+        if (!isBoxInFrustum_Cached(&boxes[i], cam)) continue;
+        CollisionBox occluder = boxes[i];
+        float insetX = fminf(SBUFFER_OCCLUDER_INSET, (occluder.bounds.maxX - occluder.bounds.minX) * 0.25f);
+        float insetY = fminf(SBUFFER_OCCLUDER_INSET, (occluder.bounds.maxY - occluder.bounds.minY) * 0.25f);
+        float insetZ = fminf(SBUFFER_OCCLUDER_INSET, (occluder.bounds.maxZ - occluder.bounds.minZ) * 0.25f);
+        occluder.bounds.minX += insetX; occluder.bounds.maxX -= insetX;
+        occluder.bounds.minY += insetY; occluder.bounds.maxY -= insetY;
+        occluder.bounds.minZ += insetZ; occluder.bounds.maxZ -= insetZ;
+        fillBoxFaces(ren, &occluder, cam, unused, unused, NULL, 0.0f);
+    }
+    g_rasterPass = RASTER_PASS_NORMAL;
+}
+
+// Направление НА солнце: та же орбита, что у g_dayNight.sunPos, только без привязки к камере
+static Vec3 Shadows_SunDirection(void) {
+    float angle = g_dayNight.timeOfDay * 2.0f * M_PI;
+    return (Vec3){0.0f, fast_sin(angle), fast_cos(angle)};
+}
+
+// Источник света и таблица множителей на кадр. Днём светит солнце, ночью - луна напротив него;
+// цвет и сила - из таблицы дня и ночи (ambientLightColor)
+void Light_BeginFrame(void) {
+    Vec3 sun = Shadows_SunDirection();
+    g_light.fromMoon = sun.y < 0.0f;
+    g_light.dir = g_light.fromMoon ? (Vec3){-sun.x, -sun.y, -sun.z} : sun;
+    g_light.verticesLit = 0;
+
+    SDL_Color lightColor = g_dayNight.ambientLightColor;
+    const Uint8 channel[3] = { lightColor.r, lightColor.g, lightColor.b };
+    for (int level = 0; level < LIGHT_LEVELS; level++) {
+        float lambert = (float)level / (LIGHT_LEVELS - 1);
+        for (int k = 0; k < 3; k++) {
+            float m = LIGHT_MIN + (1.0f - LIGHT_MIN) * (channel[k] / 255.0f) * (LIGHT_AMBIENT + (1.0f - LIGHT_AMBIENT) * lambert);
+            g_light.lut[level][k] = (Uint16)(m * 256.0f);
+        }
+    }
+}
+
+// Выпуклая оболочка точек пола (монотонная цепь по x, потом z). Возвращает число вершин.
+static int shadowHull(Vec3* pts, int count, Vec3* hull) {
+    for (int i = 1; i < count; i++) { // Вставками: точек всего 8
+        Vec3 p = pts[i];
+        int j = i - 1;
+        while (j >= 0 && (pts[j].x > p.x || (pts[j].x == p.x && pts[j].z > p.z))) {
+            pts[j + 1] = pts[j];
+            j--;
+        }
+        pts[j + 1] = p;
+    }
+    int n = 0;
+    for (int pass = 0; pass < 2; pass++) { // Нижняя цепь слева направо, верхняя обратно
+        int chainStart = n;
+        for (int k = 0; k < count; k++) {
+            Vec3 p = pts[pass == 0 ? k : count - 1 - k];
+            while (n >= chainStart + 2) {
+                Vec3 a = hull[n - 2], b = hull[n - 1];
+                float cross = (b.x - a.x) * (p.z - a.z) - (b.z - a.z) * (p.x - a.x);
+                if (cross > 0.0f) break;
+                n--;
+            }
+            hull[n++] = p;
+        }
+        n--; // Последняя точка цепи - первая точка следующей
+    }
+    return n;
+}
+
+// Тень одного AABB: 8 углов вдоль лучей на пол, оболочка, заливка в проходе теней
+static void castBoxShadow(RenderBackend* ren, Vec3 mn, Vec3 mx, Vec3 sun, Camera cam) {
+    Vec3 pts[8];
+    float minX = FLT_MAX, maxX = -FLT_MAX, minZ = FLT_MAX, maxZ = -FLT_MAX;
+    for (int i = 0; i < 8; i++) {
+        Vec3 p = { (i & 1) ? mx.x : mn.x, (i & 2) ? mx.y : mn.y, (i & 4) ? mx.z : mn.z };
+        float t = (p.y - SHADOW_FLOOR_Y) / sun.y;
+        if (t < 0.0f) t = 0.0f; // Что ниже пола, тени не даёт
+        pts[i] = (Vec3){ p.x - sun.x * t, SHADOW_FLOOR_Y, p.z - sun.z * t };
+        minX = fminf(minX, pts[i].x); maxX = fmaxf(maxX, pts[i].x);
+        minZ = fminf(minZ, pts[i].z); maxZ = fmaxf(maxZ, pts[i].z);
+    }
+    CollisionBox footprint = { {0, 0, 0}, {minX, SHADOW_FLOOR_Y - 0.01f, minZ, maxX, SHADOW_FLOOR_Y + 0.01f, maxZ}, {0, 0, 0, 0} };
+    if (!isBoxInFrustum_Improved(&footprint, cam)) return;
+
+    Vec3 hull[16];
+    int n = shadowHull(pts, 8, hull);
+    if (n < 3) return;
+    fillWorldPolygon(ren, hull, n, cam, (SDL_Color){0, 0, 0, g_shadows.alpha}, NULL, NULL);
+    g_shadows.casters++;
+}
+
+// Вызывать сразу после пола: он уже в z-буфере, а всё, что перед ним, закроет тень тестом глубины
+void drawPlanarShadows(RenderBackend* ren, Camera cam) {
+    g_shadows.casters = 0;
+    g_shadows.pixels = 0;
+    g_shadows.alpha = 0;
+    g_shadows.costMs = 0.0f;
+    // Тени падают только на сплошной пол и проявляются вместе с его заливкой
+    if (!g_shadows.enabled || g_worldEvolution.currentState < WORLD_STATE_TEXTURED) return;
+
+    Vec3 sun = Shadows_SunDirection();
+    float fade = (sun.y - SHADOW_FADE_START) / (SHADOW_FADE_FULL - SHADOW_FADE_START);
+    if (fade > 1.0f) fade = 1.0f;
+    if (fade <= 0.0f) return;
+    g_shadows.alpha = (Uint8)(SHADOW_MAX_ALPHA * fade * fminf(g_worldEvolution.textureBlend, 1.0f));
+    if (g_shadows.alpha == 0) return;
+    if (sun.y < SHADOW_MIN_ELEVATION) sun.y = SHADOW_MIN_ELEVATION;
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    if (++g_shadows.frame == 0) { // Метки кончились - раз в 255 кадров чистим маску (только свой вид)
+        for (int y = g_view.y0; y < g_view.y1; y++) {
+            memset(&g_shadowMask[y][g_view.x0], 0, (size_t)(g_view.x1 - g_view.x0));
+        }
+        g_shadows.frame = 1;
+    }
+    Render_SetBlendMode(ren, SDL_BLENDMODE_BLEND);
+    g_rasterPass = RASTER_PASS_SHADOW;
+
+    for (int i = 0; i < numCollisionBoxes; i++) {
+        CollisionBox* box = &collisionBoxes[i];
+        castBoxShadow(ren, (Vec3){box->pos.x + box->bounds.minX, box->pos.y + box->bounds.minY, box->pos.z + box->bounds.minZ},
+                      (Vec3){box->pos.x + box->bounds.maxX, box->pos.y + box->bounds.maxY, box->pos.z + box->bounds.maxZ}, sun, cam);
+    }
+    for (int i = 0; i < g_numPickups; i++) {
+        PickupObject* obj = &g_pickups[i];
+        if (obj->state == PICKUP_STATE_BROKEN) continue;
+        Vec3 half = { obj->size.x / 2, obj->size.y / 2, obj->size.z / 2 };
+        castBoxShadow(ren, (Vec3){obj->pos.x - half.x, obj->pos.y - half.y, obj->pos.z - half.z},
+                      (Vec3){obj->pos.x + half.x, obj->pos.y + half.y, obj->pos.z + half.z}, sun, cam);
+    }
+    // Игрок - столбик от пола под ногами до глаз. В кинематографе камера не игрок
+    if (!g_cinematic.isActive) {
+        castBoxShadow(ren, (Vec3){cam.x - SHADOW_PLAYER_RADIUS, cam.y + SHADOW_FLOOR_Y, cam.z - SHADOW_PLAYER_RADIUS},
+                      (Vec3){cam.x + SHADOW_PLAYER_RADIUS, cam.y + cam.height, cam.z + SHADOW_PLAYER_RADIUS}, sun, cam);
+    }
+
+    g_rasterPass = RASTER_PASS_NORMAL;
+    Render_SetBlendMode(ren, SDL_BLENDMODE_NONE);
+    g_shadows.costMs = (float)((SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+}
+
+void drawMaterializedFloor(RenderBackend* ren, Camera cam) {
+    if (g_worldEvolution.currentState < WORLD_STATE_MATERIALIZING) return;
+    
+    float opacity = g_worldEvolution.polygonOpacity;
+    if (opacity < 0.01f) return;
+    
+    Render_SetBlendMode(ren, SDL_BLENDMODE_BLEND);
+    
+    // Цвет пола меняется с прогрессом
+    Uint8 baseColor = 40 + (Uint8)(g_worldEvolution.textureBlend * 60);
+    
+    // --- ОПТИМИЗАЦИЯ: Увеличиваем размер плиток ---
+    float tileSize = 4.0f;  // Было 2.0f
+    int viewRange = 12;      // Было 15
+    
+    for (float x = -viewRange; x < viewRange; x += tileSize) {
+        for (float z = -viewRange; z < viewRange; z += tileSize) {
+            // --- ОПТИМИЗАЦИЯ: Более строгая проверка расстояния ---
+            float distToCam = sqrtf(powf(x - cam.x, 2) + powf(z - cam.z, 2));
+            if (distToCam > fminf(Quality_Current()->floorRange, g_fog.farPlane)) continue;  // Было 20, на высоком качестве 15
+            
+            // Шахматный паттерн
+            int checkX = (int)(x / tileSize);
+            int checkZ = (int)(z / tileSize);
+            int isEven = (checkX + checkZ) % 2 == 0;
+            
+            SDL_Color tileColor;
+            if (g_worldEvolution.currentState >= WORLD_STATE_TEXTURED) {
+                if (isEven) {
+                    tileColor = (SDL_Color){baseColor, baseColor + 10, baseColor + 15, (Uint8)(opacity * 255)};
+                } else {
+                    tileColor = (SDL_Color){baseColor - 10, baseColor, baseColor + 5, (Uint8)(opacity * 255)};
+                }
+            } else {
+                tileColor = (SDL_Color){baseColor, baseColor, baseColor + 20, (Uint8)(opacity * 200)};
+            }
+            
+            Vec3 corners[4] = {
+                {x, -2.0f, z},
+                {x + tileSize, -2.0f, z},
+                {x + tileSize, -2.0f, z + tileSize},
+                {x, -2.0f, z + tileSize}
+            };
+            
+            // --- СУПЕР ОПТИМИЗАЦИЯ: Вместо заливки рисуем крест и контур ---
+            if (g_worldEvolution.currentState >= WORLD_STATE_REALISTIC && Quality_Current()->floorCross) {
+                // Только контур + диагонали для иллюзии заливки
+                for (int i = 0; i < 4; i++) {
+                    clipAndDrawLine(ren, corners[i], corners[(i+1)%4], cam, tileColor);
+                }
+                // Диагонали для эффекта заливки
+                clipAndDrawLine(ren, corners[0], corners[2], cam, tileColor);
+                clipAndDrawLine(ren, corners[1], corners[3], cam, tileColor);
+                
+                // Центральный крест
+                Vec3 midH1 = {x + tileSize/2, -2.0f, z};
+                Vec3 midH2 = {x + tileSize/2, -2.0f, z + tileSize};
+                Vec3 midV1 = {x, -2.0f, z + tileSize/2};
+                Vec3 midV2 = {x + tileSize, -2.0f, z + tileSize/2};
+                clipAndDrawLine(ren, midH1, midH2, cam, tileColor);
+                clipAndDrawLine(ren, midV1, midV2, cam, tileColor);
+            } else {
+                // Только контур для производительности
+                for (int i = 0; i < 4; i++) {
+                    clipAndDrawLine(ren, corners[i], corners[(i+1)%4], cam, tileColor);
+                }
+            }
+        }
+    }
+    
+    Render_SetBlendMode(ren, SDL_BLENDMODE_NONE);
+}
+
+void drawMaterializedBox(RenderBackend* ren, CollisionBox* box, Camera cam) {
+    // В режиме реализма делаем грани непрозрачными
+    float opacity = g_worldEvolution.polygonOpacity;
+    
+    if (g_worldEvolution.currentState >= WORLD_STATE_REALISTIC) {
+        opacity = 1.0f;  // Полная непрозрачность в режиме реализма
+    }
+    
+    // Каркас рисуем только если не в режиме реализма
+    if (g_worldEvolution.currentState < WORLD_STATE_REALISTIC) {
+        drawOptimizedBox(ren, box, cam);
+    }
+    
+    // Материализованные грани
+    if (g_worldEvolution.currentState >= WORLD_STATE_MATERIALIZING) {
+        SDL_Color materialColor;
+        
+        if (g_worldEvolution.currentState >= WORLD_STATE_REALISTIC) {
+            // В режиме реализма - полные насыщенные цвета
+            materialColor = (SDL_Color){
+                box->color.r,
+                box->color.g,
+                box->color.b,
+                255  // Полностью непрозрачный
+            };
+        } else {
+            // В промежуточных режимах - полупрозрачность
+            materialColor = (SDL_Color){
+                (Uint8)(box->color.r * 0.7f),
+                (Uint8)(box->color.g * 0.7f),
+                (Uint8)(box->color.b * 0.7f),
+                (Uint8)(opacity * 150)
+            };
+        }
+        
+        // Реализм: настоящая сплошная заливка граней вместо штриховки.
+        // Если был пре-пасс глубины - красим только пиксели, чья глубина победила.
+        if (g_worldEvolution.currentState >= WORLD_STATE_REALISTIC) {
+            SDL_Color topColor = materialColor;
+            if (!g_light.enabled) { // Со светом верх и так светлее - на него смотрит солнце
+                topColor.r = fminf(255, topColor.r + 30);
+                topColor.g = fminf(255, topColor.g + 30);
+                topColor.b = fminf(255, topColor.b + 30);
+            }
+
+            g_rasterPass = g_depthPrepassActive ? RASTER_PASS_COLOR_EQUAL : RASTER_PASS_NORMAL;
+            fillBoxFaces(ren, box, cam, materialColor, topColor, g_boxTexture, g_worldEvolution.textureBlend);
+            g_rasterPass = RASTER_PASS_NORMAL;
+
+            // Контур для чёткости - чуть "ближе" к камере, чтобы не тонул в своих же гранях
+            CollisionBox outlined = *box;
+            outlined.color = (SDL_Color){
+                (Uint8)(box->color.r * 0.5f),
+                (Uint8)(box->color.g * 0.5f),
+                (Uint8)(box->color.b * 0.5f),
+                255
+            };
+            g_lineDepthBias = 0.995f;
+            drawOptimizedBox(ren, &outlined, cam);
+            g_lineDepthBias = 1.0f;
+            return;
+        }
+
+        // Текстуры: вместо штриховки полупрозрачные грани, на которых проявляется текстура
+        if (g_worldEvolution.currentState >= WORLD_STATE_TEXTURED && g_boxTexture) {
+            Render_SetBlendMode(ren, SDL_BLENDMODE_BLEND);
+            fillBoxFaces(ren, box, cam, materialColor, materialColor, g_boxTexture, g_worldEvolution.textureBlend);
+            Render_SetBlendMode(ren, SDL_BLENDMODE_NONE);
+            return;
+        }
+
+        Render_SetBlendMode(ren, SDL_BLENDMODE_BLEND);
+        
+        Vec3 center = box->pos;
+        
+        // --- ОПТИМИЗАЦИЯ: Рисуем только видимые грани ---
+        Vec3 toCam = {cam.x - center.x, cam.y - center.y, cam.z - center.z};
+        
+        // Определяем какие грани видны
+        int drawFront = (toCam.z < 0);
+        int drawBack = (toCam.z > 0);
+        int drawLeft = (toCam.x < 0);
+        int drawRight = (toCam.x > 0);
+        int drawTop = (toCam.y > center.y);
+        
+        float step = ((g_worldEvolution.currentState >= WORLD_STATE_REALISTIC) ? 0.15f : 0.3f) * Quality_Current()->hatchScale;
+        
+        // Передняя грань
+        if (drawFront) {
+            for (float y = box->bounds.minY; y < box->bounds.maxY; y += step) {
+                Vec3 p1 = {center.x + box->bounds.minX, center.y + y, center.z + box->bounds.minZ};
+                Vec3 p2 = {center.x + box->bounds.maxX, center.y + y, center.z + box->bounds.minZ};
+                clipAndDrawLine(ren, p1, p2, cam, materialColor);
+            }
+        }
+        
+        // Верхняя грань (важна для платформ)
+        if (drawTop) {
+            SDL_Color topColor = materialColor;
+            if (g_worldEvolution.currentState >= WORLD_STATE_REALISTIC) {
+                // Верх светлее (освещение)
+                topColor.r = fminf(255, topColor.r + 30);
+                topColor.g = fminf(255, topColor.g + 30);
+                topColor.b = fminf(255, topColor.b + 30);
+            }
+            
+            for (float x = box->bounds.minX; x < box->bounds.maxX; x += step) {
+                Vec3 p1 = {center.x + x, center.y + box->bounds.maxY, center.z + box->bounds.minZ};
+                Vec3 p2 = {center.x + x, center.y + box->bounds.maxY, center.z + box->bounds.maxZ};
+                clipAndDrawLine(ren, p1, p2, cam, topColor);
+            }
+        }
+        
+        
+        Render_SetBlendMode(ren, SDL_BLENDMODE_NONE);
+    }
+}
+
+// [Продолжение в следующем сообщении...]
+
+// --- ФУНКЦИИ ДЛЯ МОНЕТ ---
+void initCoins() {
+    g_numCoins = 45;  // Много монет для эволюции
+    
+    // Счётчик реально созданных монет
+    int actualCoins = 0;
+    
+    // Генерируем монеты по спирали, избегая коллизий
+    for (int i = 0; i < g_numCoins && i < 50; i++) {
+        float angle = ((float)i / 10.0f) * 2.0f * M_PI;
+        float radius = 4.0f + (float)(i / 5) * 2.5f;  // Расширяющаяся спираль
+        
+        // Базовая позиция
+        float baseX = fast_cos(angle) * radius;
+        float baseZ = fast_sin(angle) * radius;
+        float baseY = 0.5f + fast_sin((float)i * 0.3f) * 0.5f;  // Разная высота
+        
+        // Находим безопасную позицию
+        Vec3 safePos = findSafeSpawnPosition(baseX, baseY, baseZ, collisionBoxes, numCollisionBoxes);
+        
+        // Дополнительная проверка - не слишком ли близко к другим монетам
+        int tooClose = 0;
+        for (int j = 0; j < actualCoins; j++) {
+            float dist = sqrtf(
+                powf(safePos.x - g_coins[j].pos.x, 2) +
+                powf(safePos.y - g_coins[j].pos.y, 2) +
+                powf(safePos.z - g_coins[j].pos.z, 2)
+            );
+            if (dist < 1.5f) { // Минимальное расстояние между монетами
+                tooClose = 1;
+                break;
+            }
+        }
+        
+        if (!tooClose) {
+            g_coins[actualCoins].pos = safePos;
+            g_coins[actualCoins].collected = 0;
+            g_coins[actualCoins].rotationPhase = (float)i * 0.5f;
+            g_coins[actualCoins].bobPhase = (float)i * 0.3f;
+            actualCoins++;
+        }
+    }
+    
+    g_numCoins = actualCoins; // Обновляем реальное количество монет
+    g_coinsCollected = 0;
+    
+    printf("🪙 Spawned %d coins in safe positions\n", g_numCoins);
+}
+
+void updateCoins(float deltaTime) {
+    for (int i = 0; i < g_numCoins; i++) {
+        if (!g_coins[i].collected) {
+            g_coins[i].rotationPhase += deltaTime * 3.0f;
+            g_coins[i].bobPhase += deltaTime * 2.0f;
+        }
     }
 }
 
-// ФИНАЛЬНАЯ, ИСПРАВЛЕННАЯ ВЕРСЯ. РУКИ ЖЕСТКО ПРИВЯЗАНЫ К КАМЕРЕ.
-void draw3DHand(SDL_Renderer* ren, Vec3 handPos, Vec3 handRot, Camera cam, int isRight) {
-    SDL_Color skinColor = {220, 180, 140, 255};
-    SDL_Color darkSkinColor = {200, 160, 120, 255};
+// Добавь в drawCoin для визуальной обратной связи:
+
+#define COIN_BOUND_RADIUS 0.7f // Вся монета вокруг центра: пульсирующая (до 0.43) с аурой сбора в 1.5 раза
+
+void drawCoin(RenderBackend* ren, Coin* coin, Camera cam) {
+    if (coin->collected) return;
     
-    // ЛАДОНЬ
-    float pW = 0.08f, pH = 0.12f, pD = 0.02f;
-    Vec3 localPalmVerts[8] = {
-        {-pW/2,-pH/2,-pD/2}, {pW/2,-pH/2,-pD/2}, {pW/2, pH/2,-pD/2}, {-pW/2, pH/2,-pD/2},
-        {-pW/2,-pH/2, pD/2}, {pW/2,-pH/2, pD/2}, {pW/2, pH/2, pD/2}, {-pW/2, pH/2, pD/2}
-    };
+    float bobOffset = fast_sin(coin->bobPhase) * 0.2f;
+    float rotation = coin->rotationPhase;
     
-    Vec3 finalPalmVerts[8];
-    for (int i = 0; i < 8; ++i) {
-        finalPalmVerts[i] = transform_hand_vertex(localPalmVerts[i], &handPos, &handRot, &cam);
+    Vec3 center = {coin->pos.x, coin->pos.y + bobOffset, coin->pos.z};
+    
+    // --- ПРОВЕРЯЕМ РАССТОЯНИЕ ДО ИГРОКА ---
+    float distToPlayer = sqrtf(
+        powf(cam.x - coin->pos.x, 2) +
+        powf(cam.y - coin->pos.y, 2) +
+        powf(cam.z - coin->pos.z, 2)
+    );
+    
+    // Меняем размер и цвет в зависимости от расстояния
+    float radius = 0.3f;
+    SDL_Color goldColor = {255, 215, 0, 255};
+    
+    if (distToPlayer < 2.0f) {
+        // Близко - монета пульсирует
+        radius = 0.3f + fast_sin(Game_GetTicks() * 0.01f) * 0.05f;
+        
+        if (distToPlayer < 1.5f) {
+            // Очень близко - меняем цвет
+            goldColor = (SDL_Color){255, 240, 100, 255};
+            radius = 0.35f + fast_sin(Game_GetTicks() * 0.02f) * 0.08f;
+        }
     }
     
-    int palmEdges[12][2] = {{0,1},{1,2},{2,3},{3,0}, {4,5},{5,6},{6,7},{7,4}, {0,4},{1,5},{2,6},{3,7}};
-    for (int i=0; i<12; ++i) {
-        clipAndDrawLine(ren, finalPalmVerts[palmEdges[i][0]], finalPalmVerts[palmEdges[i][1]], cam, skinColor);
+    // Далёкие монеты - пара пикселей: хватит точки или упрощённого кольца
+    LodLevel lod = Lod_Select(Lod_ProjectedSize(center, radius, cam), &coin->lodLevel[g_view.index]);
+    if (lod == LOD_POINT) {
+        clipAndDrawLine(ren, center, center, cam, goldColor);
+        return;
     }
 
-    // ПАЛЬЦЫ
-    // ПАЛЬЦЫ
-    float fLen = 0.08f, fSpace = pW / 4.0f;
-    float thickness = 0.015f;
-    float bend = 0.0f;
+    int segments = (lod == LOD_FULL) ? 8 : 4;
+    Vec3 points[8];
+    
+    for (int i = 0; i < segments; i++) {
+        float angle = (float)i / segments * 2.0f * M_PI + rotation;
+        points[i].x = center.x + fast_cos(angle) * radius * fabsf(fast_cos(rotation));
+        points[i].y = center.y + fast_sin(angle) * radius * 0.3f;
+        points[i].z = center.z + fast_sin(angle) * radius * fabsf(fast_sin(rotation));
+    }
+    
+    // Рисуем грани монеты
+    for (int i = 0; i < segments; i++) {
+        clipAndDrawLine(ren, points[i], points[(i + 1) % segments], cam, goldColor);
+    }
+    
+    if (lod < LOD_FULL) return;
 
-    if (g_hands.heldObject && isRight) bend = 0.8f;
-    else if (g_hands.currentState == HAND_STATE_AIMING && isRight) bend = 0.2f;
+    // Центральные линии для объёма
+    for (int i = 0; i < segments; i += 2) {
+        clipAndDrawLine(ren, center, points[i], cam, goldColor);
+    }
+    
+    // Если очень близко, рисуем "ауру" сбора
+    if (distToPlayer < 1.5f) {
+        SDL_Color auraColor = {255, 255, 150, 100};
+        float auraRadius = radius * 1.5f;
+        
+        for (int i = 0; i < segments; i++) {
+            float angle = (float)i / segments * 2.0f * M_PI;
+            Vec3 auraPoint = {
+                center.x + fast_cos(angle) * auraRadius,
+                center.y,
+                center.z + fast_sin(angle) * auraRadius
+            };
+            if (i % 2 == 0) {  // Рисуем через одну для эффекта
+                clipAndDrawLine(ren, center, auraPoint, cam, auraColor);
+            }
+        }
+    }
+}
 
-    for (int i = 0; i < 4; i++) {
-        float fX = (i - 1.5f) * fSpace;
+void checkCoinCollection(Camera* cam) {
+    for (int i = 0; i < g_numCoins; i++) {
+        if (g_coins[i].collected) continue; // Пропускаем собранные
         
-        // Суставы
-        Vec3 base = transform_hand_vertex((Vec3){fX, pH/2, 0}, &handPos, &handRot, &cam);
-        Vec3 mid = transform_hand_vertex((Vec3){fX, pH/2 + fLen/2, fLen/2 * fast_sin(bend)}, &handPos, &handRot, &cam);
-        Vec3 tip = transform_hand_vertex((Vec3){fX, pH/2 + fLen, fLen * fast_sin(bend)}, &handPos, &handRot, &cam);
+        // --- УЛУЧШЕННАЯ ПРОВЕРКА РАССТОЯНИЯ ---
+        // Учитываем высоту камеры и радиус игрока
+        float playerFootY = cam->y;  // Позиция ног
+        float playerHeadY = cam->y + cam->height;  // Позиция головы
+        
+        // Проверяем расстояние по горизонтали (XZ)
+        float horizontalDist = sqrtf(
+            powf(cam->x - g_coins[i].pos.x, 2) +
+            powf(cam->z - g_coins[i].pos.z, 2)
+        );
+        
+        // Текущая высота монеты с учётом анимации
+        float coinY = g_coins[i].pos.y + fast_sin(g_coins[i].bobPhase) * 0.2f;
+        
+        // Проверяем, находится ли монета в пределах досягаемости игрока
+        int inVerticalRange = (coinY >= playerFootY - 0.5f && coinY <= playerHeadY + 0.5f);
+        int inHorizontalRange = (horizontalDist < 1.2f);  // Увеличенный радиус
+        
+        if (inHorizontalRange && inVerticalRange) {
+            // --- ДВОЙНАЯ ПРОВЕРКА для надёжности ---
+            // Полное 3D расстояние
+            float distSq = powf(cam->x - g_coins[i].pos.x, 2) +
+               powf(cam->y + cam->height/2 - coinY, 2) +
+               powf(cam->z - g_coins[i].pos.z, 2);
+
+const float collectRadiusSq = 1.5f * 1.5f; // Считаем квадрат радиуса ОДИН раз
 
-        // Рисуем два сегмента
-        drawVolumetricSegment(ren, base, mid, thickness, cam, skinColor);
-        drawVolumetricSegment(ren, mid, tip, thickness * 0.8f, cam, skinColor);
+if (distSq < collectRadiusSq) {  // Увеличенный радиус сбора
+                g_coins[i].collected = 1;
+                g_coinsCollected++;
+                
+                printf("💰 Coin collected! Total: %d/%d (Distance was: %.2f)\n", 
+                       g_coinsCollected, g_numCoins, distSq
+                    );
+                
+                // Особые сообщения при важных вехах
+                switch(g_coinsCollected) {
+                    case 10:
+                        printf("🌐 REALITY STABILIZING... Grid walls emerging.\n");
+                        break;
+                    case 15:
+                        printf("📦 SIMULATION BOUNDARIES DETECTED... Cube forming.\n");
+                        break;
+                    case 20:
+                        printf("🎨 MATERIALIZING... Polygons phasing in.\n");
+                        break;
+                    case 30:
+                        printf("🖼️ TEXTURES LOADING... World gaining substance.\n");
+                        break;
+                    case 40:
+                        printf("☁️ BREAKING THROUGH... Sky becoming visible.\n");
+                        printf("✨ WORLD FULLY MATERIALIZED!\n");
+                        break;
+                }
+                
+                break; // Важно! Выходим из цикла после сбора
+            }
+        }
     }
-    
-    // БОЛЬШОЙ ПАЛЕЦ
-    float thumbSide = isRight ? pW/2 : -pW/2;
-    Vec3 t_base = transform_hand_vertex((Vec3){thumbSide, -pH/4, 0.01f}, &handPos, &handRot, &cam);
-    Vec3 t_mid = transform_hand_vertex((Vec3){thumbSide + (isRight?0.03f:-0.03f), 0, 0.04f}, &handPos, &handRot, &cam);
-    Vec3 t_tip = transform_hand_vertex((Vec3){thumbSide + (isRight?0.05f:-0.05f), 0.02f, 0.05f}, &handPos, &handRot, &cam);
-    clipAndDrawLine(ren, t_base, t_mid, cam, skinColor);
-    clipAndDrawLine(ren, t_mid, t_tip, cam, skinColor);
+}
 
-    // ЗАПЯСТЬЕ
-    Vec3 wristEnd = transform_hand_vertex((Vec3){0, -pH/2 - 0.08f, 0}, &handPos, &handRot, &cam);
-    clipAndDrawLine(ren, finalPalmVerts[0], wristEnd, cam, darkSkinColor);
-    clipAndDrawLine(ren, finalPalmVerts[1], wristEnd, cam, darkSkinColor);
-    clipAndDrawLine(ren, finalPalmVerts[4], wristEnd, cam, darkSkinColor);
-    clipAndDrawLine(ren, finalPalmVerts[5], wristEnd, cam, darkSkinColor);
+void initQuestSystem(QuestSystem* qs) {
+    // Квест 0: Туториал - ИСПРАВЛЕНА ЦЕЛЕВАЯ ТОЧКА
+    qs->nodes[0] = (QuestNode){
+        .id = 0,
+        .name = "First Steps",
+        .description = "Learn basic movement",
+        .worldPos = {0, 3, -5},
+        .color = {100, 255, 100, 255},
+        .status = QUEST_AVAILABLE,
+        .numObjectives = 2,
+        .expReward = 10,
+        .nodeScale = 1.0f
+    };
+    
+    // ИСПРАВЛЯЕМ: Правильная целевая точка - зелёная платформа
+    qs->nodes[0].objectives[0] = (QuestObjective){
+        .type = OBJECTIVE_REACH_POINT,
+        .target = &collisionBoxes[1].pos, // Указатель на позицию зелёной платформы
+        .description = "Reach the green platform",
+        .requiredProgress = 1,
+        .currentProgress = 0
+    };
+    qs->nodes[0].objectives[1] = (QuestObjective){
+        .type = OBJECTIVE_COLLECT_ITEM,
+        .description = "Collect 3 coins",
+        .requiredProgress = 3,
+        .currentProgress = 0
+    };
+    qs->nodes[0].unlocksQuests[0] = 1;
+    qs->nodes[0].unlocksQuests[1] = 2;
+    qs->nodes[0].numUnlocks = 2;
+    
+    // Остальные квесты остаются такими же
+    qs->nodes[1] = (QuestNode){
+        .id = 1,
+        .name = "Parkour Master",
+        .description = "Complete the jumping puzzle",
+        .worldPos = {10, 4, 0},
+        .color = {255, 150, 100, 255},
+        .status = QUEST_LOCKED,
+        .numRequired = 1,
+        .expReward = 25,
+        .nodeScale = 1.0f
+    };
+    qs->nodes[1].requiredQuests[0] = 0;
+    qs->nodes[1].unlocksQuests[0] = 3;
+    qs->nodes[1].numUnlocks = 1;
+    
+    qs->nodes[2] = (QuestNode){
+        .id = 2,
+        .name = "Explorer",
+        .description = "Find all hidden areas",
+        .worldPos = {-10, 4, 0},
+        .color = {100, 150, 255, 255},
+        .status = QUEST_LOCKED,
+        .numRequired = 1,
+        .expReward = 30,
+        .nodeScale = 1.0f
+    };
+    qs->nodes[2].requiredQuests[0] = 0;
+    qs->nodes[2].unlocksQuests[0] = 3;
+    qs->nodes[2].numUnlocks = 1;
+    
+    qs->nodes[3] = (QuestNode){
+        .id = 3,
+        .name = "Final Challenge",
+        .description = "Defeat the cube guardian",
+        .worldPos = {0, 6, 10},
+        .color = {255, 100, 100, 255},
+        .status = QUEST_LOCKED,
+        .numRequired = 2,
+        .expReward = 100,
+        .nodeScale = 1.5f
+    };
+    qs->nodes[3].requiredQuests[0] = 1;
+    qs->nodes[3].requiredQuests[1] = 2;
+    
+    qs->numNodes = 4;
+    qs->activeQuestId = -1;
 }
 
-// Обновлённая функция отрисовки обеих рук
-void drawHands(SDL_Renderer* ren, Camera cam) {
-    // Определяем, нужно ли показывать руки
-    int shouldDrawHands = 0;
-    float handsAlpha = 1.0f;
+void drawQuestNode(RenderBackend* ren, QuestNode* node, Camera cam, float time) {
+    float pulse = (node->status == QUEST_ACTIVE) ? 
+                fast_sin(time * 3.0f) * 0.2f + 1.0f : 1.0f;
     
-    // Всегда показываем при осмотре
-    if (g_hands.currentState == HAND_STATE_INSPECTING) {
-        shouldDrawHands = 1;
-        handsAlpha = 1.0f;
-    }
-    // Показываем при взгляде вниз
-    else if (cam.rotX < -0.3f) {
-        shouldDrawHands = 1;
-        handsAlpha = fmaxf(0.3f, fminf(1.0f, (-cam.rotX - 0.3f) * 2));
-    }
-    // Показываем при взаимодействии
-    else if (g_hands.currentState == HAND_STATE_REACHING || 
-             g_hands.currentState == HAND_STATE_HOLDING ||
-             g_hands.currentState == HAND_STATE_THROWING) {
-        shouldDrawHands = 1;
-        handsAlpha = 1.0f;
-    }
-    // При ходьбе/беге показываем слегка
-    else if (g_hands.currentState == HAND_STATE_WALKING || 
-             g_hands.currentState == HAND_STATE_RUNNING) {
-        shouldDrawHands = 1;
-        handsAlpha = 0.5f;
-    }
+    float scale = node->nodeScale * pulse;
     
-    if (!shouldDrawHands) return;
+    Vec3 top = {node->worldPos.x, node->worldPos.y + scale, node->worldPos.z};
+    Vec3 bottom = {node->worldPos.x, node->worldPos.y - scale, node->worldPos.z};
     
-    // Рисуем обе руки
-    draw3DHand(ren, g_hands.leftPos, g_hands.leftRot, cam, 0);
-    draw3DHand(ren, g_hands.rightPos, g_hands.rightRot, cam, 1);
+    Vec3 corners[4] = {
+        {node->worldPos.x - scale*0.7f, node->worldPos.y, node->worldPos.z - scale*0.7f},
+        {node->worldPos.x + scale*0.7f, node->worldPos.y, node->worldPos.z - scale*0.7f},
+        {node->worldPos.x + scale*0.7f, node->worldPos.y, node->worldPos.z + scale*0.7f},
+        {node->worldPos.x - scale*0.7f, node->worldPos.y, node->worldPos.z + scale*0.7f}
+    };
     
-    // Если держим объект, рисуем его в правой руке
-    if (g_hands.heldObject) {
-        float cameraEyeY = cam.y + cam.height;
-        
-        // Позиционируем объект чуть впереди правой руки
-        Vec3 holdOffset = {
-            g_hands.rightPos.x + 0.05f,
-            g_hands.rightPos.y + 0.1f,
-            g_hands.rightPos.z + 0.15f
-        };
-        
-        // Применяем поворот камеры
-        float camSin = fast_sin(cam.rotY);
-        float camCos = fast_cos(cam.rotY);
-        
-        g_hands.heldObject->pos.x = cam.x + camCos * holdOffset.x - camSin * holdOffset.z;
-        g_hands.heldObject->pos.y = cameraEyeY + holdOffset.y;
-        g_hands.heldObject->pos.z = cam.z + camSin * holdOffset.x + camCos * holdOffset.z;
-        
-        // Поворачиваем объект вместе с камерой
-        g_hands.heldObject->rotation.y = -cam.rotY;
-        g_hands.heldObject->rotation.x = -cam.rotX * 0.5f;
-        
-        drawPickupObject(ren, g_hands.heldObject, cam);
+    SDL_Color color = node->color;
+    if (node->status == QUEST_LOCKED) {
+        color.r /= 3; color.g /= 3; color.b /= 3;
+    } else if (node->status == QUEST_COMPLETED) {
+        color.r = 200; color.g = 200; color.b = 200;
     }
-}
-
-void updateCameraBob(Camera* cam, float deltaTime) {
-    float speed = sqrtf(cam->vx * cam->vx + cam->vz * cam->vz);
     
-    if (speed > 0.01f) {
-        cam->isMoving = 1;
-        
-        float bobFrequency = cam->isRunning ? 12.0f : 8.0f;
-        float bobAmplitude = cam->isRunning ? 0.08f : (cam->isCrouching ? 0.03f : 0.05f);
-        
-        cam->bobPhase += bobFrequency * deltaTime * speed * 5.0f;
-        cam->bobAmount = lerp(cam->bobAmount, 1.0f, deltaTime * 8.0f);
-        
-        float verticalBob = fast_sin(cam->bobPhase) * bobAmplitude * cam->bobAmount;
-        float horizontalBob = fast_sin(cam->bobPhase * 0.5f) * bobAmplitude * 0.5f * cam->bobAmount;
-        
-        cam->currentBobY = lerp(cam->currentBobY, verticalBob, deltaTime * 15.0f);
-        cam->currentBobX = lerp(cam->currentBobX, horizontalBob, deltaTime * 15.0f);
-    } else {
-        cam->isMoving = 0;
-        
-        cam->bobAmount = lerp(cam->bobAmount, 0.0f, deltaTime * 6.0f);
-        cam->currentBobY = lerp(cam->currentBobY, 0.0f, deltaTime * 8.0f);
-        cam->currentBobX = lerp(cam->currentBobX, 0.0f, deltaTime * 8.0f);
+    for (int i = 0; i < 4; i++) {
+        clipAndDrawLine(ren, top, corners[i], cam, color);
+        clipAndDrawLine(ren, corners[i], corners[(i+1)%4], cam, color);
     }
     
-    if (!cam->isMoving) {
-        float breathe = fast_sin(SDL_GetTicks() * 0.001f) * 0.01f;
-        cam->currentBobY += breathe;
+    for (int i = 0; i < 4; i++) {
+        clipAndDrawLine(ren, bottom, corners[i], cam, color);
+    }
+    
+    if (node->status == QUEST_AVAILABLE) {
+        Vec3 markTop = {node->worldPos.x, node->worldPos.y + scale + 1.5f, node->worldPos.z};
+        Vec3 markBottom = {node->worldPos.x, node->worldPos.y + scale + 0.5f, node->worldPos.z};
+        SDL_Color yellow = {255, 255, 0, 255};
+        clipAndDrawLine(ren, markTop, markBottom, cam, yellow);
     }
 }
 
-int checkCollision(float x, float y, float z, float radius, CollisionBox* boxes, int numBoxes) {
-    for (int i = 0; i < numBoxes; i++) {
-        CollisionBox* box = &boxes[i];
-        
-        float boxMinX = box->pos.x + box->bounds.minX;
-        float boxMaxX = box->pos.x + box->bounds.maxX;
-        float boxMinY = box->pos.y + box->bounds.minY;
-        float boxMaxY = box->pos.y + box->bounds.maxY;
-        float boxMinZ = box->pos.z + box->bounds.minZ;
-        float boxMaxZ = box->pos.z + box->bounds.maxZ;
-        
-        boxMinX -= radius;
-        boxMaxX += radius;
-        boxMinY -= radius;
-        boxMaxY += radius;
-        boxMinZ -= radius;
-        boxMaxZ += radius;
+void drawQuestConnections(RenderBackend* ren, QuestSystem* qs, Camera cam, float time) {
+    for (int i = 0; i < qs->numNodes; i++) {
+        QuestNode* node = &qs->nodes[i];
         
-        if (x >= boxMinX && x <= boxMaxX &&
-            y >= boxMinY && y <= boxMaxY &&
-            z >= boxMinZ && z <= boxMaxZ) {
-            return 1;
+        for (int j = 0; j < node->numUnlocks; j++) {
+            int targetId = node->unlocksQuests[j];
+            QuestNode* target = &qs->nodes[targetId];
+            
+            SDL_Color lineColor = {100, 100, 100, 255};
+            
+            if (node->status == QUEST_COMPLETED) {
+                float glow = fast_sin(time * 2.0f + i) * 0.5f + 0.5f;
+                lineColor.r = 100 + glow * 155;
+                lineColor.g = 100 + glow * 155;
+                lineColor.b = 255;
+            }
+            
+            // Размер связи на экране - по описанной сфере вокруг её середины
+            Vec3 mid = {
+                (node->worldPos.x + target->worldPos.x) * 0.5f,
+                (node->worldPos.y + target->worldPos.y) * 0.5f,
+                (node->worldPos.z + target->worldPos.z) * 0.5f
+            };
+            float halfLength = 0.5f * sqrtf(
+                powf(target->worldPos.x - node->worldPos.x, 2) +
+                powf(target->worldPos.y - node->worldPos.y, 2) +
+                powf(target->worldPos.z - node->worldPos.z, 2)
+            );
+            LodLevel lod = Lod_Select(Lod_ProjectedSize(mid, halfLength, cam), &node->unlockLinkLod[j]);
+            if (lod == LOD_POINT) {
+                clipAndDrawLine(ren, mid, mid, cam, lineColor);
+                continue;
+            }
+
+            int segments = (lod == LOD_FULL) ? 10 : 4;
+            for (int s = 0; s < segments; s += 2) {
+                Vec3 start = {
+                    node->worldPos.x + (target->worldPos.x - node->worldPos.x) * s / segments,
+                    node->worldPos.y + (target->worldPos.y - node->worldPos.y) * s / segments,
+                    node->worldPos.z + (target->worldPos.z - node->worldPos.z) * s / segments
+                };
+                Vec3 end = {
+                    node->worldPos.x + (target->worldPos.x - node->worldPos.x) * (s+1) / segments,
+                    node->worldPos.y + (target->worldPos.y - node->worldPos.y) * (s+1) / segments,
+                    node->worldPos.z + (target->worldPos.z - node->worldPos.z) * (s+1) / segments
+                };
+                clipAndDrawLine(ren, start, end, cam, lineColor);
+            }
         }
     }
-    return 0;
 }
 
-// Добавь после функции checkCollision:
-
-// Проверяет, находится ли точка внутри какого-либо объекта
-int isPositionInsideBox(Vec3 pos, CollisionBox* boxes, int numBoxes) {
-    for (int i = 0; i < numBoxes; i++) {
-        CollisionBox* box = &boxes[i];
+void updateQuestSystem(QuestSystem* qs, Camera* cam, float playerRadius) {
+    for (int i = 0; i < qs->numNodes; i++) {
+        QuestNode* node = &qs->nodes[i];
         
-        // Проверяем, находится ли точка внутри границ бокса
-        if (pos.x >= box->pos.x + box->bounds.minX &&
-            pos.x <= box->pos.x + box->bounds.maxX &&
-            pos.y >= box->pos.y + box->bounds.minY &&
-            pos.y <= box->pos.y + box->bounds.maxY &&
-            pos.z >= box->pos.z + box->bounds.minZ &&
-            pos.z <= box->pos.z + box->bounds.maxZ) {
-            return 1; // Позиция занята
+        float dist = sqrtf(
+            powf(cam->x - node->worldPos.x, 2) +
+            powf(cam->y - node->worldPos.y, 2) +
+            powf(cam->z - node->worldPos.z, 2)
+        );
+        
+        if (dist < 2.0f && node->status == QUEST_AVAILABLE) {
+            const Uint8* keys = SDL_GetKeyboardState(NULL);
+            if (keys[SDL_SCANCODE_E]) {
+                node->status = QUEST_ACTIVE;
+                qs->activeQuestId = node->id;
+                
+                printf("Quest started: %s\n", node->name);
+            }
+        }
+        
+        if (node->status == QUEST_LOCKED) {
+            int allCompleted = 1;
+            for (int j = 0; j < node->numRequired; j++) {
+                if (qs->nodes[node->requiredQuests[j]].status != QUEST_COMPLETED) {
+                    allCompleted = 0;
+                    break;
+                }
+            }
+            if (allCompleted && node->numRequired > 0) {
+                node->status = QUEST_AVAILABLE;
+                printf("Quest unlocked: %s\n", node->name);
+            }
         }
     }
-    return 0; // Позиция свободна
 }
 
-// Находит безопасную позицию для спавна монеты
-Vec3 findSafeSpawnPosition(float baseX, float baseY, float baseZ, CollisionBox* boxes, int numBoxes) {
-    Vec3 pos = {baseX, baseY, baseZ};
-    
-    // Если позиция свободна, возвращаем её
-    if (!isPositionInsideBox(pos, boxes, numBoxes)) {
-        return pos;
-    }
-    
-    // Иначе ищем свободную позицию по спирали вокруг
-    float searchRadius = 1.0f;
-    int attempts = 0;
-    
-    while (attempts < 50) { // Максимум 50 попыток
-        float angle = (float)attempts * 0.5f;
-        float radius = searchRadius + (float)attempts * 0.2f;
-        
-        pos.x = baseX + fast_cos(angle) * radius;
-        pos.z = baseZ + fast_sin(angle) * radius;
-        pos.y = baseY;
+// --- ИСПРАВЛЕННАЯ ФУНКЦИЯ ПРОВЕРКИ ЦЕЛЕЙ ---
+void checkQuestObjectives(QuestSystem* qs, Camera* cam, CollisionBox* boxes, int numBoxes) {
+    if (qs->activeQuestId >= 0) {
+        QuestNode* quest = &qs->nodes[qs->activeQuestId];
         
-        if (!isPositionInsideBox(pos, boxes, numBoxes)) {
-            return pos; // Нашли свободную позицию
+        int allCompleted = 1;
+        for (int i = 0; i < quest->numObjectives; i++) {
+            QuestObjective* obj = &quest->objectives[i];
+            
+            switch(obj->type) {
+                case OBJECTIVE_REACH_POINT:
+                    // ИСПРАВЛЯЕМ: Проверяем, стоим ли мы на зелёной платформе
+                    if (obj->target) {
+                        Vec3* targetPos = (Vec3*)obj->target;
+                        
+                        // Проверяем расстояние до центра платформы
+                        float distXZ = sqrtf(powf(cam->x - targetPos->x, 2) + 
+                                           powf(cam->z - targetPos->z, 2));
+                        
+                        // Проверяем высоту - стоим ли мы НА платформе
+                        float platformTop = targetPos->y + boxes[1].bounds.maxY; // Используем bounds зелёной платформы
+                        float heightDiff = fabsf(cam->y - platformTop);
+                        
+                        // Засчитываем, если мы близко по горизонтали И стоим на платформе
+                        if (distXZ < 2.0f && heightDiff < 0.5f) {
+                            obj->currentProgress = 1;
+                            printf("Reached green platform!\n");
+                        }
+                    }
+                    break;
+                    
+                case OBJECTIVE_COLLECT_ITEM:
+                    // ИСПРАВЛЯЕМ: Берём данные из глобального счётчика монет
+                    obj->currentProgress = g_coinsCollected;
+                    break;
+            }
+            
+            if (obj->currentProgress < obj->requiredProgress) {
+                allCompleted = 0;
+            }
         }
         
-        attempts++;
+        if (allCompleted) {
+            quest->status = QUEST_COMPLETED;
+            printf("Quest completed: %s! Reward: %d XP\n", quest->name, quest->expReward);
+            qs->activeQuestId = -1;
+        }
     }
-    
-    // Если не нашли, поднимаем выше
-    pos.x = baseX;
-    pos.z = baseZ;
-    pos.y = baseY + 3.0f;
-    return pos;
 }
 
-int checkWallCollision(float x, float y, float z, float radius, CollisionBox* boxes, int numBoxes) {
-    for (int i = 0; i < numBoxes; i++) {
-        CollisionBox* box = &boxes[i];
+void drawQuestUI(RenderBackend* ren, TTF_Font* font, QuestSystem* qs) {
+    if (qs->activeQuestId >= 0) {
+        QuestNode* quest = &qs->nodes[qs->activeQuestId];
         
-        float boxMinX = box->pos.x + box->bounds.minX;
-        float boxMaxX = box->pos.x + box->bounds.maxX;
-        float boxMinY = box->pos.y + box->bounds.minY;
-        float boxMaxY = box->pos.y + box->bounds.maxY;
-        float boxMinZ = box->pos.z + box->bounds.minZ;
-        float boxMaxZ = box->pos.z + box->bounds.maxZ;
+        Render_SetBlendMode(ren, SDL_BLENDMODE_BLEND);
+        Render_SetColor(ren, 0, 0, 0, 180);
+        SDL_Rect bgRect = {WIDTH - 320, 20, 300, 100 + quest->numObjectives * 25};
+        Render_FillRect(ren, &bgRect);
         
-        if (y + radius > boxMinY && y - radius < boxMaxY) {
-            if (x + radius > boxMinX && x - radius < boxMaxX &&
-                z + radius > boxMinZ && z - radius < boxMaxZ) {
-                
-                float distToTop = fabsf(y - (boxMaxY + radius));
-                if (distToTop < 0.2f) {
-                    continue;
-                }
-                
-                return 1;
-            }
-        }
-    }
-    return 0;
-}
-
-float getGroundHeight(float x, float z, float playerRadius, CollisionBox* boxes, int numBoxes, int* foundGround) {
-    float highestGround = -999.0f;
-    *foundGround = 0;
-    
-    for (int i = 0; i < numBoxes; i++) {
-        CollisionBox* box = &boxes[i];
+        SDL_Color white = {255, 255, 255, 255};
+        SDL_Color yellow = {255, 255, 0, 255};
+        SDL_Color green = {100, 255, 100, 255};
         
-        if (x >= box->pos.x + box->bounds.minX - playerRadius &&
-            x <= box->pos.x + box->bounds.maxX + playerRadius &&
-            z >= box->pos.z + box->bounds.minZ - playerRadius &&
-            z <= box->pos.z + box->bounds.maxZ + playerRadius) {
+        drawText(ren, font, quest->name, WIDTH - 310, 30, yellow);
+        
+        for (int i = 0; i < quest->numObjectives; i++) {
+            QuestObjective* obj = &quest->objectives[i];
+            char buffer[256];
             
-            float boxTop = box->pos.y + box->bounds.maxY;
+            SDL_Color objColor = (obj->currentProgress >= obj->requiredProgress) ? green : white;
             
-            if (boxTop > highestGround) {
-                highestGround = boxTop;
-                *foundGround = 1;
-            }
+            snprintf(buffer, 256, "[%c] %s (%d/%d)",
+                    (obj->currentProgress >= obj->requiredProgress) ? 'X' : ' ',
+                    obj->description,
+                    obj->currentProgress,
+                    obj->requiredProgress);
+            
+            drawText(ren, font, buffer, WIDTH - 310, 60 + i * 25, objColor);
         }
     }
     
-    return highestGround;
+    // ДОБАВЛЯЕМ: Показываем общий счётчик монет
+    char coinCounter[64];
+    snprintf(coinCounter, 64, "Coins: %d/%d", g_coinsCollected, g_numCoins);
+    SDL_Color gold = {255, 215, 0, 255};
+    drawText(ren, font, coinCounter, 20, HEIGHT - 40, gold);
+
+    // Уровень качества виден всегда, чтобы было понятно, почему мир стал реже
+    char qualityText[64];
+    snprintf(qualityText, 64, "Quality: %s (%s)", Quality_Current()->name, g_qualityAutoNames[g_quality.autoAdjust]);
+    drawText(ren, font, qualityText, 20, HEIGHT - 65, g_quality.tier == QUALITY_HIGH ? (SDL_Color){150, 150, 150, 255} : (SDL_Color){255, 140, 60, 255});
 }
 
-int isGrounded(Camera* cam, float playerRadius, CollisionBox* boxes, int numBoxes) {
-    if (cam->y <= 0.01f && cam->vy <= 0) {
-        return 1;
+void spawnGlitches(int count) {
+    printf("RKN-chan is summoning glitches!\n");
+    g_activeGlitches = 0;
+    for (int i = 0; i < count && i < MAX_GLITCHES; i++) {
+        g_glitchBytes[i].active = 1;
+        float angle = ((float)rand() / RAND_MAX) * 2.0f * M_PI;
+        float distance = 5.0f + ((float)rand() / RAND_MAX) * 3.0f;
+        g_glitchBytes[i].pos.x = g_rknChan.pos.x + fast_cos(angle) * distance;
+        g_glitchBytes[i].pos.y = 1.5f;
+        g_glitchBytes[i].pos.z = g_rknChan.pos.z + fast_sin(angle) * distance;
+        g_glitchBytes[i].velocity = (Vec3){0, 0, 0};
+        g_glitchBytes[i].jitter = 0.0f;
+        g_activeGlitches++;
     }
-    
-    int foundGround;
-    float groundHeight = getGroundHeight(cam->x, cam->z, playerRadius, boxes, numBoxes, &foundGround);
-    
-    if (foundGround) {
-        float distToGround = cam->y - (groundHeight + playerRadius);
-        if (distToGround <= 0.1f && distToGround >= -0.1f && cam->vy <= 0) {
-            return 1;
+}
+
+void initBoss() {
+    g_rknChan.pos = (Vec3){0, 1, 15}; // Поставим её в дальнем конце арены
+    g_rknChan.maxHealth = BOSS_MAX_HEALTH;
+    g_rknChan.health = BOSS_MAX_HEALTH;
+    g_rknChan.state = BOSS_STATE_IDLE;
+    g_rknChan.stateTimer = 3.0f; // Через 3 секунды начнёт действовать
+    g_bossFightActive = 1; // Битва началась!
+    printf("A wild RKN-chan appeared!\n");
+}
+
+// --- ИНСТАНСИНГ МЕШЕЙ ---
+// Один меш (вершины + рёбра) рисуется сразу для пачки экземпляров. Камера считается
+// один раз, экземпляры за пирамидой видимости отсекаются целиком по описанной сфере,
+// а вершины всех видимых экземпляров уходят в систему камеры одним SIMD-проходом -
+// каждая вершина ровно один раз, а не по разу на каждое ребро.
+
+typedef struct {
+    int numVertices;
+    const Vec3* vertices;   // Единичный масштаб, центр в (0,0,0)
+    int numEdges;
+    const int (*edges)[2];
+    float boundRadius;      // Радиус описанной сферы при scale = 1
+    int isBox;              // Вершины в нумерации getBoxVertices: рёбра режем по граням (classifyBoxEdges)
+} InstancedMesh;
+
+typedef struct {
+    Vec3 pos;
+    float scale;
+    SDL_Color color;
+} MeshInstance;
+
+static const Vec3 g_cubeMeshVertices[8] = {
+    {-0.5f, -0.5f, -0.5f}, { 0.5f, -0.5f, -0.5f}, { 0.5f,  0.5f, -0.5f}, {-0.5f,  0.5f, -0.5f},
+    {-0.5f, -0.5f,  0.5f}, { 0.5f, -0.5f,  0.5f}, { 0.5f,  0.5f,  0.5f}, {-0.5f,  0.5f,  0.5f}
+};
+const InstancedMesh g_cubeMesh = { 8, g_cubeMeshVertices, 12, BOX_EDGES, 0.8660254f, 1 };
+
+// Сфера (центр уже в системе камеры) против ближней, дальней и боковых плоскостей
+static int isSphereInView(float x, float y, float z, float radius) {
+    if (z + radius < NEAR_PLANE) return 0;
+    if (g_fog.active && z - radius > g_fog.farPlane) return 0;
+    // Боковые плоскости проходят через глаз: |x| * fov <= z * (половина ширины вида)
+    float fov = g_fov;
+    float halfW = (g_view.x1 - g_view.x0) * 0.5f, halfH = (g_view.y1 - g_view.y0) * 0.5f;
+    if (fabsf(x) * fov - z * halfW > radius * sqrtf(fov * fov + halfW * halfW)) return 0;
+    if (fabsf(y) * fov - z * halfH > radius * sqrtf(fov * fov + halfH * halfH)) return 0;
+    return 1;
+}
+
+void drawMeshInstanced(RenderBackend* ren, const InstancedMesh* mesh, const MeshInstance* instances, int count, Camera cam) {
+    if (count <= 0 || mesh->numVertices > INSTANCE_BATCH_VERTS) return;
+    CameraTransform ct = CameraTransform_From(cam);
+    int perChunk = INSTANCE_BATCH_VERTS / mesh->numVertices;
+    int visible[INSTANCE_BATCH_VERTS];
+
+    for (int first = 0; first < count; first += perChunk) {
+        int chunk = count - first < perChunk ? count - first : perChunk;
+
+        // 1. Центры экземпляров - одним проходом, и сразу отсечение целых экземпляров
+        for (int i = 0; i < chunk; i++) {
+            g_batchWX[i] = instances[first + i].pos.x;
+            g_batchWY[i] = instances[first + i].pos.y;
+            g_batchWZ[i] = instances[first + i].pos.z;
+        }
+        transformBatchToCameraSpace(&ct, chunk);
+        int numVisible = 0;
+        for (int i = 0; i < chunk; i++) {
+            float radius = mesh->boundRadius * instances[first + i].scale;
+            if (isSphereInView(g_batchCX[i], g_batchCY[i], g_batchCZ[i], radius)) {
+                visible[numVisible++] = first + i;
+            } else {
+                g_rasterStats.instancesCulled++;
+            }
+        }
+        if (numVisible == 0) continue;
+
+        // 2. Вершины всех видимых экземпляров - второй проход
+        int n = 0;
+        for (int k = 0; k < numVisible; k++) {
+            const MeshInstance* inst = &instances[visible[k]];
+            for (int v = 0; v < mesh->numVertices; v++, n++) {
+                g_batchWX[n] = inst->pos.x + mesh->vertices[v].x * inst->scale;
+                g_batchWY[n] = inst->pos.y + mesh->vertices[v].y * inst->scale;
+                g_batchWZ[n] = inst->pos.z + mesh->vertices[v].z * inst->scale;
+            }
+        }
+        transformBatchToCameraSpace(&ct, n);
+
+        // 3. Рёбра: отсечение, проекция и растеризация как у обычной линии.
+        // У бокса вершины уже в системе камеры, так что глаз для проверки граней - (0,0,0)
+        unsigned char edgeFlags[12];
+        for (int k = 0; k < numVisible; k++) {
+            int base = k * mesh->numVertices;
+            SDL_Color color = instances[visible[k]].color;
+            if (mesh->isBox) {
+                Vec3 cv[8];
+                for (int v = 0; v < 8; v++) cv[v] = (Vec3){g_batchCX[base + v], g_batchCY[base + v], g_batchCZ[base + v]};
+                classifyBoxEdges(cv, (Vec3){0, 0, 0}, edgeFlags);
+            }
+            for (int e = 0; e < mesh->numEdges; e++) {
+                if (mesh->isBox && edgeFlags[e] == BOX_EDGE_HIDDEN) continue;
+                int i0 = base + mesh->edges[e][0], i1 = base + mesh->edges[e][1];
+                drawCameraSpaceLine(ren, (Vec3){g_batchCX[i0], g_batchCY[i0], g_batchCZ[i0]},
+                                         (Vec3){g_batchCX[i1], g_batchCY[i1], g_batchCZ[i1]}, color);
+            }
+            g_rasterStats.instancesDrawn++;
         }
     }
-    
-    return 0;
 }
 
-void drawOptimizedBox(SDL_Renderer* ren, CollisionBox* box, Camera cam) {
-    // 1. Получаем 8 вершин бокса в мировых координатах (как и раньше)
-    Vec3 vertices[8];
-    vertices[0] = (Vec3){box->pos.x + box->bounds.minX, box->pos.y + box->bounds.minY, box->pos.z + box->bounds.minZ};
-    vertices[1] = (Vec3){box->pos.x + box->bounds.maxX, box->pos.y + box->bounds.minY, box->pos.z + box->bounds.minZ};
-    vertices[2] = (Vec3){box->pos.x + box->bounds.maxX, box->pos.y + box->bounds.maxY, box->pos.z + box->bounds.minZ};
-    vertices[3] = (Vec3){box->pos.x + box->bounds.minX, box->pos.y + box->bounds.maxY, box->pos.z + box->bounds.minZ};
-    vertices[4] = (Vec3){box->pos.x + box->bounds.minX, box->pos.y + box->bounds.minY, box->pos.z + box->bounds.maxZ};
-    vertices[5] = (Vec3){box->pos.x + box->bounds.maxX, box->pos.y + box->bounds.minY, box->pos.z + box->bounds.maxZ};
-    vertices[6] = (Vec3){box->pos.x + box->bounds.maxX, box->pos.y + box->bounds.maxY, box->pos.z + box->bounds.maxZ};
-    vertices[7] = (Vec3){box->pos.x + box->bounds.minX, box->pos.y + box->bounds.maxY, box->pos.z + box->bounds.maxZ};
+// Простая функция для отрисовки куба в любой точке мира
+void drawWorldCube(RenderBackend* ren, Vec3 center, float size, Camera cam, SDL_Color color) {
+    MeshInstance instance = { center, size, color };
+    drawMeshInstanced(ren, &g_cubeMesh, &instance, 1, cam);
+}
 
-    // 2. Определяем геометрию куба: 6 граней, каждая из 4 вершин.
-    // Это индексы вершин из массива vertices[]
-    static const int faces[6][4] = {
-        {0, 1, 2, 3}, // Передняя
-        {5, 4, 7, 6}, // Задняя
-        {4, 0, 3, 7}, // Левая
-        {1, 5, 6, 2}, // Правая
-        {3, 2, 6, 7}, // Верхняя
-        {4, 5, 1, 0}  // Нижняя
-    };
+void drawBoss(RenderBackend* ren, Camera cam) {
+    if (!g_bossFightActive || g_rknChan.state == BOSS_STATE_DEFEATED) return;
 
-    // 3. Нормали для каждой из 6 граней (векторы, "смотрящие" наружу)
-    static const Vec3 face_normals[6] = {
-        {0, 0, -1}, // Передняя
-        {0, 0, 1},  // Задняя
-        {-1, 0, 0}, // Левая
-        {1, 0, 0},  // Правая
-        {0, 1, 0},  // Верхняя
-        {0, -1, 0}  // Нижняя
+    // Цвет тела
+    SDL_Color bodyColor = {50, 50, 80, 255};
+    if (g_rknChan.state == BOSS_STATE_VULNERABLE) {
+        bodyColor = (SDL_Color){255, 100, 100, 255}; // Краснеет, когда уязвима
+    }
+    // Тело, голова и банхаммер - одной пачкой
+    MeshInstance parts[3] = {
+        { g_rknChan.pos, 2.0f, bodyColor },
+        { {g_rknChan.pos.x, g_rknChan.pos.y + 1.5f, g_rknChan.pos.z}, 1.0f, {200, 200, 220, 255} },
+        { {g_rknChan.pos.x + 1.5f, g_rknChan.pos.y, g_rknChan.pos.z}, 1.5f, {100, 80, 70, 255} }
     };
+    drawMeshInstanced(ren, &g_cubeMesh, parts, 3, cam);
+}
 
-    // 4. Главный цикл: проходим по 6 граням, а не 12 ребрам
-    for (int i = 0; i < 6; i++) {
-        // Вектор от камеры к центру объекта (можно использовать любую точку на грани, центр проще всего)
-        Vec3 to_face = {
-            box->pos.x - cam.x,
-            box->pos.y - cam.y,
-            box->pos.z - cam.z
-        };
-
-        // Скалярное произведение (dot product).
-        // Если результат < 0, значит нормаль грани и вектор к камере смотрят
-        // в противоположные стороны. Это значит, что грань "смотрит" на нас!
-        if (dot(face_normals[i], to_face) < 0) {
-            
-            // Грань видима! Рисуем 4 ребра, которые ее составляют.
-            const int* face_verts = faces[i];
-            clipAndDrawLine(ren, vertices[face_verts[0]], vertices[face_verts[1]], cam, box->color);
-            clipAndDrawLine(ren, vertices[face_verts[1]], vertices[face_verts[2]], cam, box->color);
-            clipAndDrawLine(ren, vertices[face_verts[2]], vertices[face_verts[3]], cam, box->color);
-            clipAndDrawLine(ren, vertices[face_verts[3]], vertices[face_verts[0]], cam, box->color);
+void drawGlitches(RenderBackend* ren, Camera cam) {
+    if (g_activeGlitches == 0) return;
+    
+    SDL_Color glitchColor = {255, 0, 255, 255};
+    MeshInstance instances[MAX_GLITCHES];
+    int count = 0;
+    for (int i = 0; i < MAX_GLITCHES; i++) {
+        if (g_glitchBytes[i].active) {
+            Vec3 jitterPos = g_glitchBytes[i].pos;
+            jitterPos.x += fast_sin(g_glitchBytes[i].jitter) * 0.2f;
+            jitterPos.y += fast_cos(g_glitchBytes[i].jitter * 1.5f) * 0.2f;
+            jitterPos.z += fast_sin(g_glitchBytes[i].jitter * 0.8f) * 0.2f;
+            instances[count++] = (MeshInstance){ jitterPos, 0.5f, glitchColor };
         }
     }
+    drawMeshInstanced(ren, &g_cubeMesh, instances, count, cam);
 }
 
-void drawMaterializedFloor(SDL_Renderer* ren, Camera cam) {
-    if (g_worldEvolution.currentState < WORLD_STATE_MATERIALIZING) return;
-    
-    float opacity = g_worldEvolution.polygonOpacity;
-    if (opacity < 0.01f) return;
-    
-    SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
-    
-    // Цвет пола меняется с прогрессом
-    Uint8 baseColor = 40 + (Uint8)(g_worldEvolution.textureBlend * 60);
-    
-    // --- ОПТИМИЗАЦИЯ: Увеличиваем размер плиток ---
-    float tileSize = 4.0f;  // Было 2.0f
-    int viewRange = 12;      // Было 15
-    
-    for (float x = -viewRange; x < viewRange; x += tileSize) {
-        for (float z = -viewRange; z < viewRange; z += tileSize) {
-            // --- ОПТИМИЗАЦИЯ: Более строгая проверка расстояния ---
-            float distToCam = sqrtf(powf(x - cam.x, 2) + powf(z - cam.z, 2));
-            if (distToCam > 15.0f) continue;  // Было 20
-            
-            // Шахматный паттерн
-            int checkX = (int)(x / tileSize);
-            int checkZ = (int)(z / tileSize);
-            int isEven = (checkX + checkZ) % 2 == 0;
-            
-            SDL_Color tileColor;
-            if (g_worldEvolution.currentState >= WORLD_STATE_TEXTURED) {
-                if (isEven) {
-                    tileColor = (SDL_Color){baseColor, baseColor + 10, baseColor + 15, (Uint8)(opacity * 255)};
-                } else {
-                    tileColor = (SDL_Color){baseColor - 10, baseColor, baseColor + 5, (Uint8)(opacity * 255)};
-                }
-            } else {
-                tileColor = (SDL_Color){baseColor, baseColor, baseColor + 20, (Uint8)(opacity * 200)};
-            }
-            
-            Vec3 corners[4] = {
-                {x, -2.0f, z},
-                {x + tileSize, -2.0f, z},
-                {x + tileSize, -2.0f, z + tileSize},
-                {x, -2.0f, z + tileSize}
-            };
-            
-            // --- СУПЕР ОПТИМИЗАЦИЯ: Вместо заливки рисуем крест и контур ---
-            if (g_worldEvolution.currentState >= WORLD_STATE_REALISTIC) {
-                // Только контур + диагонали для иллюзии заливки
-                for (int i = 0; i < 4; i++) {
-                    clipAndDrawLine(ren, corners[i], corners[(i+1)%4], cam, tileColor);
-                }
-                // Диагонали для эффекта заливки
-                clipAndDrawLine(ren, corners[0], corners[2], cam, tileColor);
-                clipAndDrawLine(ren, corners[1], corners[3], cam, tileColor);
-                
-                // Центральный крест
-                Vec3 midH1 = {x + tileSize/2, -2.0f, z};
-                Vec3 midH2 = {x + tileSize/2, -2.0f, z + tileSize};
-                Vec3 midV1 = {x, -2.0f, z + tileSize/2};
-                Vec3 midV2 = {x + tileSize, -2.0f, z + tileSize/2};
-                clipAndDrawLine(ren, midH1, midH2, cam, tileColor);
-                clipAndDrawLine(ren, midV1, midV2, cam, tileColor);
-            } else {
-                // Только контур для производительности
-                for (int i = 0; i < 4; i++) {
-                    clipAndDrawLine(ren, corners[i], corners[(i+1)%4], cam, tileColor);
-                }
+void updateGlitches(float deltaTime, Camera* cam) {
+    if (g_activeGlitches == 0) return;
+
+    for (int i = 0; i < MAX_GLITCHES; i++) {
+        if (g_glitchBytes[i].active) {
+            g_glitchBytes[i].jitter += deltaTime * 20.0f;
+
+            // Движение к игроку
+            float dx = cam->x - g_glitchBytes[i].pos.x;
+            float dy = cam->y - g_glitchBytes[i].pos.y;
+            float dz = cam->z - g_glitchBytes[i].pos.z;
+            float dist = sqrtf(dx*dx + dy*dy + dz*dz);
+
+            if (dist > 0.1f) {
+                g_glitchBytes[i].pos.x += (dx / dist) * GLITCH_SPEED * deltaTime;
+                g_glitchBytes[i].pos.y += (dy / dist) * GLITCH_SPEED * deltaTime;
+                g_glitchBytes[i].pos.z += (dz / dist) * GLITCH_SPEED * deltaTime;
+            }
+
+            // Проверка "очистки" (коллизии с игроком)
+            if (dist < 1.0f) {
+                g_glitchBytes[i].active = 0;
+                g_activeGlitches--;
+                printf("Glitch cleared! Remaining: %d\n", g_activeGlitches);
             }
         }
     }
     
-    SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_NONE);
+    // Если все глюки зачищены, делаем босса уязвимым
+    if (g_activeGlitches == 0 && g_rknChan.state != BOSS_STATE_VULNERABLE) {
+        printf("All glitches cleared! RKN-chan is vulnerable!\n");
+        g_rknChan.state = BOSS_STATE_VULNERABLE;
+        g_rknChan.stateTimer = BOSS_VULNERABLE_DURATION;
+    }
 }
 
-void drawMaterializedBox(SDL_Renderer* ren, CollisionBox* box, Camera cam) {
-    // В режиме реализма делаем грани непрозрачными
-    float opacity = g_worldEvolution.polygonOpacity;
-    
-    if (g_worldEvolution.currentState >= WORLD_STATE_REALISTIC) {
-        opacity = 1.0f;  // Полная непрозрачность в режиме реализма
-    }
-    
-    // Каркас рисуем только если не в режиме реализма
-    if (g_worldEvolution.currentState < WORLD_STATE_REALISTIC) {
-        drawOptimizedBox(ren, box, cam);
-    }
+
+void updateBoss(float deltaTime, Camera* cam) {
+    if (!g_bossFightActive || g_rknChan.state == BOSS_STATE_DEFEATED) return;
+
+    g_rknChan.stateTimer -= deltaTime;
+
+    // Вектор от босса к игроку
+    float dx = cam->x - g_rknChan.pos.x;
+    float dz = cam->z - g_rknChan.pos.z;
+    float distance = sqrtf(dx*dx + dz*dz);
     
-    // Материализованные грани
-    if (g_worldEvolution.currentState >= WORLD_STATE_MATERIALIZING) {
-        SDL_Color materialColor;
-        
-        if (g_worldEvolution.currentState >= WORLD_STATE_REALISTIC) {
-            // В режиме реализма - полные насыщенные цвета
-            materialColor = (SDL_Color){
-                box->color.r,
-                box->color.g,
-                box->color.b,
-                255  // Полностью непрозрачный
-            };
-        } else {
-            // В промежуточных режимах - полупрозрачность
-            materialColor = (SDL_Color){
-                (Uint8)(box->color.r * 0.7f),
-                (Uint8)(box->color.g * 0.7f),
-                (Uint8)(box->color.b * 0.7f),
-                (Uint8)(opacity * 150)
-            };
-        }
-        
-        SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
-        
-        Vec3 center = box->pos;
-        
-        // --- ОПТИМИЗАЦИЯ: Рисуем только видимые грани ---
-        Vec3 toCam = {cam.x - center.x, cam.y - center.y, cam.z - center.z};
-        
-        // Определяем какие грани видны
-        int drawFront = (toCam.z < 0);
-        int drawBack = (toCam.z > 0);
-        int drawLeft = (toCam.x < 0);
-        int drawRight = (toCam.x > 0);
-        int drawTop = (toCam.y > center.y);
-        
-        float step = (g_worldEvolution.currentState >= WORLD_STATE_REALISTIC) ? 0.15f : 0.3f;
-        
-        // Передняя грань
-        if (drawFront) {
-            for (float y = box->bounds.minY; y < box->bounds.maxY; y += step) {
-                Vec3 p1 = {center.x + box->bounds.minX, center.y + y, center.z + box->bounds.minZ};
-                Vec3 p2 = {center.x + box->bounds.maxX, center.y + y, center.z + box->bounds.minZ};
-                clipAndDrawLine(ren, p1, p2, cam, materialColor);
+    switch(g_rknChan.state) {
+        case BOSS_STATE_IDLE:
+            if (g_rknChan.stateTimer <= 0) {
+                g_rknChan.state = BOSS_STATE_CHASING;
+                g_rknChan.stateTimer = 7.0f; // Преследовать 7 секунд
             }
-        }
-        
-        // Верхняя грань (важна для платформ)
-        if (drawTop) {
-            SDL_Color topColor = materialColor;
-            if (g_worldEvolution.currentState >= WORLD_STATE_REALISTIC) {
-                // Верх светлее (освещение)
-                topColor.r = fminf(255, topColor.r + 30);
-                topColor.g = fminf(255, topColor.g + 30);
-                topColor.b = fminf(255, topColor.b + 30);
+            break;
+
+        case BOSS_STATE_CHASING:
+            // Двигается к игроку
+            if (distance > 0.1f) {
+                g_rknChan.pos.x += (dx / distance) * BOSS_SPEED * deltaTime;
+                g_rknChan.pos.z += (dz / distance) * BOSS_SPEED * deltaTime;
+            }
+            if (g_rknChan.stateTimer <= 0) {
+                g_rknChan.state = BOSS_STATE_SUMMONING_GLITCHES;
+                g_rknChan.stateTimer = 2.0f; // 2 секунды каста
+            }
+            break;
+
+        case BOSS_STATE_SUMMONING_GLITCHES:
+            // Стоит на месте, "кастует"
+            if (g_rknChan.stateTimer <= 0) {
+                spawnGlitches(MAX_GLITCHES);
+                g_rknChan.state = BOSS_STATE_IDLE;
+                g_rknChan.stateTimer = 999.0f; // Ждет, пока не зачистят глюки
             }
+            break;
             
-            for (float x = box->bounds.minX; x < box->bounds.maxX; x += step) {
-                Vec3 p1 = {center.x + x, center.y + box->bounds.maxY, center.z + box->bounds.minZ};
-                Vec3 p2 = {center.x + x, center.y + box->bounds.maxY, center.z + box->bounds.maxZ};
-                clipAndDrawLine(ren, p1, p2, cam, topColor);
+        case BOSS_STATE_VULNERABLE:
+            // Проверяем, наносит ли игрок урон
+            if (distance < 3.0f) { // Нужно подойти вплотную для урона
+                g_rknChan.health -= 20.0f * deltaTime; // Теряет 20 хп в секунду
+                 if (g_rknChan.health <= 0) {
+                    g_rknChan.health = 0;
+                    g_rknChan.state = BOSS_STATE_DEFEATED;
+                    printf("RKN-chan has been defeated! The Internet is free!\n");
+                 }
             }
-        }
-        
-        // В режиме реализма добавляем контур для чёткости
-        if (g_worldEvolution.currentState >= WORLD_STATE_REALISTIC) {
-            SDL_Color outlineColor = {
-                (Uint8)(box->color.r * 0.5f),
-                (Uint8)(box->color.g * 0.5f),
-                (Uint8)(box->color.b * 0.5f),
-                255
-            };
-            drawOptimizedBox(ren, box, cam);  // Рисуем контур поверх
-        }
+            if (g_rknChan.stateTimer <= 0) {
+                printf("RKN-chan is no longer vulnerable.\n");
+                g_rknChan.state = BOSS_STATE_IDLE;
+                g_rknChan.stateTimer = 2.0f;
+            }
+            break;
         
-        SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_NONE);
+        default: break;
     }
 }
 
-// [Продолжение в следующем сообщении...]
+void drawBossUI(RenderBackend* ren) {
+    if (!g_bossFightActive || g_rknChan.state == BOSS_STATE_DEFEATED) return;
 
-// --- ФУНКЦИИ ДЛЯ МОНЕТ ---
-void initCoins() {
-    g_numCoins = 45;  // Много монет для эволюции
+    int barWidth = WIDTH / 2;
+    int barHeight = 20;
+    int barX = (WIDTH - barWidth) / 2;
+    int barY = 30;
+
+    // Фон
+    Render_SetColor(ren, 50, 50, 50, 200);
+    SDL_Rect bgRect = {barX, barY, barWidth, barHeight};
+    Render_FillRect(ren, &bgRect);
+
+    // Полоска здоровья
+    float healthPercent = g_rknChan.health / g_rknChan.maxHealth;
+    Render_SetColor(ren, 200, 40, 40, 220);
+    SDL_Rect hpRect = {barX, barY, (int)(barWidth * healthPercent), barHeight};
+    Render_FillRect(ren, &hpRect);
+}
+
+#define POINT_FRUSTUM_MIN_COS 0.3f
+
+// Проверяет, находится ли точка в упрощенной "пирамиде видимости" камеры
+int isPointInFrustum(Vec3 point, Camera cam) {
+    // --- 1. Проверка расстояния (отсечение по ближней и дальней плоскости) ---
+    float dx = point.x - cam.x;
+    float dz = point.z - cam.z;
+    float distanceSq = dx*dx + dz*dz; // Используем квадрат расстояния, чтобы не считать корень
+
+    // Дальше дальней плоскости тумана не рисуем
+    if (distanceSq > g_fog.farPlane * g_fog.farPlane) {
+        return 0; // Слишком далеко
+    }
     
-    // Счётчик реально созданных монет
-    int actualCoins = 0;
+    // --- 2. Проверка по углу обзора (отсечение по боковым плоскостям) ---
+    // Вектор направления камеры
+    Vec3 camDir = {fast_sin(cam.rotY), 0, fast_cos(cam.rotY)};
     
-    // Генерируем монеты по спирали, избегая коллизий
-    for (int i = 0; i < g_numCoins && i < 50; i++) {
-        float angle = ((float)i / 10.0f) * 2.0f * M_PI;
-        float radius = 4.0f + (float)(i / 5) * 2.5f;  // Расширяющаяся спираль
-        
-        // Базовая позиция
-        float baseX = fast_cos(angle) * radius;
-        float baseZ = fast_sin(angle) * radius;
-        float baseY = 0.5f + fast_sin((float)i * 0.3f) * 0.5f;  // Разная высота
-        
-        // Находим безопасную позицию
-        Vec3 safePos = findSafeSpawnPosition(baseX, baseY, baseZ, collisionBoxes, numCollisionBoxes);
-        
-        // Дополнительная проверка - не слишком ли близко к другим монетам
-        int tooClose = 0;
-        for (int j = 0; j < actualCoins; j++) {
-            float dist = sqrtf(
-                powf(safePos.x - g_coins[j].pos.x, 2) +
-                powf(safePos.y - g_coins[j].pos.y, 2) +
-                powf(safePos.z - g_coins[j].pos.z, 2)
-            );
-            if (dist < 1.5f) { // Минимальное расстояние между монетами
-                tooClose = 1;
-                break;
-            }
-        }
-        
-        if (!tooClose) {
-            g_coins[actualCoins].pos = safePos;
-            g_coins[actualCoins].collected = 0;
-            g_coins[actualCoins].rotationPhase = (float)i * 0.5f;
-            g_coins[actualCoins].bobPhase = (float)i * 0.3f;
-            actualCoins++;
-        }
+    // Вектор от камеры к точке
+    Vec3 pointDir = {dx, 0, dz};
+    
+    // Нормализуем вектор к точке (для dot product)
+    float pointDirLen = sqrtf(distanceSq);
+    if (pointDirLen < 1e-6f) return 1; // Если точка в камере, считаем видимой
+    pointDir.x /= pointDirLen;
+    pointDir.z /= pointDirLen;
+    
+    // Скалярное произведение векторов. dot(A, B) = cos(угол между A и B), если векторы нормализованы.
+    float dotProduct = dot(camDir, pointDir);
+    
+    // g_fov у вас большой, поэтому возьмем широкий угол. 
+    // cos(60 градусов) ~ 0.5. Если dotProduct меньше этого, значит угол больше 60, и точка сбоку.
+    // Настройте значение POINT_FRUSTUM_MIN_COS под себя. Чем оно меньше, тем шире угол обзора для отсечения.
+    if (dotProduct < POINT_FRUSTUM_MIN_COS) {
+        return 0; // Точка находится слишком сбоку от направления взгляда
     }
+
+    return 1; // Точка видна
+}
+
+// Вычисляет радиус описывающей сферы для CollisionBox
+float getBoundingSphereRadius(CollisionBox* box) {
+    // Находим самую "дальнюю" точку от центра бокса по всем осям
+    float dx = fmaxf(fabsf(box->bounds.minX), fabsf(box->bounds.maxX));
+    float dy = fmaxf(fabsf(box->bounds.minY), fabsf(box->bounds.maxY));
+    float dz = fmaxf(fabsf(box->bounds.minZ), fabsf(box->bounds.maxZ));
     
-    g_numCoins = actualCoins; // Обновляем реальное количество монет
-    g_coinsCollected = 0;
+    // Радиус - это расстояние от центра (0,0,0) до этой дальней точки
+    return sqrtf(dx*dx + dy*dy + dz*dz);
+}
+
+int isBoxInFrustum_Improved(CollisionBox* box, Camera cam) {
+    float radius = getBoundingSphereRadius(box);
+    Vec3 pos = box->pos;
+
+    // --- 1. Проверка на слишком близкое/далекое расстояние ---
+    float dx = pos.x - cam.x;
+    float dz = pos.z - cam.z;
+    float distanceSq = dx*dx + dz*dz;
+    float distance = sqrtf(distanceSq);
+
+    // Если объект слишком далеко (с учетом его радиуса) или слишком близко, отсекаем
+    if (distance > g_fog.farPlane + radius || distance < NEAR_PLANE - radius) {
+        return 0;
+    }
+    
+    // --- 2. Улучшенная проверка по углу обзора ---
+    Vec3 camDir = {fast_sin(cam.rotY), 0, fast_cos(cam.rotY)}; // Вектор взгляда камеры
+    Vec3 toObject = {dx, 0, dz}; // Вектор от камеры к центру объекта
     
-    printf("🪙 Spawned %d coins in safe positions\n", g_numCoins);
-}
+    // Проекция вектора toObject на вектор camDir. Это расстояние 'd' вдоль луча взгляда.
+    float d = dot(toObject, camDir);
 
-void updateCoins(float deltaTime) {
-    for (int i = 0; i < g_numCoins; i++) {
-        if (!g_coins[i].collected) {
-            g_coins[i].rotationPhase += deltaTime * 3.0f;
-            g_coins[i].bobPhase += deltaTime * 2.0f;
-        }
+    // Если d отрицательно, и объект далеко, то он точно сзади
+    if (d < 0 && distance > radius) {
+        return 0; // Объект сзади
     }
-}
 
-// Добавь в drawCoin для визуальной обратной связи:
+    // Находим ближайшую к центру объекта точку на линии взгляда камеры
+    Vec3 closestPointOnRay;
+    closestPointOnRay.x = cam.x + camDir.x * d;
+    closestPointOnRay.y = cam.y; // Мы делаем проверку в 2D (XZ) для простоты
+    closestPointOnRay.z = cam.z + camDir.z * d;
 
-void drawCoin(SDL_Renderer* ren, Coin* coin, Camera cam) {
-    if (coin->collected) return;
-    
-    float bobOffset = fast_sin(coin->bobPhase) * 0.2f;
-    float rotation = coin->rotationPhase;
-    
-    Vec3 center = {coin->pos.x, coin->pos.y + bobOffset, coin->pos.z};
-    
-    // --- ПРОВЕРЯЕМ РАССТОЯНИЕ ДО ИГРОКА ---
-    float distToPlayer = sqrtf(
-        powf(cam.x - coin->pos.x, 2) +
-        powf(cam.y - coin->pos.y, 2) +
-        powf(cam.z - coin->pos.z, 2)
-    );
-    
-    // Меняем размер и цвет в зависимости от расстояния
-    float radius = 0.3f;
-    SDL_Color goldColor = {255, 215, 0, 255};
-    
-    if (distToPlayer < 2.0f) {
-        // Близко - монета пульсирует
-        radius = 0.3f + fast_sin(SDL_GetTicks() * 0.01f) * 0.05f;
-        
-        if (distToPlayer < 1.5f) {
-            // Очень близко - меняем цвет
-            goldColor = (SDL_Color){255, 240, 100, 255};
-            radius = 0.35f + fast_sin(SDL_GetTicks() * 0.02f) * 0.08f;
-        }
+    // Расстояние от центра объекта до этой ближайшей точки
+    float distToRaySq = powf(pos.x - closestPointOnRay.x, 2) + 
+                        powf(pos.z - closestPointOnRay.z, 2);
+
+    // Если квадрат этого расстояния меньше квадрата радиуса, то сфера объекта пересекает центральный луч взгляда
+    if (distToRaySq < radius * radius) {
+        return 1; // Мы точно видим объект
     }
     
-    int segments = 8;
-    Vec3 points[8];
-    
-    for (int i = 0; i < segments; i++) {
-        float angle = (float)i / segments * 2.0f * M_PI + rotation;
-        points[i].x = center.x + fast_cos(angle) * radius * fabsf(fast_cos(rotation));
-        points[i].y = center.y + fast_sin(angle) * radius * 0.3f;
-        points[i].z = center.z + fast_sin(angle) * radius * fabsf(fast_sin(rotation));
-    }
+    // --- 3. Проверка по краям поля зрения ---
+    // Это более сложная часть, но мы можем схитрить.
+    // Мы знаем 'd' (расстояние по лучу) и 'distToRay' (расстояние вбок от луча).
+    // Это образует прямоугольный треугольник. Тангенс угла до объекта = distToRay / d.
     
-    // Рисуем грани монеты
-    for (int i = 0; i < segments; i++) {
-        clipAndDrawLine(ren, points[i], points[(i + 1) % segments], cam, goldColor);
-    }
+    float distToRay = sqrtf(distToRaySq);
     
-    // Центральные линии для объёма
-    for (int i = 0; i < segments; i += 2) {
-        clipAndDrawLine(ren, center, points[i], cam, goldColor);
+    // Угол обзора (FOV). g_fov у тебя - это не угол, а проекционный множитель.
+    // Возьмем примерный угол в 45 градусов от центра в каждую сторону (общий 90).
+    // tan(45) = 1.0
+    float fovLimit = tanf(45.0f * M_PI / 180.0f); 
+
+    // Если тангенс угла до объекта МЕНЬШЕ, чем тангенс половины FOV, то объект в поле зрения.
+    // Мы также должны учесть радиус объекта, чтобы края не исчезали.
+    if (distToRay - radius < d * fovLimit) {
+        return 1;
     }
     
-    // Если очень близко, рисуем "ауру" сбора
-    if (distToPlayer < 1.5f) {
-        SDL_Color auraColor = {255, 255, 150, 100};
-        float auraRadius = radius * 1.5f;
-        
-        for (int i = 0; i < segments; i++) {
-            float angle = (float)i / segments * 2.0f * M_PI;
-            Vec3 auraPoint = {
-                center.x + fast_cos(angle) * auraRadius,
-                center.y,
-                center.z + fast_sin(angle) * auraRadius
-            };
-            if (i % 2 == 0) {  // Рисуем через одну для эффекта
-                clipAndDrawLine(ren, center, auraPoint, cam, auraColor);
-            }
-        }
+    return 0; // Объект за пределами поля зрения
+}
+
+// --- КЭШ ВИДИМОСТИ: запросы ---
+// Раз в кадр, до первого запроса, с той камерой, которой рисуется весь кадр
+void VisCache_BeginFrame(Camera cam) {
+    Vec3 eye = cameraEyePosition(cam);
+    float adjRotY = cam.rotY + cam.currentBobX * 0.02f; // Так поворачивает project_with_depth
+    g_vis.queries = 0;
+    g_vis.tests = 0;
+    g_vis.occlusionTests = 0;
+    g_vis.occlusionPixels = 0;
+    g_vis.occluded = 0;
+    if (!g_vis.hasLast || g_fog.farPlane != g_vis.farPlane) {
+        g_vis.generation++;
+        g_vis.farPlane = g_fog.farPlane;
+        g_vis.hasLast = 1;
+    } else {
+        float dx = eye.x - g_vis.lastEye.x, dy = eye.y - g_vis.lastEye.y, dz = eye.z - g_vis.lastEye.z;
+        g_vis.travel += sqrtf(dx*dx + dy*dy + dz*dz);
+        g_vis.turn += fmaxf(fabsf(cam.rotY - g_vis.lastRotY), fabsf(adjRotY - g_vis.lastAdjRotY))
+                    + fabsf(cam.rotX - g_vis.lastRotX);
+    }
+    g_vis.lastEye = eye;
+    g_vis.lastRotY = cam.rotY;
+    g_vis.lastAdjRotY = adjRotY;
+    g_vis.lastRotX = cam.rotX;
+}
+
+static inline int VisCache_Lookup(const VisCacheEntry* e, float objX, float objZ) {
+    g_vis.queries++;
+    return g_vis.enabled && e->generation == g_vis.generation && e->objX == objX && e->objZ == objZ
+        && g_vis.travel <= e->travelLimit && g_vis.turn <= e->turnLimit;
+}
+
+// Граница теста в запасе m, тест меняется не быстрее kPos за юнит шага и kTurn * (dist + шаг)
+// за радиан поворота. Половину запаса отдаём на ход, остаток на поворот; итог - минимум по всем границам
+static void VisCache_Bound(float m, float kPos, float kTurn, float dist, float* posMargin, float* turnMargin) {
+    m -= VIS_CACHE_VALUE_EPS;
+    if (m <= 0.0f) {
+        *posMargin = 0.0f;
+        *turnMargin = 0.0f;
+        return;
     }
+    float p = kTurn > 0.0f ? m / (2.0f * kPos) : m / kPos;
+    float t = kTurn > 0.0f ? (m - kPos * p) / (kTurn * (dist + p)) : (float)VIS_CACHE_NO_LIMIT;
+    if (p < *posMargin) *posMargin = p;
+    if (t < *turnMargin) *turnMargin = t;
 }
 
-void checkCoinCollection(Camera* cam) {
-    for (int i = 0; i < g_numCoins; i++) {
-        if (g_coins[i].collected) continue; // Пропускаем собранные
-        
-        // --- УЛУЧШЕННАЯ ПРОВЕРКА РАССТОЯНИЯ ---
-        // Учитываем высоту камеры и радиус игрока
-        float playerFootY = cam->y;  // Позиция ног
-        float playerHeadY = cam->y + cam->height;  // Позиция головы
-        
-        // Проверяем расстояние по горизонтали (XZ)
-        float horizontalDist = sqrtf(
-            powf(cam->x - g_coins[i].pos.x, 2) +
-            powf(cam->z - g_coins[i].pos.z, 2)
-        );
-        
-        // Текущая высота монеты с учётом анимации
-        float coinY = g_coins[i].pos.y + fast_sin(g_coins[i].bobPhase) * 0.2f;
-        
-        // Проверяем, находится ли монета в пределах досягаемости игрока
-        int inVerticalRange = (coinY >= playerFootY - 0.5f && coinY <= playerHeadY + 0.5f);
-        int inHorizontalRange = (horizontalDist < 1.2f);  // Увеличенный радиус
-        
-        if (inHorizontalRange && inVerticalRange) {
-            // --- ДВОЙНАЯ ПРОВЕРКА для надёжности ---
-            // Полное 3D расстояние
-            float distSq = powf(cam->x - g_coins[i].pos.x, 2) +
-               powf(cam->y + cam->height/2 - coinY, 2) +
-               powf(cam->z - g_coins[i].pos.z, 2);
+static int VisCache_Store(VisCacheEntry* e, int visible, float objX, float objZ, float posMargin, float turnMargin) {
+    g_vis.tests++;
+    e->visible = (Uint8)visible;
+    e->objX = objX;
+    e->objZ = objZ;
+    e->generation = g_vis.generation;
+    e->travelLimit = g_vis.travel + posMargin;
+    e->turnLimit = turnMargin >= (float)VIS_CACHE_NO_LIMIT ? VIS_CACHE_NO_LIMIT : g_vis.turn + (turnMargin - VIS_CACHE_ANGLE_EPS);
+    return visible;
+}
 
-const float collectRadiusSq = 1.5f * 1.5f; // Считаем квадрат радиуса ОДИН раз
+// isBoxInFrustum_Improved в виде границ: дальность, ближняя плоскость, "камера внутри сферы"
+// и клин 90 градусов (расстояние вбок от луча минус радиус против расстояния вдоль луча)
+int isBoxInFrustum_Cached(CollisionBox* box, Camera cam) {
+    if (box < collisionBoxes || box >= collisionBoxes + numCollisionBoxes || box - collisionBoxes >= VIS_CACHE_MAX_BOXES) {
+        return isBoxInFrustum_Improved(box, cam);
+    }
+    VisCacheEntry* e = &g_vis.boxes[box - collisionBoxes];
+    if (VisCache_Lookup(e, box->pos.x, box->pos.z)) return e->visible;
 
-if (distSq < collectRadiusSq) {  // Увеличенный радиус сбора
-                g_coins[i].collected = 1;
-                g_coinsCollected++;
-                
-                printf("💰 Coin collected! Total: %d/%d (Distance was: %.2f)\n", 
-                       g_coinsCollected, g_numCoins, distSq
-                    );
-                
-                // Особые сообщения при важных вехах
-                switch(g_coinsCollected) {
-                    case 10:
-                        printf("🌐 REALITY STABILIZING... Grid walls emerging.\n");
-                        break;
-                    case 15:
-                        printf("📦 SIMULATION BOUNDARIES DETECTED... Cube forming.\n");
-                        break;
-                    case 20:
-                        printf("🎨 MATERIALIZING... Polygons phasing in.\n");
-                        break;
-                    case 30:
-                        printf("🖼️ TEXTURES LOADING... World gaining substance.\n");
-                        break;
-                    case 40:
-                        printf("☁️ BREAKING THROUGH... Sky becoming visible.\n");
-                        printf("✨ WORLD FULLY MATERIALIZED!\n");
-                        break;
-                }
-                
-                break; // Важно! Выходим из цикла после сбора
-            }
+    int visible = isBoxInFrustum_Improved(box, cam);
+    float r = getBoundingSphereRadius(box);
+    float dx = box->pos.x - cam.x, dz = box->pos.z - cam.z;
+    float dist = sqrtf(dx*dx + dz*dz);
+    float sy = fast_sin(cam.rotY), cy = fast_cos(cam.rotY);
+    float along = dx * sy + dz * cy;
+    float side = fabsf(dx * cy - dz * sy);
+    float farLimit = g_fog.farPlane + r, nearLimit = NEAR_PLANE - r;
+    float posMargin = (float)VIS_CACHE_NO_LIMIT, turnMargin = (float)VIS_CACHE_NO_LIMIT;
+    if (visible) {
+        VisCache_Bound(farLimit - dist, 1.0f, 0.0f, dist, &posMargin, &turnMargin);
+        if (nearLimit > 0.0f) VisCache_Bound(dist - nearLimit, 1.0f, 0.0f, dist, &posMargin, &turnMargin);
+        if (dist <= r) {
+            VisCache_Bound(r - dist, 1.0f, 0.0f, dist, &posMargin, &turnMargin); // Виден при любом повороте
+        } else {
+            VisCache_Bound(r + along - side, VIS_CACHE_SIDE_SLOPE, VIS_CACHE_SIDE_SLOPE, dist, &posMargin, &turnMargin);
         }
+    } else if (dist > farLimit) {
+        VisCache_Bound(dist - farLimit, 1.0f, 0.0f, dist, &posMargin, &turnMargin);
+    } else if (dist < nearLimit) {
+        VisCache_Bound(nearLimit - dist, 1.0f, 0.0f, dist, &posMargin, &turnMargin);
+    } else {
+        VisCache_Bound(dist - r, 1.0f, 0.0f, dist, &posMargin, &turnMargin);
+        VisCache_Bound(side - along - r, VIS_CACHE_SIDE_SLOPE, VIS_CACHE_SIDE_SLOPE, dist, &posMargin, &turnMargin);
     }
+    return VisCache_Store(e, visible, box->pos.x, box->pos.z, posMargin, turnMargin);
 }
 
-void initQuestSystem(QuestSystem* qs) {
-    // Квест 0: Туториал - ИСПРАВЛЕНА ЦЕЛЕВАЯ ТОЧКА
-    qs->nodes[0] = (QuestNode){
-        .id = 0,
-        .name = "First Steps",
-        .description = "Learn basic movement",
-        .worldPos = {0, 3, -5},
-        .color = {100, 255, 100, 255},
-        .status = QUEST_AVAILABLE,
-        .numObjectives = 2,
-        .expReward = 10,
-        .nodeScale = 1.0f
-    };
-    
-    // ИСПРАВЛЯЕМ: Правильная целевая точка - зелёная платформа
-    qs->nodes[0].objectives[0] = (QuestObjective){
-        .type = OBJECTIVE_REACH_POINT,
-        .target = &collisionBoxes[1].pos, // Указатель на позицию зелёной платформы
-        .description = "Reach the green platform",
-        .requiredProgress = 1,
-        .currentProgress = 0
-    };
-    qs->nodes[0].objectives[1] = (QuestObjective){
-        .type = OBJECTIVE_COLLECT_ITEM,
-        .description = "Collect 3 coins",
-        .requiredProgress = 3,
-        .currentProgress = 0
-    };
-    qs->nodes[0].unlocksQuests[0] = 1;
-    qs->nodes[0].unlocksQuests[1] = 2;
-    qs->nodes[0].numUnlocks = 2;
-    
-    // Остальные квесты остаются такими же
-    qs->nodes[1] = (QuestNode){
-        .id = 1,
-        .name = "Parkour Master",
-        .description = "Complete the jumping puzzle",
-        .worldPos = {10, 4, 0},
-        .color = {255, 150, 100, 255},
-        .status = QUEST_LOCKED,
-        .numRequired = 1,
-        .expReward = 25,
-        .nodeScale = 1.0f
-    };
-    qs->nodes[1].requiredQuests[0] = 0;
-    qs->nodes[1].unlocksQuests[0] = 3;
-    qs->nodes[1].numUnlocks = 1;
-    
-    qs->nodes[2] = (QuestNode){
-        .id = 2,
-        .name = "Explorer",
-        .description = "Find all hidden areas",
-        .worldPos = {-10, 4, 0},
-        .color = {100, 150, 255, 255},
-        .status = QUEST_LOCKED,
-        .numRequired = 1,
-        .expReward = 30,
-        .nodeScale = 1.0f
-    };
-    qs->nodes[2].requiredQuests[0] = 0;
-    qs->nodes[2].unlocksQuests[0] = 3;
-    qs->nodes[2].numUnlocks = 1;
-    
-    qs->nodes[3] = (QuestNode){
-        .id = 3,
-        .name = "Final Challenge",
-        .description = "Defeat the cube guardian",
-        .worldPos = {0, 6, 10},
-        .color = {255, 100, 100, 255},
-        .status = QUEST_LOCKED,
-        .numRequired = 2,
-        .expReward = 100,
-        .nodeScale = 1.5f
-    };
-    qs->nodes[3].requiredQuests[0] = 1;
-    qs->nodes[3].requiredQuests[1] = 2;
-    
-    qs->numNodes = 4;
-    qs->activeQuestId = -1;
+// isPointInFrustum: дальность и конус cos >= POINT_FRUSTUM_MIN_COS
+int isPointInFrustum_Cached(VisCacheEntry* e, Vec3 point, Camera cam) {
+    if (VisCache_Lookup(e, point.x, point.z)) return e->visible;
+
+    int visible = isPointInFrustum(point, cam);
+    float dx = point.x - cam.x, dz = point.z - cam.z;
+    float dist = sqrtf(dx*dx + dz*dz);
+    float along = dx * fast_sin(cam.rotY) + dz * fast_cos(cam.rotY);
+    float cone = along - POINT_FRUSTUM_MIN_COS * dist;
+    float posMargin = (float)VIS_CACHE_NO_LIMIT, turnMargin = (float)VIS_CACHE_NO_LIMIT;
+    if (dist < 1e-6f) {
+        posMargin = turnMargin = 0.0f; // Точка в самой камере - без запаса
+    } else if (visible) {
+        VisCache_Bound(g_fog.farPlane - dist, 1.0f, 0.0f, dist, &posMargin, &turnMargin);
+        VisCache_Bound(cone, 1.0f + POINT_FRUSTUM_MIN_COS, 1.0f, dist, &posMargin, &turnMargin);
+    } else if (dist > g_fog.farPlane) {
+        VisCache_Bound(dist - g_fog.farPlane, 1.0f, 0.0f, dist, &posMargin, &turnMargin);
+    } else {
+        VisCache_Bound(-cone, 1.0f + POINT_FRUSTUM_MIN_COS, 1.0f, dist, &posMargin, &turnMargin);
+    }
+    return VisCache_Store(e, visible, point.x, point.z, posMargin, turnMargin);
+}
+
+// Угол плитки пола перед ближней плоскостью (глубина в системе камеры, с наклоном камеры)
+int isFloorCornerInFront_Cached(Vec3 corner, int tileX, int tileZ, Camera cam) {
+    int ix = ((tileX % VIS_CACHE_TILES) + VIS_CACHE_TILES) % VIS_CACHE_TILES;
+    int iz = ((tileZ % VIS_CACHE_TILES) + VIS_CACHE_TILES) % VIS_CACHE_TILES;
+    VisCacheEntry* e = &g_vis.tiles[ix][iz];
+    if (VisCache_Lookup(e, corner.x, corner.z)) return e->visible;
+
+    ProjectedPoint pp = project_with_depth(corner, cam);
+    int visible = pp.z >= NEAR_PLANE;
+    Vec3 eye = cameraEyePosition(cam);
+    float dx = corner.x - eye.x, dy = corner.y - eye.y, dz = corner.z - eye.z;
+    float dist = sqrtf(dx*dx + dy*dy + dz*dz);
+    float posMargin = (float)VIS_CACHE_NO_LIMIT, turnMargin = (float)VIS_CACHE_NO_LIMIT;
+    VisCache_Bound(fabsf(pp.z - NEAR_PLANE), 1.0f, 1.0f, dist, &posMargin, &turnMargin);
+    return VisCache_Store(e, visible, corner.x, corner.z, posMargin, turnMargin);
 }
 
-void drawQuestNode(SDL_Renderer* ren, QuestNode* node, Camera cam, float time) {
-    float pulse = (node->status == QUEST_ACTIVE) ? 
-                fast_sin(time * 3.0f) * 0.2f + 1.0f : 1.0f;
-    
-    float scale = node->nodeScale * pulse;
-    
-    Vec3 top = {node->worldPos.x, node->worldPos.y + scale, node->worldPos.z};
-    Vec3 bottom = {node->worldPos.x, node->worldPos.y - scale, node->worldPos.z};
-    
-    Vec3 corners[4] = {
-        {node->worldPos.x - scale*0.7f, node->worldPos.y, node->worldPos.z - scale*0.7f},
-        {node->worldPos.x + scale*0.7f, node->worldPos.y, node->worldPos.z - scale*0.7f},
-        {node->worldPos.x + scale*0.7f, node->worldPos.y, node->worldPos.z + scale*0.7f},
-        {node->worldPos.x - scale*0.7f, node->worldPos.y, node->worldPos.z + scale*0.7f}
+// Пиксель (x, y) не закрывает точку с глубиной z - по тем же правилам, что у линий
+static inline int visOcclusionOpen(int x, int y, float z) {
+    return g_sbuffer.active ? !SBuffer_IsHidden(x, y, z) : z < g_zBuffer[y][x];
+}
+
+// Закрыта ли сфера (center, radius) целиком тем, что уже нарисовано в виде: во всём её экранном
+// квадрате нет пикселя, где её ближняя точка прошла бы тест глубины. Звать после пирамиды, перед
+// рисованием объекта. Сомнения (задевает ближнюю плоскость, выключено) - всегда "не закрыта"
+int VisCache_Occluded(VisCacheEntry* e, Vec3 center, float radius, Camera cam) {
+    if (!g_vis.enabled) return 0;
+    Camera bobbed = cam; // Поворот, как в project_with_depth
+    bobbed.rotY += cam.currentBobX * 0.02f;
+    CameraTransform ct = CameraTransform_From(bobbed);
+    Vec3 c = CameraTransform_Apply(&ct, center);
+    float zNear = c.z - radius, zFar = c.z + radius;
+    if (zNear <= NEAR_PLANE) {
+        e->occluded = 0;
+        return 0;
+    }
+    // Квадрат вокруг всего куба сферы: x/z (и y/z) на кубе крайние в его углах
+    float xMax = (c.x + radius) / (c.x + radius >= 0.0f ? zNear : zFar);
+    float xMin = (c.x - radius) / (c.x - radius >= 0.0f ? zFar : zNear);
+    float yMax = (c.y + radius) / (c.y + radius >= 0.0f ? zNear : zFar);
+    float yMin = (c.y - radius) / (c.y - radius >= 0.0f ? zFar : zNear);
+    int x0 = (int)floorf(g_view.cx + xMin * g_fov) - VIS_OCCLUSION_MARGIN;
+    int x1 = (int)ceilf(g_view.cx + xMax * g_fov) + VIS_OCCLUSION_MARGIN + 1;
+    int y0 = (int)floorf(g_view.cy - yMax * g_fov) - VIS_OCCLUSION_MARGIN;
+    int y1 = (int)ceilf(g_view.cy - yMin * g_fov) + VIS_OCCLUSION_MARGIN + 1;
+    if (x0 < g_view.x0) x0 = g_view.x0;
+    if (y0 < g_view.y0) y0 = g_view.y0;
+    if (x1 > g_view.x1) x1 = g_view.x1;
+    if (y1 > g_view.y1) y1 = g_view.y1;
+    if (x0 >= x1 || y0 >= y1) {
+        e->occluded = 0;
+        return 0;
+    }
+    float z = zNear * g_lineDepthBias;
+    g_vis.occlusionTests++;
+
+    // Дешёвое первым: видимый в прошлый раз - его свидетель, скрытый - центр и углы квадрата
+    int probes[5][2] = {
+        { e->witnessX, e->witnessY }, { (x0 + x1) / 2, (y0 + y1) / 2 },
+        { x0, y0 }, { x1 - 1, y0 }, { x0, y1 - 1 }
     };
-    
-    SDL_Color color = node->color;
-    if (node->status == QUEST_LOCKED) {
-        color.r /= 3; color.g /= 3; color.b /= 3;
-    } else if (node->status == QUEST_COMPLETED) {
-        color.r = 200; color.g = 200; color.b = 200;
+    int first = e->occluded ? 1 : 0, last = e->occluded ? 5 : 1;
+    for (int i = first; i < last; i++) {
+        int px = probes[i][0], py = probes[i][1];
+        if (px < x0 || px >= x1 || py < y0 || py >= y1) continue;
+        g_vis.occlusionPixels++;
+        if (visOcclusionOpen(px, py, z)) {
+            e->witnessX = (Sint16)px;
+            e->witnessY = (Sint16)py;
+            e->occluded = 0;
+            return 0;
+        }
     }
-    
-    for (int i = 0; i < 4; i++) {
-        clipAndDrawLine(ren, top, corners[i], cam, color);
-        clipAndDrawLine(ren, corners[i], corners[(i+1)%4], cam, color);
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            if (!visOcclusionOpen(x, y, z)) continue;
+            g_vis.occlusionPixels += (Uint32)((y - y0) * (x1 - x0) + (x - x0) + 1);
+            e->witnessX = (Sint16)x;
+            e->witnessY = (Sint16)y;
+            e->occluded = 0;
+            return 0;
+        }
     }
-    
-    for (int i = 0; i < 4; i++) {
-        clipAndDrawLine(ren, bottom, corners[i], cam, color);
+    g_vis.occlusionPixels += (Uint32)((y1 - y0) * (x1 - x0));
+    g_vis.occluded++;
+    e->witnessX = e->witnessY = -1;
+    e->occluded = 1;
+    return 1;
+}
+
+// Наша новая глобальная переменная. Будет хранить то, на что мы смотрим.
+PickupObject* g_targetedObject = NULL;
+
+void drawCrosshair(RenderBackend* ren) {
+
+    if (!g_showCrosshair) {
+        return; // Если кнопка выключена - ПОШЁЛ НАХУЙ ОТСЮДА
+    }
+
+    int cx = WIDTH / 2;
+    int cy = HEIGHT / 2;
+    if (g_split.numViews > 1) { // В сплит-скрине прицел - в центре вида игрока
+        cx = g_split.views[0].view.cx;
+        cy = g_split.views[0].view.cy;
     }
     
-    if (node->status == QUEST_AVAILABLE) {
-        Vec3 markTop = {node->worldPos.x, node->worldPos.y + scale + 1.5f, node->worldPos.z};
-        Vec3 markBottom = {node->worldPos.x, node->worldPos.y + scale + 0.5f, node->worldPos.z};
-        SDL_Color yellow = {255, 255, 0, 255};
-        clipAndDrawLine(ren, markTop, markBottom, cam, yellow);
+    // Если мы на что-то навелись - прицел становится жёлтым и большим
+    if (g_targetedObject) {
+        Render_SetColor(ren, 255, 255, 0, 255);
+        Render_Line(ren, cx - 10, cy, cx + 10, cy);
+        Render_Line(ren, cx, cy - 10, cx, cy + 10);
+    } else {
+        // Обычный, маленький, белый прицел
+        Render_SetColor(ren, 255, 255, 255, 255);
+        Render_Line(ren, cx - 5, cy, cx + 5, cy);
+        Render_Line(ren, cx, cy - 5, cx, cy + 5);
     }
 }
 
-void drawQuestConnections(SDL_Renderer* ren, QuestSystem* qs, Camera cam, float time) {
-    for (int i = 0; i < qs->numNodes; i++) {
-        QuestNode* node = &qs->nodes[i];
-        
-        for (int j = 0; j < node->numUnlocks; j++) {
-            int targetId = node->unlocksQuests[j];
-            QuestNode* target = &qs->nodes[targetId];
-            
-            SDL_Color lineColor = {100, 100, 100, 255};
-            
-            if (node->status == QUEST_COMPLETED) {
-                float glow = fast_sin(time * 2.0f + i) * 0.5f + 0.5f;
-                lineColor.r = 100 + glow * 155;
-                lineColor.g = 100 + glow * 155;
-                lineColor.b = 255;
-            }
-            
-            int segments = 10;
-            for (int s = 0; s < segments; s += 2) {
-                Vec3 start = {
-                    node->worldPos.x + (target->worldPos.x - node->worldPos.x) * s / segments,
-                    node->worldPos.y + (target->worldPos.y - node->worldPos.y) * s / segments,
-                    node->worldPos.z + (target->worldPos.z - node->worldPos.z) * s / segments
-                };
-                Vec3 end = {
-                    node->worldPos.x + (target->worldPos.x - node->worldPos.x) * (s+1) / segments,
-                    node->worldPos.y + (target->worldPos.y - node->worldPos.y) * (s+1) / segments,
-                    node->worldPos.z + (target->worldPos.z - node->worldPos.z) * (s+1) / segments
-                };
-                clipAndDrawLine(ren, start, end, cam, lineColor);
-            }
-        }
-    }
+// Луч против AABB предмета (вращение не учитываем - как и раньше)
+static int rayHitsPickup(PickupObject* obj, Vec3 rayOrigin, Vec3 rayDir, float* t) {
+    Vec3 boxMin = {obj->pos.x - obj->size.x/2, obj->pos.y - obj->size.y/2, obj->pos.z - obj->size.z/2};
+    Vec3 boxMax = {obj->pos.x + obj->size.x/2, obj->pos.y + obj->size.y/2, obj->pos.z + obj->size.z/2};
+    g_pick.rayTests++;
+    return intersectRayAABB(rayOrigin, rayDir, boxMin, boxMax, t);
 }
 
-void updateQuestSystem(QuestSystem* qs, Camera* cam, float playerRadius) {
-    for (int i = 0; i < qs->numNodes; i++) {
-        QuestNode* node = &qs->nodes[i];
-        
-        float dist = sqrtf(
-            powf(cam->x - node->worldPos.x, 2) +
-            powf(cam->y - node->worldPos.y, 2) +
-            powf(cam->z - node->worldPos.z, 2)
-        );
-        
-        if (dist < 2.0f && node->status == QUEST_AVAILABLE) {
-            const Uint8* keys = SDL_GetKeyboardState(NULL);
-            if (keys[SDL_SCANCODE_E]) {
-                node->status = QUEST_ACTIVE;
-                qs->activeQuestId = node->id;
-                
-                printf("Quest started: %s\n", node->name);
+// === ЗАМЕНИ СТАРУЮ updateTractorBeam НА ЭТУ ===
+void updateTractorBeam(Camera* cam) {
+    if (g_targetedObject) {
+        g_targetedObject->color = g_targetedObject->originalColor;
+        g_targetedObject = NULL;
+    }
+    if (g_hands.heldObject) return;
+
+    Vec3 rayOrigin = {cam->x, cam->y + cam->height, cam->z};
+    Vec3 rayDir = { fast_sin(cam->rotY) * fast_cos(cam->rotX), fast_sin(cam->rotX), fast_cos(cam->rotY) * fast_cos(cam->rotX) };
+    rayDir = normalize(rayDir);
+
+    // <<< НАЧИНАЕМ, БЛЯДЬ, ВСКРЫТИЕ >>>
+    static Uint32 last_debug_print = 0;
+    if (SDL_GetTicks() - last_debug_print > 500) { // Печатаем дебаг 2 раза в секунду
+        printf("--- DEBUG TICK ---\n");
+        printf("[CAM POS]: x=%.2f, y=%.2f, z=%.2f\n", cam->x, cam->y, cam->z);
+        printf("[CAM ROT]: y=%.2f, x=%.2f\n", cam->rotY, cam->rotX);
+        printf("[RAY DIR]: x=%.2f, y=%.2f, z=%.2f\n", rayDir.x, rayDir.y, rayDir.z);
+        last_debug_print = SDL_GetTicks();
+    }
+
+    float closest_t = 3.0f; // Максимальная дистанция
+    PickupObject* potentialTarget = NULL;
+    g_pick.rayTests = 0;
+
+    if (g_pick.valid) {
+        // Под прицелом - одно чтение буфера ID прошлого кадра, лучом только то, что меньше пикселя
+        float depth;
+        Uint16 id = Pick_At(g_pick.centerX, g_pick.centerY, &depth);
+        if (Pick_Kind(id) == PICK_KIND_PICKUP && depth < closest_t) {
+            int index = Pick_Index(id);
+            if (index < g_numPickups && g_pickups[index].state == PICKUP_STATE_IDLE) {
+                closest_t = depth;
+                potentialTarget = &g_pickups[index];
             }
         }
-        
-        if (node->status == QUEST_LOCKED) {
-            int allCompleted = 1;
-            for (int j = 0; j < node->numRequired; j++) {
-                if (qs->nodes[node->requiredQuests[j]].status != QUEST_COMPLETED) {
-                    allCompleted = 0;
-                    break;
-                }
+        for (int k = 0; k < g_pick.numTiny; k++) {
+            PickupObject* obj = &g_pickups[g_pick.tiny[k]];
+            float t;
+            if (obj->state == PICKUP_STATE_IDLE && rayHitsPickup(obj, rayOrigin, rayDir, &t) && t < closest_t) {
+                closest_t = t;
+                potentialTarget = obj;
             }
-            if (allCompleted && node->numRequired > 0) {
-                node->status = QUEST_AVAILABLE;
-                printf("Quest unlocked: %s\n", node->name);
+        }
+    } else {
+        for (int i = 0; i < g_numPickups; i++) {
+            PickupObject* obj = &g_pickups[i];
+            if (obj->state != PICKUP_STATE_IDLE) continue;
+            float t;
+            if (rayHitsPickup(obj, rayOrigin, rayDir, &t)) {
+                if (t < closest_t) {
+                    closest_t = t;
+                    potentialTarget = obj;
+                }
             }
         }
     }
-}
+    
+    g_targetedObject = potentialTarget;
+    g_pick.lastId = potentialTarget ? Pick_MakeId(PICK_KIND_PICKUP, (int)(potentialTarget - g_pickups)) : PICK_ID_NONE;
 
-// --- ИСПРАВЛЕННАЯ ФУНКЦИЯ ПРОВЕРКИ ЦЕЛЕЙ ---
-void checkQuestObjectives(QuestSystem* qs, Camera* cam, CollisionBox* boxes, int numBoxes) {
-    if (qs->activeQuestId >= 0) {
-        QuestNode* quest = &qs->nodes[qs->activeQuestId];
-        
-        int allCompleted = 1;
-        for (int i = 0; i < quest->numObjectives; i++) {
-            QuestObjective* obj = &quest->objectives[i];
-            
-            switch(obj->type) {
-                case OBJECTIVE_REACH_POINT:
-                    // ИСПРАВЛЯЕМ: Проверяем, стоим ли мы на зелёной платформе
-                    if (obj->target) {
-                        Vec3* targetPos = (Vec3*)obj->target;
-                        
-                        // Проверяем расстояние до центра платформы
-                        float distXZ = sqrtf(powf(cam->x - targetPos->x, 2) + 
-                                           powf(cam->z - targetPos->z, 2));
-                        
-                        // Проверяем высоту - стоим ли мы НА платформе
-                        float platformTop = targetPos->y + boxes[1].bounds.maxY; // Используем bounds зелёной платформы
-                        float heightDiff = fabsf(cam->y - platformTop);
-                        
-                        // Засчитываем, если мы близко по горизонтали И стоим на платформе
-                        if (distXZ < 2.0f && heightDiff < 0.5f) {
-                            obj->currentProgress = 1;
-                            printf("Reached green platform!\n");
-                        }
-                    }
-                    break;
-                    
-                case OBJECTIVE_COLLECT_ITEM:
-                    // ИСПРАВЛЯЕМ: Берём данные из глобального счётчика монет
-                    obj->currentProgress = g_coinsCollected;
-                    break;
-            }
-            
-            if (obj->currentProgress < obj->requiredProgress) {
-                allCompleted = 0;
-            }
-        }
-        
-        if (allCompleted) {
-            quest->status = QUEST_COMPLETED;
-            printf("Quest completed: %s! Reward: %d XP\n", quest->name, quest->expReward);
-            qs->activeQuestId = -1;
-        }
+    if (g_targetedObject) {
+        g_targetedObject->color = (SDL_Color){255, 255, 0, 255};
     }
 }
 
-void drawQuestUI(SDL_Renderer* ren, TTF_Font* font, QuestSystem* qs) {
-    if (qs->activeQuestId >= 0) {
-        QuestNode* quest = &qs->nodes[qs->activeQuestId];
-        
-        SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
-        SDL_SetRenderDrawColor(ren, 0, 0, 0, 180);
-        SDL_Rect bgRect = {WIDTH - 320, 20, 300, 100 + quest->numObjectives * 25};
-        SDL_RenderFillRect(ren, &bgRect);
-        
-        SDL_Color white = {255, 255, 255, 255};
-        SDL_Color yellow = {255, 255, 0, 255};
-        SDL_Color green = {100, 255, 100, 255};
-        
-        drawText(ren, font, quest->name, WIDTH - 310, 30, yellow);
-        
-        for (int i = 0; i < quest->numObjectives; i++) {
-            QuestObjective* obj = &quest->objectives[i];
-            char buffer[256];
-            
-            SDL_Color objColor = (obj->currentProgress >= obj->requiredProgress) ? green : white;
-            
-            snprintf(buffer, 256, "[%c] %s (%d/%d)",
-                    (obj->currentProgress >= obj->requiredProgress) ? 'X' : ' ',
-                    obj->description,
-                    obj->currentProgress,
-                    obj->requiredProgress);
-            
-            drawText(ren, font, buffer, WIDTH - 310, 60 + i * 25, objColor);
-        }
+// --- DAY/NIGHT CYCLE FUNCTIONS ---
+
+// Вспомогательная функция для плавного смешивания цветов
+SDL_Color lerpColor(SDL_Color a, SDL_Color b, float t) {
+    if (t < 0.0f) t = 0.0f;
+    if (t > 1.0f) t = 1.0f;
+    SDL_Color result;
+    result.r = (Uint8)(a.r + (b.r - a.r) * t);
+    result.g = (Uint8)(a.g + (b.g - a.g) * t);
+    result.b = (Uint8)(a.b + (b.b - a.b) * t);
+    result.a = 255;
+    return result;
+}
+
+// --- ТАБЛИЦА ЦВЕТОВ СУТОК ---
+// Сутки длятся 48 минут, за кадр цвета не меняются даже на единицу.
+// Поэтому три градиента считаем один раз на старте, а в кадре только берём строку таблицы.
+typedef struct {
+    SDL_Color skyTop;
+    SDL_Color skyBottom;
+    SDL_Color ambient;
+} DayNightColors;
+
+static DayNightColors g_dayNightLUT[DAY_NIGHT_LUT_SIZE];
+static int g_dayNightLUTReady = 0;
+
+static void sampleDayNightColors(float timeOfDay, DayNightColors* out) {
+    // НОВЫЕ, БОЛЕЕ ПРИГЛУШЕННЫЕ ЦВЕТА
+    const SDL_Color midnightTop = {5, 5, 15, 255};
+    const SDL_Color midnightBottom = {10, 10, 25, 255};
+    const SDL_Color midnightLight = {30, 30, 45, 255}; // Немного светлее ночь
+
+    const SDL_Color sunriseTop = {60, 70, 100, 255}; // Менее яркий восход
+    const SDL_Color sunriseBottom = {200, 100, 50, 255}; 
+    const SDL_Color sunriseLight = {200, 160, 140, 255};
+
+    const SDL_Color noonTop = {100, 140, 180, 255}; // Приглушенный голубой день
+    const SDL_Color noonBottom = {130, 170, 200, 255};
+    const SDL_Color noonLight = {220, 220, 230, 255}; // Не чисто белый, а сероватый свет
+
+    const SDL_Color sunsetBottom = {220, 90, 55, 255}; // Менее кричащий закат
+
+    // Смешиваем цвета
+    float t = 0.0f;
+    if (timeOfDay >= 0.0f && timeOfDay < 0.25f) { // Ночь -> Восход
+        t = timeOfDay / 0.25f;
+        out->skyTop = lerpColor(midnightTop, sunriseTop, t);
+        out->skyBottom = lerpColor(midnightBottom, sunriseBottom, t);
+        out->ambient = lerpColor(midnightLight, sunriseLight, t);
+    } else if (timeOfDay >= 0.25f && timeOfDay < 0.5f) { // Восход -> Полдень
+        t = (timeOfDay - 0.25f) / 0.25f;
+        out->skyTop = lerpColor(sunriseTop, noonTop, t);
+        out->skyBottom = lerpColor(sunriseBottom, noonBottom, t);
+        out->ambient = lerpColor(sunriseLight, noonLight, t);
+    } else if (timeOfDay >= 0.5f && timeOfDay < 0.75f) { // Полдень -> Закат
+        t = (timeOfDay - 0.5f) / 0.25f;
+        out->skyTop = lerpColor(noonTop, sunriseTop, t);
+        out->skyBottom = lerpColor(noonBottom, sunsetBottom, t);
+        out->ambient = lerpColor(noonLight, sunriseLight, t);
+    } else { // Закат -> Ночь
+        t = (timeOfDay - 0.75f) / 0.25f;
+        out->skyTop = lerpColor(sunriseTop, midnightTop, t);
+        out->skyBottom = lerpColor(sunsetBottom, midnightBottom, t);
+        out->ambient = lerpColor(sunriseLight, midnightLight, t);
     }
-    
-    // ДОБАВЛЯЕМ: Показываем общий счётчик монет
-    char coinCounter[64];
-    snprintf(coinCounter, 64, "Coins: %d/%d", g_coinsCollected, g_numCoins);
-    SDL_Color gold = {255, 215, 0, 255};
-    drawText(ren, font, coinCounter, 20, HEIGHT - 40, gold);
 }
 
-void spawnGlitches(int count) {
-    printf("RKN-chan is summoning glitches!\n");
-    g_activeGlitches = 0;
-    for (int i = 0; i < count && i < MAX_GLITCHES; i++) {
-        g_glitchBytes[i].active = 1;
-        float angle = ((float)rand() / RAND_MAX) * 2.0f * M_PI;
-        float distance = 5.0f + ((float)rand() / RAND_MAX) * 3.0f;
-        g_glitchBytes[i].pos.x = g_rknChan.pos.x + fast_cos(angle) * distance;
-        g_glitchBytes[i].pos.y = 1.5f;
-        g_glitchBytes[i].pos.z = g_rknChan.pos.z + fast_sin(angle) * distance;
-        g_glitchBytes[i].velocity = (Vec3){0, 0, 0};
-        g_glitchBytes[i].jitter = 0.0f;
-        g_activeGlitches++;
+static void bakeDayNightLUT(void) {
+    for (int i = 0; i < DAY_NIGHT_LUT_SIZE; i++) {
+        sampleDayNightColors((float)i / DAY_NIGHT_LUT_SIZE, &g_dayNightLUT[i]);
     }
+    g_dayNightLUTReady = 1;
 }
 
-void initBoss() {
-    g_rknChan.pos = (Vec3){0, 1, 15}; // Поставим её в дальнем конце арены
-    g_rknChan.maxHealth = BOSS_MAX_HEALTH;
-    g_rknChan.health = BOSS_MAX_HEALTH;
-    g_rknChan.state = BOSS_STATE_IDLE;
-    g_rknChan.stateTimer = 3.0f; // Через 3 секунды начнёт действовать
-    g_bossFightActive = 1; // Битва началась!
-    printf("A wild RKN-chan appeared!\n");
+// Инициализация цикла
+void initDayNightCycle() {
+    g_dayNight.timeOfDay = 0.25f; // Начинаем с восхода
+    bakeDayNightLUT();
 }
 
-// Простая функция для отрисовки куба в любой точке мира
-void drawWorldCube(SDL_Renderer* ren, Vec3 center, float size, Camera cam, SDL_Color color) {
-    Vec3 vertices[8];
-    float s = size / 2.0f;
-    vertices[0] = (Vec3){center.x - s, center.y - s, center.z - s};
-    vertices[1] = (Vec3){center.x + s, center.y - s, center.z - s};
-    vertices[2] = (Vec3){center.x + s, center.y + s, center.z - s};
-    vertices[3] = (Vec3){center.x - s, center.y + s, center.z - s};
-    vertices[4] = (Vec3){center.x - s, center.y - s, center.z + s};
-    vertices[5] = (Vec3){center.x + s, center.y - s, center.z + s};
-    vertices[6] = (Vec3){center.x + s, center.y + s, center.z + s};
-    vertices[7] = (Vec3){center.x - s, center.y + s, center.z + s};
-
-    int edges[12][2] = {
-        {0,1},{1,2},{2,3},{3,0}, {4,5},{5,6},{6,7},{7,4},
-        {0,4},{1,5},{2,6},{3,7}
-    };
-    for (int i = 0; i < 12; i++) {
-        clipAndDrawLine(ren, vertices[edges[i][0]], vertices[edges[i][1]], cam, color);
+void SetTimeOfDay(float newTime) {
+    // fmodf - это остаток от деления для float. Гарантирует, что время всегда будет в пределах 0.0-1.0
+    g_dayNight.timeOfDay = fmodf(newTime, 1.0f); 
+    if (g_dayNight.timeOfDay < 0.0f) {
+        g_dayNight.timeOfDay += 1.0f;
     }
 }
 
-void drawBoss(SDL_Renderer* ren, Camera cam) {
-    if (!g_bossFightActive || g_rknChan.state == BOSS_STATE_DEFEATED) return;
+void updateDayNightCycle(float deltaTime, Camera cam) {
+    // СТАНЕТ (умножаем deltaTime на наш множитель):
+    g_dayNight.timeOfDay += (deltaTime * g_timeScale) / DAY_NIGHT_DURATION_SECONDS;
 
-    // Тело
-    SDL_Color bodyColor = {50, 50, 80, 255};
-    if (g_rknChan.state == BOSS_STATE_VULNERABLE) {
-        bodyColor = (SDL_Color){255, 100, 100, 255}; // Краснеет, когда уязвима
+    if (g_dayNight.timeOfDay >= 1.0f) {
+        g_dayNight.timeOfDay -= 1.0f;
     }
-    drawWorldCube(ren, g_rknChan.pos, 2.0f, cam, bodyColor);
 
-    // Голова
-    Vec3 headPos = {g_rknChan.pos.x, g_rknChan.pos.y + 1.5f, g_rknChan.pos.z};
-    drawWorldCube(ren, headPos, 1.0f, cam, (SDL_Color){200, 200, 220, 255});
+    // Цвета - готовые из таблицы
+    if (!g_dayNightLUTReady) bakeDayNightLUT();
+    int lutIndex = (int)(g_dayNight.timeOfDay * DAY_NIGHT_LUT_SIZE);
+    if (lutIndex < 0) lutIndex = 0;
+    if (lutIndex >= DAY_NIGHT_LUT_SIZE) lutIndex = DAY_NIGHT_LUT_SIZE - 1;
+    const DayNightColors* colors = &g_dayNightLUT[lutIndex];
+    g_dayNight.lutIndex = lutIndex;
+    g_dayNight.skyTopColor = colors->skyTop;
+    g_dayNight.skyBottomColor = colors->skyBottom;
+    g_dayNight.ambientLightColor = colors->ambient;
+    g_dayNight.fogColor = g_dayNight.skyBottomColor;
+
+    // Расчет позиций небесных тел
+    float timeAngle = g_dayNight.timeOfDay * 2.0f * M_PI;
+    g_dayNight.sunPos.y = cam.y + fast_sin(timeAngle) * SKY_RADIUS;
+    g_dayNight.sunPos.z = cam.z + fast_cos(timeAngle) * SKY_RADIUS;
+    g_dayNight.sunPos.x = cam.x; 
 
-    // Банхаммер
-    Vec3 hammerPos = {g_rknChan.pos.x + 1.5f, g_rknChan.pos.y, g_rknChan.pos.z};
-    drawWorldCube(ren, hammerPos, 1.5f, cam, (SDL_Color){100, 80, 70, 255});
+    g_dayNight.moonPos.y = cam.y + fast_sin(timeAngle + M_PI) * SKY_RADIUS;
+    g_dayNight.moonPos.z = cam.z + fast_cos(timeAngle + M_PI) * SKY_RADIUS;
+    g_dayNight.moonPos.x = cam.x;
 }
 
-void drawGlitches(SDL_Renderer* ren, Camera cam) {
-    if (g_activeGlitches == 0) return;
-    
-    SDL_Color glitchColor = {255, 0, 255, 255};
-    for (int i = 0; i < MAX_GLITCHES; i++) {
-        if (g_glitchBytes[i].active) {
-            Vec3 jitterPos = g_glitchBytes[i].pos;
-            jitterPos.x += fast_sin(g_glitchBytes[i].jitter) * 0.2f;
-            jitterPos.y += fast_cos(g_glitchBytes[i].jitter * 1.5f) * 0.2f;
-            jitterPos.z += fast_sin(g_glitchBytes[i].jitter * 0.8f) * 0.2f;
-            drawWorldCube(ren, jitterPos, 0.5f, cam, glitchColor);
+// Рисуем Солнце и Луну
+void drawSunAndMoon(RenderBackend* ren, Camera cam) {
+    MeshInstance bodies[2];
+    int count = 0;
+    // Рисуем Солнце, если оно над горизонтом
+    if (g_dayNight.sunPos.y > cam.y) {
+        bodies[count++] = (MeshInstance){ g_dayNight.sunPos, 10.0f, {255, 255, 0, 255} };
+    }
+
+    // Рисуем Луну, если она над горизонтом
+    if (g_dayNight.moonPos.y > cam.y) {
+        bodies[count++] = (MeshInstance){ g_dayNight.moonPos, 8.0f, {200, 200, 220, 255} };
+    }
+    drawMeshInstanced(ren, &g_cubeMesh, bodies, count, cam);
+}
+
+// Инициализация телефона (вызвать один раз в main)
+void initPhone() {
+    g_phone.state = PHONE_STATE_HIDDEN;
+    g_phone.animationProgress = 0.0f;
+}
+
+// Обновление логики и анимации телефона (вызывать каждый кадр)
+void updatePhone(float deltaTime) {
+    // Плавное движение к цели
+    if (g_phone.state == PHONE_STATE_SHOWING) {
+        g_phone.animationProgress = lerp(g_phone.animationProgress, 1.0f, deltaTime * PHONE_ANIM_SPEED);
+        // Когда анимация почти закончилась, фиксируем состояние
+        if (g_phone.animationProgress > 0.99f) {
+            g_phone.animationProgress = 1.0f;
+            g_phone.state = PHONE_STATE_VISIBLE;
+        }
+    } else if (g_phone.state == PHONE_STATE_HIDING) {
+        g_phone.animationProgress = lerp(g_phone.animationProgress, 0.0f, deltaTime * PHONE_ANIM_SPEED);
+        // Когда анимация почти закончилась, фиксируем состояние
+        if (g_phone.animationProgress < 0.01f) {
+            g_phone.animationProgress = 0.0f;
+            g_phone.state = PHONE_STATE_HIDDEN;
         }
     }
 }
 
-void updateGlitches(float deltaTime, Camera* cam) {
-    if (g_activeGlitches == 0) return;
+// Отрисовка телефона (вызывать в конце цикла рендеринга)
+void drawPhone(RenderBackend* ren, TTF_Font* font) {
+    // Если телефон полностью убран, ничего не рисуем
+    if (g_phone.state == PHONE_STATE_HIDDEN) {
+        return;
+    }
 
-    for (int i = 0; i < MAX_GLITCHES; i++) {
-        if (g_glitchBytes[i].active) {
-            g_glitchBytes[i].jitter += deltaTime * 20.0f;
+    // --- Расчеты размеров и позиций ---
+    const int phoneWidth = 250;
+    const int phoneHeight = 500;
+    const int phoneOnScreenX = WIDTH - phoneWidth - 50;
+    const int phoneOnScreenY = HEIGHT - phoneHeight - 50;
+    const int phoneOffScreenY = HEIGHT; // Стартует за нижней границей экрана
 
-            // Движение к игроку
-            float dx = cam->x - g_glitchBytes[i].pos.x;
-            float dy = cam->y - g_glitchBytes[i].pos.y;
-            float dz = cam->z - g_glitchBytes[i].pos.z;
-            float dist = sqrtf(dx*dx + dy*dy + dz*dz);
+    // --- Анимация ---
+    // Вычисляем текущую позицию Y на основе прогресса анимации
+    int currentY = (int)lerp((float)phoneOffScreenY, (float)phoneOnScreenY, g_phone.animationProgress);
 
-            if (dist > 0.1f) {
-                g_glitchBytes[i].pos.x += (dx / dist) * GLITCH_SPEED * deltaTime;
-                g_glitchBytes[i].pos.y += (dy / dist) * GLITCH_SPEED * deltaTime;
-                g_glitchBytes[i].pos.z += (dz / dist) * GLITCH_SPEED * deltaTime;
-            }
+    // --- Отрисовка ---
+    Render_SetBlendMode(ren, SDL_BLENDMODE_BLEND);
 
-            // Проверка "очистки" (коллизии с игроком)
-            if (dist < 1.0f) {
-                g_glitchBytes[i].active = 0;
-                g_activeGlitches--;
-                printf("Glitch cleared! Remaining: %d\n", g_activeGlitches);
-            }
+    // 1. Корпус телефона (темно-серый)
+    Render_SetColor(ren, 25, 25, 30, 230);
+    SDL_Rect phoneBody = { phoneOnScreenX, currentY, phoneWidth, phoneHeight };
+    Render_FillRect(ren, &phoneBody);
+
+    // 2. Экран телефона (черный)
+    Render_SetColor(ren, 0, 0, 0, 255);
+    SDL_Rect phoneScreen = { phoneOnScreenX + 15, currentY + 15, phoneWidth - 30, phoneHeight - 30 };
+    Render_FillRect(ren, &phoneScreen);
+
+    // 3. Отображение времени
+    // Конвертируем время суток (0.0-1.0) в часы и минуты
+    float totalHours = g_dayNight.timeOfDay * 24.0f;
+    int hours = (int)totalHours;
+    int minutes = (int)((totalHours - hours) * 60.0f);
+
+    char timeString[6];
+    snprintf(timeString, 6, "%02d:%02d", hours, minutes); // Форматируем в "ЧЧ:ММ"
+
+    // Рисуем время на экране телефона
+    SDL_Color white = {255, 255, 255, 255};
+    drawText(ren, font, timeString, phoneScreen.x + 85, phoneScreen.y + 30, white);
+
+    if (g_timeScale != 1.0f) { // Показываем, только если скорость не стандартная
+        char scaleString[32];
+        snprintf(scaleString, 32, "Time Scale: x%.1f", g_timeScale);
+
+        SDL_Color yellow = {255, 255, 0, 255};
+        // Рисуем внизу экрана телефона
+        drawText(ren, font, scaleString, phoneScreen.x + 60, phoneScreen.y + phoneScreen.h - 50, yellow);
+    }
+}
+
+// Сколько плиток пола вокруг камеры рисовать: не больше maxTiles и не дальше тумана
+static int fogTileRange(int maxTiles, float tileSize) {
+    int fogTiles = (int)ceilf(g_fog.farPlane / tileSize);
+    return fogTiles < maxTiles ? fogTiles : maxTiles;
+}
+
+// === ВСТАВЬ ЭТУ НОВУЮ ФУНКЦИЮ ПЕРЕД drawFloor ===
+
+void drawStableWireframeFloor(RenderBackend* ren, Camera cam) {
+    SDL_Color gridColor = {60, 60, 70, 255};
+    float tileSize = 2.0f; // Такой же шаг, как у старой сетки
+
+    // <<< ВОТ ОНА, БЛЯДЬ, МАГИЯ: Мы берем цикл от старой сетки... >>>
+    for (int i = -20; i <= 20; i += 2) {
+        for (int j = -20; j <= 20; j += 2) {
+            
+            float x = (float)i;
+            float z = (float)j;
+
+            // <<< ...А ЛОГИКУ РИСОВАНИЯ - ОТ НОВОЙ! >>>
+            Vec3 corners[4] = {
+                {x, -2.0f, z},
+                {x + tileSize, -2.0f, z},
+                {x + tileSize, -2.0f, z + tileSize},
+                {x, -2.0f, z + tileSize}
+            };
+
+            // Рисуем квадрат + диагонали. Никакого, нахуй, Z-fighting'а.
+            clipAndDrawLine(ren, corners[0], corners[1], cam, gridColor);
+            clipAndDrawLine(ren, corners[1], corners[2], cam, gridColor);
+            clipAndDrawLine(ren, corners[2], corners[3], cam, gridColor);
+            clipAndDrawLine(ren, corners[3], corners[0], cam, gridColor);
+            clipAndDrawLine(ren, corners[0], corners[2], cam, gridColor);
         }
     }
-    
-    // Если все глюки зачищены, делаем босса уязвимым
-    if (g_activeGlitches == 0 && g_rknChan.state != BOSS_STATE_VULNERABLE) {
-        printf("All glitches cleared! RKN-chan is vulnerable!\n");
-        g_rknChan.state = BOSS_STATE_VULNERABLE;
-        g_rknChan.stateTimer = BOSS_VULNERABLE_DURATION;
+}
+
+// === ВСТАВЬ ЭТУ НОВУЮ ФУНКЦИЮ ПЕРЕД drawFloor ===
+
+void drawMultiplayerFloor(RenderBackend* ren, Camera cam) {
+    // <<< МЫ, БЛЯДЬ, ВЫРВАЛИ СЕРДЦЕ ИЗ СТАРОЙ ФУНКЦИИ >>>
+    // --- ЭТО ВСЕГДА ОХУЕННЫЙ, ПРОЦЕДУРНЫЙ ПОЛ ---
+    float tileSize = 4.0f;
+    int viewRange = fogTileRange(8, tileSize);
+
+    int camTileX = (int)floorf(cam.x / tileSize);
+    int camTileZ = (int)floorf(cam.z / tileSize);
+
+    for (int x = -viewRange; x <= viewRange; x++) {
+        for (int z = -viewRange; z <= viewRange; z++) {
+            float worldX = (camTileX + x) * tileSize;
+            float worldZ = (camTileZ + z) * tileSize;
+
+            float distSq = x*x + z*z;
+            if (distSq > viewRange * viewRange) continue;
+
+            Vec3 corners[4] = {
+                {worldX, -2.0f, worldZ},
+                {worldX + tileSize, -2.0f, worldZ},
+                {worldX + tileSize, -2.0f, worldZ + tileSize},
+                {worldX, -2.0f, worldZ + tileSize}
+            };
+
+            ProjectedPoint pp = project_with_depth(corners[0], cam);
+            if (pp.z < NEAR_PLANE) continue;
+
+            // В МП пол всегда будет одного, сука, стиля. Четкого.
+            SDL_Color tileColor = (( (int)(worldX/tileSize) + (int)(worldZ/tileSize) ) % 2 == 0) ? 
+                                  (SDL_Color){45, 45, 55, 255} : 
+                                  (SDL_Color){35, 35, 45, 255};
+            
+            clipAndDrawLine(ren, corners[0], corners[1], cam, tileColor);
+            clipAndDrawLine(ren, corners[1], corners[2], cam, tileColor);
+            clipAndDrawLine(ren, corners[2], corners[3], cam, tileColor);
+            clipAndDrawLine(ren, corners[3], corners[0], cam, tileColor);
+            clipAndDrawLine(ren, corners[0], corners[2], cam, tileColor);
+        }
     }
 }
 
+// === ЗАМЕНИ СТАРУЮ drawFloor НА ЭТУ ===
+void drawFloor(RenderBackend* ren, Camera cam) {
+    // Если мир еще на ранней стадии, рисуем простую сетку
+    if (g_worldEvolution.currentState < WORLD_STATE_MATERIALIZING) {
+        drawStableWireframeFloor(ren, cam); // <<< ВОТ ОНА, БЛЯДЬ!
+        return;
+    }
+
+    // --- НОВАЯ СУПЕР-ОПТИМИЗИРОВАННАЯ ЛОГИКА ---
+    float tileSize = 4.0f;
+    int viewRange = fogTileRange(8, tileSize); // Уменьшаем дальность прорисовки, но увеличиваем размер плитки
+
+    // Вычисляем, на какой плитке стоит камера
+    int camTileX = (int)floorf(cam.x / tileSize);
+    int camTileZ = (int)floorf(cam.z / tileSize);
+
+    // С текстурами плитки заливаются, и заливка проявляется по textureBlend.
+    // Контуры тогда чуть подтягиваем к камере, чтобы не тонули в заливке.
+    float texBlend = fminf(g_worldEvolution.textureBlend, 1.0f);
+    int floorFill = g_worldEvolution.currentState >= WORLD_STATE_TEXTURED && g_floorTexture && texBlend > 0.01f;
+    static const float floorUVs[8] = { 0, 0,  1, 0,  1, 1,  0, 1 }; // Одна текстура на плитку
+    PolygonTexturing floorTex = { g_floorTexture, floorUVs, 1.0f };
+    float floorLight[4]; // Пол плоский: у всех вершин одна нормаль и один свет
+    if (g_light.enabled) {
+        float level = Light_VertexLevel((Vec3){0.0f, 1.0f, 0.0f});
+        for (int k = 0; k < 4; k++) floorLight[k] = level;
+    }
+    Uint8 fillAlpha = (Uint8)(texBlend * 255);
+    if (floorFill) {
+        Render_SetBlendMode(ren, fillAlpha == 255 ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
+        g_lineDepthBias = 0.995f;
+    }
+
+    for (int x = -viewRange; x <= viewRange; x++) {
+        for (int z = -viewRange; z <= viewRange; z++) {
+            // Рисуем от плитки, где стоит игрок, наружу
+            float worldX = (camTileX + x) * tileSize;
+            float worldZ = (camTileZ + z) * tileSize;
 
-void updateBoss(float deltaTime, Camera* cam) {
-    if (!g_bossFightActive || g_rknChan.state == BOSS_STATE_DEFEATED) return;
+            // Простое отсечение по расстоянию, чтобы не рисовать углы
+            float distSq = x*x + z*z;
+            if (distSq > viewRange * viewRange) continue;
 
-    g_rknChan.stateTimer -= deltaTime;
+            Vec3 corners[4] = {
+                {worldX, -2.0f, worldZ},
+                {worldX + tileSize, -2.0f, worldZ},
+                {worldX + tileSize, -2.0f, worldZ + tileSize},
+                {worldX, -2.0f, worldZ + tileSize}
+            };
 
-    // Вектор от босса к игроку
-    float dx = cam->x - g_rknChan.pos.x;
-    float dz = cam->z - g_rknChan.pos.z;
-    float distance = sqrtf(dx*dx + dz*dz);
-    
-    switch(g_rknChan.state) {
-        case BOSS_STATE_IDLE:
-            if (g_rknChan.stateTimer <= 0) {
-                g_rknChan.state = BOSS_STATE_CHASING;
-                g_rknChan.stateTimer = 7.0f; // Преследовать 7 секунд
+            // Заливка сама отсекает себя по ближней плоскости, поэтому идёт до проверки угла ниже
+            // (иначе под ногами оставалась бы дыра)
+            if (floorFill) {
+                int even = ((int)(worldX/tileSize) + (int)(worldZ/tileSize)) % 2 == 0;
+                SDL_Color fillColor = even ? (SDL_Color){95, 95, 110, fillAlpha} : (SDL_Color){80, 80, 95, fillAlpha};
+                g_gbuffer.normal = GBUF_NORMAL_UP;
+                fillWorldPolygon(ren, corners, 4, cam, fillColor, &floorTex, g_light.enabled ? floorLight : NULL);
+                g_gbuffer.normal = GBUF_NORMAL_NONE;
             }
-            break;
 
-        case BOSS_STATE_CHASING:
-            // Двигается к игроку
-            if (distance > 0.1f) {
-                g_rknChan.pos.x += (dx / distance) * BOSS_SPEED * deltaTime;
-                g_rknChan.pos.z += (dz / distance) * BOSS_SPEED * deltaTime;
-            }
-            if (g_rknChan.stateTimer <= 0) {
-                g_rknChan.state = BOSS_STATE_SUMMONING_GLITCHES;
-                g_rknChan.stateTimer = 2.0f; // 2 секунды каста
-            }
-            break;
+            // Проверяем, находится ли хотя бы один угол плитки перед нами
+            if (!isFloorCornerInFront_Cached(corners[0], camTileX + x, camTileZ + z, cam)) continue;
 
-        case BOSS_STATE_SUMMONING_GLITCHES:
-            // Стоит на месте, "кастует"
-            if (g_rknChan.stateTimer <= 0) {
-                spawnGlitches(MAX_GLITCHES);
-                g_rknChan.state = BOSS_STATE_IDLE;
-                g_rknChan.stateTimer = 999.0f; // Ждет, пока не зачистят глюки
-            }
-            break;
+            SDL_Color tileColor = (( (int)(worldX/tileSize) + (int)(worldZ/tileSize) ) % 2 == 0) ? 
+                                  (SDL_Color){45, 45, 55, 255} : 
+                                  (SDL_Color){35, 35, 45, 255};
             
-        case BOSS_STATE_VULNERABLE:
-            // Проверяем, наносит ли игрок урон
-            if (distance < 3.0f) { // Нужно подойти вплотную для урона
-                g_rknChan.health -= 20.0f * deltaTime; // Теряет 20 хп в секунду
-                 if (g_rknChan.health <= 0) {
-                    g_rknChan.health = 0;
-                    g_rknChan.state = BOSS_STATE_DEFEATED;
-                    printf("RKN-chan has been defeated! The Internet is free!\n");
-                 }
-            }
-            if (g_rknChan.stateTimer <= 0) {
-                printf("RKN-chan is no longer vulnerable.\n");
-                g_rknChan.state = BOSS_STATE_IDLE;
-                g_rknChan.stateTimer = 2.0f;
-            }
-            break;
-        
-        default: break;
+            // Вместо заливки рисуем только контур и диагонали - это в 100 раз быстрее
+            clipAndDrawLine(ren, corners[0], corners[1], cam, tileColor);
+            clipAndDrawLine(ren, corners[1], corners[2], cam, tileColor);
+            clipAndDrawLine(ren, corners[2], corners[3], cam, tileColor);
+            clipAndDrawLine(ren, corners[3], corners[0], cam, tileColor);
+            clipAndDrawLine(ren, corners[0], corners[2], cam, tileColor);
+        }
     }
-}
-
-void drawBossUI(SDL_Renderer* ren) {
-    if (!g_bossFightActive || g_rknChan.state == BOSS_STATE_DEFEATED) return;
-
-    int barWidth = WIDTH / 2;
-    int barHeight = 20;
-    int barX = (WIDTH - barWidth) / 2;
-    int barY = 30;
 
-    // Фон
-    SDL_SetRenderDrawColor(ren, 50, 50, 50, 200);
-    SDL_Rect bgRect = {barX, barY, barWidth, barHeight};
-    SDL_RenderFillRect(ren, &bgRect);
-
-    // Полоска здоровья
-    float healthPercent = g_rknChan.health / g_rknChan.maxHealth;
-    SDL_SetRenderDrawColor(ren, 200, 40, 40, 220);
-    SDL_Rect hpRect = {barX, barY, (int)(barWidth * healthPercent), barHeight};
-    SDL_RenderFillRect(ren, &hpRect);
+    if (floorFill) {
+        Render_SetBlendMode(ren, SDL_BLENDMODE_NONE);
+        g_lineDepthBias = 1.0f;
+    }
 }
 
-// Проверяет, находится ли точка в упрощенной "пирамиде видимости" камеры
-int isPointInFrustum(Vec3 point, Camera cam) {
-    // --- 1. Проверка расстояния (отсечение по ближней и дальней плоскости) ---
-    float dx = point.x - cam.x;
-    float dz = point.z - cam.z;
-    float distanceSq = dx*dx + dz*dz; // Используем квадрат расстояния, чтобы не считать корень
+// === ВСТАВЬ ЭТОТ БЛОК ПЕРЕД main() ===
 
-    // Если объект дальше 50 юнитов, не рисуем (настройте значение)
-    if (distanceSq > 50.0f * 50.0f) {
-        return 0; // Слишком далеко
-    }
-    
-    // --- 2. Проверка по углу обзора (отсечение по боковым плоскостям) ---
-    // Вектор направления камеры
-    Vec3 camDir = {fast_sin(cam.rotY), 0, fast_cos(cam.rotY)};
-    
-    // Вектор от камеры к точке
-    Vec3 pointDir = {dx, 0, dz};
-    
-    // Нормализуем вектор к точке (для dot product)
-    float pointDirLen = sqrtf(distanceSq);
-    if (pointDirLen < 1e-6f) return 1; // Если точка в камере, считаем видимой
-    pointDir.x /= pointDirLen;
-    pointDir.z /= pointDirLen;
+void drawJet(RenderBackend* ren, FighterJet* jet, Camera cam) {
+    if (!jet->active) return;
     
-    // Скалярное произведение векторов. dot(A, B) = cos(угол между A и B), если векторы нормализованы.
-    float dotProduct = dot(camDir, pointDir);
+    Vec3 body_front = {jet->pos.x, jet->pos.y, jet->pos.z + 2.0f};
+    Vec3 body_rear = {jet->pos.x, jet->pos.y, jet->pos.z - 2.0f};
+    Vec3 wing_left = {jet->pos.x - 2.5f, jet->pos.y, jet->pos.z - 1.0f};
+    Vec3 wing_right = {jet->pos.x + 2.5f, jet->pos.y, jet->pos.z - 1.0f};
     
-    // g_fov у вас большой, поэтому возьмем широкий угол. 
-    // cos(60 градусов) ~ 0.5. Если dotProduct меньше этого, значит угол больше 60, и точка сбоку.
-    // Настройте значение 0.3f под себя. Чем оно меньше, тем шире угол обзора для отсечения.
-    if (dotProduct < 0.3f) {
-        return 0; // Точка находится слишком сбоку от направления взгляда
-    }
+    SDL_Color jetColor = {200, 200, 210, 255};
 
-    return 1; // Точка видна
+    clipAndDrawLine(ren, body_front, wing_left, cam, jetColor);
+    clipAndDrawLine(ren, wing_left, body_rear, cam, jetColor);
+    clipAndDrawLine(ren, body_rear, wing_right, cam, jetColor);
+    clipAndDrawLine(ren, wing_right, body_front, cam, jetColor);
 }
 
-// Вычисляет радиус описывающей сферы для CollisionBox
-float getBoundingSphereRadius(CollisionBox* box) {
-    // Находим самую "дальнюю" точку от центра бокса по всем осям
-    float dx = fmaxf(fabsf(box->bounds.minX), fabsf(box->bounds.maxX));
-    float dy = fmaxf(fabsf(box->bounds.minY), fabsf(box->bounds.maxY));
-    float dz = fmaxf(fabsf(box->bounds.minZ), fabsf(box->bounds.maxZ));
+void drawBomb(RenderBackend* ren, Bomb* bomb, Camera cam) {
+    if (!bomb->active) return;
     
-    // Радиус - это расстояние от центра (0,0,0) до этой дальней точки
-    return sqrtf(dx*dx + dy*dy + dz*dz);
+    Vec3 top = {bomb->pos.x, bomb->pos.y + 0.3f, bomb->pos.z};
+    Vec3 bottom = {bomb->pos.x, bomb->pos.y - 0.3f, bomb->pos.z};
+    SDL_Color bombColor = {50, 50, 50, 255};
+    clipAndDrawLine(ren, top, bottom, cam, bombColor);
 }
 
-int isBoxInFrustum_Improved(CollisionBox* box, Camera cam) {
-    float radius = getBoundingSphereRadius(box);
-    Vec3 pos = box->pos;
+void drawExplosion(RenderBackend* ren, Explosion* explosion, Camera cam) {
+    if (!explosion->active) return;
+    
+    float radius = explosion->currentRadius;
+    float opacity = (explosion->lifetime / 1.5f);
+    if (opacity > 1.0f) opacity = 1.0f;
+    
+    SDL_Color color = {255, (int)(150 * opacity), 0, (int)(255 * opacity)};
 
-    // --- 1. Проверка на слишком близкое/далекое расстояние ---
-    float dx = pos.x - cam.x;
-    float dz = pos.z - cam.z;
-    float distanceSq = dx*dx + dz*dz;
-    float distance = sqrtf(distanceSq);
+    Vec3 center = explosion->pos;
+    LodLevel lod = Lod_Select(Lod_ProjectedSize(center, radius, cam), &explosion->lodLevel[g_view.index]);
+    if (lod == LOD_POINT) {
+        clipAndDrawLine(ren, center, center, cam, color);
+        return;
+    }
+    int segments = (lod == LOD_FULL) ? 12 : 6;
+    Vec3 points_xy[segments], points_xz[segments];
 
-    // Если объект слишком далеко (с учетом его радиуса) или слишком близко, отсекаем
-    if (distance > 50.0f + radius || distance < NEAR_PLANE - radius) {
-        return 0;
+    for (int i = 0; i < segments; i++) {
+        float angle = 2.0f * M_PI * i / segments;
+        points_xy[i] = (Vec3){center.x + fast_cos(angle) * radius, center.y + fast_sin(angle) * radius, center.z};
+        points_xz[i] = (Vec3){center.x + fast_cos(angle) * radius, center.y, center.z + fast_sin(angle) * radius};
     }
+
+    for (int i = 0; i < segments; i++) {
+        clipAndDrawLine(ren, points_xy[i], points_xy[(i + 1) % segments], cam, color);
+        clipAndDrawLine(ren, points_xz[i], points_xz[(i + 1) % segments], cam, color);
+    }
+}
+
+void startAirstrike(Vec3 start, Vec3 end, Camera* playerCam) {
+    if (g_airstrike.isActive) return;
     
-    // --- 2. Улучшенная проверка по углу обзора ---
-    Vec3 camDir = {fast_sin(cam.rotY), 0, fast_cos(cam.rotY)}; // Вектор взгляда камеры
-    Vec3 toObject = {dx, 0, dz}; // Вектор от камеры к центру объекта
+    printf("Calling for Democracy!\n");
+    g_airstrike.isActive = 1;
+    g_airstrike.timer = 0.0f;
     
-    // Проекция вектора toObject на вектор camDir. Это расстояние 'd' вдоль луча взгляда.
-    float d = dot(toObject, camDir);
-
-    // Если d отрицательно, и объект далеко, то он точно сзади
-    if (d < 0 && distance > radius) {
-        return 0; // Объект сзади
+    for (int i = 0; i < 3; i++) {
+        Vec3 offset = {(float)(i-1) * 6.0f, 0, (float)(i-1) * 3.0f};
+        g_airstrike.jets[i].startPos = (Vec3){start.x + offset.x, start.y, start.z + offset.z};
+        g_airstrike.jets[i].endPos = (Vec3){end.x + offset.x, end.y, end.z + offset.z};
+        g_airstrike.jets[i].pos = g_airstrike.jets[i].startPos;
+        g_airstrike.jets[i].progress = 0.0f;
+        g_airstrike.jets[i].velocity = normalize((Vec3){end.x-start.x, 0, end.z-start.z});
+        g_airstrike.jets[i].active = 1;
+        g_airstrike.jets[i].hasDroppedBomb = 0;
+        
+        g_airstrike.bombs[i].active = 0;
+        g_airstrike.explosions[i].active = 0;
     }
+    
+    g_cinematic.isActive = 1;
+    g_cinematic.transitionProgress = 0.0f;
+    g_cinematic.target = (Vec3){ (start.x + end.x)/2, (start.y + end.y)/2 - 10, (start.z + end.z)/2 };
+    g_cinematic.position = (Vec3){ playerCam->x, playerCam->y + 5, playerCam->z };
+    g_cinematic.fov = g_fov;
+}
 
-    // Находим ближайшую к центру объекта точку на линии взгляда камеры
-    Vec3 closestPointOnRay;
-    closestPointOnRay.x = cam.x + camDir.x * d;
-    closestPointOnRay.y = cam.y; // Мы делаем проверку в 2D (XZ) для простоты
-    closestPointOnRay.z = cam.z + camDir.z * d;
+void updateAirstrike(float deltaTime, Camera* playerCam) {
+    if (!g_airstrike.isActive) return;
 
-    // Расстояние от центра объекта до этой ближайшей точки
-    float distToRaySq = powf(pos.x - closestPointOnRay.x, 2) + 
-                        powf(pos.z - closestPointOnRay.z, 2);
+    g_airstrike.timer += deltaTime;
 
-    // Если квадрат этого расстояния меньше квадрата радиуса, то сфера объекта пересекает центральный луч взгляда
-    if (distToRaySq < radius * radius) {
-        return 1; // Мы точно видим объект
+    for (int i = 0; i < 3; i++) {
+        if (!g_airstrike.jets[i].active) continue;
+        
+        g_airstrike.jets[i].progress += deltaTime * 0.2f;
+        g_airstrike.jets[i].pos.x = lerp(g_airstrike.jets[i].startPos.x, g_airstrike.jets[i].endPos.x, g_airstrike.jets[i].progress);
+        g_airstrike.jets[i].pos.y = lerp(g_airstrike.jets[i].startPos.y, g_airstrike.jets[i].endPos.y, g_airstrike.jets[i].progress);
+        g_airstrike.jets[i].pos.z = lerp(g_airstrike.jets[i].startPos.z, g_airstrike.jets[i].endPos.z, g_airstrike.jets[i].progress);
+        
+        if (g_airstrike.jets[i].progress > 0.5f && !g_airstrike.jets[i].hasDroppedBomb) {
+            g_airstrike.jets[i].hasDroppedBomb = 1;
+            g_airstrike.bombs[i].active = 1;
+            g_airstrike.bombs[i].pos = g_airstrike.jets[i].pos;
+            g_airstrike.bombs[i].velocity = (Vec3){0, -15.0f, 0};
+            g_airstrike.bombs[i].fuse = 2.0f;
+        }
+
+        if (g_airstrike.jets[i].progress >= 1.0f) g_airstrike.jets[i].active = 0;
+    }
+    
+    for (int i = 0; i < 3; i++) {
+        if (!g_airstrike.bombs[i].active) continue;
+        
+        g_airstrike.bombs[i].fuse -= deltaTime;
+        g_airstrike.bombs[i].velocity.y -= 12.8f * deltaTime;
+        g_airstrike.bombs[i].pos.y += g_airstrike.bombs[i].velocity.y * deltaTime;
+        
+        if (g_airstrike.bombs[i].pos.y < -1.9f || g_airstrike.bombs[i].fuse <= 0) {
+            g_airstrike.bombs[i].active = 0;
+            g_airstrike.explosions[i].active = 1;
+            g_airstrike.explosions[i].pos = (Vec3){g_airstrike.bombs[i].pos.x, -1.9f, g_airstrike.bombs[i].pos.z};
+            g_airstrike.explosions[i].currentRadius = 0.0f;
+            g_airstrike.explosions[i].maxRadius = 12.0f;
+            g_airstrike.explosions[i].lifetime = 1.5f;
+            
+            float dist = sqrtf(powf(playerCam->x - g_airstrike.explosions[i].pos.x, 2) + powf(playerCam->z - g_airstrike.explosions[i].pos.z, 2));
+            if (dist < g_airstrike.explosions[i].maxRadius) {
+                printf("Player was hit by Democracy! Distance: %.2f\n", dist);
+            }
+        }
     }
     
-    // --- 3. Проверка по краям поля зрения ---
-    // Это более сложная часть, но мы можем схитрить.
-    // Мы знаем 'd' (расстояние по лучу) и 'distToRay' (расстояние вбок от луча).
-    // Это образует прямоугольный треугольник. Тангенс угла до объекта = distToRay / d.
-    
-    float distToRay = sqrtf(distToRaySq);
-    
-    // Угол обзора (FOV). g_fov у тебя - это не угол, а проекционный множитель.
-    // Возьмем примерный угол в 45 градусов от центра в каждую сторону (общий 90).
-    // tan(45) = 1.0
-    float fovLimit = tanf(45.0f * M_PI / 180.0f); 
+    for (int i = 0; i < 3; i++) {
+        if (!g_airstrike.explosions[i].active) continue;
+        
+        g_airstrike.explosions[i].lifetime -= deltaTime;
+        g_airstrike.explosions[i].currentRadius = lerp(0.0f, g_airstrike.explosions[i].maxRadius, 1.0f - (g_airstrike.explosions[i].lifetime / 1.5f));
+        
+        if (g_airstrike.explosions[i].lifetime <= 0) g_airstrike.explosions[i].active = 0;
+    }
 
-    // Если тангенс угла до объекта МЕНЬШЕ, чем тангенс половины FOV, то объект в поле зрения.
-    // Мы также должны учесть радиус объекта, чтобы края не исчезали.
-    if (distToRay - radius < d * fovLimit) {
-        return 1;
+    if (g_airstrike.timer > 15.0f) {
+        g_airstrike.isActive = 0;
+        g_cinematic.isActive = 0;
     }
-    
-    return 0; // Объект за пределами поля зрения
 }
-// Наша новая глобальная переменная. Будет хранить то, на что мы смотрим.
-PickupObject* g_targetedObject = NULL;
 
-void drawCrosshair(SDL_Renderer* ren) {
+// === ВСТАВЬ ЭТОТ ЧЕРТЁЖ ПЕРЕД drawMainMenu ===
 
-    if (!g_showCrosshair) {
-        return; // Если кнопка выключена - ПОШЁЛ НАХУЙ ОТСЮДА
-    }
+// 6 вершин нашего охуенного октаэдра
+Vec3 octahedron_verts[6] = {
+    { 0,  1,  0}, // 0: Верхняя точка
+    { 0, -1,  0}, // 1: Нижняя точка
+    { 1,  0,  0}, // 2: Правая
+    {-1,  0,  0}, // 3: Левая
+    { 0,  0,  1}, // 4: Передняя
+    { 0,  0, -1}  // 5: Задняя
+};
 
-    int cx = WIDTH / 2;
-    int cy = HEIGHT / 2;
-    
-    // Если мы на что-то навелись - прицел становится жёлтым и большим
-    if (g_targetedObject) {
-        SDL_SetRenderDrawColor(ren, 255, 255, 0, 255);
-        SDL_RenderDrawLine(ren, cx - 10, cy, cx + 10, cy);
-        SDL_RenderDrawLine(ren, cx, cy - 10, cx, cy + 10);
-    } else {
-        // Обычный, маленький, белый прицел
-        SDL_SetRenderDrawColor(ren, 255, 255, 255, 255);
-        SDL_RenderDrawLine(ren, cx - 5, cy, cx + 5, cy);
-        SDL_RenderDrawLine(ren, cx, cy - 5, cx, cy + 5);
-    }
-}
+// 12 рёбер, которые соединяют эти вершины
+int octahedron_edges[12][2] = {
+    {0, 2}, {0, 3}, {0, 4}, {0, 5}, // Рёбра от верхушки
+    {1, 2}, {1, 3}, {1, 4}, {1, 5}, // Рёбра от низа
+    {2, 4}, {4, 3}, {3, 5}, {5, 2}  // Рёбра по экватору
+};
 
-// === ЗАМЕНИ СТАРУЮ updateTractorBeam НА ЭТУ ===
-void updateTractorBeam(Camera* cam) {
-    if (g_targetedObject) {
-        g_targetedObject->color = g_targetedObject->originalColor;
-        g_targetedObject = NULL;
-    }
-    if (g_hands.heldObject) return;
+void drawMainMenu(RenderBackend* ren, TTF_Font* font) {
+    ren->BeginFrame(ren, (SDL_Color){10, 10, 15, 255});
 
-    Vec3 rayOrigin = {cam->x, cam->y + cam->height, cam->z};
-    Vec3 rayDir = { fast_sin(cam->rotY) * fast_cos(cam->rotX), fast_sin(cam->rotX), fast_cos(cam->rotY) * fast_cos(cam->rotX) };
-    rayDir = normalize(rayDir);
+    SDL_Color titleColor = {0, 255, 100, 255};
+    SDL_Color optionColor = {200, 200, 200, 255};
+    SDL_Color selectedColor = {255, 255, 0, 255};
 
-    // <<< НАЧИНАЕМ, БЛЯДЬ, ВСКРЫТИЕ >>>
-    static Uint32 last_debug_print = 0;
-    if (SDL_GetTicks() - last_debug_print > 500) { // Печатаем дебаг 2 раза в секунду
-        printf("--- DEBUG TICK ---\n");
-        printf("[CAM POS]: x=%.2f, y=%.2f, z=%.2f\n", cam->x, cam->y, cam->z);
-        printf("[CAM ROT]: y=%.2f, x=%.2f\n", cam->rotY, cam->rotX);
-        printf("[RAY DIR]: x=%.2f, y=%.2f, z=%.2f\n", rayDir.x, rayDir.y, rayDir.z);
-        last_debug_print = SDL_GetTicks();
-    }
+    SDL_Color splashColor = {255, 255, 0, 255};
 
-    float closest_t = 3.0f; // Максимальная дистанция
-    PickupObject* potentialTarget = NULL;
+    // --- Рисуем название "G OMETRICA" (как и раньше) ---
+    drawText(ren, font, "G", WIDTH/2 - 150, HEIGHT/2 - 100, titleColor);
+    drawText(ren, font, "OMETRICA", WIDTH/2 - 80, HEIGHT/2 - 100, titleColor);
 
-    for (int i = 0; i < g_numPickups; i++) {
-        PickupObject* obj = &g_pickups[i];
-        if (obj->state != PICKUP_STATE_IDLE) continue;
-        Vec3 boxMin = {obj->pos.x - obj->size.x/2, obj->pos.y - obj->size.y/2, obj->pos.z - obj->size.z/2};
-        Vec3 boxMax = {obj->pos.x + obj->size.x/2, obj->pos.y + obj->size.y/2, obj->pos.z + obj->size.z/2};
-        float t;
-        if (intersectRayAABB(rayOrigin, rayDir, boxMin, boxMax, &t)) {
-            if (t < closest_t) {
-                closest_t = t;
-                potentialTarget = obj;
-            }
-        }
-    }
+    // --- А ВОТ ТУТ, БЛЯДЬ, НАЧИНАЕТСЯ МАГИЯ ---
+    int center_x = WIDTH/2 - 106.5;
+    int center_y = HEIGHT/2 - 90;
+    int size = 20;
     
-    g_targetedObject = potentialTarget;
+    // Создаем массив для 2D-точек на экране
+    SDL_Point screen_points[6];
 
-    if (g_targetedObject) {
-        g_targetedObject->color = (SDL_Color){255, 255, 0, 255};
+    // 1. ВРАЩАЕМ, БЛЯДЬ, ВЕРШИНЫ В 3D
+    for(int i = 0; i < 6; i++) {
+        Vec3 v = octahedron_verts[i];
+
+        // Вращаем по Y (вокруг вертикальной оси)
+        float newX = v.x * fast_cos(g_menuRhombusAngle) - v.z * fast_sin(g_menuRhombusAngle);
+        float newZ = v.x * fast_sin(g_menuRhombusAngle) + v.z * fast_cos(g_menuRhombusAngle);
+        
+        // 2. ПРОЕЦИРУЕМ, НАХУЙ, НА 2D-ЭКРАН
+        // Мы просто, блядь, берем X и Y. А Z используем для перспективы.
+        screen_points[i].x = center_x + (int)(newX * size);
+        screen_points[i].y = center_y - (int)(v.y * size); // Y в SDL инвертирован
     }
-}
 
-// --- DAY/NIGHT CYCLE FUNCTIONS ---
+    // 3. РИСУЕМ, СУКА, РЁБРА
+    Render_SetColor(ren, titleColor.r, titleColor.g, titleColor.b, 255);
+    for(int i = 0; i < 12; i++) {
+        int start_index = octahedron_edges[i][0];
+        int end_index = octahedron_edges[i][1];
+        
+        Render_Line(ren, 
+            screen_points[start_index].x, screen_points[start_index].y,
+            screen_points[end_index].x, screen_points[end_index].y
+        );
+    }
 
-// Вспомогательная функция для плавного смешивания цветов
-SDL_Color lerpColor(SDL_Color a, SDL_Color b, float t) {
-    if (t < 0.0f) t = 0.0f;
-    if (t > 1.0f) t = 1.0f;
-    SDL_Color result;
-    result.r = (Uint8)(a.r + (b.r - a.r) * t);
-    result.g = (Uint8)(a.g + (b.g - a.g) * t);
-    result.b = (Uint8)(a.b + (b.b - a.b) * t);
-    result.a = 255;
-    return result;
-}
+    // --- А ВОТ, БЛЯДЬ, И ГОЛОС ИЗ НООСФЕРЫ ---
+    // Слегка пульсирующая прозрачность
+    splashColor.a = 155 + (Uint8)(fast_sin(Game_GetTicks() * 0.002f) * 100.0f);
+    int text_w, text_h;
+    TTF_SizeUTF8(font, g_current_splash, &text_w, &text_h);
+    // Рисуем чуть выше и правее заголовка
+    drawText(ren, font, g_current_splash, WIDTH/2 - 100 + text_w / 2, HEIGHT/2 - 120, splashColor);
+    
+    // --- Рисуем пункты меню ---
+    const char* menuItems[] = { "Single Player", "Multiplayer", "Settings", "Exit" };
+    for (int i = 0; i < 4; i++) {
+        char itemText[128];
+        snprintf(itemText, sizeof(itemText), "%s %s", (i == g_menuSelectedOption) ? ">" : " ", menuItems[i]);
+        drawText(ren, font, itemText, WIDTH/2 - 100, HEIGHT/2 + 20 + i * 40, (i == g_menuSelectedOption) ? selectedColor : optionColor);
+    }
 
-// Инициализация цикла
-void initDayNightCycle() {
-    g_dayNight.timeOfDay = 0.25f; // Начинаем с восхода
 }
 
-void SetTimeOfDay(float newTime) {
-    // fmodf - это остаток от деления для float. Гарантирует, что время всегда будет в пределах 0.0-1.0
-    g_dayNight.timeOfDay = fmodf(newTime, 1.0f); 
-    if (g_dayNight.timeOfDay < 0.0f) {
-        g_dayNight.timeOfDay += 1.0f;
-    }
-}
+// === ДОБАВЬ ЭТУ НОВУЮ ФУНКЦИЮ ===
+// === ЗАМЕНИ drawMultiplayerMenu ===
+void drawMultiplayerMenu(RenderBackend* ren, TTF_Font* font) {
+    ren->BeginFrame(ren, (SDL_Color){10, 10, 15, 255});
 
-void updateDayNightCycle(float deltaTime, Camera cam) {
-    // СТАНЕТ (умножаем deltaTime на наш множитель):
-    g_dayNight.timeOfDay += (deltaTime * g_timeScale) / DAY_NIGHT_DURATION_SECONDS;
+    SDL_Color titleColor = {0, 255, 100, 255};
+    SDL_Color optionColor = {200, 200, 200, 255};
+    SDL_Color selectedColor = {255, 255, 0, 255};
 
-    if (g_dayNight.timeOfDay >= 1.0f) {
-        g_dayNight.timeOfDay -= 1.0f;
+    drawText(ren, font, "MULTIPLAYER", WIDTH/2 - 100, 100, titleColor);
+
+    // <<< ВОТ ОНА, БЛЯДЬ, ПРОВЕРКА, КОТОРОЙ НЕ ХВАТАЛО >>>
+    if (g_mp_menu_state == MP_MENU_SELECT) {
+        // Рисуем меню выбора
+        const char* menuItems[] = { "Host Game", "Join Game", "Back" };
+        for (int i = 0; i < 3; i++) {
+            char itemText[128];
+            snprintf(itemText, sizeof(itemText), "%s %s", (i == g_menuSelectedOption) ? ">" : " ", menuItems[i]);
+            drawText(ren, font, itemText, WIDTH/2 - 100, 200 + i * 40, (i == g_menuSelectedOption) ? selectedColor : optionColor);
+        }
+        drawText(ren, font, "Host: To find your IP, open Google and search 'my ip address'", 20, HEIGHT - 50, (SDL_Color){100,100,100,255});
+
+    } else if (g_mp_menu_state == MP_MENU_INPUT_IP) {
+        // Рисуем поле для ввода IP
+        drawText(ren, font, "Enter Host IP Address:", WIDTH/2 - 150, 200, optionColor);
+        
+        char inputLine[128];
+        snprintf(inputLine, sizeof(inputLine), "> %s", g_ip_input_buffer);
+        drawText(ren, font, inputLine, WIDTH/2 - 150, 240, selectedColor);
+
+        // Мигающий курсор
+        if ((Game_GetTicks() / 500) % 2 == 0) {
+            int text_w, text_h;
+            TTF_SizeUTF8(font, inputLine, &text_w, &text_h);
+            SDL_Rect cursorRect = { WIDTH/2 - 150 + text_w, 240, 10, 20 };
+            Render_SetColor(ren, selectedColor.r, selectedColor.g, selectedColor.b, 255);
+            Render_FillRect(ren, &cursorRect);
+        }
+        drawText(ren, font, "Press [Enter] to connect, [Escape] to cancel", 20, HEIGHT - 50, (SDL_Color){100,100,100,255});
     }
+}
 
-    // 2. НОВЫЕ, БОЛЕЕ ПРИГЛУШЕННЫЕ ЦВЕТА
-    const SDL_Color midnightTop = {5, 5, 15, 255};
-    const SDL_Color midnightBottom = {10, 10, 25, 255};
-    const SDL_Color midnightLight = {30, 30, 45, 255}; // Немного светлее ночь
+// === ВСТАВЬ ЭТОТ БЛОК ПЕРЕД drawSettingsMenu ===
 
-    const SDL_Color sunriseTop = {60, 70, 100, 255}; // Менее яркий восход
-    const SDL_Color sunriseBottom = {200, 100, 50, 255}; 
-    const SDL_Color sunriseLight = {200, 160, 140, 255};
+// Наши, блядь, ASCII-лица. По одному на каждую настройку + "Назад".
+const char* SETTINGS_FACES[] = {
+    "(⌐■_■)", // Mouse Sensitivity
+    "(•_•)",   // Walk Speed
+    "\\(>o<)/", // Run Speed
+    "(^.^)",   // Jump Force
+    "(v_v)",   // Gravity
+    "(O_O)",   // Field of View
+    "(._.) /"  // Back
+};
 
-    const SDL_Color noonTop = {100, 140, 180, 255}; // Приглушенный голубой день
-    const SDL_Color noonBottom = {130, 170, 200, 255};
-    const SDL_Color noonLight = {220, 220, 230, 255}; // Не чисто белый, а сероватый свет
+// Наши, блядь, объяснения.
+const char* SETTINGS_DESCRIPTIONS[] = {
+    "Как быстро, нахуй, башка вертится.",
+    "Скорость для чилла и прогулок.",
+    "Когда надо съебаться. Быстро.",
+    "Как высоко, блядь, подлетаешь.",
+    "Как сильно тебя к земле тянет.",
+    "Насколько у тебя, нахуй, широкие глаза.",
+    "Вернуться и сохранить эту дичь."
+};
 
-    const SDL_Color sunsetBottom = {220, 90, 55, 255}; // Менее кричащий закат
+// Наши, блядь, финальные реплики.
+const char* SETTINGS_REMARKS[] = {
+    "Резкость — это вежливость.",
+    "Тише едешь - дальше будешь.",
+    "Беги, Форрест, беги!",
+    "В небо, нахуй!",
+    "Помни о своих корнях, брат.",
+    "Видишь всё. Вообще всё.",
+    "Был рад попиздеть."
+};
 
-    // 3. Смешиваем цвета (логика остается той же)
-    float t = 0.0f;
-    if (g_dayNight.timeOfDay >= 0.0f && g_dayNight.timeOfDay < 0.25f) { // Ночь -> Восход
-        t = g_dayNight.timeOfDay / 0.25f;
-        g_dayNight.skyTopColor = lerpColor(midnightTop, sunriseTop, t);
-        g_dayNight.skyBottomColor = lerpColor(midnightBottom, sunriseBottom, t);
-        g_dayNight.ambientLightColor = lerpColor(midnightLight, sunriseLight, t);
-    } else if (g_dayNight.timeOfDay >= 0.25f && g_dayNight.timeOfDay < 0.5f) { // Восход -> Полдень
-        t = (g_dayNight.timeOfDay - 0.25f) / 0.25f;
-        g_dayNight.skyTopColor = lerpColor(sunriseTop, noonTop, t);
-        g_dayNight.skyBottomColor = lerpColor(sunriseBottom, noonBottom, t);
-        g_dayNight.ambientLightColor = lerpColor(sunriseLight, noonLight, t);
-    } else if (g_dayNight.timeOfDay >= 0.5f && g_dayNight.timeOfDay < 0.75f) { // Полдень -> Закат
-        t = (g_dayNight.timeOfDay - 0.5f) / 0.25f;
-        g_dayNight.skyTopColor = lerpColor(noonTop, sunriseTop, t);
-        g_dayNight.skyBottomColor = lerpColor(noonBottom, sunsetBottom, t);
-        g_dayNight.ambientLightColor = lerpColor(noonLight, sunriseLight, t);
-    } else { // Закат -> Ночь
-        t = (g_dayNight.timeOfDay - 0.75f) / 0.25f;
-        g_dayNight.skyTopColor = lerpColor(sunriseTop, midnightTop, t);
-        g_dayNight.skyBottomColor = lerpColor(sunsetBottom, midnightBottom, t);
-        g_dayNight.ambientLightColor = lerpColor(sunriseLight, midnightLight, t);
+void drawSettingsMenu(RenderBackend* ren, TTF_Font* font, TTF_Font* large_font, EditableVariable* vars, int numVars) {
+    ren->BeginFrame(ren, (SDL_Color){10, 10, 15, 255});
+    
+    SDL_Color titleColor = {0, 255, 100, 255};
+    SDL_Color optionColor = {200, 200, 200, 255};
+    SDL_Color selectedColor = {255, 255, 0, 255};
+    
+    drawText(ren, font, "SETTINGS", 20, 20, titleColor);
+
+    for (int i = 0; i < numVars; ++i) {
+        char buffer[128];
+        snprintf(buffer, 128, "%s: < %.4f >", vars[i].name, *vars[i].value_ptr);
+        drawText(ren, font, buffer, 50, 80 + i * 30, (i == g_settingsSelectedOption) ? selectedColor : optionColor);
     }
-    g_dayNight.fogColor = g_dayNight.skyBottomColor;
+    
+    drawText(ren, font, "Back", 50, 80 + numVars * 30, (numVars == g_settingsSelectedOption) ? selectedColor : optionColor);
 
-    // 4. Расчет позиций небесных тел (без изменений)
-    float timeAngle = g_dayNight.timeOfDay * 2.0f * M_PI;
-    g_dayNight.sunPos.y = cam.y + fast_sin(timeAngle) * SKY_RADIUS;
-    g_dayNight.sunPos.z = cam.z + fast_cos(timeAngle) * SKY_RADIUS;
-    g_dayNight.sunPos.x = cam.x; 
+    if (g_settingsSelectedOption >= 0 && g_settingsSelectedOption <= numVars) {
+        
+        // 1. Рисуем ASCII-морду в центре
+        const char* face = SETTINGS_FACES[g_settingsSelectedOption];
+        int face_w, face_h;
+        TTF_SizeUTF8(large_font, face, &face_w, &face_h);
+        drawText(ren, large_font, face, WIDTH / 2 - face_w / 2, HEIGHT / 2 - 100, selectedColor);
 
-    g_dayNight.moonPos.y = cam.y + fast_sin(timeAngle + M_PI) * SKY_RADIUS;
-    g_dayNight.moonPos.z = cam.z + fast_cos(timeAngle + M_PI) * SKY_RADIUS;
-    g_dayNight.moonPos.x = cam.x;
+        // 2. Рисуем фон для описания внизу
+        Render_SetBlendMode(ren, SDL_BLENDMODE_BLEND);
+        Render_SetColor(ren, 0, 0, 0, 180);
+        SDL_Rect bgRect = { 0, HEIGHT - 100, WIDTH, 100 };
+        Render_FillRect(ren, &bgRect);
+
+        // 3. Собираем и рисуем текст
+        char full_text[512];
+        snprintf(full_text, sizeof(full_text), "Хммм... %s %s", 
+                 SETTINGS_DESCRIPTIONS[g_settingsSelectedOption], 
+                 SETTINGS_REMARKS[g_settingsSelectedOption]);
+        
+        drawText(ren, font, full_text, 50, HEIGHT - 70, optionColor);
+    }
 }
 
-// Рисуем Солнце и Луну
-void drawSunAndMoon(SDL_Renderer* ren, Camera cam) {
-    // Рисуем Солнце, если оно над горизонтом
-    if (g_dayNight.sunPos.y > cam.y) {
-        drawWorldCube(ren, g_dayNight.sunPos, 10.0f, cam, (SDL_Color){255, 255, 0, 255});
+void clearZBuffer() {
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            // Заполняем буфер "бесконечностью", чтобы любой первый пиксель
+            // был ближе, чем это значение.
+            g_zBuffer[y][x] = INFINITY;
+        }
     }
+}
 
-    // Рисуем Луну, если она над горизонтом
-    if (g_dayNight.moonPos.y > cam.y) {
-        drawWorldCube(ren, g_dayNight.moonPos, 8.0f, cam, (SDL_Color){200, 200, 220, 255});
+// Начало кадра сцены: для кадров из одних линий вместо чистки z-буфера
+// просто обнуляем списки пролётов s-буфера
+void Visibility_BeginFrame(int lineOnly) {
+    g_sbuffer.active = lineOnly;
+    g_sbuffer.spansInserted = 0;
+    g_sbuffer.spansDropped = 0;
+    if (lineOnly) {
+        memset(g_sbuffer.count, 0, sizeof(g_sbuffer.count));
+    } else {
+        clearZBuffer();
     }
 }
 
-// Инициализация телефона (вызвать один раз в main)
-void initPhone() {
-    g_phone.state = PHONE_STATE_HIDDEN;
-    g_phone.animationProgress = 0.0f;
+// Кадр мира из одних линий: до MATERIALIZING ничего не заливается
+int isLineOnlyWorldState(WorldState state) {
+    return state < WORLD_STATE_MATERIALIZING;
 }
 
-// Обновление логики и анимации телефона (вызывать каждый кадр)
-void updatePhone(float deltaTime) {
-    // Плавное движение к цели
-    if (g_phone.state == PHONE_STATE_SHOWING) {
-        g_phone.animationProgress = lerp(g_phone.animationProgress, 1.0f, deltaTime * PHONE_ANIM_SPEED);
-        // Когда анимация почти закончилась, фиксируем состояние
-        if (g_phone.animationProgress > 0.99f) {
-            g_phone.animationProgress = 1.0f;
-            g_phone.state = PHONE_STATE_VISIBLE;
-        }
-    } else if (g_phone.state == PHONE_STATE_HIDING) {
-        g_phone.animationProgress = lerp(g_phone.animationProgress, 0.0f, deltaTime * PHONE_ANIM_SPEED);
-        // Когда анимация почти закончилась, фиксируем состояние
-        if (g_phone.animationProgress < 0.01f) {
-            g_phone.animationProgress = 0.0f;
-            g_phone.state = PHONE_STATE_HIDDEN;
-        }
-    }
+// === ВСТАВЬ ЭТУ ФУНКЦИЮ ПЕРЕД main ===
+void selectNewSplash() {
+    int index = rand() % NUM_SPLASHES;
+    strncpy(g_current_splash, g_splashes[index], 255);
+    g_current_splash[255] = '\0';
 }
 
-// Отрисовка телефона (вызывать в конце цикла рендеринга)
-void drawPhone(SDL_Renderer* ren, TTF_Font* font) {
-    // Если телефон полностью убран, ничего не рисуем
-    if (g_phone.state == PHONE_STATE_HIDDEN) {
+void saveConfig(const char* filename, GameConfig* config) {
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        printf("Не удалось сохранить настройки в %s\n", filename);
         return;
     }
+    
+    fprintf(file, "mouseSensitivity=%.6f\n", config->mouseSensitivity);
+    fprintf(file, "walkSpeed=%.6f\n", config->walkSpeed);
+    fprintf(file, "runSpeed=%.6f\n", config->runSpeed);
+    fprintf(file, "crouchSpeedMultiplier=%.6f\n", config->crouchSpeedMultiplier);
+    fprintf(file, "acceleration=%.6f\n", config->acceleration);
+    fprintf(file, "deceleration=%.6f\n", config->deceleration);
+    fprintf(file, "jumpForce=%.6f\n", config->jumpForce);
+    fprintf(file, "gravity=%.6f\n", config->gravity);
+    fprintf(file, "fov=%.6f\n", config->fov);
+    fprintf(file, "fogDensity=%.6f\n", config->fogDensity);
+    fprintf(file, "lodPointPixels=%.6f\n", config->lodPointPixels);
+    fprintf(file, "lodLowPixels=%.6f\n", config->lodLowPixels);
+    
+    fclose(file);
+    printf("Настройки сохранены в %s\n", filename);
+}
 
-    // --- Расчеты размеров и позиций ---
-    const int phoneWidth = 250;
-    const int phoneHeight = 500;
-    const int phoneOnScreenX = WIDTH - phoneWidth - 50;
-    const int phoneOnScreenY = HEIGHT - phoneHeight - 50;
-    const int phoneOffScreenY = HEIGHT; // Стартует за нижней границей экрана
-
-    // --- Анимация ---
-    // Вычисляем текущую позицию Y на основе прогресса анимации
-    int currentY = (int)lerp((float)phoneOffScreenY, (float)phoneOnScreenY, g_phone.animationProgress);
-
-    // --- Отрисовка ---
-    SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
-
-    // 1. Корпус телефона (темно-серый)
-    SDL_SetRenderDrawColor(ren, 25, 25, 30, 230);
-    SDL_Rect phoneBody = { phoneOnScreenX, currentY, phoneWidth, phoneHeight };
-    SDL_RenderFillRect(ren, &phoneBody);
-
-    // 2. Экран телефона (черный)
-    SDL_SetRenderDrawColor(ren, 0, 0, 0, 255);
-    SDL_Rect phoneScreen = { phoneOnScreenX + 15, currentY + 15, phoneWidth - 30, phoneHeight - 30 };
-    SDL_RenderFillRect(ren, &phoneScreen);
-
-    // 3. Отображение времени
-    // Конвертируем время суток (0.0-1.0) в часы и минуты
-    float totalHours = g_dayNight.timeOfDay * 24.0f;
-    int hours = (int)totalHours;
-    int minutes = (int)((totalHours - hours) * 60.0f);
-
-    char timeString[6];
-    snprintf(timeString, 6, "%02d:%02d", hours, minutes); // Форматируем в "ЧЧ:ММ"
-
-    // Рисуем время на экране телефона
-    SDL_Color white = {255, 255, 255, 255};
-    drawText(ren, font, timeString, phoneScreen.x + 85, phoneScreen.y + 30, white);
-
-    if (g_timeScale != 1.0f) { // Показываем, только если скорость не стандартная
-        char scaleString[32];
-        snprintf(scaleString, 32, "Time Scale: x%.1f", g_timeScale);
+void loadConfig(const char* filename, GameConfig* config) {
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        printf("Файл настроек %s не найден, используем значения по умолчанию\n", filename);
+        return;
+    }
+    
+    // === ИСПРАВЛЕНИЕ 1: Используем безопасное чтение ===
+    char line[CONFIG_LINE_SIZE];
+    while (readConfigLine(file, line, sizeof(line))) {
+        // Пробуем распарсить каждое возможное значение
+        parseConfigValue(line, "mouseSensitivity", &config->mouseSensitivity);
+        parseConfigValue(line, "walkSpeed", &config->walkSpeed);
+        parseConfigValue(line, "runSpeed", &config->runSpeed);
+        parseConfigValue(line, "crouchSpeedMultiplier", &config->crouchSpeedMultiplier);
+        parseConfigValue(line, "acceleration", &config->acceleration);
+        parseConfigValue(line, "deceleration", &config->deceleration);
+        parseConfigValue(line, "jumpForce", &config->jumpForce);
+        parseConfigValue(line, "gravity", &config->gravity);
+        parseConfigValue(line, "fov", &config->fov);
+        parseConfigValue(line, "fogDensity", &config->fogDensity);
+        parseConfigValue(line, "lodPointPixels", &config->lodPointPixels);
+        parseConfigValue(line, "lodLowPixels", &config->lodLowPixels);
+    }
+    
+    fclose(file);
+    printf("Настройки загружены из %s\n", filename);
+}
 
-        SDL_Color yellow = {255, 255, 0, 255};
-        // Рисуем внизу экрана телефона
-        drawText(ren, font, scaleString, phoneScreen.x + 60, phoneScreen.y + phoneScreen.h - 50, yellow);
+void init_multiplayer() {
+    SDLNet_Init();
+    g_isMultiplayer = 0;
+    g_isServer = 0;
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        g_players[i].active = 0;
     }
 }
 
-// === ВСТАВЬ ЭТУ НОВУЮ ФУНКЦИЮ ПЕРЕД drawFloor ===
+void start_server() {
+    printf("[SERVER] Attempting to start on port 1234...\n");
+    if (SDLNet_ResolveHost(&g_server_ip, NULL, 1234) == -1) {
+        printf("[SERVER] [FATAL] SDLNet_ResolveHost: %s\n", SDLNet_GetError());
+        return;
+    }
+    printf("[SERVER] Host resolved.\n");
+    g_server_socket = SDLNet_TCP_Open(&g_server_ip);
+    if (!g_server_socket) {
+        printf("[SERVER] [FATAL] SDLNet_TCP_Open: %s\n", SDLNet_GetError());
+        return;
+    }
+    g_socket_set = SDLNet_AllocSocketSet(MAX_PLAYERS);
+    SDLNet_TCP_AddSocket(g_socket_set, g_server_socket);
+    
+    g_isServer = 1; g_isMultiplayer = 1; g_players[0].active = 1; g_myPlayerID = 0;
+    printf("[SERVER] Server started successfully!\n");
+}
 
-void drawStableWireframeFloor(SDL_Renderer* ren, Camera cam) {
-    SDL_Color gridColor = {60, 60, 70, 255};
-    float tileSize = 2.0f; // Такой же шаг, как у старой сетки
+int connect_to_server(const char* ip_address) {
+    printf("[CLIENT] Attempting to connect to %s:1234...\n", ip_address);
+    if (SDLNet_ResolveHost(&g_server_ip, ip_address, 1234) == -1) {
+        printf("[CLIENT] [FATAL] SDLNet_ResolveHost: %s\n", SDLNet_GetError());
+        return 0;
+    }
+    printf("[CLIENT] Host resolved.\n");
+    g_server_socket = SDLNet_TCP_Open(&g_server_ip);
+    if (!g_server_socket) {
+        printf("[CLIENT] [FATAL] SDLNet_TCP_Open: %s\n", SDLNet_GetError());
+        return 0;
+    }
+    printf("[CLIENT] Connection established! Awaiting Player ID...\n");
+    
+    if (SDLNet_TCP_Recv(g_server_socket, &g_myPlayerID, sizeof(int)) <= 0) {
+        printf("[CLIENT] [FATAL] Failed to receive player ID from server: %s\n", SDLNet_GetError());
+        SDLNet_TCP_Close(g_server_socket);
+        return 0;
+    }
+    
+    g_isServer = 0;
+    g_isMultiplayer = 1;
+    printf("[CLIENT] Success! I am Player %d\n", g_myPlayerID);
+    return 1;
+}
 
-    // <<< ВОТ ОНА, БЛЯДЬ, МАГИЯ: Мы берем цикл от старой сетки... >>>
-    for (int i = -20; i <= 20; i += 2) {
-        for (int j = -20; j <= 20; j += 2) {
-            
-            float x = (float)i;
-            float z = (float)j;
+// === ЗАМЕНИ СТАРУЮ update_multiplayer НА ЭТУ ===
+void update_multiplayer(Camera* cam) {
+    if (!g_isMultiplayer) return;
+    if (g_isServer) {
+        // --- СЕРВЕР ---
+        // <<< ВОТ ОН, ДАТЧИК ДВИЖЕНИЯ >>>
+        // Проверяем, есть ли активность, но НЕ ЖДЁМ (таймаут 0)
+        int num_ready = SDLNet_CheckSockets(g_socket_set, 0);
+        if (num_ready > 0) {
+            // Проверяем, не на главном ли сокете активность (новый клиент)
+            if (SDLNet_SocketReady(g_server_socket)) {
+                TCPsocket new_client = SDLNet_TCP_Accept(g_server_socket);
+                if (new_client) {
+                    for (int i = 1; i < MAX_PLAYERS; i++) {
+                        if (!g_players[i].active) {
+                            g_players[i].active = 1;
+                            g_players[i].socket = new_client;
+                            SDLNet_TCP_AddSocket(g_socket_set, new_client); // Добавляем в "прослушку"
+                            SDLNet_TCP_Send(new_client, &i, sizeof(int));
+                            printf("[SERVER] Player %d connected!\n", i);
+                            break;
+                        }
+                    }
+                }
+            }
+            // Проверяем активность на сокетах клиентов (прислали данные)
+            for (int i = 1; i < MAX_PLAYERS; i++) {
+                if (g_players[i].active && SDLNet_SocketReady(g_players[i].socket)) {
+                    if (SDLNet_TCP_Recv(g_players[i].socket, &g_players[i].pos, sizeof(Vec3)) <= 0) {
+                        printf("[SERVER] Player %d disconnected.\n", i);
+                        SDLNet_TCP_DelSocket(g_socket_set, g_players[i].socket);
+                        SDLNet_TCP_Close(g_players[i].socket);
+                        g_players[i].active = 0;
+                        g_players[i].socket = NULL;
+                    }
+                }
+            }
+        }
+        
+        g_players[0].pos = (Vec3){cam->x, cam->y, cam->z};
+        // Рассылаем всем обновленное состояние
+        for (int i = 1; i < MAX_PLAYERS; i++) {
+            if (g_players[i].active) {
+                SDLNet_TCP_Send(g_players[i].socket, g_players, sizeof(Player) * MAX_PLAYERS);
+            }
+        }
 
-            // <<< ...А ЛОГИКУ РИСОВАНИЯ - ОТ НОВОЙ! >>>
-            Vec3 corners[4] = {
-                {x, -2.0f, z},
-                {x + tileSize, -2.0f, z},
-                {x + tileSize, -2.0f, z + tileSize},
-                {x, -2.0f, z + tileSize}
-            };
+    } else {
+        // --- ЛОГИКА КЛИЕНТА ---
+        Vec3 mypos = {cam->x, cam->y, cam->z};
+        SDLNet_TCP_Send(g_server_socket, &mypos, sizeof(Vec3));
+        SDLNet_TCP_Recv(g_server_socket, g_players, sizeof(Player) * MAX_PLAYERS);
+    }
+}
 
-            // Рисуем квадрат + диагонали. Никакого, нахуй, Z-fighting'а.
-            clipAndDrawLine(ren, corners[0], corners[1], cam, gridColor);
-            clipAndDrawLine(ren, corners[1], corners[2], cam, gridColor);
-            clipAndDrawLine(ren, corners[2], corners[3], cam, gridColor);
-            clipAndDrawLine(ren, corners[3], corners[0], cam, gridColor);
-            clipAndDrawLine(ren, corners[0], corners[2], cam, gridColor);
+void shutdown_multiplayer() {
+    if (g_isMultiplayer) {
+        printf("Shutting down multiplayer...\n");
+        if (g_socket_set) {
+            SDLNet_FreeSocketSet(g_socket_set); // <<< Чистим за собой
+            g_socket_set = NULL;
+        }
+        if (g_server_socket) {
+            SDLNet_TCP_Close(g_server_socket);
+            g_server_socket = NULL;
         }
+        for (int i = 0; i < MAX_PLAYERS; i++) {
+            if (g_players[i].socket) {
+                SDLNet_TCP_Close(g_players[i].socket);
+                g_players[i].socket = NULL;
+            }
+        }
+        g_isMultiplayer = 0;
+        g_isServer = 0;
     }
 }
 
-// === ВСТАВЬ ЭТУ НОВУЮ ФУНКЦИЮ ПЕРЕД drawFloor ===
-
-void drawMultiplayerFloor(SDL_Renderer* ren, Camera cam) {
-    // <<< МЫ, БЛЯДЬ, ВЫРВАЛИ СЕРДЦЕ ИЗ СТАРОЙ ФУНКЦИИ >>>
-    // --- ЭТО ВСЕГДА ОХУЕННЫЙ, ПРОЦЕДУРНЫЙ ПОЛ ---
-    float tileSize = 4.0f;
-    int viewRange = 8; 
-
-    int camTileX = (int)floorf(cam.x / tileSize);
-    int camTileZ = (int)floorf(cam.z / tileSize);
-
-    for (int x = -viewRange; x <= viewRange; x++) {
-        for (int z = -viewRange; z <= viewRange; z++) {
-            float worldX = (camTileX + x) * tileSize;
-            float worldZ = (camTileZ + z) * tileSize;
-
-            float distSq = x*x + z*z;
-            if (distSq > viewRange * viewRange) continue;
-
-            Vec3 corners[4] = {
-                {worldX, -2.0f, worldZ},
-                {worldX + tileSize, -2.0f, worldZ},
-                {worldX + tileSize, -2.0f, worldZ + tileSize},
-                {worldX, -2.0f, worldZ + tileSize}
-            };
+// --- РЕЙКАСТ ПО BVH: дерево, пачки лучей, плитки ---
 
-            ProjectedPoint pp = project_with_depth(corners[0], cam);
-            if (pp.z < NEAR_PLANE) continue;
+// Центр бокса по оси (удвоенный - для сравнения всё равно)
+static inline float rayBoxCenter2(const RayBox* b, int axis) {
+    return b->min[axis] + b->max[axis];
+}
 
-            // В МП пол всегда будет одного, сука, стиля. Четкого.
-            SDL_Color tileColor = (( (int)(worldX/tileSize) + (int)(worldZ/tileSize) ) % 2 == 0) ? 
-                                  (SDL_Color){45, 45, 55, 255} : 
-                                  (SDL_Color){35, 35, 45, 255};
-            
-            clipAndDrawLine(ren, corners[0], corners[1], cam, tileColor);
-            clipAndDrawLine(ren, corners[1], corners[2], cam, tileColor);
-            clipAndDrawLine(ren, corners[2], corners[3], cam, tileColor);
-            clipAndDrawLine(ren, corners[3], corners[0], cam, tileColor);
-            clipAndDrawLine(ren, corners[0], corners[2], cam, tileColor);
+// Частичная сортировка leafBoxes[begin, end) по центру на оси: на место nth встаёт тот же бокс,
+// что и после полной сортировки, слева от него центры не больше, справа - не меньше
+static void bvhSelect(int begin, int end, int nth, int axis) {
+    RayBox* b = g_rayRender.leafBoxes;
+    while (end - begin > 1) {
+        float pivot = rayBoxCenter2(&b[(begin + end) / 2], axis);
+        int i = begin, j = end - 1;
+        while (i <= j) {
+            while (rayBoxCenter2(&b[i], axis) < pivot) i++;
+            while (rayBoxCenter2(&b[j], axis) > pivot) j--;
+            if (i <= j) {
+                RayBox tmp = b[i]; b[i] = b[j]; b[j] = tmp;
+                i++; j--;
+            }
         }
+        if (nth <= j) end = j + 1;
+        else if (nth >= i) begin = i;
+        else return; // Между j и i - только равные опорному
     }
 }
 
-// === ЗАМЕНИ СТАРУЮ drawFloor НА ЭТУ ===
-void drawFloor(SDL_Renderer* ren, Camera cam) {
-    // Если мир еще на ранней стадии, рисуем простую сетку
-    if (g_worldEvolution.currentState < WORLD_STATE_MATERIALIZING) {
-        drawStableWireframeFloor(ren, cam); // <<< ВОТ ОНА, БЛЯДЬ!
-        return;
+// Узел над leafBoxes[first, first + count): делим пополам по оси с самым большим разбросом центров
+static int bvhBuild(int first, int count, int depth) {
+    int index = g_rayRender.numNodes++;
+    BvhNode* node = &g_rayRender.nodes[index];
+    if (depth > g_rayRender.depth) g_rayRender.depth = depth;
+
+    float centerMin[3], centerMax[3];
+    for (int k = 0; k < 3; k++) {
+        node->min[k] = centerMin[k] = FLT_MAX;
+        node->max[k] = centerMax[k] = -FLT_MAX;
+    }
+    for (int i = first; i < first + count; i++) {
+        const RayBox* b = &g_rayRender.leafBoxes[i];
+        for (int k = 0; k < 3; k++) {
+            node->min[k] = fminf(node->min[k], b->min[k]);
+            node->max[k] = fmaxf(node->max[k], b->max[k]);
+            float c = rayBoxCenter2(b, k);
+            centerMin[k] = fminf(centerMin[k], c);
+            centerMax[k] = fmaxf(centerMax[k], c);
+        }
     }
+    if (count <= RAYRENDER_LEAF_BOXES) {
+        node->first = first;
+        node->count = (Uint16)count;
+        node->axis = 0;
+        return index;
+    }
+
+    int axis = 0;
+    for (int k = 1; k < 3; k++) {
+        if (centerMax[k] - centerMin[k] > centerMax[axis] - centerMin[axis]) axis = k;
+    }
+    int half = count / 2;
+    bvhSelect(first, first + count, first + half, axis);
+    node->count = 0;
+    node->axis = (Uint16)axis;
+    bvhBuild(first, half, depth + 1); // Левый ребёнок - сразу следующий узел
+    int right = bvhBuild(first + half, count - half, depth + 1);
+    g_rayRender.nodes[index].first = right;
+    return index;
+}
 
-    // --- НОВАЯ СУПЕР-ОПТИМИЗИРОВАННАЯ ЛОГИКА ---
-    float tileSize = 4.0f;
-    int viewRange = 8; // Уменьшаем дальность прорисовки, но увеличиваем размер плитки
-
-    // Вычисляем, на какой плитке стоит камера
-    int camTileX = (int)floorf(cam.x / tileSize);
-    int camTileZ = (int)floorf(cam.z / tileSize);
+// Раз в кадр до отрисовки видов: итоги прошлого кадра в ноль, а дерево - заново, если боксы
+// уровня сдвинулись, появились или пропали. Сравнение - один проход по боксам, без дерева
+void RayRender_BeginFrame(const CollisionBox* boxes, int count) {
+    SDL_AtomicSet(&g_rayRender.rays, 0);
+    SDL_AtomicSet(&g_rayRender.tiles, 0);
+    SDL_AtomicSet(&g_rayRender.nodeTests, 0);
+    SDL_AtomicSet(&g_rayRender.boxTests, 0);
+    SDL_AtomicSet(&g_rayRender.micros, 0);
+
+    if (count > RAYRENDER_MAX_BOXES) count = RAYRENDER_MAX_BOXES;
+    int dirty = count != g_rayRender.numBoxes;
+    for (int i = 0; i < count; i++) {
+        const CollisionBox* c = &boxes[i];
+        RayBox b = {
+            { c->pos.x + c->bounds.minX, c->pos.y + c->bounds.minY, c->pos.z + c->bounds.minZ },
+            { c->pos.x + c->bounds.maxX, c->pos.y + c->bounds.maxY, c->pos.z + c->bounds.maxZ },
+            c->color
+        };
+        if (memcmp(&b, &g_rayRender.boxes[i], sizeof(b)) != 0) {
+            g_rayRender.boxes[i] = b;
+            dirty = 1;
+        }
+    }
+    g_rayRender.numBoxes = count;
+    if (!dirty) return;
 
-    for (int x = -viewRange; x <= viewRange; x++) {
-        for (int z = -viewRange; z <= viewRange; z++) {
-            // Рисуем от плитки, где стоит игрок, наружу
-            float worldX = (camTileX + x) * tileSize;
-            float worldZ = (camTileZ + z) * tileSize;
+    memcpy(g_rayRender.leafBoxes, g_rayRender.boxes, count * sizeof(RayBox));
+    g_rayRender.numNodes = 0;
+    g_rayRender.depth = 0;
+    if (count > 0) bvhBuild(0, count, 1);
+    g_rayRender.rebuilds++;
+}
 
-            // Простое отсечение по расстоянию, чтобы не рисовать углы
-            float distSq = x*x + z*z;
-            if (distSq > viewRange * viewRange) continue;
+void RayRender_CycleMode(void) {
+    g_rayRender.mode = (RayRenderMode)((g_rayRender.mode + 1) % RAYRENDER_MODE_COUNT);
+    printf("Ray render: %s\n", g_rayRenderModeNames[g_rayRender.mode]);
+}
 
-            Vec3 corners[4] = {
-                {worldX, -2.0f, worldZ},
-                {worldX + tileSize, -2.0f, worldZ},
-                {worldX + tileSize, -2.0f, worldZ + tileSize},
-                {worldX, -2.0f, worldZ + tileSize}
-            };
+// Пачка из 4 лучей из одного глаза
+typedef struct {
+    float dx[4], dy[4], dz[4];
+    float t[4];     // Ближайшее попадание; на входе - пол или дальняя плоскость
+    int hit[4];     // Бокс в leafBoxes, RAYRENDER_HIT_FLOOR или RAYRENDER_MISS
+    int axis[4];    // Ось грани бокса, в которую упёрся луч
+} RayPacket;
+
+// Все лучи плитки разом: по каждой оси отрезок, в котором лежит 1/d любого из них.
+// Направление линейно по экрану, поэтому крайние значения - у лучей в углах плитки
+typedef struct {
+    float invLo[3], invHi[3];
+    int bounded[3];   // 0 - лучи плитки идут по оси в обе стороны: такая ось ничего не отсекает
+    int negative[3];  // Все лучи идут по оси в минус: ближняя плоскость слоя - max, а не min
+} RayTileFrustum;
 
-            // Проверяем, находится ли хотя бы один угол плитки перед нами
-            ProjectedPoint pp = project_with_depth(corners[0], cam);
-            if (pp.z < NEAR_PLANE) continue;
+// Бокс из списка плитки: tMin - раньше этого в него не попадёт ни один луч плитки
+typedef struct {
+    float tMin;
+    int box;
+} RayCandidate;
+
+static RENDER_TLS RayCandidate g_rayCandidates[RAYRENDER_MAX_BOXES];
+
+// Может ли хоть один луч плитки попасть в AABB ближе farZ. Интервальная арифметика: вход в слой
+// по оси не раньше нижней границы (b - o) * [invLo, invHi], выход - не позже верхней
+static int rayTileSlab(const RayTileFrustum* fr, const float eye[3], const float mn[3], const float mx[3], float farZ, float* tMin) {
+    float lo = 0.0f, hi = farZ;
+    for (int k = 0; k < 3; k++) {
+        if (!fr->bounded[k]) continue;
+        float nearPlane = (fr->negative[k] ? mx[k] : mn[k]) - eye[k];
+        float farPlane = (fr->negative[k] ? mn[k] : mx[k]) - eye[k];
+        lo = fmaxf(lo, fminf(nearPlane * fr->invLo[k], nearPlane * fr->invHi[k]));
+        hi = fminf(hi, fmaxf(farPlane * fr->invLo[k], farPlane * fr->invHi[k]));
+    }
+    *tMin = lo * (1.0f - RAYRENDER_CULL_SLACK);
+    return *tMin <= hi * (1.0f + RAYRENDER_CULL_SLACK);
+}
 
-            SDL_Color tileColor = (( (int)(worldX/tileSize) + (int)(worldZ/tileSize) ) % 2 == 0) ? 
-                                  (SDL_Color){45, 45, 55, 255} : 
-                                  (SDL_Color){35, 35, 45, 255};
-            
-            // Вместо заливки рисуем только контур и диагонали - это в 100 раз быстрее
-            clipAndDrawLine(ren, corners[0], corners[1], cam, tileColor);
-            clipAndDrawLine(ren, corners[1], corners[2], cam, tileColor);
-            clipAndDrawLine(ren, corners[2], corners[3], cam, tileColor);
-            clipAndDrawLine(ren, corners[3], corners[0], cam, tileColor);
-            clipAndDrawLine(ren, corners[0], corners[2], cam, tileColor);
+// BVH обходится один раз на всю плитку: узел отбрасывается, если в него заведомо не попадает
+// ни один её луч. Боксы уцелевших листьев встают в g_rayCandidates по возрастанию tMin.
+// Плитка узкая, и кандидатов у неё единицы, сколько бы боксов ни было в уровне
+static int rayTileCandidates(const RayTileFrustum* fr, const float eye[3], float farZ, Uint32* nodeTests) {
+    if (g_rayRender.numNodes == 0) return 0;
+    RayCandidate* out = g_rayCandidates;
+    int count = 0;
+    int stack[RAYRENDER_STACK];
+    int sp = 0, node = 0;
+    for (;;) {
+        const BvhNode* n = &g_rayRender.nodes[node];
+        float tMin;
+        (*nodeTests)++;
+        if (rayTileSlab(fr, eye, n->min, n->max, farZ, &tMin)) {
+            if (n->count == 0) {
+                stack[sp++] = n->first;
+                node = node + 1;
+                continue;
+            }
+            for (int b = n->first; b < n->first + n->count; b++) {
+                const RayBox* box = &g_rayRender.leafBoxes[b];
+                if (!rayTileSlab(fr, eye, box->min, box->max, farZ, &tMin)) continue;
+                int i = count++;
+                while (i > 0 && out[i - 1].tMin > tMin) { out[i] = out[i - 1]; i--; }
+                out[i].tMin = tMin;
+                out[i].box = b;
+            }
         }
+        if (sp == 0) break;
+        node = stack[--sp];
     }
+    return count;
 }
 
-// === ВСТАВЬ ЭТОТ БЛОК ПЕРЕД main() ===
-
-void drawJet(SDL_Renderer* ren, FighterJet* jet, Camera cam) {
-    if (!jet->active) return;
-    
-    Vec3 body_front = {jet->pos.x, jet->pos.y, jet->pos.z + 2.0f};
-    Vec3 body_rear = {jet->pos.x, jet->pos.y, jet->pos.z - 2.0f};
-    Vec3 wing_left = {jet->pos.x - 2.5f, jet->pos.y, jet->pos.z - 1.0f};
-    Vec3 wing_right = {jet->pos.x + 2.5f, jet->pos.y, jet->pos.z - 1.0f};
-    
-    SDL_Color jetColor = {200, 200, 210, 255};
-
-    clipAndDrawLine(ren, body_front, wing_left, cam, jetColor);
-    clipAndDrawLine(ren, wing_left, body_rear, cam, jetColor);
-    clipAndDrawLine(ren, body_rear, wing_right, cam, jetColor);
-    clipAndDrawLine(ren, wing_right, body_front, cam, jetColor);
+#ifdef __SSE2__
+static inline __m128i raySelect(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
 }
 
-void drawBomb(SDL_Renderer* ren, Bomb* bomb, Camera cam) {
-    if (!bomb->active) return;
-    
-    Vec3 top = {bomb->pos.x, bomb->pos.y + 0.3f, bomb->pos.z};
-    Vec3 bottom = {bomb->pos.x, bomb->pos.y - 0.3f, bomb->pos.z};
-    SDL_Color bombColor = {50, 50, 50, 255};
-    clipAndDrawLine(ren, top, bottom, cam, bombColor);
+static inline float rayMax4(__m128 v) {
+    __m128 m = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(m);
 }
 
-void drawExplosion(SDL_Renderer* ren, Explosion* explosion, Camera cam) {
-    if (!explosion->active) return;
-    
-    int segments = 12;
-    float radius = explosion->currentRadius;
-    float opacity = (explosion->lifetime / 1.5f);
-    if (opacity > 1.0f) opacity = 1.0f;
-    
-    SDL_Color color = {255, (int)(150 * opacity), 0, (int)(255 * opacity)};
-
-    Vec3 center = explosion->pos;
-    Vec3 points_xy[segments], points_xz[segments];
-
-    for (int i = 0; i < segments; i++) {
-        float angle = 2.0f * M_PI * i / segments;
-        points_xy[i] = (Vec3){center.x + fast_cos(angle) * radius, center.y + fast_sin(angle) * radius, center.z};
-        points_xz[i] = (Vec3){center.x + fast_cos(angle) * radius, center.y, center.z + fast_sin(angle) * radius};
+// Кандидаты плитки против пачки: плоскость b по оси пересекается при t = (b - o) * (1/d).
+// Список идёт от ближних к дальним, и как только следующий бокс дальше всех попаданий пачки - хватит
+static void rayTracePacket(RayPacket* p, const float eye[3], const RayCandidate* cand, int count, Uint32* boxTests) {
+    const RayBox* boxes = g_rayRender.leafBoxes;
+    __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+    __m128 ix = _mm_div_ps(one, _mm_loadu_ps(p->dx));
+    __m128 iy = _mm_div_ps(one, _mm_loadu_ps(p->dy));
+    __m128 iz = _mm_div_ps(one, _mm_loadu_ps(p->dz));
+    __m128 tBest = _mm_loadu_ps(p->t);
+    __m128i hit = _mm_loadu_si128((const __m128i*)p->hit);
+    __m128i axis = _mm_loadu_si128((const __m128i*)p->axis);
+    float farthest = rayMax4(tBest);
+
+    for (int c = 0; c < count && cand[c].tMin < farthest; c++) {
+        const RayBox* box = &boxes[cand[c].box];
+        (*boxTests)++;
+        __m128 x0 = _mm_mul_ps(_mm_set1_ps(box->min[0] - eye[0]), ix);
+        __m128 x1 = _mm_mul_ps(_mm_set1_ps(box->max[0] - eye[0]), ix);
+        __m128 y0 = _mm_mul_ps(_mm_set1_ps(box->min[1] - eye[1]), iy);
+        __m128 y1 = _mm_mul_ps(_mm_set1_ps(box->max[1] - eye[1]), iy);
+        __m128 z0 = _mm_mul_ps(_mm_set1_ps(box->min[2] - eye[2]), iz);
+        __m128 z1 = _mm_mul_ps(_mm_set1_ps(box->max[2] - eye[2]), iz);
+        __m128 nx = _mm_min_ps(x0, x1), ny = _mm_min_ps(y0, y1), nz = _mm_min_ps(z0, z1);
+        __m128 tEnter = _mm_max_ps(_mm_max_ps(nx, ny), nz);
+        __m128 tExit = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)), _mm_max_ps(z0, z1));
+        // Глаз внутри бокса (tEnter <= 0) - его стенок не видно, как и у растеризатора
+        __m128 m = _mm_and_ps(_mm_and_ps(_mm_cmple_ps(tEnter, tExit), _mm_cmpgt_ps(tEnter, zero)), _mm_cmplt_ps(tEnter, tBest));
+        if (!_mm_movemask_ps(m)) continue;
+
+        __m128i mi = _mm_castps_si128(m);
+        tBest = _mm_or_ps(_mm_and_ps(m, tEnter), _mm_andnot_ps(m, tBest));
+        hit = raySelect(mi, _mm_set1_epi32(cand[c].box), hit);
+        // Грань - та ось, чья плоскость входа дальше всех
+        __m128i faceAxis = raySelect(_mm_castps_si128(_mm_cmpeq_ps(tEnter, ny)), _mm_set1_epi32(1), _mm_set1_epi32(2));
+        faceAxis = _mm_andnot_si128(_mm_castps_si128(_mm_cmpeq_ps(tEnter, nx)), faceAxis);
+        axis = raySelect(mi, faceAxis, axis);
+        farthest = rayMax4(tBest);
+    }
+
+    _mm_storeu_ps(p->t, tBest);
+    _mm_storeu_si128((__m128i*)p->hit, hit);
+    _mm_storeu_si128((__m128i*)p->axis, axis);
+}
+#else
+// Без SSE2 - те же кандидаты, но каждым лучом по отдельности
+static void rayTracePacket(RayPacket* p, const float eye[3], const RayCandidate* cand, int count, Uint32* boxTests) {
+    const RayBox* boxes = g_rayRender.leafBoxes;
+    for (int lane = 0; lane < 4; lane++) {
+        const float inv[3] = { 1.0f / p->dx[lane], 1.0f / p->dy[lane], 1.0f / p->dz[lane] };
+        for (int c = 0; c < count && cand[c].tMin < p->t[lane]; c++) {
+            const RayBox* box = &boxes[cand[c].box];
+            (*boxTests)++;
+            float tEnter = -FLT_MAX, tExit = FLT_MAX;
+            int faceAxis = 0;
+            for (int k = 0; k < 3; k++) {
+                float t0 = (box->min[k] - eye[k]) * inv[k], t1 = (box->max[k] - eye[k]) * inv[k];
+                if (fminf(t0, t1) > tEnter) { tEnter = fminf(t0, t1); faceAxis = k; }
+                tExit = fminf(tExit, fmaxf(t0, t1));
+            }
+            if (tEnter <= tExit && tEnter > 0.0f && tEnter < p->t[lane]) {
+                p->t[lane] = tEnter;
+                p->hit[lane] = cand[c].box;
+                p->axis[lane] = faceAxis;
+            }
+        }
     }
+}
+#endif
 
-    for (int i = 0; i < segments; i++) {
-        clipAndDrawLine(ren, points_xy[i], points_xy[(i + 1) % segments], cam, color);
-        clipAndDrawLine(ren, points_xz[i], points_xz[(i + 1) % segments], cam, color);
-    }
+// Всё, что нужно плиткам на кадр вида. Плитки разбирают другие потоки, поэтому туман и свет
+// едут снимком, а не через RENDER_TLS
+typedef struct {
+    RenderBackend* ren;
+    Viewport view;
+    int step;                   // 1 - луч на пиксель, 2 - на блок 2x2
+    int tilesX, tilesY;
+    float eye[3];
+    Vec3 forward, right, up;    // Луч в точку (px, py): forward + right * (px - cx) - up * (py - cy), z камеры = 1
+    float farZ;
+    int lit, shadeFog;
+    int gbuffer;                // В виде есть лампы: попадания идут и в G-буфер
+    int faceLevel[7];           // Ступень света грани: ось * 2 + (1, если нормаль в плюс); 6 - пол
+    SDL_Color floorColors[2];   // Клетки пола: чётная и нечётная
+    FogSettings fog;
+    LightingState light;
+} RayRenderFrame;
+
+#ifdef __SSE2__
+// Одна компонента направления у 4 лучей; |d| не меньше RAYRENDER_MIN_DIR, знак тот же
+static inline __m128 rayDirLanes(float forward, float right, float up, __m128 px, __m128 py) {
+    __m128 v = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(forward), _mm_mul_ps(_mm_set1_ps(right), px)), _mm_mul_ps(_mm_set1_ps(up), py));
+    __m128 signBit = _mm_set1_ps(-0.0f);
+    return _mm_or_ps(_mm_max_ps(_mm_andnot_ps(signBit, v), _mm_set1_ps(RAYRENDER_MIN_DIR)), _mm_and_ps(signBit, v));
 }
+#endif
 
-void startAirstrike(Vec3 start, Vec3 end, Camera* playerCam) {
-    if (g_airstrike.isActive) return;
-    
-    printf("Calling for Democracy!\n");
-    g_airstrike.isActive = 1;
-    g_airstrike.timer = 0.0f;
-    
-    for (int i = 0; i < 3; i++) {
-        Vec3 offset = {(float)(i-1) * 6.0f, 0, (float)(i-1) * 3.0f};
-        g_airstrike.jets[i].startPos = (Vec3){start.x + offset.x, start.y, start.z + offset.z};
-        g_airstrike.jets[i].endPos = (Vec3){end.x + offset.x, end.y, end.z + offset.z};
-        g_airstrike.jets[i].pos = g_airstrike.jets[i].startPos;
-        g_airstrike.jets[i].progress = 0.0f;
-        g_airstrike.jets[i].velocity = normalize((Vec3){end.x-start.x, 0, end.z-start.z});
-        g_airstrike.jets[i].active = 1;
-        g_airstrike.jets[i].hasDroppedBomb = 0;
-        
-        g_airstrike.bombs[i].active = 0;
-        g_airstrike.explosions[i].active = 0;
+// Лучи пачки через центры пикселей (блоков) квадрата 2x2 с левым верхним углом (sx, sy) от центра вида.
+// Пол - плоскость, его проверяем сразу: ближайшее попадание в пол ограничивает и обход дерева
+static void rayPacketSetup(RayPacket* p, const RayRenderFrame* f, float sx, float sy, float step) {
+#ifdef __SSE2__
+    __m128 px = _mm_add_ps(_mm_set1_ps(sx), _mm_set_ps(step, 0.0f, step, 0.0f));
+    __m128 py = _mm_add_ps(_mm_set1_ps(sy), _mm_set_ps(step, step, 0.0f, 0.0f));
+    __m128 d[3] = {
+        rayDirLanes(f->forward.x, f->right.x, f->up.x, px, py),
+        rayDirLanes(f->forward.y, f->right.y, f->up.y, px, py),
+        rayDirLanes(f->forward.z, f->right.z, f->up.z, px, py)
+    };
+    _mm_storeu_ps(p->dx, d[0]);
+    _mm_storeu_ps(p->dy, d[1]);
+    _mm_storeu_ps(p->dz, d[2]);
+
+    __m128 far = _mm_set1_ps(f->farZ);
+    __m128 tFloor = _mm_div_ps(_mm_set1_ps(SHADOW_FLOOR_Y - f->eye[1]), d[1]);
+    __m128 onFloor = _mm_and_ps(_mm_cmplt_ps(d[1], _mm_setzero_ps()), _mm_cmplt_ps(tFloor, far));
+    if (f->eye[1] <= SHADOW_FLOOR_Y) onFloor = _mm_setzero_ps();
+    __m128i onFloorI = _mm_castps_si128(onFloor);
+    _mm_storeu_ps(p->t, _mm_or_ps(_mm_and_ps(onFloor, tFloor), _mm_andnot_ps(onFloor, far)));
+    _mm_storeu_si128((__m128i*)p->hit, raySelect(onFloorI, _mm_set1_epi32(RAYRENDER_HIT_FLOOR), _mm_set1_epi32(RAYRENDER_MISS)));
+    _mm_storeu_si128((__m128i*)p->axis, _mm_setzero_si128());
+#else
+    for (int lane = 0; lane < 4; lane++) {
+        float lx = sx + (lane & 1) * step, ly = sy + (lane >> 1) * step;
+        float d[3] = {
+            f->forward.x + f->right.x * lx - f->up.x * ly,
+            f->forward.y + f->right.y * lx - f->up.y * ly,
+            f->forward.z + f->right.z * lx - f->up.z * ly
+        };
+        for (int k = 0; k < 3; k++) {
+            if (fabsf(d[k]) < RAYRENDER_MIN_DIR) d[k] = d[k] < 0.0f ? -RAYRENDER_MIN_DIR : RAYRENDER_MIN_DIR;
+        }
+        p->dx[lane] = d[0]; p->dy[lane] = d[1]; p->dz[lane] = d[2];
+        p->t[lane] = f->farZ;
+        p->hit[lane] = RAYRENDER_MISS;
+        p->axis[lane] = 0;
+        if (d[1] < 0.0f && f->eye[1] > SHADOW_FLOOR_Y) {
+            float tFloor = (SHADOW_FLOOR_Y - f->eye[1]) / d[1];
+            if (tFloor < p->t[lane]) {
+                p->t[lane] = tFloor;
+                p->hit[lane] = RAYRENDER_HIT_FLOOR;
+            }
+        }
     }
-    
-    g_cinematic.isActive = 1;
-    g_cinematic.transitionProgress = 0.0f;
-    g_cinematic.target = (Vec3){ (start.x + end.x)/2, (start.y + end.y)/2 - 10, (start.z + end.z)/2 };
-    g_cinematic.position = (Vec3){ playerCam->x, playerCam->y + 5, playerCam->z };
-    g_cinematic.fov = g_fov;
+#endif
 }
 
-void updateAirstrike(float deltaTime, Camera* playerCam) {
-    if (!g_airstrike.isActive) return;
+// Грань попадания: 0..5 - нормали -X, +X, -Y, +Y, -Z, +Z (как у G-буфера, только с нуля), 6 - пол
+static inline int rayHitFace(const RayPacket* p, int lane) {
+    if (p->hit[lane] == RAYRENDER_HIT_FLOOR) return 6;
+    int a = p->axis[lane];
+    float d = a == 0 ? p->dx[lane] : (a == 1 ? p->dy[lane] : p->dz[lane]);
+    return a * 2 + (d < 0.0f); // Луч идёт в минус по оси - упёрся в грань с нормалью в плюс
+}
 
-    g_airstrike.timer += deltaTime;
+// Базовый цвет попадания (до света и тумана); colorId - 0/1 для клеток пола, hit + 2 для бокса
+static inline SDL_Color rayHitColor(const RayRenderFrame* f, const RayPacket* p, int lane, int* colorId) {
+    int hit = p->hit[lane];
+    if (hit != RAYRENDER_HIT_FLOOR) {
+        *colorId = hit + 2;
+        return g_rayRender.leafBoxes[hit].color;
+    }
+    float t = p->t[lane];
+    float wx = f->eye[0] + p->dx[lane] * t, wz = f->eye[2] + p->dz[lane] * t;
+    *colorId = ((int)floorf(wx / RAYRENDER_FLOOR_TILE) + (int)floorf(wz / RAYRENDER_FLOOR_TILE)) & 1;
+    return f->floorColors[*colorId];
+}
 
-    for (int i = 0; i < 3; i++) {
-        if (!g_airstrike.jets[i].active) continue;
-        
-        g_airstrike.jets[i].progress += deltaTime * 0.2f;
-        g_airstrike.jets[i].pos.x = lerp(g_airstrike.jets[i].startPos.x, g_airstrike.jets[i].endPos.x, g_airstrike.jets[i].progress);
-        g_airstrike.jets[i].pos.y = lerp(g_airstrike.jets[i].startPos.y, g_airstrike.jets[i].endPos.y, g_airstrike.jets[i].progress);
-        g_airstrike.jets[i].pos.z = lerp(g_airstrike.jets[i].startPos.z, g_airstrike.jets[i].endPos.z, g_airstrike.jets[i].progress);
-        
-        if (g_airstrike.jets[i].progress > 0.5f && !g_airstrike.jets[i].hasDroppedBomb) {
-            g_airstrike.jets[i].hasDroppedBomb = 1;
-            g_airstrike.bombs[i].active = 1;
-            g_airstrike.bombs[i].pos = g_airstrike.jets[i].pos;
-            g_airstrike.bombs[i].velocity = (Vec3){0, -15.0f, 0};
-            g_airstrike.bombs[i].fuse = 2.0f;
-        }
+// Цвет попадания: цвет бокса (или клетки пола), свет грани и туман. Соседние лучи почти всегда
+// попадают в ту же грань на том же уровне тумана - такой цвет берём из прошлого раза
+static Uint32 rayShade(const RayRenderFrame* f, const RayPacket* p, int lane, Uint32* cacheKey, Uint32* cacheColor) {
+    int fogLevel = f->shadeFog ? Fog_Level(p->t[lane]) : 0;
+    int face = rayHitFace(p, lane), colorId;
+    SDL_Color c = rayHitColor(f, p, lane, &colorId);
+    Uint32 key = ((Uint32)colorId << 8) | ((Uint32)face << 5) | (Uint32)fogLevel;
+    if (key == *cacheKey) return *cacheColor;
+
+    if (f->lit) c = Light_Apply(c, f->faceLevel[face]);
+    c = Fog_Apply(c, fogLevel);
+    *cacheKey = key;
+    *cacheColor = packARGB(c);
+    return *cacheColor;
+}
 
-        if (g_airstrike.jets[i].progress >= 1.0f) g_airstrike.jets[i].active = 0;
+// Отрезки 1/d для лучей с точками экрана в [sx0, sx1] x [sy0, sy1] (от центра вида)
+static void rayTileFrustumFrom(const RayRenderFrame* f, float sx0, float sy0, float sx1, float sy1, RayTileFrustum* fr) {
+    const float forward[3] = { f->forward.x, f->forward.y, f->forward.z };
+    const float right[3] = { f->right.x, f->right.y, f->right.z };
+    const float up[3] = { f->up.x, f->up.y, f->up.z };
+    for (int k = 0; k < 3; k++) {
+        float dMin = forward[k] + fminf(right[k] * sx0, right[k] * sx1) - fmaxf(up[k] * sy0, up[k] * sy1);
+        float dMax = forward[k] + fmaxf(right[k] * sx0, right[k] * sx1) - fminf(up[k] * sy0, up[k] * sy1);
+        fr->bounded[k] = dMin > 0.0f || dMax < 0.0f;
+        fr->negative[k] = dMax < 0.0f;
+        if (!fr->bounded[k]) continue;
+        // Лучи с |d| меньше RAYRENDER_MIN_DIR его и получат - на границах отрезка так же
+        if (fabsf(dMin) < RAYRENDER_MIN_DIR) dMin = dMin < 0.0f ? -RAYRENDER_MIN_DIR : RAYRENDER_MIN_DIR;
+        if (fabsf(dMax) < RAYRENDER_MIN_DIR) dMax = dMax < 0.0f ? -RAYRENDER_MIN_DIR : RAYRENDER_MIN_DIR;
+        fr->invLo[k] = 1.0f / dMax;
+        fr->invHi[k] = 1.0f / dMin;
     }
-    
-    for (int i = 0; i < 3; i++) {
-        if (!g_airstrike.bombs[i].active) continue;
-        
-        g_airstrike.bombs[i].fuse -= deltaTime;
-        g_airstrike.bombs[i].velocity.y -= 12.8f * deltaTime;
-        g_airstrike.bombs[i].pos.y += g_airstrike.bombs[i].velocity.y * deltaTime;
-        
-        if (g_airstrike.bombs[i].pos.y < -1.9f || g_airstrike.bombs[i].fuse <= 0) {
-            g_airstrike.bombs[i].active = 0;
-            g_airstrike.explosions[i].active = 1;
-            g_airstrike.explosions[i].pos = (Vec3){g_airstrike.bombs[i].pos.x, -1.9f, g_airstrike.bombs[i].pos.z};
-            g_airstrike.explosions[i].currentRadius = 0.0f;
-            g_airstrike.explosions[i].maxRadius = 12.0f;
-            g_airstrike.explosions[i].lifetime = 1.5f;
-            
-            float dist = sqrtf(powf(playerCam->x - g_airstrike.explosions[i].pos.x, 2) + powf(playerCam->z - g_airstrike.explosions[i].pos.z, 2));
-            if (dist < g_airstrike.explosions[i].maxRadius) {
-                printf("Player was hit by Democracy! Distance: %.2f\n", dist);
+}
+
+// Плитки [begin, end) вида: пачки 2x2 лучей, цвет в буфер плитки, глубина сразу в z-буфер.
+// Программный бэкенд получает пролёты попаданий прямо из потока, для SDL плитка ложится в g_rayRenderPixels
+static void rayRenderTileBand(void* ctx, int begin, int end) {
+    const RayRenderFrame* f = (const RayRenderFrame*)ctx;
+    g_fog = f->fog;
+    g_light = f->light;
+    RenderBackend sub = *f->ren;
+    Uint32 colors[RAYRENDER_TILE][RAYRENDER_TILE];
+    Uint32 cacheKey = 0xFFFFFFFFu, cacheColor = 0;
+    Uint32 rays = 0, nodeTests = 0, boxTests = 0;
+    int s = f->step;
+    float half = 0.5f * s; // Луч идёт через центр своего пикселя (блока)
+
+    for (int tile = begin; tile < end; tile++) {
+        int x0 = f->view.x0 + (tile % f->tilesX) * RAYRENDER_TILE;
+        int y0 = f->view.y0 + (tile / f->tilesX) * RAYRENDER_TILE;
+        int x1 = x0 + RAYRENDER_TILE < f->view.x1 ? x0 + RAYRENDER_TILE : f->view.x1;
+        int y1 = y0 + RAYRENDER_TILE < f->view.y1 ? y0 + RAYRENDER_TILE : f->view.y1;
+
+        RayTileFrustum fr;
+        rayTileFrustumFrom(f, x0 + half - f->view.cx, y0 + half - f->view.cy, x1 - 1 + half - f->view.cx, y1 - 1 + half - f->view.cy, &fr);
+        int numCandidates = rayTileCandidates(&fr, f->eye, f->farZ, &nodeTests);
+
+        for (int y = y0; y < y1; y += 2 * s) {
+            for (int x = x0; x < x1; x += 2 * s) {
+                RayPacket p;
+                rayPacketSetup(&p, f, x + half - f->view.cx, y + half - f->view.cy, (float)s);
+                rays += 4;
+                if (numCandidates > 0) rayTracePacket(&p, f->eye, g_rayCandidates, numCandidates, &boxTests);
+
+                for (int lane = 0; lane < 4; lane++) {
+                    int bx = x + (lane & 1) * s, by = y + (lane >> 1) * s;
+                    if (bx >= x1 || by >= y1) continue;
+                    Uint32 color = 0; // Альфа 0 - промах: там остаётся небо
+                    float depth = INFINITY;
+                    Uint8 normal = GBUF_NORMAL_NONE;
+                    Uint32 albedo = 0;
+                    if (p.hit[lane] != RAYRENDER_MISS) {
+                        color = rayShade(f, &p, lane, &cacheKey, &cacheColor);
+                        depth = p.t[lane];
+                        if (f->gbuffer) {
+                            int colorId;
+                            int face = rayHitFace(&p, lane);
+                            normal = face == 6 ? GBUF_NORMAL_UP : (Uint8)(face + 1);
+                            albedo = packARGB(rayHitColor(f, &p, lane, &colorId));
+                        }
+                    }
+                    for (int yy = by; yy < by + s && yy < y1; yy++) {
+                        for (int xx = bx; xx < bx + s && xx < x1; xx++) {
+                            colors[yy - y0][xx - x0] = color;
+                            g_zBuffer[yy][xx] = depth;
+                            if (f->gbuffer) {
+                                g_gbufferNormal[yy][xx] = normal;
+                                g_gbufferAlbedo[yy][xx] = albedo;
+                            }
+                        }
+                    }
+                }
             }
         }
-    }
-    
-    for (int i = 0; i < 3; i++) {
-        if (!g_airstrike.explosions[i].active) continue;
-        
-        g_airstrike.explosions[i].lifetime -= deltaTime;
-        g_airstrike.explosions[i].currentRadius = lerp(0.0f, g_airstrike.explosions[i].maxRadius, 1.0f - (g_airstrike.explosions[i].lifetime / 1.5f));
-        
-        if (g_airstrike.explosions[i].lifetime <= 0) g_airstrike.explosions[i].active = 0;
-    }
 
-    if (g_airstrike.timer > 15.0f) {
-        g_airstrike.isActive = 0;
-        g_cinematic.isActive = 0;
+        for (int y = y0; y < y1; y++) {
+            const Uint32* row = colors[y - y0];
+            int w = x1 - x0;
+            if (!sub.pixelRows) {
+                memcpy(&g_rayRenderPixels[y][x0], row, w * sizeof(Uint32));
+                continue;
+            }
+            for (int x = 0; x < w;) {
+                while (x < w && !(row[x] >> 24)) x++;
+                int runStart = x;
+                while (x < w && (row[x] >> 24)) x++;
+                if (x > runStart) sub.Pixels(&sub, y, x0 + runStart, row + runStart, x - runStart);
+            }
+        }
     }
-}
 
-// === ВСТАВЬ ЭТОТ ЧЕРТЁЖ ПЕРЕД drawMainMenu ===
+    SDL_AtomicAdd(&g_rayRender.rays, (int)rays);
+    SDL_AtomicAdd(&g_rayRender.tiles, end - begin);
+    SDL_AtomicAdd(&g_rayRender.nodeTests, (int)nodeTests);
+    SDL_AtomicAdd(&g_rayRender.boxTests, (int)boxTests);
+}
 
-// 6 вершин нашего охуенного октаэдра
-Vec3 octahedron_verts[6] = {
-    { 0,  1,  0}, // 0: Верхняя точка
-    { 0, -1,  0}, // 1: Нижняя точка
-    { 1,  0,  0}, // 2: Правая
-    {-1,  0,  0}, // 3: Левая
-    { 0,  0,  1}, // 4: Передняя
-    { 0,  0, -1}  // 5: Задняя
-};
+// Пол и боксы уровня лучами вместо растеризатора. Цвет и глубина пишутся во всём виде: где луч
+// ничего не нашёл, остаётся небо и бесконечная глубина. Вызывать после неба, в тумане сцены
+void drawRayCastWorld(RenderBackend* ren, Camera cam) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    RayRenderFrame f;
+    f.ren = ren;
+    f.view = g_view;
+    f.step = g_rayRender.mode == RAYRENDER_BLOCK ? 2 : 1;
+    f.tilesX = (g_view.x1 - g_view.x0 + RAYRENDER_TILE - 1) / RAYRENDER_TILE;
+    f.tilesY = (g_view.y1 - g_view.y0 + RAYRENDER_TILE - 1) / RAYRENDER_TILE;
+
+    // Обратный поворот камеры: оси экрана и взгляд в мировых координатах
+    CameraTransform ct = CameraTransform_From(cam);
+    float invFov = 1.0f / g_fov;
+    f.eye[0] = ct.eyeX; f.eye[1] = ct.eyeY; f.eye[2] = ct.eyeZ;
+    f.forward = (Vec3){ ct.sy * ct.cx, ct.sx, ct.cy * ct.cx };
+    f.right = (Vec3){ ct.cy * invFov, 0.0f, -ct.sy * invFov };
+    f.up = (Vec3){ -ct.sy * ct.sx * invFov, ct.cx * invFov, -ct.cy * ct.sx * invFov };
+
+    f.farZ = g_fog.active ? g_fog.farPlane : FLT_MAX;
+    f.shadeFog = g_fog.active && g_fog.mode != FOG_OFF;
+    f.lit = g_light.enabled;
+    f.gbuffer = g_gbuffer.writing;
+    if (f.lit) {
+        static const Vec3 faceNormals[7] = { {-1,0,0}, {1,0,0}, {0,-1,0}, {0,1,0}, {0,0,-1}, {0,0,1}, {0,1,0} };
+        for (int i = 0; i < 7; i++) f.faceLevel[i] = lightLevelAt(Light_VertexLevel(faceNormals[i]), 0.0f, 0);
+    }
+    // Пол тех же цветов, что и у заливки пола растеризатором
+    Uint8 base = 40 + (Uint8)(g_worldEvolution.textureBlend * 60);
+    if (g_worldEvolution.currentState >= WORLD_STATE_TEXTURED) {
+        f.floorColors[0] = (SDL_Color){base, base + 10, base + 15, 255};
+        f.floorColors[1] = (SDL_Color){base - 10, base, base + 5, 255};
+    } else {
+        f.floorColors[0] = f.floorColors[1] = (SDL_Color){base, base, base + 20, 255};
+    }
+    f.fog = g_fog;
+    f.light = g_light;
+
+    Render_SetBlendMode(ren, SDL_BLENDMODE_NONE);
+    Jobs_ParallelFor(f.tilesX * f.tilesY, 1, rayRenderTileBand, &f);
+
+    // SDL живёт в одном потоке: готовый кадр вида отдаём ему отсюда пролётами попаданий
+    if (!ren->pixelRows) {
+        for (int y = g_view.y0; y < g_view.y1; y++) {
+            const Uint32* row = g_rayRenderPixels[y];
+            for (int x = g_view.x0; x < g_view.x1;) {
+                while (x < g_view.x1 && !(row[x] >> 24)) x++;
+                int runStart = x;
+                while (x < g_view.x1 && (row[x] >> 24)) x++;
+                if (x > runStart) ren->Pixels(ren, y, runStart, row + runStart, x - runStart);
+            }
+        }
+    }
+    SDL_AtomicAdd(&g_rayRender.micros, (int)((SDL_GetPerformanceCounter() - start) * 1000000 / SDL_GetPerformanceFrequency()));
+}
 
-// 12 рёбер, которые соединяют эти вершины
-int octahedron_edges[12][2] = {
-    {0, 2}, {0, 3}, {0, 4}, {0, 5}, // Рёбра от верхушки
-    {1, 2}, {1, 3}, {1, 4}, {1, 5}, // Рёбра от низа
-    {2, 4}, {4, 3}, {3, 5}, {5, 2}  // Рёбра по экватору
-};
+// --- ОТЛОЖЕННОЕ ОСВЕЩЕНИЕ: лампы, плитки, проход света ---
+#define DEFERRED_EXPLOSION_RADIUS 1.5f  // Свет взрыва достаёт дальше видимого огненного шара...
+#define DEFERRED_EXPLOSION_REACH 4.0f   // ...и даже у только что родившегося есть радиус
+#define DEFERRED_COIN_RADIUS 3.0f
+#define DEFERRED_MIN_DIST2 1e-4f        // Пиксель прямо в центре лампы: без деления на ноль
 
-void drawMainMenu(SDL_Renderer* ren, TTF_Font* font) {
-    SDL_SetRenderDrawColor(ren, 10, 10, 15, 255);
-    SDL_RenderClear(ren);
+// Лампа в координатах камеры вида
+typedef struct {
+    float x, y, z;
+    float radius, invRadius2;
+    float r, g, b;
+    float zMin, zMax;       // Какие глубины сфера может задеть
+    int tx0, ty0, tx1, ty1; // Плитки вида под экранным прямоугольником сферы, включительно
+} ViewLight;
+
+static RENDER_TLS ViewLight g_viewLights[DEFERRED_MAX_LIGHTS];
+static RENDER_TLS int g_numViewLights;
+
+static void Deferred_AddLight(Vec3 pos, float radius, float r, float g, float b) {
+    if (g_deferred.count >= DEFERRED_MAX_LIGHTS || radius <= 0.0f) return;
+    g_deferred.lights[g_deferred.count++] = (PointLight){ pos, radius, r, g, b };
+}
 
-    SDL_Color titleColor = {0, 255, 100, 255};
-    SDL_Color optionColor = {200, 200, 200, 255};
-    SDL_Color selectedColor = {255, 255, 0, 255};
+// Лампы кадра - раз на кадр, до всех видов: взрывы авиаудара и несобранные монеты
+void Deferred_BeginFrame(void) {
+    g_deferred.count = 0;
+    SDL_AtomicSet(&g_deferred.lightsInView, 0);
+    SDL_AtomicSet(&g_deferred.litTiles, 0);
+    SDL_AtomicSet(&g_deferred.tileLights, 0);
+    SDL_AtomicSet(&g_deferred.pixelsLit, 0);
+    SDL_AtomicSet(&g_deferred.dropped, 0);
+    SDL_AtomicSet(&g_deferred.micros, 0);
+    if (!g_deferred.enabled) return;
+
+    if (g_airstrike.isActive) {
+        for (int i = 0; i < 3; i++) {
+            Explosion* e = &g_airstrike.explosions[i];
+            if (!e->active) continue;
+            float strength = fminf(e->lifetime / 1.5f, 1.0f) * 2.0f; // Гаснет вместе с шаром (как его прозрачность в drawExplosion)
+            Deferred_AddLight(e->pos, e->currentRadius * DEFERRED_EXPLOSION_RADIUS + DEFERRED_EXPLOSION_REACH,
+                              strength, strength * 0.55f, strength * 0.15f);
+        }
+    }
+    for (int i = 0; i < g_numCoins; i++) {
+        if (g_coins[i].collected) continue;
+        Vec3 pos = g_coins[i].pos;
+        pos.y += fast_sin(g_coins[i].bobPhase) * 0.2f; // Как в drawCoin
+        Deferred_AddLight(pos, DEFERRED_COIN_RADIUS, 0.8f, 0.65f, 0.15f);
+    }
+}
 
-    SDL_Color splashColor = {255, 255, 0, 255};
+// Наклоны x/z (или y/z) двух касательных из глаза к окружности с центром (a, z) и радиусом r;
+// z > r, то есть глаз снаружи и окружность целиком впереди
+static void sphereTangentSlopes(float a, float z, float r, float* lo, float* hi) {
+    float root = r * sqrtf(a * a + z * z - r * r);
+    float inv = 1.0f / (z * z - r * r);
+    *lo = (a * z - root) * inv;
+    *hi = (a * z + root) * inv;
+}
 
-    // --- Рисуем название "G OMETRICA" (как и раньше) ---
-    drawText(ren, font, "G", WIDTH/2 - 150, HEIGHT/2 - 100, titleColor);
-    drawText(ren, font, "OMETRICA", WIDTH/2 - 80, HEIGHT/2 - 100, titleColor);
+void Deferred_Toggle(void) {
+    g_deferred.enabled = !g_deferred.enabled;
+    printf("Deferred lamps: %s\n", g_deferred.enabled ? "ON" : "OFF");
+}
 
-    // --- А ВОТ ТУТ, БЛЯДЬ, НАЧИНАЕТСЯ МАГИЯ ---
-    int center_x = WIDTH/2 - 106.5;
-    int center_y = HEIGHT/2 - 90;
-    int size = 20;
-    
-    // Создаем массив для 2D-точек на экране
-    SDL_Point screen_points[6];
+// Начало вида: лампы - в систему камеры, отсечение по виду и туману. Если ни одна не видна,
+// G-буфер в этом кадре не пишется вовсе. Вызывать в тумане сцены (нужна дальняя плоскость)
+void Deferred_BeginView(Camera cam) {
+    g_gbuffer.writing = 0;
+    g_gbuffer.normal = GBUF_NORMAL_NONE;
+    g_numViewLights = 0;
+    if (!g_deferred.enabled || g_deferred.count == 0 || g_sbuffer.active) return;
+    // Пока грани не залиты, освещать нечего (лучам заливка не нужна)
+    if (!RayRender_Active() && g_worldEvolution.currentState < WORLD_STATE_MATERIALIZING) return;
+
+    CameraTransform ct = CameraTransform_From(cam);
+    int tilesX = (g_view.x1 - g_view.x0 + DEFERRED_TILE - 1) / DEFERRED_TILE;
+    int tilesY = (g_view.y1 - g_view.y0 + DEFERRED_TILE - 1) / DEFERRED_TILE;
+    for (int i = 0; i < g_deferred.count; i++) {
+        const PointLight* pl = &g_deferred.lights[i];
+        Vec3 c = CameraTransform_Apply(&ct, pl->pos);
+        float r = pl->radius;
+        if (c.z + r <= NEAR_PLANE || c.z - r >= g_fog.farPlane) continue;
+
+        // Экранный прямоугольник сферы по касательным из глаза; задевает ближнюю плоскость - весь вид
+        float sx0 = (float)g_view.x0, sx1 = (float)g_view.x1, sy0 = (float)g_view.y0, sy1 = (float)g_view.y1;
+        if (c.z - r > NEAR_PLANE) {
+            float lo, hi;
+            sphereTangentSlopes(c.x, c.z, r, &lo, &hi);
+            sx0 = g_view.cx + lo * g_fov;
+            sx1 = g_view.cx + hi * g_fov;
+            sphereTangentSlopes(c.y, c.z, r, &lo, &hi);
+            sy0 = g_view.cy - hi * g_fov;
+            sy1 = g_view.cy - lo * g_fov;
+            if (sx1 < g_view.x0 || sx0 >= g_view.x1 || sy1 < g_view.y0 || sy0 >= g_view.y1) continue;
+        }
 
-    // 1. ВРАЩАЕМ, БЛЯДЬ, ВЕРШИНЫ В 3D
-    for(int i = 0; i < 6; i++) {
-        Vec3 v = octahedron_verts[i];
+        ViewLight* vl = &g_viewLights[g_numViewLights++];
+        vl->x = c.x; vl->y = c.y; vl->z = c.z;
+        vl->radius = r;
+        vl->invRadius2 = 1.0f / (r * r);
+        vl->r = pl->r; vl->g = pl->g; vl->b = pl->b;
+        vl->zMin = c.z - r;
+        vl->zMax = c.z + r;
+        vl->tx0 = sx0 <= g_view.x0 ? 0 : (int)(sx0 - g_view.x0) / DEFERRED_TILE;
+        vl->ty0 = sy0 <= g_view.y0 ? 0 : (int)(sy0 - g_view.y0) / DEFERRED_TILE;
+        vl->tx1 = sx1 >= g_view.x1 ? tilesX - 1 : (int)(sx1 - g_view.x0) / DEFERRED_TILE;
+        vl->ty1 = sy1 >= g_view.y1 ? tilesY - 1 : (int)(sy1 - g_view.y0) / DEFERRED_TILE;
+    }
+    if (g_numViewLights == 0) return;
+
+    g_gbuffer.writing = 1;
+    for (int y = g_view.y0; y < g_view.y1; y++) {
+        memset(&g_gbufferNormal[y][g_view.x0], GBUF_NORMAL_NONE, (size_t)(g_view.x1 - g_view.x0));
+    }
+    SDL_AtomicAdd(&g_deferred.lightsInView, g_numViewLights);
+}
 
-        // Вращаем по Y (вокруг вертикальной оси)
-        float newX = v.x * fast_cos(g_menuRhombusAngle) - v.z * fast_sin(g_menuRhombusAngle);
-        float newZ = v.x * fast_sin(g_menuRhombusAngle) + v.z * fast_cos(g_menuRhombusAngle);
-        
-        // 2. ПРОЕЦИРУЕМ, НАХУЙ, НА 2D-ЭКРАН
-        // Мы просто, блядь, берем X и Y. А Z используем для перспективы.
-        screen_points[i].x = center_x + (int)(newX * size);
-        screen_points[i].y = center_y - (int)(v.y * size); // Y в SDL инвертирован
-    }
+// Всё, что нужно плиткам на проход света вида (как RayRenderFrame: плитки разбирают другие потоки)
+typedef struct {
+    RenderBackend* ren;
+    Viewport view;
+    float invFov;
+    int tilesX, tilesY;
+    const ViewLight* lights;             // g_viewLights потока, который рисует вид
+    int numLights;
+    float normals[GBUF_NORMAL_COUNT][3]; // Нормали G-буфера в системе камеры; 0 - нулевая
+    int shadeFog;
+    FogSettings fog;
+    Uint8* tileLit;                      // Для SDL: каким плиткам есть что отдать из g_deferredPixels
+} DeferredFrame;
+
+// Лампы, задевающие плитку: по экрану (прямоугольник сферы) и по коробке плитки в системе камеры -
+// между ближней и дальней глубинами её пикселей
+static int deferredTileLights(const DeferredFrame* f, const int* rowLights, int numRowLights, int tx, int x0, int x1, int y0, int y1,
+                              float zMin, float zMax, int* out, Uint32* dropped) {
+    // Коробка плитки: края по x, y расходятся с глубиной, берём обе крайние глубины
+    float ax0 = (x0 - f->view.cx) * f->invFov, ax1 = (x1 - f->view.cx) * f->invFov;
+    float ay0 = (f->view.cy - y1) * f->invFov, ay1 = (f->view.cy - y0) * f->invFov;
+    float bx0 = ax0 < 0.0f ? ax0 * zMax : ax0 * zMin, bx1 = ax1 > 0.0f ? ax1 * zMax : ax1 * zMin;
+    float by0 = ay0 < 0.0f ? ay0 * zMax : ay0 * zMin, by1 = ay1 > 0.0f ? ay1 * zMax : ay1 * zMin;
+    int count = 0;
+    for (int k = 0; k < numRowLights; k++) {
+        const ViewLight* l = &f->lights[rowLights[k]];
+        if (tx < l->tx0 || tx > l->tx1 || l->zMax < zMin || l->zMin > zMax) continue;
+        float dx = l->x < bx0 ? bx0 - l->x : (l->x > bx1 ? l->x - bx1 : 0.0f);
+        float dy = l->y < by0 ? by0 - l->y : (l->y > by1 ? l->y - by1 : 0.0f);
+        float dz = l->z < zMin ? zMin - l->z : (l->z > zMax ? l->z - zMax : 0.0f);
+        if (dx * dx + dy * dy + dz * dz >= l->radius * l->radius) continue;
+        if (count == DEFERRED_TILE_MAX_LIGHTS) { (*dropped)++; continue; }
+        out[count++] = rowLights[k];
+    }
+    return count;
+}
 
-    // 3. РИСУЕМ, СУКА, РЁБРА
-    SDL_SetRenderDrawColor(ren, titleColor.r, titleColor.g, titleColor.b, 255);
-    for(int i = 0; i < 12; i++) {
-        int start_index = octahedron_edges[i][0];
-        int end_index = octahedron_edges[i][1];
-        
-        SDL_RenderDrawLine(ren, 
-            screen_points[start_index].x, screen_points[start_index].y,
-            screen_points[end_index].x, screen_points[end_index].y
-        );
+// Ближняя и дальняя глубины пикселей плитки, попавших в G-буфер; пусто - zMin > zMax
+static void deferredTileDepthRange(int x0, int x1, int y0, int y1, float* outMin, float* outMax) {
+    float zMin = FLT_MAX, zMax = 0.0f;
+#ifdef __SSE2__
+    __m128 vMin = _mm_set1_ps(FLT_MAX), vMax = _mm_setzero_ps();
+    __m128i zeroi = _mm_setzero_si128();
+#endif
+    for (int y = y0; y < y1; y++) {
+        const Uint8* normalRow = g_gbufferNormal[y];
+        const float* zRow = g_zBuffer[y];
+        int x = x0;
+#ifdef __SSE2__
+        for (; x + 4 <= x1; x += 4) {
+            int bytes;
+            memcpy(&bytes, normalRow + x, sizeof(bytes));
+            __m128i n = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zeroi), zeroi);
+            __m128 none = _mm_castsi128_ps(_mm_cmpeq_epi32(n, zeroi));
+            __m128 z = _mm_andnot_ps(none, _mm_loadu_ps(zRow + x));
+            vMin = _mm_min_ps(vMin, _mm_or_ps(z, _mm_and_ps(none, _mm_set1_ps(FLT_MAX))));
+            vMax = _mm_max_ps(vMax, z);
+        }
+#endif
+        for (; x < x1; x++) {
+            if (normalRow[x] == GBUF_NORMAL_NONE) continue;
+            zMin = zRow[x] < zMin ? zRow[x] : zMin;
+            zMax = zRow[x] > zMax ? zRow[x] : zMax;
+        }
     }
+#ifdef __SSE2__
+    float lanes[4];
+    _mm_storeu_ps(lanes, vMin);
+    for (int i = 0; i < 4; i++) zMin = lanes[i] < zMin ? lanes[i] : zMin;
+    _mm_storeu_ps(lanes, vMax);
+    for (int i = 0; i < 4; i++) zMax = lanes[i] > zMax ? lanes[i] : zMax;
+#endif
+    *outMin = zMin;
+    *outMax = zMax;
+}
 
-    // --- А ВОТ, БЛЯДЬ, И ГОЛОС ИЗ НООСФЕРЫ ---
-    // Слегка пульсирующая прозрачность
-    splashColor.a = 155 + (Uint8)(fast_sin(SDL_GetTicks() * 0.002f) * 100.0f);
-    int text_w, text_h;
-    TTF_SizeUTF8(font, g_current_splash, &text_w, &text_h);
-    // Рисуем чуть выше и правее заголовка
-    drawText(ren, font, g_current_splash, WIDTH/2 - 100 + text_w / 2, HEIGHT/2 - 120, splashColor);
-    
-    // --- Рисуем пункты меню ---
-    const char* menuItems[] = { "Single Player", "Multiplayer", "Settings", "Exit" };
+// Прибавка count (<= 4) пикселей строки y с x: сумма ламп * базовый цвет * keep, готовые ARGB в out.
+// keep - доля, которую не съели туман и полупрозрачность; альфа 0 - прибавки нет. Возвращает, сколько пикселей светится
+static int deferredShadeGroup(const DeferredFrame* f, const int* tileLights, int numTileLights, int y, int x, int count,
+                              const float* zRow, const Uint8* normalRow, Uint32 out[4]) {
+    float zs[4], nx[4], ny[4], nz[4], keep[4];
+    Uint32 albedo[4];
     for (int i = 0; i < 4; i++) {
-        char itemText[128];
-        snprintf(itemText, sizeof(itemText), "%s %s", (i == g_menuSelectedOption) ? ">" : " ", menuItems[i]);
-        drawText(ren, font, itemText, WIDTH/2 - 100, HEIGHT/2 + 20 + i * 40, (i == g_menuSelectedOption) ? selectedColor : optionColor);
+        int n = i < count ? normalRow[x + i] : GBUF_NORMAL_NONE;
+        zs[i] = n != GBUF_NORMAL_NONE ? zRow[x + i] : 1.0f;
+        nx[i] = f->normals[n][0]; ny[i] = f->normals[n][1]; nz[i] = f->normals[n][2];
+        albedo[i] = n != GBUF_NORMAL_NONE ? g_gbufferAlbedo[y][x + i] : 0;
+        keep[i] = (float)(albedo[i] >> 24) * (1.0f / 255.0f); // Полупрозрачная заливка и светится слабее
+        if (f->shadeFog && n != GBUF_NORMAL_NONE) keep[i] *= 1.0f - (float)Fog_Level(zs[i]) * (1.0f / (FOG_LEVELS - 1));
+    }
+#ifdef __SSE2__
+    // Точка пикселя в системе камеры: обратная проекция по его глубине
+    __m128 z = _mm_loadu_ps(zs);
+    __m128 sx = _mm_add_ps(_mm_set1_ps((float)x - f->view.cx), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+    __m128 px = _mm_mul_ps(_mm_mul_ps(sx, z), _mm_set1_ps(f->invFov));
+    __m128 py = _mm_mul_ps(z, _mm_set1_ps((f->view.cy - (float)y) * f->invFov));
+    __m128 vnx = _mm_loadu_ps(nx), vny = _mm_loadu_ps(ny), vnz = _mm_loadu_ps(nz);
+    __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), minD2 = _mm_set1_ps(DEFERRED_MIN_DIST2);
+    __m128 accR = zero, accG = zero, accB = zero;
+
+    for (int k = 0; k < numTileLights; k++) {
+        const ViewLight* l = &f->lights[tileLights[k]];
+        __m128 lx = _mm_sub_ps(_mm_set1_ps(l->x), px);
+        __m128 ly = _mm_sub_ps(_mm_set1_ps(l->y), py);
+        __m128 lz = _mm_sub_ps(_mm_set1_ps(l->z), z);
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly)), _mm_mul_ps(lz, lz));
+        // Затухание (1 - d²/R²)², за радиусом ноль
+        __m128 att = _mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(d2, _mm_set1_ps(l->invRadius2))), zero);
+        att = _mm_mul_ps(att, att);
+        // Ламберт: n·L / |L|
+        __m128 ndl = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vnx, lx), _mm_mul_ps(vny, ly)), _mm_mul_ps(vnz, lz));
+        ndl = _mm_max_ps(_mm_mul_ps(ndl, _mm_rsqrt_ps(_mm_max_ps(d2, minD2))), zero);
+        __m128 w = _mm_mul_ps(att, ndl);
+        accR = _mm_add_ps(accR, _mm_mul_ps(w, _mm_set1_ps(l->r)));
+        accG = _mm_add_ps(accG, _mm_mul_ps(w, _mm_set1_ps(l->g)));
+        accB = _mm_add_ps(accB, _mm_mul_ps(w, _mm_set1_ps(l->b)));
+    }
+
+    // Свет * базовый цвет * keep, с потолком 255, и в ARGB
+    __m128i base = _mm_loadu_si128((const __m128i*)albedo);
+    __m128i byteMask = _mm_set1_epi32(0xFF);
+    __m128 vkeep = _mm_loadu_ps(keep), cap = _mm_set1_ps(255.0f);
+    __m128 br = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(base, 16), byteMask));
+    __m128 bg = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(base, 8), byteMask));
+    __m128 bb = _mm_cvtepi32_ps(_mm_and_si128(base, byteMask));
+    __m128i r = _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(_mm_mul_ps(br, accR), vkeep), cap));
+    __m128i g = _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(_mm_mul_ps(bg, accG), vkeep), cap));
+    __m128i b = _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(_mm_mul_ps(bb, accB), vkeep), cap));
+    __m128i minAdd = _mm_set1_epi32(DEFERRED_MIN_ADD - 1);
+    __m128i lit = _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi32(r, minAdd), _mm_cmpgt_epi32(g, minAdd)), _mm_cmpgt_epi32(b, minAdd));
+    __m128i argb = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 16), _mm_slli_epi32(g, 8)), b);
+    argb = _mm_and_si128(_mm_or_si128(argb, _mm_set1_epi32((int)0xFF000000u)), lit);
+    _mm_storeu_si128((__m128i*)out, argb);
+    int litMask = _mm_movemask_ps(_mm_castsi128_ps(lit));
+    return (litMask & 1) + (litMask >> 1 & 1) + (litMask >> 2 & 1) + (litMask >> 3 & 1);
+#else
+    int numLit = 0;
+    for (int i = 0; i < 4; i++) {
+        out[i] = 0;
+        int n = i < count ? normalRow[x + i] : GBUF_NORMAL_NONE;
+        if (n == GBUF_NORMAL_NONE) continue;
+        float z = zRow[x + i];
+        float lr = 0.0f, lg = 0.0f, lb = 0.0f;
+        float px = ((float)(x + i) - f->view.cx) * z * f->invFov;
+        float py = (f->view.cy - (float)y) * z * f->invFov;
+        for (int k = 0; k < numTileLights; k++) {
+            const ViewLight* l = &f->lights[tileLights[k]];
+            float lx = l->x - px, ly = l->y - py, lz = l->z - z;
+            float d2 = lx * lx + ly * ly + lz * lz;
+            float att = fmaxf(1.0f - d2 * l->invRadius2, 0.0f);
+            float ndl = (f->normals[n][0] * lx + f->normals[n][1] * ly + f->normals[n][2] * lz) / sqrtf(fmaxf(d2, DEFERRED_MIN_DIST2));
+            float w = att * att * fmaxf(ndl, 0.0f);
+            lr += w * l->r;
+            lg += w * l->g;
+            lb += w * l->b;
+        }
+        int r = (int)fminf((float)((albedo[i] >> 16) & 0xFF) * lr * keep[i], 255.0f);
+        int g = (int)fminf((float)((albedo[i] >> 8) & 0xFF) * lg * keep[i], 255.0f);
+        int b = (int)fminf((float)(albedo[i] & 0xFF) * lb * keep[i], 255.0f);
+        if (r < DEFERRED_MIN_ADD && g < DEFERRED_MIN_ADD && b < DEFERRED_MIN_ADD) continue;
+        out[i] = 0xFF000000u | (Uint32)r << 16 | (Uint32)g << 8 | (Uint32)b;
+        numLit++;
+    }
+    return numLit;
+#endif
+}
+
+// Ряды плиток [begin, end): список ламп ряда, потом у каждой плитки - свои лампы и свет её пикселей
+static void deferredLightBand(void* ctx, int begin, int end) {
+    const DeferredFrame* f = (const DeferredFrame*)ctx;
+    g_fog = f->fog;
+    RenderBackend sub = *f->ren;
+    int rowLights[DEFERRED_MAX_LIGHTS], tileLights[DEFERRED_TILE_MAX_LIGHTS];
+    Uint32 add[DEFERRED_TILE][DEFERRED_TILE];
+    Uint32 litTiles = 0, tileLightSum = 0, pixelsLit = 0, dropped = 0;
+
+    for (int ty = begin; ty < end; ty++) {
+        int numRowLights = 0;
+        for (int k = 0; k < f->numLights; k++) {
+            if (ty >= f->lights[k].ty0 && ty <= f->lights[k].ty1) rowLights[numRowLights++] = k;
+        }
+        if (numRowLights == 0) continue;
+        int y0 = f->view.y0 + ty * DEFERRED_TILE;
+        int y1 = y0 + DEFERRED_TILE < f->view.y1 ? y0 + DEFERRED_TILE : f->view.y1;
+
+        for (int tx = 0; tx < f->tilesX; tx++) {
+            int x0 = f->view.x0 + tx * DEFERRED_TILE;
+            int x1 = x0 + DEFERRED_TILE < f->view.x1 ? x0 + DEFERRED_TILE : f->view.x1;
+            int covered = 0;
+            for (int k = 0; k < numRowLights && !covered; k++) {
+                covered = tx >= f->lights[rowLights[k]].tx0 && tx <= f->lights[rowLights[k]].tx1;
+            }
+            if (!covered) continue;
+
+            float zMin, zMax;
+            deferredTileDepthRange(x0, x1, y0, y1, &zMin, &zMax);
+            if (zMin > zMax) continue;
+            int numTileLights = deferredTileLights(f, rowLights, numRowLights, tx, x0, x1, y0, y1, zMin, zMax, tileLights, &dropped);
+            if (numTileLights == 0) continue;
+            litTiles++;
+            tileLightSum += (Uint32)numTileLights;
+
+            for (int y = y0; y < y1; y++) {
+                const Uint8* normalRow = g_gbufferNormal[y];
+                const float* zRow = g_zBuffer[y];
+                Uint32* addRow = add[y - y0];
+                for (int x = x0; x < x1; x += 4) {
+                    int count = x1 - x < 4 ? x1 - x : 4;
+                    Uint32 group[4];
+                    pixelsLit += (Uint32)deferredShadeGroup(f, tileLights, numTileLights, y, x, count, zRow, normalRow, group);
+                    memcpy(&addRow[x - x0], group, (size_t)count * sizeof(Uint32));
+                }
+            }
+
+            // Программный бэкенд складывает прямо из потока, для SDL плитка ложится в g_deferredPixels
+            if (!sub.pixelRows) f->tileLit[ty * f->tilesX + tx] = 1;
+            for (int y = y0; y < y1; y++) {
+                const Uint32* row = add[y - y0];
+                int w = x1 - x0;
+                if (!sub.pixelRows) {
+                    memcpy(&g_deferredPixels[y][x0], row, w * sizeof(Uint32));
+                    continue;
+                }
+                for (int x = 0; x < w;) {
+                    while (x < w && !(row[x] >> 24)) x++;
+                    int runStart = x;
+                    while (x < w && (row[x] >> 24)) x++;
+                    if (x > runStart) sub.Pixels(&sub, y, x0 + runStart, row + runStart, x - runStart);
+                }
+            }
+        }
     }
 
+    SDL_AtomicAdd(&g_deferred.litTiles, (int)litTiles);
+    SDL_AtomicAdd(&g_deferred.tileLights, (int)tileLightSum);
+    SDL_AtomicAdd(&g_deferred.pixelsLit, (int)pixelsLit);
+    SDL_AtomicAdd(&g_deferred.dropped, (int)dropped);
 }
 
-// === ДОБАВЬ ЭТУ НОВУЮ ФУНКЦИЮ ===
-// === ЗАМЕНИ drawMultiplayerMenu ===
-void drawMultiplayerMenu(SDL_Renderer* ren, TTF_Font* font) {
-    SDL_SetRenderDrawColor(ren, 10, 10, 15, 255);
-    SDL_RenderClear(ren);
+// Проход света вида: после всей непрозрачной геометрии, до спрайтов и линий поверх неё.
+// Дальше этот вид G-буфер уже не пишет
+void Deferred_LightView(RenderBackend* ren, Camera cam) {
+    if (!g_gbuffer.writing) return;
+    g_gbuffer.writing = 0;
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    static RENDER_TLS Uint8 tileLit[(WIDTH / DEFERRED_TILE + 1) * (HEIGHT / DEFERRED_TILE + 1)];
+    DeferredFrame f;
+    f.ren = ren;
+    f.view = g_view;
+    f.invFov = 1.0f / g_fov;
+    f.tilesX = (g_view.x1 - g_view.x0 + DEFERRED_TILE - 1) / DEFERRED_TILE;
+    f.tilesY = (g_view.y1 - g_view.y0 + DEFERRED_TILE - 1) / DEFERRED_TILE;
+    f.lights = g_viewLights;
+    f.numLights = g_numViewLights;
+    f.shadeFog = g_fog.active && g_fog.mode != FOG_OFF;
+    f.fog = g_fog;
+    f.tileLit = tileLit;
+    if (!ren->pixelRows) memset(tileLit, 0, (size_t)(f.tilesX * f.tilesY));
+
+    // Нормали осей в систему камеры: поворот без переноса
+    CameraTransform ct = CameraTransform_From(cam);
+    Vec3 eye = { ct.eyeX, ct.eyeY, ct.eyeZ };
+    memset(f.normals[GBUF_NORMAL_NONE], 0, sizeof(f.normals[0]));
+    for (int n = 1; n < GBUF_NORMAL_COUNT; n++) {
+        int axis = (n - 1) / 2;
+        float sign = (n - 1) % 2 ? 1.0f : -1.0f;
+        Vec3 p = { eye.x + (axis == 0 ? sign : 0.0f), eye.y + (axis == 1 ? sign : 0.0f), eye.z + (axis == 2 ? sign : 0.0f) };
+        Vec3 c = CameraTransform_Apply(&ct, p);
+        f.normals[n][0] = c.x; f.normals[n][1] = c.y; f.normals[n][2] = c.z;
+    }
+
+    Render_SetBlendMode(ren, SDL_BLENDMODE_ADD);
+    Jobs_ParallelFor(f.tilesY, 1, deferredLightBand, &f);
+
+    // SDL живёт в одном потоке: прибавку освещённых плиток отдаём ему отсюда
+    if (!ren->pixelRows) {
+        for (int tile = 0; tile < f.tilesX * f.tilesY; tile++) {
+            if (!tileLit[tile]) continue;
+            int x0 = g_view.x0 + (tile % f.tilesX) * DEFERRED_TILE;
+            int y0 = g_view.y0 + (tile / f.tilesX) * DEFERRED_TILE;
+            int x1 = x0 + DEFERRED_TILE < g_view.x1 ? x0 + DEFERRED_TILE : g_view.x1;
+            int y1 = y0 + DEFERRED_TILE < g_view.y1 ? y0 + DEFERRED_TILE : g_view.y1;
+            for (int y = y0; y < y1; y++) {
+                const Uint32* row = g_deferredPixels[y];
+                for (int x = x0; x < x1;) {
+                    while (x < x1 && !(row[x] >> 24)) x++;
+                    int runStart = x;
+                    while (x < x1 && (row[x] >> 24)) x++;
+                    if (x > runStart) ren->Pixels(ren, y, runStart, row + runStart, x - runStart);
+                }
+            }
+        }
+    }
+    Render_SetBlendMode(ren, SDL_BLENDMODE_NONE);
+    SDL_AtomicAdd(&g_deferred.micros, (int)((SDL_GetPerformanceCounter() - start) * 1000000 / SDL_GetPerformanceFrequency()));
+}
 
-    SDL_Color titleColor = {0, 255, 100, 255};
-    SDL_Color optionColor = {200, 200, 200, 255};
-    SDL_Color selectedColor = {255, 255, 0, 255};
+// --- ЦЕНТРАЛЬНЫЙ КУБ ---
+static const Vec3 CENTER_CUBE_VERTS[8] = {
+    {-2,-2,-2}, {2,-2,-2}, {2,2,-2}, {-2,2,-2},
+    {-2,-2,2},  {2,-2,2},  {2,2,2},  {-2,2,2}
+};
+static const int CENTER_CUBE_EDGES[12][2] = { {0,1},{1,2},{2,3},{3,0}, {4,5},{5,6},{6,7},{7,4}, {0,4},{1,5},{2,6},{3,7} };
+static const Vec3 CENTER_CUBE_FACE_NORMALS[6] = { {0,0,-1}, {0,0,1}, {0,-1,0}, {0,1,0}, {-1,0,0}, {1,0,0} };
+static const int CENTER_CUBE_EDGE_FACES[12][2] = { {0,2},{0,4},{0,3},{0,5}, {1,2},{1,4},{1,3},{1,5}, {2,5},{2,4},{3,4},{3,5} };
+
+// --- ГРАФ ПРОХОДОВ РЕНДЕРА ---
+// Сцена синглплеера - не ручной список вызовов, а таблица проходов. Каждый проход объявляет,
+// что читает (состояние мира, камеру, наборы сущностей, то, что приготовили проходы до него)
+// и что пишет (цвет, глубину, ID или свой кэш). Исполнитель:
+//  - пропускает проход, если хоть один его вход инертен: неба нет, стены не выросли,
+//    осколков нет. Выходы пропущенного прохода тоже инертны - за ним молчат и потребители;
+//  - собирает подряд идущие проходы без общих ресурсов в волну и отдаёт волну пулу потоков,
+//    когда по сглаженной цене это окупается (на деле - подготовка кадра; всё, что пишет цвет,
+//    упирается в один кадр и идёт по порядку);
+//  - меряет каждый проход: профайлер показывает цену и что было пропущено.
+// Новый проход - строчка в таблице, а не ещё один вызов где-то посреди main.
+typedef enum {
+    // Источники: живы или нет по состоянию игры на начало кадра
+    RG_WORLD      = 1 << 0,   // Эволюция мира, сутки, монеты - есть всегда
+    RG_SKY        = 1 << 1,   // Небо проявилось (skyboxAlpha > 0)
+    RG_WALLS      = 1 << 2,   // Стены выросли (gridWallHeight > 0)
+    RG_RASTER     = 1 << 3,   // Мир рисуется треугольниками...
+    RG_RAYS       = 1 << 4,   // ...или лучами по BVH (F4)
+    RG_PREPASS    = 1 << 5,   // Пре-пасс глубины включён и нужен (реализм, F7)
+    RG_SBUFFER    = 1 << 6,   // Мир из линий: видимость решает s-буфер
+    RG_COINS      = 1 << 7,   // Есть несобранные монеты
+    RG_PICKUPS    = 1 << 8,
+    RG_AIRSTRIKE  = 1 << 9,
+    RG_SHARDS     = 1 << 10,
+    RG_GLITCHES   = 1 << 11,
+    RG_BOSS       = 1 << 12,
+    RG_TRAJECTORY = 1 << 13,  // Держим предмет - есть траектория броска
+    // То, что готовят проходы кадра
+    RG_LIGHT_LUT  = 1 << 14,
+    RG_SKY_ROWS   = 1 << 15,
+    RG_LATTICE    = 1 << 16,
+    RG_BVH        = 1 << 17,
+    RG_LAMPS      = 1 << 18,  // Живо, только если в кадре есть хоть одна лампа
+    RG_POSTFX     = 1 << 19,  // Интенсивности пост-обработки (её проходы сами пропускают ~0)
+    // Контекст вида: есть всегда, по нему проход не пропускается
+    RG_CAMERA     = 1 << 20,
+    RG_COLOR      = 1 << 21,
+    RG_DEPTH      = 1 << 22,
+    RG_ID         = 1 << 23
+} RenderResource;
+
+#define RG_CONTEXT (RG_CAMERA | RG_COLOR | RG_DEPTH | RG_ID)
+#define RG_MODES (RG_RASTER | RG_RAYS | RG_PREPASS | RG_SBUFFER) // Выбор пути, а не "пусто": соблюдается и без пропусков
+#define RG_PARALLEL_MIN_MS 0.2f  // Волна уходит в пул, если всё, кроме её самого дорогого прохода, стоит больше
+#define RG_MAX_PASSES 24
 
-    drawText(ren, font, "MULTIPLAYER", WIDTH/2 - 100, 100, titleColor);
+typedef struct {
+    RenderBackend* ren;   // NULL у проходов кадра
+    Camera cam;
+    SDL_Color fogColor;
+} RenderView;
 
-    // <<< ВОТ ОНА, БЛЯДЬ, ПРОВЕРКА, КОТОРОЙ НЕ ХВАТАЛО >>>
-    if (g_mp_menu_state == MP_MENU_SELECT) {
-        // Рисуем меню выбора
-        const char* menuItems[] = { "Host Game", "Join Game", "Back" };
-        for (int i = 0; i < 3; i++) {
-            char itemText[128];
-            snprintf(itemText, sizeof(itemText), "%s %s", (i == g_menuSelectedOption) ? ">" : " ", menuItems[i]);
-            drawText(ren, font, itemText, WIDTH/2 - 100, 200 + i * 40, (i == g_menuSelectedOption) ? selectedColor : optionColor);
-        }
-        drawText(ren, font, "Host: To find your IP, open Google and search 'my ip address'", 20, HEIGHT - 50, (SDL_Color){100,100,100,255});
+typedef int (*RenderPassFunc)(RenderView* v); // 0 - выходы прохода пустые (например, ламп нет)
 
-    } else if (g_mp_menu_state == MP_MENU_INPUT_IP) {
-        // Рисуем поле для ввода IP
-        drawText(ren, font, "Enter Host IP Address:", WIDTH/2 - 150, 200, optionColor);
-        
-        char inputLine[128];
-        snprintf(inputLine, sizeof(inputLine), "> %s", g_ip_input_buffer);
-        drawText(ren, font, inputLine, WIDTH/2 - 150, 240, selectedColor);
+typedef struct {
+    const char* name;
+    Uint32 reads, writes;
+    int callerThread;       // Пишет RENDER_TLS-состояние - только на вызывающем потоке
+    RenderPassFunc run;
+    SDL_atomic_t micros;    // За кадр; виды сплит-скрина складываются
+    SDL_atomic_t runs, skips;
+    float costMs;           // Сглаженная цена одного запуска - по ней решаем, звать ли пул
+} RenderPass;
 
-        // Мигающий курсор
-        if ((SDL_GetTicks() / 500) % 2 == 0) {
-            int text_w, text_h;
-            TTF_SizeUTF8(font, inputLine, &text_w, &text_h);
-            SDL_Rect cursorRect = { WIDTH/2 - 150 + text_w, 240, 10, 20 };
-            SDL_SetRenderDrawColor(ren, selectedColor.r, selectedColor.g, selectedColor.b, 255);
-            SDL_RenderFillRect(ren, &cursorRect);
+typedef struct {
+    int skipInert;          // Shift+F3: выключить пропуски (кроме выбора режима) и сравнить время кадра
+    Uint32 live;            // Живые ресурсы после проходов кадра - с них начинает каждый вид
+    int parallelWaves;      // Волн за кадр, ушедших в пул
+} RenderGraph;
+
+RenderGraph g_renderGraph = { .skipInert = 1 };
+
+// Проходы кадра: всё, что не зависит от камеры, - один раз до всех видов
+static int rgLight(RenderView* v) { (void)v; Light_BeginFrame(); return 1; }
+static int rgSkyRows(RenderView* v) { (void)v; updateSkyCache(); return g_skyCache.version != 0; }
+static int rgLattice(RenderView* v) { (void)v; updateWallLattice(); return g_wallLattice.valid; }
+static int rgPostFx(RenderView* v) { (void)v; applyGlitchEffect(); return 1; }
+static int rgBvh(RenderView* v) { (void)v; RayRender_BeginFrame(collisionBoxes, numCollisionBoxes); return 1; }
+static int rgLamps(RenderView* v) { (void)v; Deferred_BeginFrame(); return g_deferred.count > 0; }
+
+// Счётчики прохода (micros, runs, skips, costMs) в таблицах всегда начинаются с нуля
+#define RG_PASS(passName, passReads, passWrites, onCaller, passRun) \
+    { .name = (passName), .reads = (passReads), .writes = (passWrites), .callerThread = (onCaller), .run = (passRun), \
+      .micros = {0}, .runs = {0}, .skips = {0}, .costMs = 0.0f }
+
+static RenderPass g_framePasses[] = {
+    RG_PASS("light",   RG_WORLD,  RG_LIGHT_LUT, 1, rgLight), // g_light - RENDER_TLS
+    RG_PASS("sky",     RG_SKY,    RG_SKY_ROWS,  0, rgSkyRows),
+    RG_PASS("lattice", RG_WALLS,  RG_LATTICE,   0, rgLattice),
+    RG_PASS("postfx",  RG_WORLD,  RG_POSTFX,    0, rgPostFx),
+    RG_PASS("bvh",     RG_RAYS,   RG_BVH,       0, rgBvh),
+    RG_PASS("lamps",   RG_WORLD,  RG_LAMPS,     0, rgLamps), // Взрывы и монеты - часть мира; счётчики обнуляет всегда
+};
+
+// Проходы вида: в порядке рисования
+static int rgPrepass(RenderView* v) {
+    g_depthPrepassActive = 1;
+    depthPrepassOpaque(v->ren, collisionBoxes, numCollisionBoxes, v->cam);
+    return 1;
+}
+static int rgOccluders(RenderView* v) { buildSBufferOccluders(v->ren, collisionBoxes, numCollisionBoxes, v->cam); return 1; }
+static int rgSkybox(RenderView* v) { drawSkybox(v->ren); return 1; }
+static int rgSunMoon(RenderView* v) {
+    // Солнце и луна - часть неба: туман и дальняя плоскость их не касаются
+    Fog_End();
+    drawSunAndMoon(v->ren, v->cam);
+    Fog_Begin(v->fogColor);
+    return 1;
+}
+static int rgRayWorld(RenderView* v) { drawRayCastWorld(v->ren, v->cam); return 1; }
+static int rgFloor(RenderView* v) { drawFloor(v->ren, v->cam); return 1; }
+static int rgShadows(RenderView* v) { drawPlanarShadows(v->ren, v->cam); return 1; }
+static int rgBoxes(RenderView* v) {
+    for (int i = 0; i < numCollisionBoxes; i++) {
+        if (!isBoxInFrustum_Cached(&collisionBoxes[i], v->cam)) continue;
+        if (g_worldEvolution.currentState >= WORLD_STATE_MATERIALIZING) {
+            drawMaterializedBox(v->ren, &collisionBoxes[i], v->cam);
+        } else {
+            drawOptimizedBox(v->ren, &collisionBoxes[i], v->cam);
         }
-        drawText(ren, font, "Press [Enter] to connect, [Escape] to cancel", 20, HEIGHT - 50, (SDL_Color){100,100,100,255});
     }
+    return 1;
+}
+static int rgWalls(RenderView* v) { drawEvolvingWalls(v->ren, v->cam); return 1; }
+static int rgLampLight(RenderView* v) { Deferred_LightView(v->ren, v->cam); return 1; }
+// Монеты и предметы рисуются после граней и пола - закрытые ими пропускаем целиком
+static int rgCoins(RenderView* v) {
+    for (int i = 0; i < g_numCoins; i++) {
+        Coin* c = &g_coins[i];
+        if (c->collected || !isPointInFrustum_Cached(&g_vis.coins[i], c->pos, v->cam)) continue;
+        Vec3 center = { c->pos.x, c->pos.y + fast_sin(c->bobPhase) * 0.2f, c->pos.z }; // Как в drawCoin
+        if (VisCache_Occluded(&g_vis.coins[i], center, COIN_BOUND_RADIUS, v->cam)) continue;
+        drawCoin(v->ren, c, v->cam);
+    }
+    return 1;
+}
+static int rgPickups(RenderView* v) {
+    for (int i = 0; i < g_numPickups; i++) {
+        PickupObject* p = &g_pickups[i];
+        if (p->state == PICKUP_STATE_BROKEN || !isPointInFrustum_Cached(&g_vis.pickups[i], p->pos, v->cam)) continue;
+        // Полудиагональ корпуса и горлышко бутылки сверху
+        float radius = 0.5f * sqrtf(p->size.x * p->size.x + p->size.y * p->size.y + p->size.z * p->size.z) + 0.1f;
+        if (VisCache_Occluded(&g_vis.pickups[i], p->pos, radius, v->cam)) continue;
+        drawPickupObject(v->ren, p, v->cam);
+    }
+    return 1;
+}
+static int rgAirstrike(RenderView* v) {
+    for (int i = 0; i < 3; i++) {
+        drawJet(v->ren, &g_airstrike.jets[i], v->cam);
+        drawBomb(v->ren, &g_airstrike.bombs[i], v->cam);
+        drawExplosion(v->ren, &g_airstrike.explosions[i], v->cam);
+    }
+    return 1;
+}
+static int rgShards(RenderView* v) { drawGlassShards(v->ren, v->cam); return 1; }
+static int rgGlitches(RenderView* v) { drawGlitches(v->ren, v->cam); return 1; }
+static int rgBoss(RenderView* v) { drawBoss(v->ren, v->cam); return 1; }
+static int rgTrajectory(RenderView* v) { drawTrajectory(v->ren, v->cam, &g_trajectory); return 1; }
+static int rgCenterCube(RenderView* v) {
+    // Ребро светится по более освещённой из двух своих граней. В режиме лучей куб - грани бокса 0
+    for (int i = 0; i < 12; ++i) {
+        float b1 = Light_VertexLevel(CENTER_CUBE_FACE_NORMALS[CENTER_CUBE_EDGE_FACES[i][0]]);
+        float b2 = Light_VertexLevel(CENTER_CUBE_FACE_NORMALS[CENTER_CUBE_EDGE_FACES[i][1]]);
+        SDL_Color edgeColor = Light_Apply((SDL_Color){255, 255, 255, 255}, lightLevelAt(fmaxf(b1, b2), 0.0f, 0));
+
+        Vec3 p1 = CENTER_CUBE_VERTS[CENTER_CUBE_EDGES[i][0]];
+        Vec3 p2 = CENTER_CUBE_VERTS[CENTER_CUBE_EDGES[i][1]];
+        clipAndDrawLine(v->ren, p1, p2, v->cam, edgeColor);
+    }
+    return 1;
 }
 
-// === ВСТАВЬ ЭТОТ БЛОК ПЕРЕД drawSettingsMenu ===
-
-// Наши, блядь, ASCII-лица. По одному на каждую настройку + "Назад".
-const char* SETTINGS_FACES[] = {
-    "(⌐■_■)", // Mouse Sensitivity
-    "(•_•)",   // Walk Speed
-    "\\(>o<)/", // Run Speed
-    "(^.^)",   // Jump Force
-    "(v_v)",   // Gravity
-    "(O_O)",   // Field of View
-    "(._.) /"  // Back
+#define RG_DRAW (RG_COLOR | RG_DEPTH) // Почти все проходы вида пишут цвет с глубиной
+static RenderPass g_viewPasses[] = {
+    // Пре-пасс: в реализме сначала z-буфер непрозрачными гранями, чтобы пол, стены и заливка не
+    // тратили вызовы на скрытые пиксели. В мире из линий вместо него закрывают грани в s-буфере
+    RG_PASS("prepass",    RG_PREPASS | RG_CAMERA,                  RG_DEPTH,          1, rgPrepass),
+    RG_PASS("occluders",  RG_SBUFFER | RG_CAMERA,                  RG_DEPTH,          1, rgOccluders),
+    RG_PASS("skybox",     RG_SKY_ROWS,                             RG_COLOR,          1, rgSkybox),
+    RG_PASS("sun",        RG_WORLD | RG_CAMERA,                    RG_COLOR,          1, rgSunMoon),
+    RG_PASS("rays",       RG_BVH | RG_CAMERA,                      RG_DRAW | RG_ID,   1, rgRayWorld), // Пол, боксы и куб - одним проходом
+    RG_PASS("floor",      RG_RASTER | RG_LIGHT_LUT | RG_CAMERA,    RG_DRAW,           1, rgFloor),
+    RG_PASS("shadows",    RG_RASTER | RG_CAMERA,                   RG_COLOR,          1, rgShadows), // Сам обнуляет свои счётчики
+    RG_PASS("boxes",      RG_RASTER | RG_LIGHT_LUT | RG_CAMERA,    RG_DRAW | RG_ID,   1, rgBoxes),
+    RG_PASS("walls",      RG_LATTICE | RG_CAMERA,                  RG_DRAW,           1, rgWalls),
+    // Лампы освещают то, что уже лежит в G-буфере (пол и грани); монеты, взрывы и линии идут поверх
+    RG_PASS("lamps",      RG_LAMPS | RG_COLOR | RG_DEPTH,          RG_COLOR,          1, rgLampLight),
+    RG_PASS("coins",      RG_COINS | RG_CAMERA,                    RG_DRAW | RG_ID,   1, rgCoins),
+    RG_PASS("pickups",    RG_PICKUPS | RG_CAMERA,                  RG_DRAW | RG_ID,   1, rgPickups),
+    RG_PASS("airstrike",  RG_AIRSTRIKE | RG_CAMERA,                RG_DRAW,           1, rgAirstrike),
+    RG_PASS("shards",     RG_SHARDS | RG_CAMERA,                   RG_DRAW,           1, rgShards),
+    RG_PASS("glitches",   RG_GLITCHES | RG_CAMERA,                 RG_DRAW,           1, rgGlitches),
+    RG_PASS("boss",       RG_BOSS | RG_CAMERA,                     RG_DRAW,           1, rgBoss),
+    RG_PASS("trajectory", RG_TRAJECTORY | RG_CAMERA,               RG_DRAW,           1, rgTrajectory),
+    RG_PASS("cube",       RG_RASTER | RG_LIGHT_LUT | RG_CAMERA,    RG_DRAW,           1, rgCenterCube),
 };
 
-// Наши, блядь, объяснения.
-const char* SETTINGS_DESCRIPTIONS[] = {
-    "Как быстро, нахуй, башка вертится.",
-    "Скорость для чилла и прогулок.",
-    "Когда надо съебаться. Быстро.",
-    "Как высоко, блядь, подлетаешь.",
-    "Как сильно тебя к земле тянет.",
-    "Насколько у тебя, нахуй, широкие глаза.",
-    "Вернуться и сохранить эту дичь."
-};
+#define RG_FRAME_PASS_COUNT ((int)(sizeof(g_framePasses) / sizeof(g_framePasses[0])))
+#define RG_VIEW_PASS_COUNT ((int)(sizeof(g_viewPasses) / sizeof(g_viewPasses[0])))
 
-// Наши, блядь, финальные реплики.
-const char* SETTINGS_REMARKS[] = {
-    "Резкость — это вежливость.",
-    "Тише едешь - дальше будешь.",
-    "Беги, Форрест, беги!",
-    "В небо, нахуй!",
-    "Помни о своих корнях, брат.",
-    "Видишь всё. Вообще всё.",
-    "Был рад попиздеть."
-};
+typedef struct {
+    RenderPass* passes[RG_MAX_PASSES];
+    int produced[RG_MAX_PASSES];
+    RenderView* view;
+} RenderWave;
+
+static int renderPassRun(RenderPass* p, RenderView* v) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    int produced = p->run(v);
+    SDL_AtomicAdd(&p->micros, (int)((SDL_GetPerformanceCounter() - start) * 1000000 / SDL_GetPerformanceFrequency()));
+    SDL_AtomicAdd(&p->runs, 1);
+    return produced;
+}
 
-void drawSettingsMenu(SDL_Renderer* ren, TTF_Font* font, TTF_Font* large_font, EditableVariable* vars, int numVars) {
-    SDL_SetRenderDrawColor(ren, 10, 10, 15, 255);
-    SDL_RenderClear(ren);
-    
-    SDL_Color titleColor = {0, 255, 100, 255};
-    SDL_Color optionColor = {200, 200, 200, 255};
-    SDL_Color selectedColor = {255, 255, 0, 255};
-    
-    drawText(ren, font, "SETTINGS", 20, 20, titleColor);
+static void renderWaveBand(void* ctx, int begin, int end) {
+    RenderWave* w = (RenderWave*)ctx;
+    for (int i = begin; i < end; i++) w->produced[i] = renderPassRun(w->passes[i], w->view);
+}
 
-    for (int i = 0; i < numVars; ++i) {
-        char buffer[128];
-        snprintf(buffer, 128, "%s: < %.4f >", vars[i].name, *vars[i].value_ptr);
-        drawText(ren, font, buffer, 50, 80 + i * 30, (i == g_settingsSelectedOption) ? selectedColor : optionColor);
-    }
-    
-    drawText(ren, font, "Back", 50, 80 + numVars * 30, (numVars == g_settingsSelectedOption) ? selectedColor : optionColor);
+// Проходы по порядку объявления. live - живые ресурсы: на входе источники, на выходе плюс то,
+// что проходы реально произвели
+static void renderGraphExecute(RenderPass* passes, int count, RenderView* view, Uint32* live) {
+    int i = 0;
+    while (i < count) {
+        // Волна: следующий проход не читает и не пишет ничего, что пишут проходы волны до него,
+        // и не пишет того, что они читают. Значит, порядок внутри волны не важен
+        Uint32 waveReads = 0, waveWrites = 0;
+        int end = i;
+        while (end < count) {
+            const RenderPass* p = &passes[end];
+            if ((p->reads & waveWrites) || (p->writes & (waveReads | waveWrites))) break;
+            waveReads |= p->reads;
+            waveWrites |= p->writes;
+            end++;
+        }
 
-    if (g_settingsSelectedOption >= 0 && g_settingsSelectedOption <= numVars) {
-        
-        // 1. Рисуем ASCII-морду в центре
-        const char* face = SETTINGS_FACES[g_settingsSelectedOption];
-        int face_w, face_h;
-        TTF_SizeUTF8(large_font, face, &face_w, &face_h);
-        drawText(ren, large_font, face, WIDTH / 2 - face_w / 2, HEIGHT / 2 - 100, selectedColor);
+        // Входы волны известны целиком: внутри неё никто не ждёт выходов соседа
+        RenderWave wave;
+        wave.view = view;
+        int numJobs = 0;
+        float jobsMs = 0.0f, maxJobMs = 0.0f;
+        for (int k = i; k < end; k++) {
+            RenderPass* p = &passes[k];
+            Uint32 needs = p->reads & ~RG_CONTEXT;
+            if (!g_renderGraph.skipInert) needs &= RG_MODES;
+            if ((needs & *live) != needs) {
+                SDL_AtomicAdd(&p->skips, 1);
+                *live &= ~(p->writes & ~RG_CONTEXT);
+                continue;
+            }
+            if (p->callerThread) {
+                if (renderPassRun(p, view)) *live |= p->writes;
+                else *live &= ~(p->writes & ~RG_CONTEXT);
+                continue;
+            }
+            wave.passes[numJobs++] = p;
+            jobsMs += p->costMs;
+            if (p->costMs > maxJobMs) maxJobMs = p->costMs;
+        }
 
-        // 2. Рисуем фон для описания внизу
-        SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
-        SDL_SetRenderDrawColor(ren, 0, 0, 0, 180);
-        SDL_Rect bgRect = { 0, HEIGHT - 100, WIDTH, 100 };
-        SDL_RenderFillRect(ren, &bgRect);
+        if (numJobs > 1 && jobsMs - maxJobMs > RG_PARALLEL_MIN_MS) {
+            Jobs_ParallelFor(numJobs, 1, renderWaveBand, &wave);
+            g_renderGraph.parallelWaves++;
+        } else {
+            renderWaveBand(&wave, 0, numJobs);
+        }
+        for (int k = 0; k < numJobs; k++) {
+            if (wave.produced[k]) *live |= wave.passes[k]->writes;
+            else *live &= ~(wave.passes[k]->writes & ~RG_CONTEXT);
+        }
+        i = end;
+    }
+}
 
-        // 3. Собираем и рисуем текст
-        char full_text[512];
-        snprintf(full_text, sizeof(full_text), "Хммм... %s %s", 
-                 SETTINGS_DESCRIPTIONS[g_settingsSelectedOption], 
-                 SETTINGS_REMARKS[g_settingsSelectedOption]);
-        
-        drawText(ren, font, full_text, 50, HEIGHT - 70, optionColor);
+static void renderPassesFold(RenderPass* passes, int count) {
+    for (int i = 0; i < count; i++) {
+        RenderPass* p = &passes[i];
+        int runs = SDL_AtomicSet(&p->runs, 0);
+        int micros = SDL_AtomicSet(&p->micros, 0);
+        SDL_AtomicSet(&p->skips, 0);
+        if (runs > 0) p->costMs = p->costMs * 0.9f + (micros / 1000.0f / runs) * 0.1f;
     }
 }
 
-void clearZBuffer() {
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            // Заполняем буфер "бесконечностью", чтобы любой первый пиксель
-            // был ближе, чем это значение.
-            g_zBuffer[y][x] = INFINITY;
+// Источники кадра: что из состояния игры вообще есть что рисовать
+static Uint32 renderGraphSources(void) {
+    Uint32 live = RG_WORLD | RG_CONTEXT;
+    if (g_worldEvolution.skyboxEnabled && g_worldEvolution.skyboxAlpha >= 0.01f) live |= RG_SKY;
+    if (g_worldEvolution.gridWallHeight > 0.01f) live |= RG_WALLS;
+    live |= RayRender_Active() ? RG_RAYS : RG_RASTER;
+    if (g_depthPrepassEnabled && g_worldEvolution.currentState >= WORLD_STATE_REALISTIC && !RayRender_Active()) live |= RG_PREPASS;
+    if (g_sbuffer.active) live |= RG_SBUFFER;
+    for (int i = 0; i < g_numCoins; i++) {
+        if (!g_coins[i].collected) {
+            live |= RG_COINS;
+            break;
+        }
+    }
+    for (int i = 0; i < g_numPickups; i++) {
+        if (g_pickups[i].state != PICKUP_STATE_BROKEN) {
+            live |= RG_PICKUPS;
+            break;
         }
     }
+    if (g_airstrike.isActive) live |= RG_AIRSTRIKE;
+    if (g_numShards > 0) live |= RG_SHARDS;
+    if (g_activeGlitches > 0) live |= RG_GLITCHES;
+    if (g_bossFightActive && g_rknChan.state != BOSS_STATE_DEFEATED) live |= RG_BOSS;
+    if (g_trajectory.numPoints >= 2) live |= RG_TRAJECTORY;
+    return live;
 }
 
-// === ВСТАВЬ ЭТУ ФУНКЦИЮ ПЕРЕД main ===
-void selectNewSplash() {
-    int index = rand() % NUM_SPLASHES;
-    strncpy(g_current_splash, g_splashes[index], 255);
-    g_current_splash[255] = '\0';
+// Всё, что в кадре не зависит от камеры: свет, строки неба, решётка стен, пост-эффекты.
+// Делается один раз до отрисовки, сколько бы видов ни было на экране
+void prepareSingleplayerFrame(void) {
+    renderPassesFold(g_framePasses, RG_FRAME_PASS_COUNT);
+    renderPassesFold(g_viewPasses, RG_VIEW_PASS_COUNT);
+    g_renderGraph.parallelWaves = 0;
+    g_renderGraph.live = renderGraphSources();
+    renderGraphExecute(g_framePasses, RG_FRAME_PASS_COUNT, NULL, &g_renderGraph.live);
 }
 
-void saveConfig(const char* filename, GameConfig* config) {
-    FILE* file = fopen(filename, "w");
-    if (!file) {
-        printf("Не удалось сохранить настройки в %s\n", filename);
-        return;
-    }
-    
-    fprintf(file, "mouseSensitivity=%.6f\n", config->mouseSensitivity);
-    fprintf(file, "walkSpeed=%.6f\n", config->walkSpeed);
-    fprintf(file, "runSpeed=%.6f\n", config->runSpeed);
-    fprintf(file, "crouchSpeedMultiplier=%.6f\n", config->crouchSpeedMultiplier);
-    fprintf(file, "acceleration=%.6f\n", config->acceleration);
-    fprintf(file, "deceleration=%.6f\n", config->deceleration);
-    fprintf(file, "jumpForce=%.6f\n", config->jumpForce);
-    fprintf(file, "gravity=%.6f\n", config->gravity);
-    fprintf(file, "fov=%.6f\n", config->fov);
-    
-    fclose(file);
-    printf("Настройки сохранены в %s\n", filename);
+// Вся 3D-сцена синглплеера без UI. Кадр и z-буфер уже очищены снаружи.
+// Эту же функцию гоняет бенчмарк бэкендов, чтобы сравнивать одну и ту же картинку
+void drawSingleplayerScene(RenderBackend* ren, Camera renderCam) {
+    // Геометрия уходит в туман цвета фона; включаем ДО пре-пасса, чтобы оба прохода резали по одной дальности
+    RenderView view = { ren, renderCam, getSkyClearColor(g_worldEvolution.skyboxAlpha) };
+    Fog_Begin(view.fogColor);
+
+    memset(&g_rasterStats, 0, sizeof(g_rasterStats));
+    memset(g_lod.counts, 0, sizeof(g_lod.counts));
+    VisCache_BeginFrame(renderCam);
+    Pick_BeginFrame(!g_cinematic.isActive);
+    Deferred_BeginView(renderCam);
+    g_depthPrepassActive = 0; // Включит проход пре-пасса, если он будет
+
+    Uint32 live = g_renderGraph.live; // У каждого вида своя копия: виды сплит-скрина идут параллельно
+    renderGraphExecute(g_viewPasses, RG_VIEW_PASS_COUNT, &view, &live);
+    Fog_End();
 }
 
-void loadConfig(const char* filename, GameConfig* config) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        printf("Файл настроек %s не найден, используем значения по умолчанию\n", filename);
-        return;
-    }
-    
-    // === ИСПРАВЛЕНИЕ 1: Используем безопасное чтение ===
-    char line[CONFIG_LINE_SIZE];
-    while (readConfigLine(file, line, sizeof(line))) {
-        // Пробуем распарсить каждое возможное значение
-        parseConfigValue(line, "mouseSensitivity", &config->mouseSensitivity);
-        parseConfigValue(line, "walkSpeed", &config->walkSpeed);
-        parseConfigValue(line, "runSpeed", &config->runSpeed);
-        parseConfigValue(line, "crouchSpeedMultiplier", &config->crouchSpeedMultiplier);
-        parseConfigValue(line, "acceleration", &config->acceleration);
-        parseConfigValue(line, "deceleration", &config->deceleration);
-        parseConfigValue(line, "jumpForce", &config->jumpForce);
-        parseConfigValue(line, "gravity", &config->gravity);
-        parseConfigValue(line, "fov", &config->fov);
+// Профайлер: что прошло и почём, что пропущено
+void RenderGraph_DrawStats(RenderBackend* ren, TTF_Font* font, int x, int y) {
+    SDL_Color white = {255, 255, 255, 255};
+    char ranLine[256], skipLine[256];
+    int ranLen = 0, skipLen = 0, ran = 0, skipped = 0;
+    float totalMs = 0.0f;
+    ranLine[0] = skipLine[0] = '\0';
+    for (int t = 0; t < 2; t++) {
+        RenderPass* passes = t == 0 ? g_framePasses : g_viewPasses;
+        int count = t == 0 ? RG_FRAME_PASS_COUNT : RG_VIEW_PASS_COUNT;
+        for (int i = 0; i < count; i++) {
+            RenderPass* p = &passes[i];
+            if (SDL_AtomicGet(&p->runs) > 0) {
+                float ms = SDL_AtomicGet(&p->micros) / 1000.0f;
+                totalMs += ms;
+                ran++;
+                if (ranLen < (int)sizeof(ranLine)) {
+                    ranLen += snprintf(ranLine + ranLen, sizeof(ranLine) - ranLen, "%s%s %.2f", ran > 1 ? ", " : "", p->name, ms);
+                }
+            } else if (SDL_AtomicGet(&p->skips) > 0) {
+                skipped++;
+                if (skipLen < (int)sizeof(skipLine)) {
+                    skipLen += snprintf(skipLine + skipLen, sizeof(skipLine) - skipLen, "%s%s", skipped > 1 ? ", " : "", p->name);
+                }
+            }
+        }
     }
-    
-    fclose(file);
-    printf("Настройки загружены из %s\n", filename);
+
+    char header[160];
+    snprintf(header, sizeof(header), "passes [Shift+F3]: skip inert %s | %d ran, %d skipped, %d parallel waves | %.2f ms",
+             g_renderGraph.skipInert ? "ON" : "OFF", ran, skipped, g_renderGraph.parallelWaves, totalMs);
+    drawText(ren, font, header, x, y, white);
+    drawText(ren, font, ranLine, x, y + 20, white);
+    if (skipped > 0) drawText(ren, font, skipLine, x, y + 40, (SDL_Color){160, 160, 160, 255});
 }
 
-void init_multiplayer() {
-    SDLNet_Init();
-    g_isMultiplayer = 0;
-    g_isServer = 0;
-    for (int i = 0; i < MAX_PLAYERS; i++) {
-        g_players[i].active = 0;
+// --- СПЛИТ-СКРИН: раскладка, гости, отрисовка ---
+// Два вида - левая и правая половины, три-четыре - четверти экрана.
+// Вертикальный угол обзора у вида тот же, что у полного экрана: fov масштабируется по высоте
+void SplitScreen_Layout(int numViews) {
+    if (numViews < 1) numViews = 1;
+    if (numViews > SPLIT_MAX_VIEWS) numViews = SPLIT_MAX_VIEWS;
+    g_split.numViews = numViews;
+
+    int cols = numViews == 1 ? 1 : 2;
+    int rows = numViews <= 2 ? 1 : 2;
+    int w = WIDTH / cols, h = HEIGHT / rows;
+    for (int i = 0; i < numViews; i++) {
+        Viewport* v = &g_split.views[i].view;
+        v->x0 = (i % cols) * w;
+        v->y0 = (i / cols) * h;
+        v->x1 = v->x0 + w;
+        v->y1 = v->y0 + h;
+        v->cx = (v->x0 + v->x1) / 2;
+        v->cy = (v->y0 + v->y1) / 2;
+        v->index = i;
     }
 }
 
-void start_server() {
-    printf("[SERVER] Attempting to start on port 1234...\n");
-    if (SDLNet_ResolveHost(&g_server_ip, NULL, 1234) == -1) {
-        printf("[SERVER] [FATAL] SDLNet_ResolveHost: %s\n", SDLNet_GetError());
-        return;
-    }
-    printf("[SERVER] Host resolved.\n");
-    g_server_socket = SDLNet_TCP_Open(&g_server_ip);
-    if (!g_server_socket) {
-        printf("[SERVER] [FATAL] SDLNet_TCP_Open: %s\n", SDLNet_GetError());
-        return;
+// Гости встают по кругу вокруг центра и смотрят на него; геймпады раздаются им по порядку
+void SplitScreen_Init(int numViews) {
+    SplitScreen_Layout(numViews);
+    if (g_split.numViews == 1) return;
+
+    int pads = 0;
+    if (SDL_InitSubSystem(SDL_INIT_GAMECONTROLLER) < 0) {
+        printf("Split screen: no gamepads (%s)\n", SDL_GetError());
+    }
+    int joystick = 0;
+    for (int i = 1; i < g_split.numViews; i++) {
+        SplitView* sv = &g_split.views[i];
+        float angle = (float)i / SPLIT_MAX_VIEWS * 2.0f * M_PI;
+        sv->cam = (Camera){
+            .x = -fast_sin(angle) * SPLIT_GUEST_DISTANCE, .y = 0, .z = -fast_cos(angle) * SPLIT_GUEST_DISTANCE,
+            .rotY = angle, .height = STANDING_HEIGHT, .targetHeight = STANDING_HEIGHT
+        };
+        while (joystick < SDL_NumJoysticks() && !SDL_IsGameController(joystick)) joystick++;
+        if (joystick < SDL_NumJoysticks()) {
+            sv->pad = SDL_GameControllerOpen(joystick++);
+            if (sv->pad) pads++;
+        }
     }
-    g_socket_set = SDLNet_AllocSocketSet(MAX_PLAYERS);
-    SDLNet_TCP_AddSocket(g_socket_set, g_server_socket);
-    
-    g_isServer = 1; g_isMultiplayer = 1; g_players[0].active = 1; g_myPlayerID = 0;
-    printf("[SERVER] Server started successfully!\n");
+    printf("Split screen: %d views, %d gamepad(s) for guests\n", g_split.numViews, pads);
 }
 
-int connect_to_server(const char* ip_address) {
-    printf("[CLIENT] Attempting to connect to %s:1234...\n", ip_address);
-    if (SDLNet_ResolveHost(&g_server_ip, ip_address, 1234) == -1) {
-        printf("[CLIENT] [FATAL] SDLNet_ResolveHost: %s\n", SDLNet_GetError());
-        return 0;
+void SplitScreen_Shutdown(void) {
+    for (int i = 1; i < g_split.numViews; i++) {
+        if (g_split.views[i].pad) SDL_GameControllerClose(g_split.views[i].pad);
+        g_split.views[i].pad = NULL;
     }
-    printf("[CLIENT] Host resolved.\n");
-    g_server_socket = SDLNet_TCP_Open(&g_server_ip);
-    if (!g_server_socket) {
-        printf("[CLIENT] [FATAL] SDLNet_TCP_Open: %s\n", SDLNet_GetError());
-        return 0;
+}
+
+static float splitStick(SDL_GameController* pad, SDL_GameControllerAxis axis) {
+    int value = SDL_GameControllerGetAxis(pad, axis);
+    if (abs(value) < SPLIT_STICK_DEADZONE) return 0.0f;
+    return value / 32767.0f;
+}
+
+// Левый стик - ходьба, правый - обзор. Без физики и столкновений: гость - камера на ногах
+void SplitScreen_UpdateGuests(float deltaTime) {
+    for (int i = 1; i < g_split.numViews; i++) {
+        SplitView* sv = &g_split.views[i];
+        if (!sv->pad) continue;
+        Camera* c = &sv->cam;
+        c->rotY += splitStick(sv->pad, SDL_CONTROLLER_AXIS_RIGHTX) * SPLIT_GUEST_TURN * deltaTime;
+        c->rotX -= splitStick(sv->pad, SDL_CONTROLLER_AXIS_RIGHTY) * SPLIT_GUEST_TURN * deltaTime;
+        if (c->rotX > 1.5f) c->rotX = 1.5f;
+        if (c->rotX < -1.5f) c->rotX = -1.5f;
+
+        float forward = -splitStick(sv->pad, SDL_CONTROLLER_AXIS_LEFTY);
+        float right = splitStick(sv->pad, SDL_CONTROLLER_AXIS_LEFTX);
+        float s = fast_sin(c->rotY), co = fast_cos(c->rotY);
+        c->x += (s * forward + co * right) * SPLIT_GUEST_SPEED * deltaTime;
+        c->z += (co * forward - s * right) * SPLIT_GUEST_SPEED * deltaTime;
     }
-    printf("[CLIENT] Connection established! Awaiting Player ID...\n");
-    
-    if (SDLNet_TCP_Recv(g_server_socket, &g_myPlayerID, sizeof(int)) <= 0) {
-        printf("[CLIENT] [FATAL] Failed to receive player ID from server: %s\n", SDLNet_GetError());
-        SDLNet_TCP_Close(g_server_socket);
-        return 0;
+}
+
+// Один вид целиком: поток берёт снимок настроек кадра и своё состояние вида с прошлого кадра,
+// рисует сцену в свой прямоугольник и отдаёт итоги обратно
+static void splitViewBand(void* ctx, int begin, int end) {
+    RenderBackend* ren = (RenderBackend*)ctx;
+    for (int i = begin; i < end; i++) {
+        SplitView* sv = &g_split.views[i];
+        Uint64 start = SDL_GetPerformanceCounter();
+
+        g_view = sv->view;
+        g_fov = sv->fov;
+        g_fog = g_split.fog;
+        g_light = g_split.light;
+        g_lod = g_split.lod;
+        g_shadows = g_split.shadows;
+        g_shadows.frame = sv->shadowFrame;
+        g_pick = g_split.pick;
+        g_pick.enabled = g_split.pick.enabled && i == 0; // Прицел и тяговый луч - только у игрока
+        g_vis = sv->vis;
+        g_vis.enabled = g_split.visEnabled;
+        g_rasterPass = RASTER_PASS_NORMAL;
+        g_lineDepthBias = 1.0f;
+        g_sbuffer.active = g_split.lineOnly;
+        g_sbuffer.spansInserted = 0;
+        g_sbuffer.spansDropped = 0;
+        if (g_split.lineOnly) memset(g_sbuffer.count, 0, sizeof(g_sbuffer.count));
+
+        // Свой цвет, режим смешивания и отсечение; кадр в памяти (или пачка SDL) общий
+        RenderBackend sub = *ren;
+        Uint32 submits = sub.submits;
+        SDL_Rect rect = { sv->view.x0, sv->view.y0, sv->view.x1 - sv->view.x0, sv->view.y1 - sv->view.y0 };
+        Render_SetClip(&sub, &rect);
+        drawSingleplayerScene(&sub, sv->cam);
+        Render_SetClip(&sub, NULL);
+
+        sv->stats = g_rasterStats;
+        sv->lod = g_lod;
+        sv->shadows = g_shadows;
+        sv->shadowFrame = g_shadows.frame;
+        sv->pick = g_pick;
+        sv->vis = g_vis;
+        sv->verticesLit = g_light.verticesLit;
+        sv->spansInserted = g_sbuffer.spansInserted;
+        sv->spansDropped = g_sbuffer.spansDropped;
+        sv->submits = sub.submits - submits;
+        sv->ms = (float)((double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
     }
-    
-    g_isServer = 0;
-    g_isMultiplayer = 1;
-    printf("[CLIENT] Success! I am Player %d\n", g_myPlayerID);
-    return 1;
 }
 
-// === ЗАМЕНИ СТАРУЮ update_multiplayer НА ЭТУ ===
-void update_multiplayer(Camera* cam) {
-    if (!g_isMultiplayer) return;
-    if (g_isServer) {
-        // --- СЕРВЕР ---
-        // <<< ВОТ ОН, ДАТЧИК ДВИЖЕНИЯ >>>
-        // Проверяем, есть ли активность, но НЕ ЖДЁМ (таймаут 0)
-        int num_ready = SDLNet_CheckSockets(g_socket_set, 0);
-        if (num_ready > 0) {
-            // Проверяем, не на главном ли сокете активность (новый клиент)
-            if (SDLNet_SocketReady(g_server_socket)) {
-                TCPsocket new_client = SDLNet_TCP_Accept(g_server_socket);
-                if (new_client) {
-                    for (int i = 1; i < MAX_PLAYERS; i++) {
-                        if (!g_players[i].active) {
-                            g_players[i].active = 1;
-                            g_players[i].socket = new_client;
-                            SDLNet_TCP_AddSocket(g_socket_set, new_client); // Добавляем в "прослушку"
-                            SDLNet_TCP_Send(new_client, &i, sizeof(int));
-                            printf("[SERVER] Player %d connected!\n", i);
-                            break;
-                        }
-                    }
-                }
+// Кадр из нескольких видов: вид 0 - камера игрока, остальные - гости. Вызывать после
+// Visibility_BeginFrame и prepareSingleplayerFrame. Программный бэкенд рисует виды
+// параллельно, SDL - по очереди (его рендерер живёт в одном потоке)
+void SplitScreen_Draw(RenderBackend* ren, Camera playerCam, float fov) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    g_split.views[0].cam = playerCam;
+    for (int i = 0; i < g_split.numViews; i++) {
+        SplitView* sv = &g_split.views[i];
+        sv->fov = fov * (float)(sv->view.y1 - sv->view.y0) / HEIGHT;
+    }
+    g_split.fog = g_fog;
+    g_split.light = g_light;
+    g_split.lod = g_lod;
+    g_split.shadows = g_shadows;
+    g_split.pick = g_pick;
+    g_split.visEnabled = g_vis.enabled;
+    g_split.lineOnly = g_sbuffer.active;
+    Viewport fullView = g_view;
+    float fullFov = g_fov;
+
+    if (ren->type == RENDER_BACKEND_SOFTWARE) {
+        Jobs_ParallelFor(g_split.numViews, 1, splitViewBand, ren);
+    } else {
+        splitViewBand(ren, 0, g_split.numViews);
+    }
+
+    // Главный поток тоже рисовал какой-то из видов: возвращаем ему весь экран и сводим итоги
+    g_view = fullView;
+    g_fov = fullFov;
+    g_fog = g_split.fog;
+    g_light = g_split.light;
+    g_lod = g_split.lod;
+    g_shadows = g_split.views[0].shadows;
+    g_pick = g_split.views[0].pick;
+    g_vis = g_split.views[0].vis;
+    g_depthPrepassActive = g_depthPrepassEnabled && g_worldEvolution.currentState >= WORLD_STATE_REALISTIC && !RayRender_Active();
+    g_sbuffer.active = g_split.lineOnly;
+    memset(&g_rasterStats, 0, sizeof(g_rasterStats));
+    memset(g_lod.counts, 0, sizeof(g_lod.counts));
+    g_shadows.casters = 0;
+    g_shadows.pixels = 0;
+    g_shadows.costMs = 0.0f;
+    g_vis.queries = 0;
+    g_vis.tests = 0;
+    g_vis.occlusionTests = 0;
+    g_vis.occlusionPixels = 0;
+    g_vis.occluded = 0;
+    g_sbuffer.spansInserted = 0;
+    g_sbuffer.spansDropped = 0;
+    for (int i = 0; i < g_split.numViews; i++) {
+        SplitView* sv = &g_split.views[i];
+        // В RasterStats одни счётчики Uint32 - складываем подряд
+        const Uint32* src = (const Uint32*)&sv->stats;
+        Uint32* dst = (Uint32*)&g_rasterStats;
+        for (size_t k = 0; k < sizeof(RasterStats) / sizeof(Uint32); k++) dst[k] += src[k];
+        for (int l = 0; l < LOD_LEVEL_COUNT; l++) g_lod.counts[l] += sv->lod.counts[l];
+        g_shadows.casters += sv->shadows.casters;
+        g_shadows.pixels += sv->shadows.pixels;
+        g_shadows.costMs += sv->shadows.costMs;
+        g_light.verticesLit += sv->verticesLit;
+        g_vis.queries += sv->vis.queries;
+        g_vis.tests += sv->vis.tests;
+        g_vis.occlusionTests += sv->vis.occlusionTests;
+        g_vis.occlusionPixels += sv->vis.occlusionPixels;
+        g_vis.occluded += sv->vis.occluded;
+        g_sbuffer.spansInserted += sv->spansInserted;
+        g_sbuffer.spansDropped += sv->spansDropped;
+        ren->submits += sv->submits;
+    }
+    g_split.frameMs = (float)((double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+}
+
+// 3D поверх сцены (луч прицеливания, квесты) принадлежит игроку - рисуем его в виде игрока
+void SplitScreen_EnterPlayerView(RenderBackend* ren) {
+    if (g_split.numViews <= 1) return;
+    const Viewport* v = &g_split.views[0].view;
+    g_split.savedView = g_view;
+    g_split.savedFov = g_fov;
+    g_view = *v;
+    g_fov = g_split.views[0].fov;
+    SDL_Rect rect = { v->x0, v->y0, v->x1 - v->x0, v->y1 - v->y0 };
+    Render_SetClip(ren, &rect);
+}
+
+void SplitScreen_LeavePlayerView(RenderBackend* ren) {
+    if (g_split.numViews <= 1) return;
+    g_view = g_split.savedView;
+    g_fov = g_split.savedFov;
+    Render_SetClip(ren, NULL);
+}
+
+// --- БЕНЧМАРК БЭКЕНДОВ ---
+#define BACKEND_BENCH_FRAMES 120
+
+// Одна и та же сцена и одна и та же облётная камера для каждого бэкенда по очереди.
+// Печатает мс/кадр и число вызовов SDL, чтобы на конкретной машине выбрать --backend.
+void runBackendBenchmark(SDL_Renderer* sdl, float fov) {
+    const WorldState benchStates[] = { WORLD_STATE_WIREFRAME, WORLD_STATE_REALISTIC };
+    const int benchCoins[] = { 0, 40 };
+    const char* benchStateNames[] = { "WIREFRAME", "REALISTIC" };
+    const int numStates = sizeof(benchStates) / sizeof(benchStates[0]);
+    double totalMs[RENDER_BACKEND_COUNT] = {0};
+
+    g_fov = fov;
+    printf("\n=== BACKEND BENCHMARK: %d frames per run, %dx%d, %d view(s) ===\n", BACKEND_BENCH_FRAMES, WIDTH, HEIGHT, g_split.numViews);
+
+    for (int s = 0; s < numStates; s++) {
+        // Доводим мир до нужного состояния тем же путём, что и в игре
+        g_coinsCollected = benchCoins[s];
+        for (int i = 0; i < 600 && g_worldEvolution.currentState != benchStates[s]; i++) {
+            updateWorldEvolution(0.05f);
+        }
+        for (int i = 0; i < 600; i++) updateWorldEvolution(0.05f);
+
+        for (int b = 0; b < RENDER_BACKEND_COUNT; b++) {
+            RenderBackend* rb = RenderBackend_Create((RenderBackendType)b, sdl);
+            if (!rb) {
+                totalMs[b] = -1.0;
+                continue;
             }
-            // Проверяем активность на сокетах клиентов (прислали данные)
-            for (int i = 1; i < MAX_PLAYERS; i++) {
-                if (g_players[i].active && SDLNet_SocketReady(g_players[i].socket)) {
-                    if (SDLNet_TCP_Recv(g_players[i].socket, &g_players[i].pos, sizeof(Vec3)) <= 0) {
-                        printf("[SERVER] Player %d disconnected.\n", i);
-                        SDLNet_TCP_DelSocket(g_socket_set, g_players[i].socket);
-                        SDLNet_TCP_Close(g_players[i].socket);
-                        g_players[i].active = 0;
-                        g_players[i].socket = NULL;
-                    }
+
+            Uint64 submits = 0;
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (int f = 0; f < BACKEND_BENCH_FRAMES; f++) {
+                SDL_Event e;
+                while (SDL_PollEvent(&e)) {} // Чтобы окно не "зависло" на время замера
+
+                // Камера облетает центр сцены и смотрит на него
+                float angle = (float)f / BACKEND_BENCH_FRAMES * 2.0f * M_PI;
+                Camera benchCam = {
+                    .x = fast_sin(angle) * 12.0f, .y = 0, .z = fast_cos(angle) * 12.0f,
+                    .rotY = angle + M_PI, .rotX = 0.1f, .height = STANDING_HEIGHT
+                };
+
+                rb->BeginFrame(rb, (SDL_Color){20, 20, 30, 255});
+                Visibility_BeginFrame(isLineOnlyWorldState(g_worldEvolution.currentState) && !RayRender_Active());
+                prepareSingleplayerFrame();
+                if (g_split.numViews > 1) {
+                    SplitScreen_Draw(rb, benchCam, fov);
+                } else {
+                    drawSingleplayerScene(rb, benchCam);
                 }
+                rb->EndFrame(rb);
+                submits += rb->submits;
             }
+            double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+
+            printf("%-10s %-5s %8.2f ms/frame  %8.0f SDL calls/frame\n",
+                   benchStateNames[s], rb->name, ms / BACKEND_BENCH_FRAMES, (double)submits / BACKEND_BENCH_FRAMES);
+            if (totalMs[b] >= 0.0) totalMs[b] += ms;
+            RenderBackend_Destroy(rb);
         }
-        
-        g_players[0].pos = (Vec3){cam->x, cam->y, cam->z};
-        // Рассылаем всем обновленное состояние
-        for (int i = 1; i < MAX_PLAYERS; i++) {
-            if (g_players[i].active) {
-                SDLNet_TCP_Send(g_players[i].socket, g_players, sizeof(Player) * MAX_PLAYERS);
-            }
-        }
+    }
 
-    } else {
-        // --- ЛОГИКА КЛИЕНТА ---
-        Vec3 mypos = {cam->x, cam->y, cam->z};
-        SDLNet_TCP_Send(g_server_socket, &mypos, sizeof(Vec3));
-        SDLNet_TCP_Recv(g_server_socket, g_players, sizeof(Player) * MAX_PLAYERS);
+    int best = -1;
+    for (int b = 0; b < RENDER_BACKEND_COUNT; b++) {
+        if (totalMs[b] >= 0.0 && (best < 0 || totalMs[b] < totalMs[best])) best = b;
+    }
+    if (best >= 0) {
+        printf("Fastest on this machine: --backend=%s\n", g_renderBackendNames[best]);
     }
 }
 
-void shutdown_multiplayer() {
-    if (g_isMultiplayer) {
-        printf("Shutting down multiplayer...\n");
-        if (g_socket_set) {
-            SDLNet_FreeSocketSet(g_socket_set); // <<< Чистим за собой
-            g_socket_set = NULL;
-        }
-        if (g_server_socket) {
-            SDLNet_TCP_Close(g_server_socket);
-            g_server_socket = NULL;
-        }
-        for (int i = 0; i < MAX_PLAYERS; i++) {
-            if (g_players[i].socket) {
-                SDLNet_TCP_Close(g_players[i].socket);
-                g_players[i].socket = NULL;
+// Игра целиком (этапы 3 и дальше). С программным бэкендом и окном - в своём потоке, см. Present_Run
+typedef struct {
+    RenderBackend* ren;
+    SDL_Renderer* sdlRen;
+    int runBenchmark;
+    int result;
+} GameStartup;
+
+static int Game_Main(GameStartup* gs);
+
+static int Game_ThreadMain(void* data) {
+    GameStartup* gs = (GameStartup*)data;
+    gs->result = Game_Main(gs);
+    Present_GameFinished();
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    // --- ЭТАП 0: КОМАНДНАЯ СТРОКА ---
+    // --backend=soft|sdl выбирает бэкенд рендера, --bench меряет оба на одной сцене и выходит,
+    // --headless [--frames=N] [--shots=a,b,...] [--shot-prefix=путь] - без окна, кадры в память и в BMP,
+    // --split=2..4 - сплит-скрин на столько игроков, --raycast[=2x2] - мир лучами по BVH (F4 в игре),
+    // --present-frames=1..3 - сколько кадров программного бэкенда в полёте (1 - игра и показ в одном потоке),
+    // --quality=auto|high|medium|low|lowest - уровень качества или подстройка под время кадра (Shift+F9)
+    RenderBackendType backendType = RENDER_BACKEND_SDL_BATCHED;
+    int runBenchmark = 0;
+    int splitViews = 1;
+    int presentFrames = PRESENT_DEFAULT_FRAMES;
+    const char* capturePath = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--backend=", 10) == 0) {
+            int parsed = RenderBackend_ParseName(argv[i] + 10);
+            if (parsed < 0) {
+                printf("Unknown backend '%s', using '%s'\n", argv[i] + 10, g_renderBackendNames[backendType]);
+            } else {
+                backendType = (RenderBackendType)parsed;
             }
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            runBenchmark = 1;
+        } else if (strncmp(argv[i], "--capture=", 10) == 0) {
+            capturePath = argv[i] + 10; // Запись с первого кадра (F10 - вкл/выкл в игре)
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            g_headless.enabled = 1;
+        } else if (strncmp(argv[i], "--frames=", 9) == 0) {
+            g_headless.frames = atoi(argv[i] + 9);
+        } else if (strncmp(argv[i], "--shots=", 8) == 0) {
+            Headless_ParseShots(argv[i] + 8);
+        } else if (strncmp(argv[i], "--shot-prefix=", 14) == 0) {
+            g_headless.shotPrefix = argv[i] + 14;
+        } else if (strncmp(argv[i], "--split=", 8) == 0) {
+            splitViews = atoi(argv[i] + 8);
+        } else if (strcmp(argv[i], "--raycast") == 0) {
+            g_rayRender.mode = RAYRENDER_PIXEL;
+        } else if (strcmp(argv[i], "--raycast=2x2") == 0) {
+            g_rayRender.mode = RAYRENDER_BLOCK;
+        } else if (strncmp(argv[i], "--present-frames=", 17) == 0) {
+            presentFrames = atoi(argv[i] + 17);
+        } else if (strncmp(argv[i], "--quality=", 10) == 0) {
+            if (!Quality_Parse(argv[i] + 10)) printf("Unknown quality '%s', using '%s'\n", argv[i] + 10, g_qualityAutoNames[g_quality.autoAdjust]);
         }
-        g_isMultiplayer = 0;
-        g_isServer = 0;
     }
-}
+    if (g_headless.enabled) {
+        if (backendType != RENDER_BACKEND_SOFTWARE) {
+            printf("Headless: using backend '%s' instead of '%s'\n",
+                   g_renderBackendNames[RENDER_BACKEND_SOFTWARE], g_renderBackendNames[backendType]);
+        }
+        backendType = RENDER_BACKEND_SOFTWARE; // Кадр должен жить в памяти
+        g_quality.autoAdjust = 0; // Кадры должны совпадать от запуска к запуску, а время кадра - нет
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1); // Дисплей не нужен, события и таймеры работают
+    }
 
-int main(int argc, char* argv[]) {
     // --- ЭТАП 1: МИНИМАЛЬНЫЙ ЗАПУСК ДЛЯ ОКНА ---
     if (SDL_Init(SDL_INIT_VIDEO) < 0) return 1;
     TTF_Init();
-    srand(time(NULL));
+    srand(g_headless.enabled ? HEADLESS_SEED : (unsigned)time(NULL));
     init_fast_math(); // Математику считаем до окна, это быстро
+    Jobs_Init();
+    SplitScreen_Init(splitViews);
     init_multiplayer();
 
-    SDL_Window* win = SDL_CreateWindow("GEOMETRICA", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WIDTH, HEIGHT, SDL_WINDOW_SHOWN);
-    if (!win) return 1;
-    SDL_Renderer* ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED);
-    
-    SDL_SetRenderDrawColor(ren, 10, 10, 15, 255);
-    SDL_RenderClear(ren);
-    TTF_Font* font = TTF_OpenFont("arial.ttf", 24); 
-    if (font) {
-        drawText(ren, font, "INITIALIZING REALITY KERNEL...", WIDTH/2 - 200, HEIGHT/2, (SDL_Color){0, 255, 100, 255});
+    SDL_Window* win = NULL;
+    SDL_Renderer* sdlRen = NULL; // В headless так и остаётся NULL: программный бэкенд рисует только в память
+    if (!g_headless.enabled) {
+        win = SDL_CreateWindow("GEOMETRICA", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WIDTH, HEIGHT, SDL_WINDOW_SHOWN);
+        if (!win) return 1;
+        sdlRen = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED);
+        if (!sdlRen) return 1;
+    }
+    RenderBackend* ren = RenderBackend_Create(backendType, sdlRen);
+    if (!ren && backendType != RENDER_BACKEND_SDL_BATCHED && sdlRen) {
+        ren = RenderBackend_Create(RENDER_BACKEND_SDL_BATCHED, sdlRen); // Запасной путь
+    }
+    if (!ren) return 1;
+    // Программный кадр показывает главный поток, пока игра рисует следующий. Бенчмарку нужен общий
+    // рендерер для обоих бэкендов без кадров в полёте
+    if (ren->type == RENDER_BACKEND_SOFTWARE && sdlRen && !runBenchmark) {
+        Present_Start(sdlRen, ((SoftBackend*)ren->impl)->texture, presentFrames);
+    }
+    if (capturePath) Capture_Start(capturePath);
+    
+    TTF_Font* font = NULL;
+    if (!g_headless.enabled) { // Заставка нужна только тому, кто смотрит в окно
+        ren->BeginFrame(ren, (SDL_Color){10, 10, 15, 255});
+        font = TTF_OpenFont("arial.ttf", 24); 
+        if (font) {
+            drawText(ren, font, "INITIALIZING REALITY KERNEL...", WIDTH/2 - 200, HEIGHT/2, (SDL_Color){0, 255, 100, 255});
+        }
+        ren->EndFrame(ren); // С потоком игры заставку покажет Present_Run, пока идёт загрузка
+    }
+
+    // --- ЭТАП 3+: ИГРА ---
+    // Программный бэкенд с окном: игра уходит в свой поток, главный только показывает её кадры
+    GameStartup gs = { ren, sdlRen, runBenchmark, 0 };
+    SDL_Thread* gameThread = NULL;
+    if (g_present.active) {
+        g_present.gameThread = 1;
+        gameThread = SDL_CreateThread(Game_ThreadMain, "game", &gs);
+        if (!gameThread) {
+            printf("Present: no game thread (%s), presenting in EndFrame\n", SDL_GetError());
+            g_present.gameThread = 0;
+            Present_Stop();
+            DirtyRects_MarkFull(&((SoftBackend*)ren->impl)->shown); // В текстуре то, что показал Present_Stop
+        }
+    }
+    if (gameThread) {
+        Present_Run();
+        SDL_WaitThread(gameThread, NULL);
+    } else {
+        gs.result = Game_Main(&gs);
     }
-    SDL_RenderPresent(ren);
+
+    Present_Stop();
+    TTF_Quit();
+    RenderBackend_Destroy(ren);
+    if (sdlRen) SDL_DestroyRenderer(sdlRen);
+    if (win) SDL_DestroyWindow(win);
+    SplitScreen_Shutdown();
+    Jobs_Shutdown();
+    SDL_Quit();
+    
+    return gs.result;
+}
+
+// Загрузка, главный цикл и то, что игра за собой убирает. Окно, рендерер и SDL закрывает main
+static int Game_Main(GameStartup* gs) {
+    RenderBackend* ren = gs->ren;
+    SDL_Renderer* sdlRen = gs->sdlRen;
+    int runBenchmark = gs->runBenchmark;
 
     // --- ЭТАП 3: ВСЯ ТВОЯ СТАРАЯ ЗАГРУЗКА ИДЕТ ЗДЕСЬ, В ФОНЕ ---
     // <<< Весь твой код, который ты прислал, теперь здесь >>>
@@ -4122,22 +10165,29 @@ int main(int argc, char* argv[]) {
     initPhone();
     
     AssetManager assetManager;
-    AssetManager_Init(&assetManager, ren);
+    AssetManager_Init(&assetManager, sdlRen);
     
     // Перезагружаем/получаем шрифты через менеджер для остальной игры
-    font = AssetManager_GetFont(&assetManager, "arial.ttf", 16);
-    if (!font) {
+    TTF_Font* font = AssetManager_GetFont(&assetManager, "arial.ttf", 16);
+    if (!font && !g_headless.enabled) {
         printf("Не удалось загрузить основной шрифт, выход.\n");
         return 1;
     }
+    if (!font) printf("Headless: no font, text is skipped\n");
     TTF_Font* large_font = AssetManager_GetFont(&assetManager, "arial.ttf", 24);
+    g_floorTexture = AssetManager_GetTexture(&assetManager, "textures/floor.bmp");
+    g_boxTexture = AssetManager_GetTexture(&assetManager, "textures/box.bmp");
 
     GameConfig config = {
         .mouseSensitivity = 0.003f, .walkSpeed = 0.3f, .runSpeed = 0.5f,
         .crouchSpeedMultiplier = 0.5f, .acceleration = 10.0f, .deceleration = 15.0f,
-        .jumpForce = 0.35f, .gravity = 1.2f, .fov = 500.0f
+        .jumpForce = 0.35f, .gravity = 1.2f, .fov = 500.0f,
+        .fogDensity = FOG_DEFAULT_DENSITY,
+        .lodPointPixels = LOD_DEFAULT_POINT_PIXELS, .lodLowPixels = LOD_DEFAULT_LOW_PIXELS
     };
     loadConfig("settings.cfg", &config);
+    Fog_SetDensity(config.fogDensity);
+    Lod_SetThresholds(config.lodPointPixels, config.lodLowPixels);
     
     EditableVariable editorVars[] = {
         { "Mouse Sensitivity", &config.mouseSensitivity, 0.0001f, 0.001f, 0.01f },
@@ -4145,7 +10195,10 @@ int main(int argc, char* argv[]) {
         { "Run Speed",         &config.runSpeed,         0.05f,   0.5f,   2.0f  },
         { "Jump Force",        &config.jumpForce,        0.05f,   0.1f,   1.0f  },
         { "Gravity",           &config.gravity,          0.1f,    0.1f,   5.0f  },
-        { "Field of View",     &config.fov,              5.0f,    50.0f,  500.0f}
+        { "Field of View",     &config.fov,              5.0f,    50.0f,  500.0f},
+        { "Fog Density",       &config.fogDensity,       0.01f,   0.05f,  0.5f  },
+        { "LOD Point Pixels",  &config.lodPointPixels,   0.5f,    0.0f,   16.0f },
+        { "LOD Low Pixels",    &config.lodLowPixels,     2.0f,    4.0f,   128.0f}
     };
     const int numEditorVars = sizeof(editorVars) / sizeof(editorVars[0]);
 
@@ -4160,28 +10213,32 @@ int main(int argc, char* argv[]) {
     spawnBottle((Vec3){-4, -1, 2});
     
     // --- ЭТАП 4: ПОДГОТОВКА К ГЛАВНОМУ ЦИКЛУ ---
-    SDL_SetRelativeMouseMode(SDL_TRUE);
+    Present_SetRelativeMouseMode(SDL_TRUE);
 
     spawnBottle((Vec3){3, -1, -3});
 spawnBottle((Vec3){-4, -1, 2});
 spawnBottle((Vec3){7, 2, 5});
 spawnBottle((Vec3){-2, 0, -6});
 
-    Vec3 cube[8] = {
-        {-2,-2,-2}, {2,-2,-2}, {2,2,-2}, {-2,2,-2},
-        {-2,-2,2},  {2,-2,2},  {2,2,2},  {-2,2,2}
-    };
-    int edges[12][2] = { {0,1},{1,2},{2,3},{3,0}, {4,5},{5,6},{6,7},{7,4}, {0,4},{1,5},{2,6},{3,7} };
-    Vec3 faceNormals[6] = { {0,0,-1}, {0,0,1}, {0,-1,0}, {0,1,0}, {-1,0,0}, {1,0,0} };
-    int edgeFaces[12][2] = { {0,2},{0,4},{0,3},{0,5}, {1,2},{1,4},{1,3},{1,5}, {2,5},{2,4},{3,4},{3,5} };
-    
+    if (runBenchmark) {
+        runBackendBenchmark(sdlRen, config.fov);
+        Capture_Stop();
+        AssetManager_Destroy(&assetManager);
+        return 0;
+    }
+
     Camera cam = { .x = 0, .y = 0, .z = -8, .height = STANDING_HEIGHT, .targetHeight = STANDING_HEIGHT };
     float playerRadius = 0.3f;
 
     g_currentState = STATE_MAIN_MENU;
     selectNewSplash();
+    if (g_headless.enabled) {
+        g_currentState = STATE_IN_GAME_SP; // Меню листать некому - сразу в игру
+        printf("Headless: %d frames at %d fps, %d shots\n", g_headless.frames, HEADLESS_FPS, g_headless.numShots);
+    }
+    Uint64 headlessStart = SDL_GetPerformanceCounter();
     
-    SDL_SetRelativeMouseMode(SDL_TRUE);
+    Present_SetRelativeMouseMode(SDL_TRUE);
 
     int running = 1;
     SDL_Event e;
@@ -4199,14 +10256,16 @@ spawnBottle((Vec3){-2, 0, -6});
     Uint32 currentTime = SDL_GetTicks();
     float deltaTime = (currentTime - lastTime) / 1000.0f;
     if (deltaTime > 0.1f) deltaTime = 0.1f;
+    if (g_headless.enabled) deltaTime = 1.0f / HEADLESS_FPS; // Ровный шаг, как у часов Game_GetTicks
     lastTime = currentTime;
+    Uint64 frameWorkStart = SDL_GetPerformanceCounter(); // Для уровней качества: кадр целиком, минус ожидание показа
 
     const Uint8* keyState = SDL_GetKeyboardState(NULL);
 
     // --- PROFILER: Начинаем замер "прочего" времени ---
     Profiler_Start(PROF_OTHER);
     // --- ОБРАБОТКА ВВОДА ---
-    while (SDL_PollEvent(&e)) {
+    while (Present_PollEvent(&e)) {
         if (e.type == SDL_QUIT) g_isExiting = 1;
 
         // <<< ВОТ ОНА, БЛЯДЬ! ЛОГИКА ВВОДА ТЕКСТА! >>>
@@ -4225,7 +10284,7 @@ spawnBottle((Vec3){-2, 0, -6});
                     if (e.key.keysym.sym == SDLK_RETURN) {
                         if (g_menuSelectedOption == 0) { // Single Player
                             g_currentState = STATE_IN_GAME_SP;
-                            SDL_SetRelativeMouseMode(SDL_TRUE); // Захватываем мышь
+                            Present_SetRelativeMouseMode(SDL_TRUE); // Захватываем мышь
                         } else if (g_menuSelectedOption == 1) { // Multiplayer
                             g_currentState = STATE_MULTIPLAYER_MENU;
                         } else if (g_menuSelectedOption == 2) { // Settings
@@ -4245,10 +10304,10 @@ spawnBottle((Vec3){-2, 0, -6});
                             if (g_menuSelectedOption == 0) { // Host
                                 start_server();
                                 g_currentState = STATE_IN_GAME_MP;
-                                SDL_SetRelativeMouseMode(SDL_TRUE);
+                                Present_SetRelativeMouseMode(SDL_TRUE);
                             } else if (g_menuSelectedOption == 1) { // Join
                                 g_mp_menu_state = MP_MENU_INPUT_IP; // Просто меняем состояние
-                                SDL_StartTextInput();
+                                Present_SetTextInput(1);
                             } else if (g_menuSelectedOption == 2) { // Back
                                 g_currentState = STATE_MAIN_MENU;
                                 g_menuSelectedOption = 0;
@@ -4259,15 +10318,15 @@ spawnBottle((Vec3){-2, 0, -6});
                         if (e.key.keysym.sym == SDLK_RETURN) {
                             if (connect_to_server(g_ip_input_buffer)) { // Пробуем подключиться
                                 g_currentState = STATE_IN_GAME_MP;
-                                SDL_SetRelativeMouseMode(SDL_TRUE);
+                                Present_SetRelativeMouseMode(SDL_TRUE);
                             } else {
                                 printf("!!! CONNECTION FAILED !!!\n"); // Если не вышло - остаемся в меню
                             }
-                            SDL_StopTextInput();
+                            Present_SetTextInput(0);
                             g_mp_menu_state = MP_MENU_SELECT;
                         }
                     }
-                    if (e.key.keysym.sym == SDLK_ESCAPE) { g_currentState = STATE_MAIN_MENU; SDL_StopTextInput(); g_mp_menu_state = MP_MENU_SELECT; g_menuSelectedOption = 0;}
+                    if (e.key.keysym.sym == SDLK_ESCAPE) { g_currentState = STATE_MAIN_MENU; Present_SetTextInput(0); g_mp_menu_state = MP_MENU_SELECT; g_menuSelectedOption = 0;}
                     break;
                     
                 case STATE_SETTINGS:
@@ -4291,7 +10350,7 @@ spawnBottle((Vec3){-2, 0, -6});
                     if (e.key.keysym.sym == SDLK_ESCAPE) {
                         g_currentState = STATE_MAIN_MENU;
                         selectNewSplash();
-                        SDL_SetRelativeMouseMode(SDL_FALSE); // Возвращаем мышь в меню
+                        Present_SetRelativeMouseMode(SDL_FALSE); // Возвращаем мышь в меню
                     }
 
                     // <<< ВОТ ОНА, НОВАЯ ЛОГИКА ПОДБОРА >>>
@@ -4333,14 +10392,32 @@ spawnBottle((Vec3){-2, 0, -6});
 
                     // F-КЛАВИШИ
                     if (e.key.keysym.sym == SDLK_F1) show_editor = !show_editor;
-                    if (e.key.keysym.sym == SDLK_F3) g_showProfiler = !g_showProfiler;
+                    if (e.key.keysym.sym == SDLK_F3) {
+                        if (e.key.keysym.mod & KMOD_SHIFT) g_renderGraph.skipInert = !g_renderGraph.skipInert; // Сравнить кадр без пропусков
+                        else g_showProfiler = !g_showProfiler;
+                    }
+                    if (e.key.keysym.sym == SDLK_F7) g_depthPrepassEnabled = !g_depthPrepassEnabled;
+                    if (e.key.keysym.sym == SDLK_F8) Fog_CycleMode();
+                    if (e.key.keysym.sym == SDLK_F9) {
+                        if (e.key.keysym.mod & KMOD_SHIFT) Quality_ToggleAuto(); // Уровни качества - рядом с LOD
+                        else g_lod.enabled = !g_lod.enabled;
+                    }
+                    if (e.key.keysym.sym == SDLK_F10) Capture_Toggle();
+                    if (e.key.keysym.sym == SDLK_F11) g_shadows.enabled = !g_shadows.enabled;
+                    if (e.key.keysym.sym == SDLK_F12) {
+                        if (e.key.keysym.mod & KMOD_SHIFT) Deferred_Toggle(); // Лампы - рядом с солнцем
+                        else g_light.enabled = !g_light.enabled;
+                    }
+                    if (e.key.keysym.sym == SDLK_F5) g_pick.enabled = !g_pick.enabled;
+                    if (e.key.keysym.sym == SDLK_F2) g_vis.enabled = !g_vis.enabled;
+                    if (e.key.keysym.sym == SDLK_F4) RayRender_CycleMode();
                     break;
                     
                 case STATE_IN_GAME_MP:
                     if (e.key.keysym.sym == SDLK_ESCAPE) {
                         shutdown_multiplayer();
                         g_currentState = STATE_MULTIPLAYER_MENU;
-                        SDL_SetRelativeMouseMode(SDL_FALSE);
+                        Present_SetRelativeMouseMode(SDL_FALSE);
                     }
                     if (e.key.keysym.sym == SDLK_SPACE && !cam.isCrouching) {
                         if (isGrounded(&cam, playerRadius, collisionBoxes, numCollisionBoxes)) {
@@ -4390,6 +10467,8 @@ spawnBottle((Vec3){-2, 0, -6});
         case STATE_IN_GAME_SP:
             // --- ВСЯ ИГРОВАЯ ЛОГИКА ДЛЯ СИНГЛПЛЕЕРА ---
             g_fov = config.fov;
+            Fog_SetDensity(config.fogDensity);
+            Lod_SetThresholds(config.lodPointPixels * Quality_Current()->lodScale, config.lodLowPixels * Quality_Current()->lodScale);
             
             cam.isCrouching = keyState[SDL_SCANCODE_LCTRL];
             
@@ -4556,6 +10635,7 @@ spawnBottle((Vec3){-2, 0, -6});
             updateDayNightCycle(deltaTime, cam);
             updateWorldEvolution(deltaTime);
             updateAirstrike(deltaTime, &cam);
+            SplitScreen_UpdateGuests(deltaTime);
 
             if (g_bossFightActive) {
                 updateBoss(deltaTime, &cam);
@@ -4578,12 +10658,9 @@ spawnBottle((Vec3){-2, 0, -6});
             Uint8 bgB = 30 + (Uint8)(g_worldEvolution.transitionProgress * 30);
 
             // Определяем цвет фона
-            const SDL_Color baseBackgroundColor = {20, 20, 30, 255}; 
-            SDL_Color targetBackgroundColor = g_dayNight.fogColor;
-            SDL_Color finalClearColor = lerpColor(baseBackgroundColor, targetBackgroundColor, g_worldEvolution.skyboxAlpha);
-            SDL_SetRenderDrawColor(ren, finalClearColor.r, finalClearColor.g, finalClearColor.b, 255);
-            SDL_RenderClear(ren);
-            clearZBuffer();
+            SDL_Color finalClearColor = getSkyClearColor(g_worldEvolution.skyboxAlpha);
+            ren->BeginFrame(ren, finalClearColor);
+            Visibility_BeginFrame(isLineOnlyWorldState(g_worldEvolution.currentState) && !RayRender_Active());
 
             // Выбираем, какую камеру использовать для рендера
             Camera renderCam = cam;
@@ -4614,38 +10691,6 @@ spawnBottle((Vec3){-2, 0, -6});
                 g_fov = config.fov;
             }
 
-            // Передаем renderCam ВО ВСЕ ФУНКЦИИ ОТРИСОВКИ
-            drawSkybox(ren);
-            drawSunAndMoon(ren, renderCam); 
-            drawFloor(ren, renderCam);
-            
-            // ОТРИСОВКА ПЛАТФОРМ С ОТСЕЧЕНИЕМ
-            for (int i = 0; i < numCollisionBoxes; i++) {
-                if (isBoxInFrustum_Improved(&collisionBoxes[i], renderCam)) {
-                    drawOptimizedBox(ren, &collisionBoxes[i], renderCam);
-                }
-            }
-
-            drawEvolvingWalls(ren, renderCam);
-
-            // ОТРИСОВКА МОНЕТ С ОТСЕЧЕНИЕМ
-            for (int i = 0; i < g_numCoins; i++) {
-                if (!g_coins[i].collected) {
-                    if (isPointInFrustum(g_coins[i].pos, renderCam)) {
-                        drawCoin(ren, &g_coins[i], renderCam);
-                    }
-                }
-            }
-
-            // ОТРИСОВКА ПРЕДМЕТОВ С ОТСЕЧЕНИЕМ
-            for (int i = 0; i < g_numPickups; i++) {
-                if (g_pickups[i].state != PICKUP_STATE_BROKEN) {
-                    if (isPointInFrustum(g_pickups[i].pos, renderCam)) {
-                        drawPickupObject(ren, &g_pickups[i], renderCam);
-                    }
-                }
-            }
-            
             // Рассчитываем траекторию, если держим объект
             if (g_hands.heldObject && rightMouseButtonHeld) {
                 calculateTrajectory(&cam, g_hands.currentThrowPower, &g_trajectory, collisionBoxes, numCollisionBoxes, config.gravity);
@@ -4653,7 +10698,16 @@ spawnBottle((Vec3){-2, 0, -6});
                 g_trajectory.numPoints = 0; // Прячем траекторию
             }
 
+            prepareSingleplayerFrame();
+            int splitFrame = g_split.numViews > 1 && !g_cinematic.isActive; // Катсцена - одна на весь экран
+            if (splitFrame) {
+                SplitScreen_Draw(ren, renderCam, g_fov);
+            } else {
+                drawSingleplayerScene(ren, renderCam);
+            }
+
             // Отрисовка луча прицеливания
+            if (splitFrame) SplitScreen_EnterPlayerView(ren);
             if (g_hands.currentState == HAND_STATE_AIMING) {
                 Vec3 rayStart = {cam.x, cam.y + cam.height, cam.z};
                 Vec3 rayDir = {fast_sin(cam.rotY)*fast_cos(cam.rotX), -fast_sin(cam.rotX), fast_cos(cam.rotY)*fast_cos(cam.rotX)};
@@ -4666,38 +10720,7 @@ spawnBottle((Vec3){-2, 0, -6});
                 Vec3 rayEnd = {rayStart.x + rayDir.x * rayLen, rayStart.y + rayDir.y * rayLen, rayStart.z + rayDir.z * rayLen};
                 clipAndDrawLine(ren, rayStart, rayEnd, cam, (SDL_Color){255,165,0,100});
             }
-
-            // Рендерим авиаудар
-            if (g_airstrike.isActive) {
-                for (int i = 0; i < 3; i++) {
-                    drawJet(ren, &g_airstrike.jets[i], renderCam);
-                    drawBomb(ren, &g_airstrike.bombs[i], renderCam);
-                    drawExplosion(ren, &g_airstrike.explosions[i], renderCam);
-                }
-            }
-
-            drawGlassShards(ren, renderCam);
-            applyGlitchEffect(ren);
-            drawGlitches(ren, renderCam);
-            drawBoss(ren, renderCam);
-            drawTrajectory(ren, renderCam, &g_trajectory);
-
-            // Отрисовка куба с освещением
-            float lightAngle = SDL_GetTicks() * 0.0003f;
-            Vec3 lightDir = normalize((Vec3){fast_cos(lightAngle) * 1.5f, 2, fast_sin(lightAngle) * 1.5f});
-            for (int i = 0; i < 12; ++i) {
-                float b1 = dot(faceNormals[edgeFaces[i][0]], lightDir);
-                float b2 = dot(faceNormals[edgeFaces[i][1]], lightDir);
-                float brightness = fmaxf(0.4f, fmaxf(b1, b2));
-                int c = (int)(brightness * 255);
-                if (c > 255) c = 255;
-                if (c < 60) c = 60;
-                SDL_Color edgeColor = {(Uint8)c, (Uint8)c, (Uint8)c, 255};
-
-                Vec3 p1 = cube[edges[i][0]];
-                Vec3 p2 = cube[edges[i][1]];
-                clipAndDrawLine(ren, p1, p2, renderCam, edgeColor);
-            }
+            if (splitFrame) SplitScreen_LeavePlayerView(ren);
 
             Profiler_End(PROF_RENDERING);
 
@@ -4717,22 +10740,24 @@ spawnBottle((Vec3){-2, 0, -6});
                 drawText(ren, font, evolutionStatus, WIDTH/2 - 100, 10, cyan);
             }
 
-            drawQuestConnections(ren, &questSystem, renderCam, SDL_GetTicks() * 0.001f);
+            if (splitFrame) SplitScreen_EnterPlayerView(ren);
+            drawQuestConnections(ren, &questSystem, renderCam, Game_GetTicks() * 0.001f);
             for (int i = 0; i < questSystem.numNodes; i++) {
-                drawQuestNode(ren, &questSystem.nodes[i], renderCam, SDL_GetTicks() * 0.001f);
+                drawQuestNode(ren, &questSystem.nodes[i], renderCam, Game_GetTicks() * 0.001f);
             }
+            if (splitFrame) SplitScreen_LeavePlayerView(ren);
             
             if (cam.isRunning && cam.isMoving) {
-                SDL_SetRenderDrawColor(ren, 255, 100, 100, 255);
+                Render_SetColor(ren, 255, 100, 100, 255);
                 SDL_Rect runIndicator = {10, 10, 20, 20};
-                SDL_RenderFillRect(ren, &runIndicator);
+                Render_FillRect(ren, &runIndicator);
             }
             
             if (show_editor) {
-                SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
-                SDL_SetRenderDrawColor(ren, 0, 0, 0, 150);
+                Render_SetBlendMode(ren, SDL_BLENDMODE_BLEND);
+                Render_SetColor(ren, 0, 0, 0, 150);
                 SDL_Rect bgRect = { 10, 10, 300, numEditorVars * 20 + 10 };
-                SDL_RenderFillRect(ren, &bgRect);
+                Render_FillRect(ren, &bgRect);
 
                 SDL_Color white = {255, 255, 255, 255};
                 SDL_Color yellow = {255, 255, 0, 255};
@@ -4775,10 +10800,10 @@ spawnBottle((Vec3){-2, 0, -6});
                 const int phoneWidth = 250, phoneHeight = 500;
                 int currentY = (int)lerp((float)HEIGHT, (float)(HEIGHT - phoneHeight - 50), g_phone.animationProgress);
 
-                SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
-                SDL_SetRenderDrawColor(ren, 25, 25, 30, 230);
+                Render_SetBlendMode(ren, SDL_BLENDMODE_BLEND);
+                Render_SetColor(ren, 25, 25, 30, 230);
                 SDL_Rect phoneBody = { WIDTH - phoneWidth - 50, currentY, phoneWidth, phoneHeight };
-                SDL_RenderFillRect(ren, &phoneBody);
+                Render_FillRect(ren, &phoneBody);
                 
                 SDL_Color textColor = {200, 200, 200, 255};
                 SDL_Color selectedColor = {255, 255, 0, 255};
@@ -4789,11 +10814,11 @@ spawnBottle((Vec3){-2, 0, -6});
             // Кинематографичные полосы
             if (g_cinematic.isActive) {
                 int barHeight = HEIGHT / 8;
-                SDL_SetRenderDrawColor(ren, 0, 0, 0, 255);
+                Render_SetColor(ren, 0, 0, 0, 255);
                 SDL_Rect topBar = {0, 0, WIDTH, barHeight};
                 SDL_Rect bottomBar = {0, HEIGHT - barHeight, WIDTH, barHeight};
-                SDL_RenderFillRect(ren, &topBar);
-                SDL_RenderFillRect(ren, &bottomBar);
+                Render_FillRect(ren, &topBar);
+                Render_FillRect(ren, &bottomBar);
             }
             break;
             
@@ -4843,9 +10868,9 @@ spawnBottle((Vec3){-2, 0, -6});
                 update_multiplayer(&cam);
 
                 // --- ОТРИСОВКА МУЛЬТИПЛЕЕРА ---
-                SDL_SetRenderDrawColor(ren, 20, 20, 30, 255);
-                SDL_RenderClear(ren);
-                clearZBuffer();
+                ren->BeginFrame(ren, (SDL_Color){20, 20, 30, 255});
+                Visibility_BeginFrame(0);
+                Fog_Begin((SDL_Color){20, 20, 30, 255});
                 drawMultiplayerFloor(ren, cam);
 
                 // <<< ВОТ ОН, ФИКС №2: Правильная отрисовка игроков >>>
@@ -4854,11 +10879,15 @@ spawnBottle((Vec3){-2, 0, -6});
                 // Определяем, кто мы, один раз
                 int my_id = g_isServer ? 0 : g_myPlayerID;
 
+                MeshInstance others[MAX_PLAYERS];
+                int numOthers = 0;
                 for (int i = 0; i < MAX_PLAYERS; i++) {
                     if (g_players[i].active && i != my_id) { // Рисуем всех, кроме себя
-                        drawWorldCube(ren, g_players[i].pos, 1.0f, cam, playerColors[i]);
+                        others[numOthers++] = (MeshInstance){ g_players[i].pos, 1.0f, playerColors[i] };
                     }
                 }
+                drawMeshInstanced(ren, &g_cubeMesh, others, numOthers, cam);
+                Fog_End();
             }
             break;
     }
@@ -4869,18 +10898,23 @@ spawnBottle((Vec3){-2, 0, -6});
         if (g_exitFadeAlpha > 254.0f) {
             running = 0; // Когда экран полностью черный, выходим по-настоящему
         }
-        SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
-        SDL_SetRenderDrawColor(ren, 0, 0, 0, (Uint8)g_exitFadeAlpha);
-        SDL_Rect fadeRect = {0, 0, WIDTH, HEIGHT};
-        SDL_RenderFillRect(ren, &fadeRect);
+        PostFX_SetIntensity(POSTFX_FADE, g_exitFadeAlpha / 255.0f);
+    }
+    ren->EndFrame(ren);
+    // После EndFrame: пост-обработка и последние пачки SDL-бэкенда - тоже работа кадра, а vsync
+    // и ожидание свободного буфера - нет
+    if (g_currentState == STATE_IN_GAME_SP) {
+        float frameMs = (float)((double)(SDL_GetPerformanceCounter() - frameWorkStart) * 1000.0 / SDL_GetPerformanceFrequency());
+        Quality_Update(frameMs - ren->presentWaitMs);
     }
-    SDL_RenderPresent(ren);
+    if (g_headless.enabled && ++g_headless.frameIndex >= g_headless.frames) running = 0;
     }
+    if (g_headless.enabled) {
+        double ms = (double)(SDL_GetPerformanceCounter() - headlessStart) * 1000.0 / SDL_GetPerformanceFrequency();
+        printf("Headless: %d frames, %.2f ms/frame, %d shots written\n", g_headless.frameIndex,
+               g_headless.frameIndex > 0 ? ms / g_headless.frameIndex : 0.0, g_headless.shotsWritten);
+    }
+    Capture_Stop();
     AssetManager_Destroy(&assetManager);
-    TTF_Quit();
-    SDL_DestroyRenderer(ren);
-    SDL_DestroyWindow(win);
-    SDL_Quit();
-    
     return 0;
 }